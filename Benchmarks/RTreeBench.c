@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+/*
+ * rtree-bench [suite...] [options]
+ * Runs the given suites, or all but stress.  See Usage() for the options.
+ */
+
+typedef struct _RTreeBenchSuite
+{
+	const char *name;
+	int (*run)(RTreeBenchOptions *);
+	int inAll;	/* run when no suite is named */
+} RTreeBenchSuite;
+
+static RTreeBenchSuite Suites[] = {
+	{"trees", RTreeBenchTrees, 1},
+	{"kernels", RTreeBenchKernels, 1},
+	{"batch", RTreeBenchBatch, 1},
+	{"nearest", RTreeBenchNearest, 1},
+	{"join", RTreeBenchJoin, 1},
+	{"parallel", RTreeBenchParallel, 1},
+	{"concurrent", RTreeBenchConcurrent, 1},
+	{"mapped", RTreeBenchMapped, 1},
+	{"save", RTreeBenchSave, 1},
+	{"quantized", RTreeBenchQuantized, 1},
+	{"ingest", RTreeBenchIngest, 1},
+	{"delete", RTreeBenchDelete, 1},
+	{"update", RTreeBenchUpdate, 1},
+	{"count", RTreeBenchCount, 1},
+	{"snapshot", RTreeBenchSnapshot, 1},
+	{"stress", RTreeBenchStress, 0},
+};
+#define SUITES (int)(sizeof(Suites) / sizeof(Suites[0]))
+
+static const char *BuildNames[RTreeBenchBuildCount] = {"quadratic", "linear", "rstar", "str", "hilbert"};
+
+const char * RTreeBenchBuildName(RTreeBenchBuild b) {
+	return BuildNames[b];
+}
+
+// MARK: - Measuring
+double RTreeBenchNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int RTreeBenchCompareDoubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/// The value below which a fraction p of a sorted array lies, nearest rank.
+double RTreeBenchPercentile(double *sorted, size_t n, double p) {
+	size_t i;
+	if (n == 0)
+		return 0;
+	i = (size_t)(p * n);
+	return sorted[i < n ? i : n - 1];
+}
+
+static int Fields;	/* of the line being printed */
+
+void RTreeBenchBegin(const char *suite) {
+	Fields = 0;
+	printf("{");
+	RTreeBenchString("suite", suite);
+}
+
+static void Key(const char *key) {
+	printf("%s\"%s\":", Fields++ ? "," : "", key);
+}
+
+void RTreeBenchString(const char *key, const char *value) {
+	register const char *s;
+	Key(key);
+	putchar('"');
+	for (s=value; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+void RTreeBenchLong(const char *key, long value) {
+	Key(key);
+	printf("%ld", value);
+}
+
+void RTreeBenchDouble(const char *key, double value) {
+	Key(key);
+	printf("%.6g", value);
+}
+
+void RTreeBenchBool(const char *key, int value) {
+	Key(key);
+	printf(value ? "true" : "false");
+}
+
+void RTreeBenchEnd() {
+	printf("}\n");
+	fflush(stdout);
+}
+
+void RTreeBenchProgress(const char *format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	vfprintf(stderr, format, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+// MARK: - Options
+static void Usage(FILE *f) {
+	int i;
+	fprintf(f,
+		"usage: rtree-bench [suite...] [options]\n"
+		"suites:");
+	for (i=0; i<SUITES; i++)
+		fprintf(f, " %s", Suites[i].name);
+	fprintf(f, "\n"
+		"  with none, all but stress run\n"
+		"options:\n"
+		"  --n N              data rects (100000)\n"
+		"  --queries N        search rects (10000)\n"
+		"  --selectivity F    fraction of the extent a search rect covers (0.0001)\n"
+		"  --seed N           seed of the data and the searches (1)\n"
+		"  --datasets LIST    of uniform, clustered, skewed (all)\n"
+		"  --splits LIST      of quadratic, linear, rstar, str, hilbert (all)\n"
+		"  --fanouts LIST     of F or NODE:LEAF, for trees (4,8,16,%d)\n"
+		"  --threads LIST     of thread counts (1,2,4,8,16,32)\n"
+		"  --seconds S        of stress (2)\n"
+		"  --quick            a small run: 10000 rects, 1000 searches, 1 to 4 threads\n"
+		"Prints one JSON object per line.\n", MAXCARD);
+}
+
+/// Split a comma separated list, calling item for each element.
+/// Returns 0 if item failed for one.
+static int ParseList(char *list, int (*item)(RTreeBenchOptions *, char *), RTreeBenchOptions *o) {
+	char *s, *next;
+	for (s=list; s; s=next)
+	{
+		if ((next = strchr(s, ',')))
+			*next++ = '\0';
+		if (!item(o, s))
+			return 0;
+	}
+	return 1;
+}
+
+static int DatasetItem(RTreeBenchOptions *o, char *s) {
+	RTreeBenchDataset d;
+	if (!RTreeBenchDatasetFromName(s, &d))
+		return 0;
+	o->datasets[d] = 1;
+	return 1;
+}
+
+static int BuildItem(RTreeBenchOptions *o, char *s) {
+	int i;
+	for (i=0; i<RTreeBenchBuildCount; i++)
+		if (!strcmp(s, BuildNames[i]))
+		{
+			o->builds[i] = 1;
+			return 1;
+		}
+	return 0;
+}
+
+static int FanoutItem(RTreeBenchOptions *o, char *s) {
+	char *leaf = strchr(s, ':');
+	int node = atoi(s);
+
+	if (o->fanouts == BENCH_LIST)
+		return 0;
+	o->nodecards[o->fanouts] = node;
+	o->leafcards[o->fanouts] = leaf ? atoi(leaf + 1) : node;
+	if (2 > node || node > MAXCARD || 2 > o->leafcards[o->fanouts] || o->leafcards[o->fanouts] > MAXCARD)
+		return 0;
+	o->fanouts++;
+	return 1;
+}
+
+static int ThreadsItem(RTreeBenchOptions *o, char *s) {
+	int threads = atoi(s);
+	if (o->threadCounts == BENCH_LIST || threads < 1)
+		return 0;
+	o->threads[o->threadCounts++] = threads;
+	return 1;
+}
+
+static void DefaultOptions(RTreeBenchOptions *o) {
+	static const int fanouts[] = {4, 8, 16, MAXCARD};
+	static const int threads[] = {1, 2, 4, 8, 16, 32};
+	int i;
+
+	memset(o, 0, sizeof(RTreeBenchOptions));
+	o->n = 100000;
+	o->queries = 10000;
+	o->selectivity = 0.0001;
+	o->seed = 1;
+	o->seconds = 2;
+	for (i=0; i<4; i++)
+		o->nodecards[i] = o->leafcards[i] = fanouts[i];
+	o->fanouts = 4;
+	for (i=0; i<6; i++)
+		o->threads[i] = threads[i];
+	o->threadCounts = 6;
+}
+
+/// Read the options, leaving the names of the suites to run in suites.
+/// Returns 0 on a bad option.
+static int ParseOptions(int argc, char **argv, RTreeBenchOptions *o, int *suites) {
+	int i, j, datasets = 0, builds = 0, fanouts = 0, threads = 0;
+	char *value;
+
+	DefaultOptions(o);
+	for (i=1; i<argc; i++)
+	{
+		if (strncmp(argv[i], "--", 2))
+		{
+			for (j=0; j<SUITES && strcmp(argv[i], Suites[j].name); j++)
+				;
+			if (j == SUITES)
+				return 0;
+			suites[j] = 1;
+			continue;
+		}
+		if (!strcmp(argv[i], "--quick"))
+		{
+			o->n = 10000;
+			o->queries = 1000;
+			o->threadCounts = 3;
+			continue;
+		}
+		if (i + 1 == argc)
+			return 0;
+		value = argv[++i];
+		if (!strcmp(argv[i-1], "--n"))
+			o->n = strtoul(value, NULL, 10);
+		else if (!strcmp(argv[i-1], "--queries"))
+			o->queries = strtoul(value, NULL, 10);
+		else if (!strcmp(argv[i-1], "--selectivity"))
+			o->selectivity = atof(value);
+		else if (!strcmp(argv[i-1], "--seed"))
+			o->seed = strtoull(value, NULL, 10);
+		else if (!strcmp(argv[i-1], "--seconds"))
+			o->seconds = atof(value);
+		else if (!strcmp(argv[i-1], "--datasets"))
+		{
+			if (!datasets++)
+				memset(o->datasets, 0, sizeof(o->datasets));
+			if (!ParseList(value, DatasetItem, o))
+				return 0;
+		}
+		else if (!strcmp(argv[i-1], "--splits"))
+		{
+			if (!builds++)
+				memset(o->builds, 0, sizeof(o->builds));
+			if (!ParseList(value, BuildItem, o))
+				return 0;
+		}
+		else if (!strcmp(argv[i-1], "--fanouts"))
+		{
+			if (!fanouts++)
+				o->fanouts = 0;
+			if (!ParseList(value, FanoutItem, o))
+				return 0;
+		}
+		else if (!strcmp(argv[i-1], "--threads"))
+		{
+			if (!threads++)
+				o->threadCounts = 0;
+			if (!ParseList(value, ThreadsItem, o))
+				return 0;
+		}
+		else
+			return 0;
+	}
+	if (!datasets)
+		for (j=0; j<RTreeBenchDataCount; j++)
+			o->datasets[j] = 1;
+	if (!builds)
+		for (j=0; j<RTreeBenchBuildCount; j++)
+			o->builds[j] = 1;
+	return o->n > 0 && o->queries > 0 && o->selectivity > 0 && o->selectivity <= 1;
+}
+
+static const char * KernelName(RTreeKernel k) {
+	switch (k)
+	{
+	case RTreeKernelScalar: return "scalar";
+	case RTreeKernelSSE: return "sse";
+	case RTreeKernelAVX2: return "avx2";
+	default: return "auto";
+	}
+}
+
+int main(int argc, char **argv) {
+	RTreeBenchOptions o;
+	int suites[SUITES], i, named = 0, failed = 0;
+
+	memset(suites, 0, sizeof(suites));
+	if (argc > 1 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-h")))
+	{
+		Usage(stdout);
+		return 0;
+	}
+	if (!ParseOptions(argc, argv, &o, suites))
+	{
+		Usage(stderr);
+		return 2;
+	}
+	for (i=0; i<SUITES; i++)
+		named |= suites[i];
+
+	RTreeBenchBegin("meta");
+	RTreeBenchLong("n", (long)o.n);
+	RTreeBenchLong("queries", (long)o.queries);
+	RTreeBenchDouble("selectivity", o.selectivity);
+	RTreeBenchLong("seed", (long)o.seed);
+	RTreeBenchLong("maxcard", MAXCARD);
+	RTreeBenchLong("node_bytes", (long)sizeof(RTreeNode));
+	RTreeBenchString("kernel", KernelName(RTreeGetKernel()));
+	RTreeBenchLong("cpus", sysconf(_SC_NPROCESSORS_ONLN));
+#ifdef __VERSION__
+	RTreeBenchString("compiler", __VERSION__);
+#endif
+	RTreeBenchEnd();
+
+	for (i=0; i<SUITES; i++)
+		if (named ? suites[i] : Suites[i].inAll)
+		{
+			RTreeBenchProgress("%s", Suites[i].name);
+			if (!Suites[i].run(&o))
+			{
+				RTreeBenchProgress("%s: FAILED", Suites[i].name);
+				failed = 1;
+			}
+		}
+	return failed;
+}
@@ -0,0 +1,114 @@
+#ifndef _RTREE_BENCH_
+#define _RTREE_BENCH_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../Source/RTreeIndexImpl/include/RTreeIndexImpl.h"
+
+/*
+ * The benchmark suite of the library.  Every run prints one JSON object
+ * per line to stdout, for tracking regressions; progress goes to stderr.
+ * All data and queries come from a seeded generator, so two runs with the
+ * same options work on the same rects.
+ */
+
+/* side of the square all datasets lie in */
+#define BENCH_EXTENT	1000.0
+
+/* longest list a --threads or --fanouts option can give */
+#define BENCH_LIST	16
+
+// MARK: - Random numbers
+/* splitmix64, one stream per generator */
+typedef struct _RTreeBenchRandom
+{
+	uint64_t state;
+} RTreeBenchRandom;
+
+extern void RTreeBenchSeed(RTreeBenchRandom *, uint64_t seed);
+extern uint64_t RTreeBenchNext(RTreeBenchRandom *);
+extern double RTreeBenchUniform(RTreeBenchRandom *);	/* [0, 1) */
+extern double RTreeBenchGaussian(RTreeBenchRandom *);	/* mean 0, deviation 1 */
+
+// MARK: - Datasets
+typedef enum
+{
+	RTreeBenchUniformData,	/* small rects spread evenly */
+	RTreeBenchClusteredData,	/* small rects around Gaussian cluster centers */
+	RTreeBenchSkewedData,	/* tiny rects around hot spots of Zipf popularity */
+	RTreeBenchDataCount
+} RTreeBenchDataset;
+
+extern const char * RTreeBenchDatasetName(RTreeBenchDataset);
+extern int RTreeBenchDatasetFromName(const char *, RTreeBenchDataset *);
+extern void RTreeBenchMakeData(RTreeBenchDataset, size_t n, uint64_t seed, RTreeRect *rects);
+extern void RTreeBenchMakeQueries(RTreeRect *data, size_t n, size_t nq, double selectivity, uint64_t seed, RTreeRect *queries);
+extern void RTreeBenchShuffle(size_t *order, size_t n, uint64_t seed);
+
+// MARK: - Options
+/* the ways a tree is built: by one of the split methods, or bulk loaded */
+typedef enum
+{
+	RTreeBenchQuadratic,
+	RTreeBenchLinear,
+	RTreeBenchRStar,
+	RTreeBenchSTR,
+	RTreeBenchHilbert,
+	RTreeBenchBuildCount
+} RTreeBenchBuild;
+
+typedef struct _RTreeBenchOptions
+{
+	size_t n;	/* data rects */
+	size_t queries;	/* search rects */
+	double selectivity;	/* fraction of the extent a search rect covers */
+	uint64_t seed;
+	int datasets[RTreeBenchDataCount];	/* nonzero: run on it */
+	int builds[RTreeBenchBuildCount];	/* nonzero: run with it */
+	int nodecards[BENCH_LIST], leafcards[BENCH_LIST];
+	int fanouts;
+	int threads[BENCH_LIST];
+	int threadCounts;
+	double seconds;	/* how long the stress test runs */
+} RTreeBenchOptions;
+
+extern const char * RTreeBenchBuildName(RTreeBenchBuild);
+
+// MARK: - Measuring
+extern double RTreeBenchNow();	/* seconds, monotonic */
+extern int RTreeBenchCompareDoubles(const void *, const void *);
+extern double RTreeBenchPercentile(double *sorted, size_t n, double p);
+
+/* fields of the line being printed */
+extern void RTreeBenchBegin(const char *suite);
+extern void RTreeBenchString(const char *key, const char *value);
+extern void RTreeBenchLong(const char *key, long value);
+extern void RTreeBenchDouble(const char *key, double value);
+extern void RTreeBenchBool(const char *key, int value);
+extern void RTreeBenchEnd();
+extern void RTreeBenchProgress(const char *format, ...);
+
+// MARK: - Trees
+extern RTreeIndex * RTreeBenchBuildIndex(RTreeBenchBuild, int nodecard, int leafcard, RTreeRect *rects, size_t n);
+extern int RTreeBenchCountHit(void *tid, RTreeRect *r, void *count);
+
+// MARK: - Suites
+extern int RTreeBenchTrees(RTreeBenchOptions *);
+extern int RTreeBenchKernels(RTreeBenchOptions *);
+extern int RTreeBenchBatch(RTreeBenchOptions *);
+extern int RTreeBenchNearest(RTreeBenchOptions *);
+extern int RTreeBenchJoin(RTreeBenchOptions *);
+extern int RTreeBenchParallel(RTreeBenchOptions *);
+extern int RTreeBenchConcurrent(RTreeBenchOptions *);
+extern int RTreeBenchStress(RTreeBenchOptions *);
+extern int RTreeBenchMapped(RTreeBenchOptions *);
+extern int RTreeBenchSave(RTreeBenchOptions *);
+extern int RTreeBenchQuantized(RTreeBenchOptions *);
+extern int RTreeBenchIngest(RTreeBenchOptions *);
+extern int RTreeBenchDelete(RTreeBenchOptions *);
+extern int RTreeBenchUpdate(RTreeBenchOptions *);
+extern int RTreeBenchCount(RTreeBenchOptions *);
+extern int RTreeBenchSnapshot(RTreeBenchOptions *);
+
+#endif /* _RTREE_BENCH_ */
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+// MARK: - Random numbers
+void RTreeBenchSeed(RTreeBenchRandom *g, uint64_t seed) {
+	g->state = seed;
+}
+
+uint64_t RTreeBenchNext(RTreeBenchRandom *g) {
+	register uint64_t z = (g->state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+double RTreeBenchUniform(RTreeBenchRandom *g) {
+	return (RTreeBenchNext(g) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/// Box-Muller, throwing away the second value to stay stateless.
+double RTreeBenchGaussian(RTreeBenchRandom *g) {
+	double u = 1.0 - RTreeBenchUniform(g), v = RTreeBenchUniform(g);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// MARK: - Datasets
+static const char *DatasetNames[RTreeBenchDataCount] = {"uniform", "clustered", "skewed"};
+
+const char * RTreeBenchDatasetName(RTreeBenchDataset d) {
+	return DatasetNames[d];
+}
+
+int RTreeBenchDatasetFromName(const char *name, RTreeBenchDataset *d) {
+	register int i;
+	for (i=0; i<RTreeBenchDataCount; i++)
+		if (!strcmp(name, DatasetNames[i]))
+		{
+			*d = (RTreeBenchDataset)i;
+			return 1;
+		}
+	return 0;
+}
+
+static double Clamp(double x, double lo, double hi) {
+	return x < lo ? lo : x > hi ? hi : x;
+}
+
+/// Set a rect of the given size around a center, moved inside the extent.
+static void PlaceRect(RTreeRect *r, double x, double y, double w, double h) {
+	x = Clamp(x - w/2, 0, BENCH_EXTENT - w);
+	y = Clamp(y - h/2, 0, BENCH_EXTENT - h);
+	r->boundary[0] = (RectReal)x;
+	r->boundary[1] = (RectReal)y;
+	r->boundary[NUMDIMS] = (RectReal)(x + w);
+	r->boundary[NUMDIMS+1] = (RectReal)(y + h);
+}
+
+/// Rects 0.1 to 2 units on a side, anywhere.
+static void MakeUniform(RTreeBenchRandom *g, size_t n, RTreeRect *rects) {
+	register size_t i;
+	double w, h;
+	for (i=0; i<n; i++)
+	{
+		w = 0.1 + 1.9 * RTreeBenchUniform(g);
+		h = 0.1 + 1.9 * RTreeBenchUniform(g);
+		PlaceRect(&rects[i], BENCH_EXTENT * RTreeBenchUniform(g), BENCH_EXTENT * RTreeBenchUniform(g), w, h);
+	}
+}
+
+/// The same rects around one center per 5000, each spread normally with a
+/// deviation of 5 to 25 units.
+static void MakeClustered(RTreeBenchRandom *g, size_t n, RTreeRect *rects) {
+	register size_t i, c;
+	size_t clusters = n / 5000 > 10 ? n / 5000 : 10;
+	double *centers = (double *)malloc(3 * clusters * sizeof(double));
+	double w, h;
+
+	assert(centers);
+	for (c=0; c<clusters; c++)
+	{
+		centers[3*c] = BENCH_EXTENT * RTreeBenchUniform(g);
+		centers[3*c+1] = BENCH_EXTENT * RTreeBenchUniform(g);
+		centers[3*c+2] = 5 + 20 * RTreeBenchUniform(g);
+	}
+	for (i=0; i<n; i++)
+	{
+		c = RTreeBenchNext(g) % clusters;
+		w = 0.1 + 1.9 * RTreeBenchUniform(g);
+		h = 0.1 + 1.9 * RTreeBenchUniform(g);
+		PlaceRect(&rects[i],
+			centers[3*c] + centers[3*c+2] * RTreeBenchGaussian(g),
+			centers[3*c+1] + centers[3*c+2] * RTreeBenchGaussian(g), w, h);
+	}
+	free(centers);
+}
+
+/// Something like points of interest or building footprints: rects of a
+/// log-normal size around 0.05 units, 90% of them around 1000 hot spots
+/// picked with Zipf popularity, each spread 0.5 to 20 units, and the rest
+/// anywhere.
+static void MakeSkewed(RTreeBenchRandom *g, size_t n, RTreeRect *rects) {
+	enum { Spots = 1000 };
+	double *cdf = (double *)malloc(Spots * sizeof(double));
+	double *spots = (double *)malloc(3 * Spots * sizeof(double));
+	register size_t i, lo, hi, mid;
+	double sum, u, size, x, y;
+
+	assert(cdf && spots);
+	for (sum=0, i=0; i<Spots; i++)
+	{
+		sum += 1.0 / (double)(i + 1);
+		cdf[i] = sum;
+		spots[3*i] = BENCH_EXTENT * RTreeBenchUniform(g);
+		spots[3*i+1] = BENCH_EXTENT * RTreeBenchUniform(g);
+		spots[3*i+2] = exp(log(0.5) + (log(20.0) - log(0.5)) * RTreeBenchUniform(g));
+	}
+	for (i=0; i<n; i++)
+	{
+		if (RTreeBenchUniform(g) < 0.1)
+		{
+			x = BENCH_EXTENT * RTreeBenchUniform(g);
+			y = BENCH_EXTENT * RTreeBenchUniform(g);
+		}
+		else
+		{
+			u = sum * RTreeBenchUniform(g);
+			for (lo=0, hi=Spots-1; lo<hi; )
+			{
+				mid = (lo + hi) / 2;
+				if (cdf[mid] < u)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			x = spots[3*lo] + spots[3*lo+2] * RTreeBenchGaussian(g);
+			y = spots[3*lo+1] + spots[3*lo+2] * RTreeBenchGaussian(g);
+		}
+		size = Clamp(0.05 * exp(RTreeBenchGaussian(g)), 0.001, 5);
+		PlaceRect(&rects[i], x, y,
+			Clamp(size * exp(0.3 * RTreeBenchGaussian(g)), 0.001, 5),
+			Clamp(size * exp(0.3 * RTreeBenchGaussian(g)), 0.001, 5));
+	}
+	free(cdf);
+	free(spots);
+}
+
+/// Fill rects with n data rects of a dataset.  The same seed gives the
+/// same rects.
+void RTreeBenchMakeData(RTreeBenchDataset d, size_t n, uint64_t seed, RTreeRect *rects) {
+	RTreeBenchRandom g;
+
+	RTreeBenchSeed(&g, seed * 31 + (uint64_t)d);
+	switch (d)
+	{
+	case RTreeBenchUniformData:
+		MakeUniform(&g, n, rects);
+		break;
+	case RTreeBenchClusteredData:
+		MakeClustered(&g, n, rects);
+		break;
+	default:
+		MakeSkewed(&g, n, rects);
+		break;
+	}
+}
+
+/// Fill queries with nq square search rects, each covering the given
+/// fraction of the extent, centered on data rects picked at random so the
+/// searches go where the data is.
+void RTreeBenchMakeQueries(RTreeRect *data, size_t n, size_t nq, double selectivity, uint64_t seed, RTreeRect *queries) {
+	RTreeBenchRandom g;
+	register size_t i;
+	RTreeRect *r;
+	double side = BENCH_EXTENT * sqrt(selectivity);
+
+	assert(n > 0);
+	RTreeBenchSeed(&g, seed ^ 0x5175657279ULL);
+	for (i=0; i<nq; i++)
+	{
+		r = &data[RTreeBenchNext(&g) % n];
+		PlaceRect(&queries[i],
+			(r->boundary[0] + r->boundary[NUMDIMS]) / 2,
+			(r->boundary[1] + r->boundary[NUMDIMS+1]) / 2, side, side);
+	}
+}
+
+/// Put the numbers 0 to n-1 in a random order.
+void RTreeBenchShuffle(size_t *order, size_t n, uint64_t seed) {
+	RTreeBenchRandom g;
+	register size_t i, j, k;
+
+	RTreeBenchSeed(&g, seed ^ 0x53687566666c65ULL);
+	for (i=0; i<n; i++)
+		order[i] = i;
+	for (i=n; i>1; i--)
+	{
+		j = RTreeBenchNext(&g) % i;
+		k = order[i-1];
+		order[i-1] = order[j];
+		order[j] = k;
+	}
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+/// Make a file name of the benchmark's own in the temporary directory.
+static void TempPath(char *path, size_t size, const char *suffix) {
+	const char *dir = getenv("TMPDIR");
+	snprintf(path, size, "%s/rtree-bench-%ld.%s", dir && *dir ? dir : "/tmp", (long)getpid(), suffix);
+}
+
+static int CountMappedHits(RTreeMapped *m, RTreeRect *queries, size_t nq, long *hits) {
+	size_t i;
+	for (i=0; i<nq; i++)
+		if (RTreeMappedSearch(m, &queries[i], RTreeModeIntersecting, hits, RTreeBenchCountHit) < 0)
+			return 0;
+	return 1;
+}
+
+static void FileRow(const char *suite, RTreeBenchDataset d, RTreeBenchBuild b, const char *method, double seconds) {
+	RTreeBenchBegin(suite);
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("split", RTreeBenchBuildName(b));
+	RTreeBenchString("method", method);
+	RTreeBenchDouble("seconds", seconds);
+}
+
+// MARK: - Mapped
+/// The startup of a tree rebuilt from its data against one mapped from a
+/// file, and searches of the mapped file against the tree in memory.
+int RTreeBenchMapped(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeIndex *t;
+	RTreeMapped m;
+	char path[1024];
+	double start, elapsed;
+	long hits, mappedHits;
+	size_t i;
+	int d, b, good, ok = 1;
+
+	assert(rects && queries);
+	TempPath(path, sizeof(path), "map");
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			start = RTreeBenchNow();
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			elapsed = RTreeBenchNow() - start;
+			FileRow("mapped", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "rebuild", elapsed);
+			RTreeBenchBool("ok", 1);
+			RTreeBenchEnd();
+
+			start = RTreeBenchNow();
+			good = RTreeIndexWriteMapped(t, path) == 0;
+			elapsed = RTreeBenchNow() - start;
+			FileRow("mapped", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "write", elapsed);
+			RTreeBenchBool("ok", good);
+			RTreeBenchEnd();
+
+			start = RTreeBenchNow();
+			good &= RTreeMappedOpen(&m, path) == 0;
+			elapsed = RTreeBenchNow() - start;
+			FileRow("mapped", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "open", elapsed);
+			RTreeBenchLong("bytes", good ? (long)m.size : 0);
+			RTreeBenchBool("ok", good);
+			RTreeBenchEnd();
+			if (!good)
+			{
+				ok = 0;
+				RTreeIndexFree(t);
+				continue;
+			}
+
+			hits = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<o->queries; i++)
+				RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+			elapsed = RTreeBenchNow() - start;
+			FileRow("mapped", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "search_memory", elapsed);
+			RTreeBenchDouble("search_mean_ns", elapsed * 1e9 / o->queries);
+			RTreeBenchLong("hits", hits);
+			RTreeBenchBool("ok", 1);
+			RTreeBenchEnd();
+
+			mappedHits = 0;
+			start = RTreeBenchNow();
+			good = CountMappedHits(&m, queries, o->queries, &mappedHits);
+			elapsed = RTreeBenchNow() - start;
+			good &= mappedHits == hits;
+			FileRow("mapped", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "search_mapped", elapsed);
+			RTreeBenchDouble("search_mean_ns", elapsed * 1e9 / o->queries);
+			RTreeBenchLong("hits", mappedHits);
+			RTreeBenchBool("ok", good);
+			RTreeBenchEnd();
+			ok &= good;
+
+			RTreeMappedClose(&m);
+			RTreeIndexFree(t);
+		}
+	}
+	unlink(path);
+	free(rects);
+	free(queries);
+	return ok;
+}
+
+// MARK: - Save
+/// Checkpointing a tree and loading it back, against rebuilding it.
+int RTreeBenchSave(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeIndex *t, *u;
+	char path[1024];
+	double start, elapsed;
+	long hits, loadedHits;
+	size_t i;
+	struct stat st;
+	int d, b, good, ok = 1;
+
+	assert(rects && queries);
+	TempPath(path, sizeof(path), "sav");
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			start = RTreeBenchNow();
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			elapsed = RTreeBenchNow() - start;
+			FileRow("save", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "rebuild", elapsed);
+			RTreeBenchBool("ok", 1);
+			RTreeBenchEnd();
+
+			start = RTreeBenchNow();
+			good = RTreeIndexSave(t, path) == 0 && stat(path, &st) == 0;
+			elapsed = RTreeBenchNow() - start;
+			FileRow("save", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "save", elapsed);
+			RTreeBenchLong("bytes", good ? (long)st.st_size : 0);
+			RTreeBenchDouble("mb_per_s", good && elapsed > 0 ? st.st_size / elapsed / 1e6 : 0);
+			RTreeBenchBool("ok", good);
+			RTreeBenchEnd();
+
+			start = RTreeBenchNow();
+			u = good ? RTreeIndexLoad(path) : NULL;
+			elapsed = RTreeBenchNow() - start;
+			hits = loadedHits = 0;
+			if ((good = u != NULL))
+			{
+				for (i=0; i<o->queries; i++)
+				{
+					RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+					RTreeIndexSearch(u, &queries[i], &loadedHits, RTreeBenchCountHit);
+				}
+				good = hits == loadedHits && RTreeIndexCheck(u) == (long)o->n;
+			}
+			FileRow("save", (RTreeBenchDataset)d, (RTreeBenchBuild)b, "load", elapsed);
+			RTreeBenchDouble("mb_per_s", u && elapsed > 0 ? st.st_size / elapsed / 1e6 : 0);
+			RTreeBenchLong("hits", loadedHits);
+			RTreeBenchBool("ok", good);
+			RTreeBenchEnd();
+			ok &= good;
+
+			if (u)
+				RTreeIndexFree(u);
+			RTreeIndexFree(t);
+		}
+	}
+	unlink(path);
+	free(rects);
+	free(queries);
+	return ok;
+}
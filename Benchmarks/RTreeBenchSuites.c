@@ -0,0 +1,1166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+#define Tid(i) ((void *)(uintptr_t)((i) + 1))
+
+/* calls of a kernel per --n data rects in the kernels suite */
+#define KERNEL_CALLS	20
+
+/* hits a batched search buffers before flushing */
+#define BATCH_HITS	4096
+
+// MARK: - Trees
+/// Make an index of the given fanout holding n data rects, tids 1 to n,
+/// inserted one by one in order or bulk loaded at full fill.
+RTreeIndex * RTreeBenchBuildIndex(RTreeBenchBuild b, int nodecard, int leafcard, RTreeRect *rects, size_t n) {
+	static const RTreeSplitMethod splits[] = {RTreeSplitQuadratic, RTreeSplitLinear, RTreeSplitRStar};
+	RTreeIndex *t;
+	void **tids;
+	register size_t i;
+
+	if (b == RTreeBenchSTR || b == RTreeBenchHilbert)
+	{
+		t = RTreeIndexNew(nodecard, leafcard, RTreeSplitQuadratic);
+		tids = (void **)malloc(n * sizeof(void *));
+		assert(t && tids);
+		for (i=0; i<n; i++)
+			tids[i] = Tid(i);
+		RTreeIndexBulkLoad(t, rects, tids, n, b == RTreeBenchSTR ? RTreeBulkLoadSTR : RTreeBulkLoadHilbert, 1.0);
+		free(tids);
+		return t;
+	}
+	t = RTreeIndexNew(nodecard, leafcard, splits[b]);
+	assert(t);
+	for (i=0; i<n; i++)
+		RTreeIndexInsertRect(t, &rects[i], Tid(i), 0);
+	return t;
+}
+
+int RTreeBenchCountHit(void *tid, RTreeRect *r, void *count) {
+	(*(long *)count)++;
+	return 1;
+}
+
+/// Count the nodes a search for r reads.
+static long Visits(RTreeNode *n, RTreeRect *r) {
+	uint64_t mask[MASKWORDS], m;
+	register int w;
+	long visits = 1;
+
+	if (n->level == 0)
+		return visits;
+	RTreeNodeOverlapMask(n, n->count, r, mask);
+	for (w=0; w<MASKWORDS; w++)
+		for (m=mask[w]; m; m&=m-1)
+			visits += Visits(n->child[64*w + MaskLowest(m)], r);
+	return visits;
+}
+
+/* fills of the extra bulk loads the trees suite checks the node fill of */
+static const double BulkFills[] = {0.5, 0.7, 0.9, 1.0};
+#define BULK_FILLS (int)(sizeof(BulkFills) / sizeof(BulkFills[0]))
+
+/// Count the nodes below the minimum fill in the trees bulk loaded one way
+/// at every fill of BulkFills, or 0 for a build by insertion.
+static long BulkUnderfull(RTreeBenchBuild b, int nodecard, int leafcard, RTreeRect *rects, size_t n) {
+	RTreeIndex *t;
+	RTreeAnalysis shape;
+	void **tids;
+	long underfull = 0;
+	size_t i;
+	int f, l;
+
+	if (b != RTreeBenchSTR && b != RTreeBenchHilbert)
+		return 0;
+	t = RTreeIndexNew(nodecard, leafcard, RTreeSplitQuadratic);
+	tids = (void **)malloc(n * sizeof(void *));
+	assert(t && tids);
+	for (i=0; i<n; i++)
+		tids[i] = Tid(i);
+	for (f=0; f<BULK_FILLS; f++)
+	{
+		RTreeIndexBulkLoad(t, rects, tids, n, b == RTreeBenchSTR ? RTreeBulkLoadSTR : RTreeBulkLoadHilbert, BulkFills[f]);
+		RTreeIndexAnalyze(t, &shape);
+		for (l=0; l<shape.height && l<ANALYZE_LEVELS; l++)
+			underfull += shape.level[l].underfull;
+	}
+	free(tids);
+	RTreeIndexFree(t);
+	return underfull;
+}
+
+/// Build a tree one way, search it, delete half of it, and print a line.
+/// A bulk loaded tree must have no node below the minimum fill either.
+static int TreeRun(RTreeBenchOptions *o, RTreeBenchDataset d, RTreeBenchBuild b, int nodecard, int leafcard,
+	RTreeRect *rects, RTreeRect *queries, size_t *order) {
+	RTreeIndex *t;
+	RTreeArenaStats stats;
+	RTreeAnalysis shape;
+	double start, build, searching, deleting, q, *times;
+	long hits = 0, visits = 0, missed = 0, entries, underfull;
+	size_t i, deletes = o->n / 2;
+	int good;
+
+	RTreeBenchProgress("  %s %s %d:%d", RTreeBenchDatasetName(d), RTreeBenchBuildName(b), nodecard, leafcard);
+	times = (double *)malloc(o->queries * sizeof(double));
+	assert(times);
+
+	start = RTreeBenchNow();
+	t = RTreeBenchBuildIndex(b, nodecard, leafcard, rects, o->n);
+	build = RTreeBenchNow() - start;
+	RTreeIndexAnalyze(t, &shape);
+	RTreeIndexGetArenaStats(t, &stats);
+
+	for (searching=0, i=0; i<o->queries; i++)
+	{
+		start = RTreeBenchNow();
+		RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+		times[i] = q = RTreeBenchNow() - start;
+		searching += q;
+	}
+	for (i=0; i<o->queries; i++)
+		visits += Visits(t->root, &queries[i]);
+	qsort(times, o->queries, sizeof(double), RTreeBenchCompareDoubles);
+
+	start = RTreeBenchNow();
+	for (i=0; i<deletes; i++)
+		missed += RTreeIndexDeleteRect(t, &rects[order[i]], Tid(order[i]));
+	deleting = RTreeBenchNow() - start;
+	entries = RTreeIndexCheck(t);
+	underfull = BulkUnderfull(b, nodecard, leafcard, rects, o->n);
+	good = shape.entries == (long)o->n && !missed && entries == (long)(o->n - deletes) && underfull == 0;
+
+	RTreeBenchBegin("trees");
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("split", RTreeBenchBuildName(b));
+	RTreeBenchLong("nodecard", nodecard);
+	RTreeBenchLong("leafcard", leafcard);
+	RTreeBenchLong("n", (long)o->n);
+	RTreeBenchDouble("build_s", build);
+	RTreeBenchDouble("insert_ns", build * 1e9 / o->n);
+	RTreeBenchLong("height", shape.height);
+	RTreeBenchLong("nodes", shape.nodes);
+	RTreeBenchDouble("leaf_fill", shape.level[0].fill);
+	RTreeBenchDouble("overlap", shape.overlap);
+	RTreeBenchDouble("pairwise_overlap", shape.pairwiseOverlap);
+	RTreeBenchDouble("dead_space", shape.deadSpace);
+	RTreeBenchDouble("perimeter", shape.perimeter);
+	RTreeBenchDouble("bytes_per_entry", (double)stats.bytes / o->n);
+	RTreeBenchDouble("node_bytes_per_entry", (double)shape.nodes * sizeof(RTreeNode) / o->n);
+	RTreeBenchDouble("search_mean_ns", searching * 1e9 / o->queries);
+	RTreeBenchDouble("search_p50_ns", RTreeBenchPercentile(times, o->queries, 0.5) * 1e9);
+	RTreeBenchDouble("search_p90_ns", RTreeBenchPercentile(times, o->queries, 0.9) * 1e9);
+	RTreeBenchDouble("search_p99_ns", RTreeBenchPercentile(times, o->queries, 0.99) * 1e9);
+	RTreeBenchDouble("search_max_ns", times[o->queries-1] * 1e9);
+	RTreeBenchDouble("hits_per_query", (double)hits / o->queries);
+	RTreeBenchDouble("hits_per_s", searching > 0 ? hits / searching : 0);
+	RTreeBenchDouble("visits_per_query", (double)visits / o->queries);
+	RTreeBenchDouble("delete_ns", deletes ? deleting * 1e9 / deletes : 0);
+	RTreeBenchDouble("deletes_per_s", deleting > 0 ? deletes / deleting : 0);
+	RTreeBenchLong("bulk_underfull", underfull);
+	RTreeBenchBool("ok", good);
+	RTreeBenchEnd();
+
+	RTreeIndexFree(t);
+	free(times);
+	return good;
+}
+
+/// Build time, search latency, deletes and memory of every dataset, split
+/// method and fanout.
+int RTreeBenchTrees(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	size_t *order = (size_t *)malloc(o->n * sizeof(size_t));
+	int d, b, f, ok = 1;
+
+	assert(rects && queries && order);
+	RTreeBenchShuffle(order, o->n, o->seed);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+			for (f=0; o->builds[b] && f<o->fanouts; f++)
+				ok &= TreeRun(o, (RTreeBenchDataset)d, (RTreeBenchBuild)b, o->nodecards[f], o->leafcards[f], rects, queries, order);
+	}
+	free(rects);
+	free(queries);
+	free(order);
+	return ok;
+}
+
+/// The first dataset asked for.
+static RTreeBenchDataset FirstDataset(RTreeBenchOptions *o) {
+	int d;
+	for (d=0; d<RTreeBenchDataCount-1 && !o->datasets[d]; d++)
+		;
+	return (RTreeBenchDataset)d;
+}
+
+// MARK: - Kernels
+static const char * KernelName(RTreeKernel k) {
+	switch (k)
+	{
+	case RTreeKernelScalar: return "scalar";
+	case RTreeKernelSSE: return "sse";
+	default: return "avx2";
+	}
+}
+
+/// Time of the whole-node tests per full node, for each kernel the CPU has.
+/// Kernels that agree print the same checksum.
+int RTreeBenchKernels(RTreeBenchOptions *o) {
+	static const char *modes[] = {"overlap", "contained", "containing"};
+	RTreeBenchDataset d = FirstDataset(o);
+	size_t nodes = o->n / MAXCARD, calls = KERNEL_CALLS * o->n, i;
+	RTreeRect *rects = (RTreeRect *)malloc(nodes * MAXCARD * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeNode **node = (RTreeNode **)malloc(nodes * sizeof(RTreeNode *));
+	uint64_t mask[MASKWORDS], sink;
+	RTreeBranch branch;
+	double start, elapsed;
+	int k, mode, j;
+
+	assert(nodes > 0 && rects && queries && node);
+	RTreeBenchMakeData(d, nodes * MAXCARD, o->seed, rects);
+	RTreeBenchMakeQueries(rects, nodes * MAXCARD, o->queries, o->selectivity, o->seed, queries);
+	for (i=0; i<nodes; i++)
+	{
+		node[i] = RTreeNewNode();
+		node[i]->level = 0;
+		for (j=0; j<MAXCARD; j++)
+		{
+			branch.rect = rects[i*MAXCARD + j];
+			branch.child = (RTreeNode *)Tid(i*MAXCARD + j);
+			RTreeNodeSetBranch(node[i], j, &branch);
+		}
+		node[i]->count = MAXCARD;
+	}
+	for (k=RTreeKernelScalar; k<=RTreeKernelAVX2; k++)
+	{
+		if (RTreeSetKernel((RTreeKernel)k) != (RTreeKernel)k)
+			continue;
+		for (mode=0; mode<3; mode++)
+		{
+			sink = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<calls; i++)
+			{
+				switch (mode)
+				{
+				case 0:
+					RTreeNodeOverlapMask(node[i % nodes], MAXCARD, &queries[i % o->queries], mask);
+					break;
+				case 1:
+					RTreeNodeContainedMask(node[i % nodes], MAXCARD, &queries[i % o->queries], mask);
+					break;
+				default:
+					RTreeNodeContainingMask(node[i % nodes], MAXCARD, &queries[i % o->queries], mask);
+					break;
+				}
+				sink += mask[0];
+			}
+			elapsed = RTreeBenchNow() - start;
+			RTreeBenchBegin("kernels");
+			RTreeBenchString("kernel", KernelName((RTreeKernel)k));
+			RTreeBenchString("test", modes[mode]);
+			RTreeBenchLong("branches", MAXCARD);
+			RTreeBenchDouble("node_ns", elapsed * 1e9 / calls);
+			RTreeBenchLong("checksum", (long)(sink & 0x7fffffff));
+			RTreeBenchEnd();
+		}
+	}
+	RTreeSetKernel(RTreeKernelAuto);
+	for (i=0; i<nodes; i++)
+		RTreeFreeNode(node[i]);
+	free(node);
+	free(rects);
+	free(queries);
+	return 1;
+}
+
+// MARK: - Batched search
+static int CountBatch(RTreeBatchHit *hits, size_t count, void *total) {
+	*(long *)total += (long)count;
+	return 1;
+}
+
+/// One walk for all queries against a search per query.
+int RTreeBenchBatch(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeBatchHit *hits = (RTreeBatchHit *)malloc(BATCH_HITS * sizeof(RTreeBatchHit));
+	RTreeIndex *t;
+	double start, loop, batch;
+	long loopHits = 0, batchHits = 0;
+	int d, ok = 1;
+	size_t i;
+
+	assert(rects && queries && hits);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		t = RTreeBenchBuildIndex(RTreeBenchQuadratic, MAXCARD, MAXCARD, rects, o->n);
+
+		loopHits = batchHits = 0;
+		start = RTreeBenchNow();
+		for (i=0; i<o->queries; i++)
+			RTreeSearch(t->root, &queries[i], &loopHits, RTreeBenchCountHit);
+		loop = RTreeBenchNow() - start;
+		start = RTreeBenchNow();
+		RTreeSearchBatch(t->root, queries, o->queries, RTreeModeIntersecting, hits, BATCH_HITS, CountBatch, &batchHits);
+		batch = RTreeBenchNow() - start;
+
+		RTreeBenchBegin("batch");
+		RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+		RTreeBenchLong("queries", (long)o->queries);
+		RTreeBenchDouble("loop_ns", loop * 1e9 / o->queries);
+		RTreeBenchDouble("batch_ns", batch * 1e9 / o->queries);
+		RTreeBenchLong("hits", batchHits);
+		RTreeBenchBool("ok", loopHits == batchHits);
+		RTreeBenchEnd();
+		ok &= loopHits == batchHits;
+		RTreeIndexFree(t);
+	}
+	free(rects);
+	free(queries);
+	free(hits);
+	return ok;
+}
+
+// MARK: - Nearest neighbors
+/* the k nearest data rects a box search has seen */
+typedef struct _BoxNearest
+{
+	RectReal *point;
+	size_t k, count;
+	double dist[16];	/* ascending */
+} BoxNearest;
+
+static double MinDist(RectReal *p, RTreeRect *r) {
+	register int i;
+	double d, sum = 0;
+	for (i=0; i<NUMDIMS; i++)
+	{
+		d = p[i] < r->boundary[i] ? r->boundary[i] - p[i] : p[i] > r->boundary[i+NUMDIMS] ? p[i] - r->boundary[i+NUMDIMS] : 0;
+		sum += d * d;
+	}
+	return sqrt(sum);
+}
+
+static int BoxHit(void *tid, RTreeRect *r, void *arg) {
+	BoxNearest *b = (BoxNearest *)arg;
+	double d = MinDist(b->point, r);
+	register size_t i;
+
+	if (b->count == b->k && d >= b->dist[b->k-1])
+		return 1;
+	if (b->count < b->k)
+		b->count++;
+	for (i=b->count-1; i>0 && b->dist[i-1] > d; i--)
+		b->dist[i] = b->dist[i-1];
+	b->dist[i] = d;
+	return 1;
+}
+
+/// The distance to the k-th nearest data rect by range searches of a box
+/// around the point, doubled until it holds k rects within its half side,
+/// as a caller without a nearest neighbor search would.
+static double BoxSearch(RTreeNode *root, RectReal *point, size_t k, double half) {
+	BoxNearest b;
+	RTreeRect box;
+	register int i;
+
+	b.point = point;
+	b.k = k;
+	for (;; half*=2)
+	{
+		b.count = 0;
+		for (i=0; i<NUMDIMS; i++)
+		{
+			box.boundary[i] = (RectReal)(point[i] - half);
+			box.boundary[i+NUMDIMS] = (RectReal)(point[i] + half);
+		}
+		RTreeSearch(root, &box, &b, BoxHit);
+		if ((b.count == k && b.dist[k-1] <= half) || half > 2 * BENCH_EXTENT)
+			return b.count ? b.dist[b.count-1] : HUGE_VAL;
+	}
+}
+
+/// Best-first k nearest neighbors against growing box searches.
+int RTreeBenchNearest(RTreeBenchOptions *o) {
+	static const size_t ks[] = {1, 10};
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RectReal *points = (RectReal *)malloc(o->queries * NUMDIMS * sizeof(RectReal));
+	double *best = (double *)malloc(o->queries * sizeof(double));
+	void *tids[10];
+	double dists[10], start, nearest, box, half;
+	RTreeIndex *t;
+	long mismatches;
+	size_t i, j, found;
+	int d, ok = 1;
+
+	assert(rects && queries && points && best);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (i=0; i<o->queries; i++)
+			for (j=0; j<NUMDIMS; j++)
+				points[i*NUMDIMS + j] = queries[i].boundary[j];	/* a corner, off the data rect */
+		t = RTreeBenchBuildIndex(RTreeBenchQuadratic, MAXCARD, MAXCARD, rects, o->n);
+		for (j=0; j<sizeof(ks)/sizeof(ks[0]); j++)
+		{
+			start = RTreeBenchNow();
+			for (i=0; i<o->queries; i++)
+			{
+				found = RTreeSearchNearest(t->root, &points[i*NUMDIMS], ks[j], HUGE_VAL, tids, dists);
+				best[i] = found ? dists[found-1] : HUGE_VAL;
+			}
+			nearest = RTreeBenchNow() - start;
+
+			/* start at the box that holds k rects on average */
+			half = BENCH_EXTENT * sqrt((double)ks[j] / o->n) / 2;
+			mismatches = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<o->queries; i++)
+				mismatches += fabs(BoxSearch(t->root, &points[i*NUMDIMS], ks[j], half) - best[i]) > 1e-4;
+			box = RTreeBenchNow() - start;
+
+			RTreeBenchBegin("nearest");
+			RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+			RTreeBenchLong("k", (long)ks[j]);
+			RTreeBenchDouble("nearest_ns", nearest * 1e9 / o->queries);
+			RTreeBenchDouble("box_ns", box * 1e9 / o->queries);
+			RTreeBenchLong("mismatches", mismatches);
+			RTreeBenchBool("ok", !mismatches);
+			RTreeBenchEnd();
+			ok &= !mismatches;
+		}
+		RTreeIndexFree(t);
+	}
+	free(rects);
+	free(queries);
+	free(points);
+	free(best);
+	return ok;
+}
+
+// MARK: - Joins
+static int CountPair(void *a, void *b, void *count) {
+	(*(long *)count)++;
+	return 1;
+}
+
+/// Pairs of intersecting rects of two datasets: the synchronized join on
+/// one thread and on a pool, against a search of one tree per rect of the
+/// other.
+int RTreeBenchJoin(RTreeBenchOptions *o) {
+	RTreeRect *a = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *b = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeIndex *ta, *tb;
+	RTreeThreadPool *pool;
+	RTreeJoinBuffer *buffers;
+	double start, elapsed;
+	long pairs, loopPairs;
+	size_t i, parallelPairs;
+	int d, th, w, ok = 1;
+
+	assert(a && b);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, a);
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed + 1, b);
+		ta = RTreeBenchBuildIndex(RTreeBenchQuadratic, MAXCARD, MAXCARD, a, o->n);
+		tb = RTreeBenchBuildIndex(RTreeBenchQuadratic, MAXCARD, MAXCARD, b, o->n);
+
+		pairs = 0;
+		start = RTreeBenchNow();
+		RTreeJoin(ta->root, tb->root, CountPair, &pairs);
+		elapsed = RTreeBenchNow() - start;
+		RTreeBenchBegin("join");
+		RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+		RTreeBenchString("method", "join");
+		RTreeBenchLong("threads", 1);
+		RTreeBenchDouble("seconds", elapsed);
+		RTreeBenchLong("pairs", pairs);
+		RTreeBenchBool("ok", 1);
+		RTreeBenchEnd();
+
+		loopPairs = 0;
+		start = RTreeBenchNow();
+		for (i=0; i<o->n; i++)
+			RTreeSearch(ta->root, &b[i], &loopPairs, RTreeBenchCountHit);
+		elapsed = RTreeBenchNow() - start;
+		RTreeBenchBegin("join");
+		RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+		RTreeBenchString("method", "loop");
+		RTreeBenchLong("threads", 1);
+		RTreeBenchDouble("seconds", elapsed);
+		RTreeBenchLong("pairs", loopPairs);
+		RTreeBenchBool("ok", loopPairs == pairs);
+		RTreeBenchEnd();
+		ok &= loopPairs == pairs;
+
+		for (th=0; th<o->threadCounts; th++)
+		{
+			pool = RTreeThreadPoolNew(o->threads[th]);
+			buffers = (RTreeJoinBuffer *)calloc(o->threads[th], sizeof(RTreeJoinBuffer));
+			assert(pool && buffers);
+			start = RTreeBenchNow();
+			parallelPairs = RTreeJoinParallel(ta->root, tb->root, pool, buffers);
+			elapsed = RTreeBenchNow() - start;
+			RTreeBenchBegin("join");
+			RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+			RTreeBenchString("method", "parallel");
+			RTreeBenchLong("threads", o->threads[th]);
+			RTreeBenchDouble("seconds", elapsed);
+			RTreeBenchLong("pairs", (long)parallelPairs);
+			RTreeBenchBool("ok", (long)parallelPairs == pairs);
+			RTreeBenchEnd();
+			ok &= (long)parallelPairs == pairs;
+			for (w=0; w<o->threads[th]; w++)
+				RTreeJoinBufferFree(&buffers[w]);
+			free(buffers);
+			RTreeThreadPoolFree(pool);
+		}
+		RTreeIndexFree(ta);
+		RTreeIndexFree(tb);
+	}
+	free(a);
+	free(b);
+	return ok;
+}
+
+// MARK: - Parallel search
+static void ParallelRow(RTreeBenchDataset d, const char *method, int threads, double elapsed, long hits, int ok) {
+	RTreeBenchBegin("parallel");
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("method", method);
+	RTreeBenchLong("threads", threads);
+	RTreeBenchDouble("seconds", elapsed);
+	RTreeBenchLong("hits", hits);
+	RTreeBenchDouble("hits_per_s", elapsed > 0 ? hits / elapsed : 0);
+	RTreeBenchBool("ok", ok);
+	RTreeBenchEnd();
+}
+
+/// Hit throughput against threads: a few large searches split over a pool,
+/// and the whole query set as parallel batches.
+int RTreeBenchParallel(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeRect *large = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeBatchHit *hits = (RTreeBatchHit *)malloc(BATCH_HITS * sizeof(RTreeBatchHit));
+	size_t nlarge = o->queries / 100 > 0 ? o->queries / 100 : 1, i;
+	double largeSelectivity = o->selectivity * 100 < 1 ? o->selectivity * 100 : 1;
+	RTreeThreadPool *pool;
+	RTreeHitBuffer *buffers;
+	RTreeIndex *t;
+	double start, elapsed;
+	long searchHits, batchHits, found;
+	int d, th, w, ok = 1;
+
+	assert(rects && queries && large && hits);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		RTreeBenchMakeQueries(rects, o->n, nlarge, largeSelectivity, o->seed + 1, large);
+		t = RTreeBenchBuildIndex(RTreeBenchQuadratic, MAXCARD, MAXCARD, rects, o->n);
+
+		searchHits = 0;
+		start = RTreeBenchNow();
+		for (i=0; i<nlarge; i++)
+			RTreeSearch(t->root, &large[i], &searchHits, RTreeBenchCountHit);
+		ParallelRow((RTreeBenchDataset)d, "sequential_search", 1, RTreeBenchNow() - start, searchHits, 1);
+		batchHits = 0;
+		start = RTreeBenchNow();
+		RTreeSearchBatch(t->root, queries, o->queries, RTreeModeIntersecting, hits, BATCH_HITS, CountBatch, &batchHits);
+		ParallelRow((RTreeBenchDataset)d, "sequential_batch", 1, RTreeBenchNow() - start, batchHits, 1);
+
+		for (th=0; th<o->threadCounts; th++)
+		{
+			pool = RTreeThreadPoolNew(o->threads[th]);
+			buffers = (RTreeHitBuffer *)calloc(o->threads[th], sizeof(RTreeHitBuffer));
+			assert(pool && buffers);
+			found = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<nlarge; i++)
+				found += (long)RTreeSearchParallel(t->root, &large[i], RTreeModeIntersecting, pool, buffers);
+			elapsed = RTreeBenchNow() - start;
+			ParallelRow((RTreeBenchDataset)d, "search", o->threads[th], elapsed, found, found == searchHits);
+			ok &= found == searchHits;
+
+			start = RTreeBenchNow();
+			found = (long)RTreeSearchBatchParallel(t->root, queries, o->queries, RTreeModeIntersecting, pool, buffers);
+			elapsed = RTreeBenchNow() - start;
+			ParallelRow((RTreeBenchDataset)d, "batch", o->threads[th], elapsed, found, found == batchHits);
+			ok &= found == batchHits;
+
+			for (w=0; w<o->threads[th]; w++)
+				RTreeHitBufferFree(&buffers[w]);
+			free(buffers);
+			RTreeThreadPoolFree(pool);
+		}
+		RTreeIndexFree(t);
+	}
+	free(rects);
+	free(queries);
+	free(large);
+	free(hits);
+	return ok;
+}
+
+// MARK: - Quantized
+static void QuantizedRow(RTreeBenchDataset d, RTreeBenchBuild b, const char *method, int height, long nodes, long bytes, double seconds, long hits, int ok) {
+	RTreeBenchBegin("quantized");
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("split", RTreeBenchBuildName(b));
+	RTreeBenchString("method", method);
+	RTreeBenchLong("bits", QUANTBITS);
+	RTreeBenchLong("height", height);
+	RTreeBenchLong("nodes", nodes);
+	RTreeBenchLong("bytes", bytes);
+	RTreeBenchDouble("search_seconds", seconds);
+	RTreeBenchLong("hits", hits);
+	RTreeBenchBool("ok", ok);
+	RTreeBenchEnd();
+}
+
+/// Searches of a quantized copy of a tree against the tree itself.
+int RTreeBenchQuantized(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeAnalysis a;
+	RTreeQuantized *q;
+	RTreeIndex *t;
+	double start, elapsed;
+	long hits, quantizedHits;
+	size_t i;
+	int d, b, ok = 1;
+
+	assert(rects && queries);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			RTreeIndexAnalyze(t, &a);
+			hits = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<o->queries; i++)
+				RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+			elapsed = RTreeBenchNow() - start;
+			QuantizedRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "exact", a.height, a.nodes, a.nodes * (long)sizeof(RTreeNode), elapsed, hits, 1);
+
+			q = RTreeIndexQuantize(t);
+			quantizedHits = 0;
+			start = RTreeBenchNow();
+			for (i=0; i<o->queries; i++)
+				RTreeQuantizedSearch(q, &queries[i], RTreeModeIntersecting, &quantizedHits, RTreeBenchCountHit);
+			elapsed = RTreeBenchNow() - start;
+			QuantizedRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "quantized", q->height, (long)(q->leafCount + q->nodeCount), (long)RTreeQuantizedBytes(q), elapsed, quantizedHits, quantizedHits == hits);
+			ok &= quantizedHits == hits;
+
+			RTreeQuantizedFree(q);
+			RTreeIndexFree(t);
+		}
+	}
+	free(rects);
+	free(queries);
+	return ok;
+}
+
+// MARK: - Ingest
+/* pauses to search in, spread over the inserts of the ingest suite */
+#define INGEST_ROUNDS	20
+
+/* write buffer thresholds the ingest suite runs, 0 for plain inserts */
+static const size_t IngestThresholds[] = {0, 1024, 16384, 131072};
+#define INGEST_THRESHOLDS (int)(sizeof(IngestThresholds) / sizeof(IngestThresholds[0]))
+
+/// Sustained inserts into a tree, straight in and through write buffers of
+/// a few sizes, with searches in between that scan what is buffered.
+int RTreeBenchIngest(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeIngest *g;
+	RTreeIndex *t;
+	double start, inserting, searching, buffered;
+	long hits, plainHits = 0;
+	size_t i, merges, rebuilds;
+	int d, b, k, round, good, ok = 1;
+
+	assert(rects && queries);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		for (b=0; b<RTreeBenchSTR; b++)	/* bulk loads don't insert */
+		{
+			if (!o->builds[b])
+				continue;
+			for (k=0; k<INGEST_THRESHOLDS; k++)
+			{
+				t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, 0);
+				g = IngestThresholds[k] ? RTreeIngestNew(t, IngestThresholds[k]) : NULL;
+				inserting = searching = buffered = 0;
+				hits = 0;
+				for (round=0; round<INGEST_ROUNDS; round++)
+				{
+					start = RTreeBenchNow();
+					for (i=o->n*round/INGEST_ROUNDS; i<o->n*(round+1)/INGEST_ROUNDS; i++)
+					{
+						if (g)
+							RTreeIngestInsert(g, &rects[i], Tid(i));
+						else
+							RTreeIndexInsertRect(t, &rects[i], Tid(i), 0);
+					}
+					inserting += RTreeBenchNow() - start;
+					buffered += g ? g->count : 0;
+
+					start = RTreeBenchNow();
+					for (i=o->queries*round/INGEST_ROUNDS; i<o->queries*(round+1)/INGEST_ROUNDS; i++)
+					{
+						if (g)
+							RTreeIngestSearch(g, &queries[i], RTreeModeIntersecting, &hits, RTreeBenchCountHit);
+						else
+							RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+					}
+					searching += RTreeBenchNow() - start;
+				}
+				merges = rebuilds = 0;
+				if (g)
+				{
+					start = RTreeBenchNow();
+					RTreeIngestMerge(g);
+					inserting += RTreeBenchNow() - start;
+					merges = g->merges;
+					rebuilds = g->rebuilds;
+					RTreeIngestFree(g);
+				}
+				else
+					plainHits = hits;
+				good = RTreeIndexCheck(t) == (long)o->n && hits == plainHits;
+				ok &= good;
+
+				RTreeBenchBegin("ingest");
+				RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+				RTreeBenchString("split", RTreeBenchBuildName((RTreeBenchBuild)b));
+				RTreeBenchString("method", g ? "buffered" : "plain");
+				RTreeBenchLong("threshold", (long)IngestThresholds[k]);
+				RTreeBenchDouble("inserts_per_s", inserting > 0 ? o->n / inserting : 0);
+				RTreeBenchDouble("search_mean_ns", o->queries ? searching * 1e9 / o->queries : 0);
+				RTreeBenchDouble("mean_buffered", buffered / INGEST_ROUNDS);
+				RTreeBenchLong("merges", (long)merges);
+				RTreeBenchLong("rebuilds", (long)rebuilds);
+				RTreeBenchLong("hits", hits);
+				RTreeBenchBool("ok", good);
+				RTreeBenchEnd();
+				RTreeIndexFree(t);
+			}
+		}
+	}
+	free(rects);
+	free(queries);
+	return ok;
+}
+
+// MARK: - Delete
+/* share of the data cover the region of the delete suite takes, per side */
+#define DELETE_SIDE	0.3
+
+/* the tids of the data rects a search finds */
+typedef struct
+{
+	void **tids;
+	size_t count;
+} DeleteHits;
+
+static int DeleteHit(void *tid, RTreeRect *r, void *hits) {
+	DeleteHits *h = (DeleteHits *)hits;
+	h->tids[h->count++] = tid;
+	return 1;
+}
+
+static void DeleteRow(RTreeBenchDataset d, RTreeBenchBuild b, const char *method, size_t removed, double seconds, long left, int ok) {
+	RTreeBenchBegin("delete");
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("split", RTreeBenchBuildName(b));
+	RTreeBenchString("method", method);
+	RTreeBenchLong("removed", (long)removed);
+	RTreeBenchDouble("seconds", seconds);
+	RTreeBenchLong("left", left);
+	RTreeBenchBool("ok", ok);
+	RTreeBenchEnd();
+}
+
+/// Deleting everything in a region of a tree, found by a search and deleted
+/// one by one, by tid through the locator, and by RTreeIndexDeleteWhere.
+int RTreeBenchDelete(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect cover, region;
+	DeleteHits h;
+	RTreeIndex *t;
+	double start, elapsed;
+	size_t i, j, removed;
+	long left;
+	int d, b, k, good, ok = 1;
+
+	h.tids = (void **)malloc(o->n * sizeof(void *) + 1);
+	assert(rects && h.tids);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d] || o->n == 0)
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		cover = rects[0];
+		for (i=1; i<o->n; i++)
+			cover = RTreeCombineRect(&cover, &rects[i]);
+		for (k=0; k<NUMDIMS; k++)
+		{
+			region.boundary[k] = cover.boundary[k] + (cover.boundary[k+NUMDIMS] - cover.boundary[k]) * (0.5 - DELETE_SIDE / 2);
+			region.boundary[k+NUMDIMS] = cover.boundary[k] + (cover.boundary[k+NUMDIMS] - cover.boundary[k]) * (0.5 + DELETE_SIDE / 2);
+		}
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			h.count = 0;
+			start = RTreeBenchNow();
+			RTreeIndexSearch(t, &region, &h, DeleteHit);
+			for (i=0; i<h.count; i++)
+			{
+				j = (uintptr_t)h.tids[i] - 1;
+				RTreeIndexDeleteRect(t, &rects[j], h.tids[i]);
+			}
+			elapsed = RTreeBenchNow() - start;
+			left = RTreeIndexCheck(t);
+			removed = h.count;
+			DeleteRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "one_by_one", removed, elapsed, left, left == (long)(o->n - removed));
+			RTreeIndexFree(t);
+
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			RTreeIndexEnableLocator(t);
+			start = RTreeBenchNow();
+			for (i=0; i<h.count; i++)
+				RTreeIndexDeleteTid(t, h.tids[i]);
+			elapsed = RTreeBenchNow() - start;
+			good = RTreeIndexCheck(t) == left;
+			ok &= good;
+			DeleteRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "locator", h.count, elapsed, RTreeIndexCheck(t), good);
+			RTreeIndexFree(t);
+
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			start = RTreeBenchNow();
+			removed = RTreeIndexDeleteWhere(t, &region, RTreeModeIntersecting, NULL, NULL);
+			elapsed = RTreeBenchNow() - start;
+			good = RTreeIndexCheck(t) == left && removed == h.count;
+			ok &= good;
+			DeleteRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "where", removed, elapsed, RTreeIndexCheck(t), good);
+			RTreeIndexFree(t);
+		}
+	}
+	free(h.tids);
+	free(rects);
+	return ok;
+}
+
+// MARK: - Update
+/* moves of every data rect in the update suite */
+#define UPDATE_TICKS	5
+
+/* longest step of a move along each axis, as a fraction of the data extent */
+#define UPDATE_STEP	0.0005
+
+/// Move every data rect of a tree UPDATE_TICKS times by a random step,
+/// by RTreeIndexUpdateRect or else by a delete and an insert, counting how
+/// each update went.  Returns the seconds the moves took.
+static double RandomWalk(RTreeIndex *t, RTreeRect *rects, size_t n, RTreeRect *extent, uint64_t seed, int update, long *kinds) {
+	RTreeBenchRandom g;
+	RTreeRect rect;
+	double start, seconds = 0, step;
+	size_t i;
+	int tick, d;
+
+	RTreeBenchSeed(&g, seed);
+	for (tick=0; tick<UPDATE_TICKS; tick++)
+	{
+		start = RTreeBenchNow();
+		for (i=0; i<n; i++)
+		{
+			rect = rects[i];
+			for (d=0; d<NUMDIMS; d++)
+			{
+				step = (2 * RTreeBenchUniform(&g) - 1) * UPDATE_STEP * (extent->boundary[d+NUMDIMS] - extent->boundary[d]);
+				rect.boundary[d] += step;
+				rect.boundary[d+NUMDIMS] += step;
+			}
+			if (update)
+				kinds[RTreeIndexUpdateRect(t, Tid(i), &rects[i], &rect)]++;
+			else
+			{
+				RTreeIndexDeleteRect(t, &rects[i], Tid(i));
+				RTreeIndexInsertRect(t, &rect, Tid(i), 0);
+				kinds[RTreeUpdateReinserted]++;
+			}
+			rects[i] = rect;
+		}
+		seconds += RTreeBenchNow() - start;
+	}
+	return seconds;
+}
+
+/* entries the update suite moves into a sibling leaf on purpose */
+#define UPDATE_SIBLING_MOVES	64
+
+/// Look for an entry to move into a sibling leaf below every node just
+/// above the leaves: one of a leaf that can spare it, to a point at the
+/// center of a sibling with room, outside its own leaf.  Sets the tids of
+/// at most max of them in which, and where they are to go in to.
+static size_t SiblingTargets(RTreeIndex *t, RTreeNode *n, size_t *which, RTreeRect *to, size_t max) {
+	RTreeNode *leaf;
+	RTreeRect own, other, point;
+	size_t found = 0;
+	int i, j, d;
+
+	if (n->level == 0)
+		return 0;
+	if (n->level > 1)
+	{
+		for (i=0; i<n->count && found<max; i++)
+			found += SiblingTargets(t, n->child[i], which + found, to + found, max - found);
+		return found;
+	}
+	for (j=0; j<n->count; j++)
+	{
+		leaf = n->child[j];
+		if (leaf->count <= MINFILL(t, leaf))
+			continue;
+		own = RTreeNodeGetRect(n, j);
+		for (i=0; i<n->count; i++)
+		{
+			if (i == j || n->child[i]->count >= t->leafcard)
+				continue;
+			other = RTreeNodeGetRect(n, i);
+			for (d=0; d<NUMDIMS; d++)
+				point.boundary[d] = point.boundary[d+NUMDIMS] = (other.boundary[d] + other.boundary[d+NUMDIMS]) / 2;
+			if (RTreeContained(&point, &own))
+				continue;
+			which[0] = (uintptr_t)leaf->child[0] - 1;
+			to[0] = point;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* clears the tid it is given when a search hits it */
+static int ClearTid(void *tid, RTreeRect *r, void *want) {
+	if (tid != *(void **)want)
+		return 1;
+	*(void **)want = NULL;
+	return 0;
+}
+
+/// Move entries into sibling leaves, as SiblingTargets picks them, counting
+/// how each update went.  Returns the entries that were not found at their
+/// new rect after.
+static long SiblingMoves(RTreeIndex *t, RTreeRect *rects, long *kinds) {
+	size_t which[UPDATE_SIBLING_MOVES], i, found;
+	RTreeRect to[UPDATE_SIBLING_MOVES];
+	void *want;
+	long missing = 0;
+
+	found = SiblingTargets(t, t->root, which, to, UPDATE_SIBLING_MOVES);
+	for (i=0; i<found; i++)
+	{
+		kinds[RTreeIndexUpdateRect(t, Tid(which[i]), &rects[which[i]], &to[i])]++;
+		rects[which[i]] = to[i];
+	}
+	for (i=0; i<found; i++)
+	{
+		want = Tid(which[i]);
+		RTreeIndexSearch(t, &to[i], &want, ClearTid);
+		missing += want != NULL;
+	}
+	return missing;
+}
+
+/// Moving objects: every data rect of a tree takes a random walk, moved by
+/// a delete and an insert and by RTreeIndexUpdateRect, with and without the
+/// locator; then the tree is searched, to see what the updates left.
+/// After the walk RTreeIndexUpdateRect also moves some entries into sibling
+/// leaves on purpose, and at least one must go by RTreeUpdateMoved.
+int RTreeBenchUpdate(RTreeBenchOptions *o) {
+	static const char *methods[] = {"delete_insert", "update", "update_locator"};
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *moved = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeRect extent;
+	RTreeIndex *t;
+	double moving, start, searching;
+	long kinds[RTreeUpdateNotFound + 1], siblings[RTreeUpdateNotFound + 1], hits, baseHits = 0, missing;
+	size_t i;
+	int d, b, m, good, ok = 1;
+
+	assert(rects && moved && queries);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d] || o->n == 0)
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		RTreeBenchMakeQueries(rects, o->n, o->queries, o->selectivity, o->seed, queries);
+		extent = rects[0];
+		for (i=1; i<o->n; i++)
+			extent = RTreeCombineRect(&extent, &rects[i]);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			for (m=0; m<3; m++)
+			{
+				t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+				if (m == 2)
+					RTreeIndexEnableLocator(t);
+				memcpy(moved, rects, o->n * sizeof(RTreeRect));
+				memset(kinds, 0, sizeof(kinds));
+				moving = RandomWalk(t, moved, o->n, &extent, o->seed, m > 0, kinds);
+
+				hits = 0;
+				start = RTreeBenchNow();
+				for (i=0; i<o->queries; i++)
+					RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+				searching = RTreeBenchNow() - start;
+				if (m == 0)
+					baseHits = hits;
+				good = RTreeIndexCheck(t) == (long)o->n && hits == baseHits && kinds[RTreeUpdateNotFound] == 0;
+
+				/* and some moves into sibling leaves, which a random walk hardly makes */
+				memset(siblings, 0, sizeof(siblings));
+				missing = 0;
+				if (m > 0)
+				{
+					missing = SiblingMoves(t, moved, siblings);
+					good &= siblings[RTreeUpdateMoved] > 0 && !missing && siblings[RTreeUpdateNotFound] == 0 &&
+						RTreeIndexCheck(t) == (long)o->n;
+				}
+				ok &= good;
+
+				RTreeBenchBegin("update");
+				RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+				RTreeBenchString("split", RTreeBenchBuildName((RTreeBenchBuild)b));
+				RTreeBenchString("method", methods[m]);
+				RTreeBenchDouble("updates_per_s", moving > 0 ? UPDATE_TICKS * o->n / moving : 0);
+				RTreeBenchLong("in_place", kinds[RTreeUpdateInPlace]);
+				RTreeBenchLong("enlarged", kinds[RTreeUpdateEnlarged]);
+				RTreeBenchLong("moved", kinds[RTreeUpdateMoved]);
+				RTreeBenchLong("reinserted", kinds[RTreeUpdateReinserted]);
+				RTreeBenchLong("sibling_moved", siblings[RTreeUpdateMoved]);
+				RTreeBenchLong("sibling_other", siblings[RTreeUpdateInPlace] + siblings[RTreeUpdateEnlarged] + siblings[RTreeUpdateReinserted]);
+				RTreeBenchLong("sibling_missing", missing);
+				RTreeBenchDouble("search_mean_ns", o->queries ? searching * 1e9 / o->queries : 0);
+				RTreeBenchLong("hits", hits);
+				RTreeBenchBool("ok", good);
+				RTreeBenchEnd();
+				RTreeIndexFree(t);
+			}
+		}
+	}
+	free(rects);
+	free(moved);
+	free(queries);
+	return ok;
+}
+
+// MARK: - Count
+/* search rect sizes of the count suite, as fractions of the extent,
+ * after the --selectivity one */
+static const double CountSelectivities[] = {0.01, 0.1, 0.5};
+#define COUNT_SELECTIVITIES (int)(sizeof(CountSelectivities) / sizeof(CountSelectivities[0]))
+
+/// Counting the data rects in search rects of growing size, by a search
+/// calling back for every hit and by RTreeCount.
+int RTreeBenchCount(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeRect *queries = (RTreeRect *)malloc(o->queries * sizeof(RTreeRect));
+	RTreeIndex *t;
+	double start, searching, counting, selectivity;
+	long hits, counted;
+	size_t i;
+	int d, b, s, good, ok = 1;
+
+	assert(rects && queries);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			for (s=-1; s<COUNT_SELECTIVITIES; s++)
+			{
+				selectivity = s < 0 ? o->selectivity : CountSelectivities[s];
+				RTreeBenchMakeQueries(rects, o->n, o->queries, selectivity, o->seed, queries);
+
+				hits = 0;
+				start = RTreeBenchNow();
+				for (i=0; i<o->queries; i++)
+					RTreeIndexSearch(t, &queries[i], &hits, RTreeBenchCountHit);
+				searching = RTreeBenchNow() - start;
+
+				counted = 0;
+				start = RTreeBenchNow();
+				for (i=0; i<o->queries; i++)
+					counted += (long)RTreeIndexCount(t, &queries[i], RTreeModeIntersecting);
+				counting = RTreeBenchNow() - start;
+				good = counted == hits && RTreeIndexCheck(t) == (long)o->n;
+				ok &= good;
+
+				RTreeBenchBegin("count");
+				RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+				RTreeBenchString("split", RTreeBenchBuildName((RTreeBenchBuild)b));
+				RTreeBenchDouble("selectivity", selectivity);
+				RTreeBenchDouble("search_ns", searching * 1e9 / o->queries);
+				RTreeBenchDouble("count_ns", counting * 1e9 / o->queries);
+				RTreeBenchLong("hits", hits);
+				RTreeBenchBool("ok", good);
+				RTreeBenchEnd();
+			}
+			RTreeIndexFree(t);
+		}
+	}
+	free(rects);
+	free(queries);
+	return ok;
+}
@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+#define Tid(i) ((void *)(uintptr_t)((i) + 1))
+
+/* the split methods a concurrent index can use */
+#define CONCURRENT_BUILDS	3
+
+/* what one thread of the concurrent suites works on */
+typedef struct _RTreeBenchWorker
+{
+	RTreeIndex *t;
+	RTreeRect *rects;
+	size_t first, step, n;	/* rects first, first+step, ... below n are its own */
+	double deadline;	/* of the stress test */
+	uint64_t seed;
+	unsigned char *present;	/* of the rects of the stress test, by index */
+	RTreeSnapshot *snapshot;	/* the old version a reader of the snapshot suite holds */
+	int *stop;	/* set by the writer of the snapshot suite when done */
+	long inserts, deletes, searches, errors;
+} RTreeBenchWorker;
+
+static void * InsertWorker(void *arg) {
+	RTreeBenchWorker *w = (RTreeBenchWorker *)arg;
+	register size_t i;
+	for (i=w->first; i<w->n; i+=w->step)
+		RTreeIndexInsertConcurrent(w->t, &w->rects[i], Tid(i));
+	return NULL;
+}
+
+/// Start a worker per thread on disjoint slices of the rects, and wait for
+/// them.  Returns the seconds taken.
+static double RunWorkers(RTreeBenchWorker *w, int threads, void *(*func)(void *)) {
+	pthread_t *tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+	double start;
+	int i;
+
+	assert(tids);
+	start = RTreeBenchNow();
+	for (i=0; i<threads; i++)
+		pthread_create(&tids[i], NULL, func, &w[i]);
+	for (i=0; i<threads; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	return RTreeBenchNow() - start;
+}
+
+static void Workers(RTreeBenchWorker *w, int threads, RTreeIndex *t, RTreeRect *rects, size_t n, uint64_t seed) {
+	int i;
+	memset(w, 0, threads * sizeof(RTreeBenchWorker));
+	for (i=0; i<threads; i++)
+	{
+		w[i].t = t;
+		w[i].rects = rects;
+		w[i].first = i;
+		w[i].step = threads;
+		w[i].n = n;
+		w[i].seed = seed * 1000 + i;
+	}
+}
+
+// MARK: - Concurrent inserts
+static void ConcurrentRow(RTreeBenchDataset d, RTreeBenchBuild b, const char *method, int threads, double elapsed, size_t n, int ok) {
+	RTreeBenchBegin("concurrent");
+	RTreeBenchString("dataset", RTreeBenchDatasetName(d));
+	RTreeBenchString("split", RTreeBenchBuildName(b));
+	RTreeBenchString("method", method);
+	RTreeBenchLong("threads", threads);
+	RTreeBenchDouble("seconds", elapsed);
+	RTreeBenchDouble("inserts_per_s", elapsed > 0 ? n / elapsed : 0);
+	RTreeBenchBool("ok", ok);
+	RTreeBenchEnd();
+}
+
+/// Insert throughput against threads into one concurrent index, and the
+/// same inserts into a plain index on one thread.
+int RTreeBenchConcurrent(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeBenchWorker *w = (RTreeBenchWorker *)malloc(BENCH_LIST * sizeof(RTreeBenchWorker));
+	RTreeIndex *t;
+	double start, elapsed;
+	int d, b, th, threads, good, ok = 1;
+
+	assert(rects && w);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		for (b=0; b<CONCURRENT_BUILDS; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			start = RTreeBenchNow();
+			t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, o->n);
+			elapsed = RTreeBenchNow() - start;
+			ConcurrentRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "plain", 1, elapsed, o->n, 1);
+			RTreeIndexFree(t);
+
+			for (th=0; th<o->threadCounts; th++)
+			{
+				threads = o->threads[th];
+				w = (RTreeBenchWorker *)realloc(w, threads * sizeof(RTreeBenchWorker));
+				assert(w);
+				t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, 0);
+				RTreeIndexEnableConcurrent(t);
+				Workers(w, threads, t, rects, o->n, o->seed);
+				elapsed = RunWorkers(w, threads, InsertWorker);
+				good = RTreeIndexCheck(t) == (long)o->n;
+				ConcurrentRow((RTreeBenchDataset)d, (RTreeBenchBuild)b, "concurrent", threads, elapsed, o->n, good);
+				ok &= good;
+				RTreeIndexFree(t);
+			}
+		}
+	}
+	free(rects);
+	free(w);
+	return ok;
+}
+
+// MARK: - Stress
+/* looks for one tid among the hits of a search */
+typedef struct _FindTid
+{
+	void *tid;
+	int found;
+} FindTid;
+
+static int FindHit(void *tid, RTreeRect *r, void *arg) {
+	FindTid *f = (FindTid *)arg;
+	if (tid == f->tid)
+	{
+		f->found = 1;
+		return 0;
+	}
+	return 1;
+}
+
+static int Find(RTreeIndex *t, RTreeRect *r, void *tid) {
+	FindTid f = { tid, 0 };
+	RTreeIndexSearchConcurrent(t, r, &f, FindHit);
+	return f.found;
+}
+
+/// Insert, delete and look up rects of its own slice at random until the
+/// deadline.  No other thread touches them, so a rect in the tree must be
+/// found and one taken out must not.
+static void * StressWorker(void *arg) {
+	RTreeBenchWorker *w = (RTreeBenchWorker *)arg;
+	RTreeBenchRandom g;
+	size_t slice = (w->n - w->first + w->step - 1) / w->step, i;
+	int op;
+
+	if (slice == 0)
+		return NULL;
+	RTreeBenchSeed(&g, w->seed);
+	while (RTreeBenchNow() < w->deadline)
+	{
+		for (op=0; op<64; op++)
+		{
+			i = w->first + (RTreeBenchNext(&g) % slice) * w->step;
+			switch (RTreeBenchNext(&g) % 4)
+			{
+			case 0:
+			case 1:
+				if (w->present[i])
+					break;
+				RTreeIndexInsertConcurrent(w->t, &w->rects[i], Tid(i));
+				w->present[i] = 1;
+				w->inserts++;
+				break;
+			case 2:
+				if (!w->present[i])
+					break;
+				w->errors += RTreeIndexDeleteConcurrent(w->t, &w->rects[i], Tid(i)) != 0;
+				w->present[i] = 0;
+				w->deletes++;
+				break;
+			default:
+				w->errors += Find(w->t, &w->rects[i], Tid(i)) != w->present[i];
+				w->searches++;
+				break;
+			}
+		}
+	}
+	return NULL;
+}
+
+/// Threads inserting, deleting and searching one concurrent index at once
+/// for --seconds per thread count, checking every answer and the tree after.
+/// Returns 0 if any was wrong.
+int RTreeBenchStress(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	unsigned char *present = (unsigned char *)malloc(o->n);
+	RTreeBenchWorker *w = NULL;
+	RTreeIndex *t;
+	double elapsed;
+	long inserts, deletes, searches, errors, entries, expected;
+	int d, b, th, i, threads, good, ok = 1;
+	size_t j;
+
+	assert(rects && present);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d])
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		for (b=0; b<CONCURRENT_BUILDS; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			for (th=0; th<o->threadCounts; th++)
+			{
+				threads = o->threads[th];
+				RTreeBenchProgress("  %s %s %d threads", RTreeBenchDatasetName((RTreeBenchDataset)d), RTreeBenchBuildName((RTreeBenchBuild)b), threads);
+				w = (RTreeBenchWorker *)realloc(w, threads * sizeof(RTreeBenchWorker));
+				assert(w);
+				memset(present, 0, o->n);
+				t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, 0);
+				RTreeIndexEnableConcurrent(t);
+				Workers(w, threads, t, rects, o->n, o->seed);
+				for (i=0; i<threads; i++)
+				{
+					w[i].present = present;
+					w[i].deadline = RTreeBenchNow() + o->seconds;
+				}
+				elapsed = RunWorkers(w, threads, StressWorker);
+
+				inserts = deletes = searches = errors = expected = 0;
+				for (i=0; i<threads; i++)
+				{
+					inserts += w[i].inserts;
+					deletes += w[i].deletes;
+					searches += w[i].searches;
+					errors += w[i].errors;
+				}
+				for (j=0; j<o->n; j++)
+				{
+					expected += present[j];
+					errors += Find(t, &rects[j], Tid(j)) != present[j];
+				}
+				entries = RTreeIndexCheck(t);
+				good = !errors && entries == expected;
+
+				RTreeBenchBegin("stress");
+				RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+				RTreeBenchString("split", RTreeBenchBuildName((RTreeBenchBuild)b));
+				RTreeBenchLong("threads", threads);
+				RTreeBenchDouble("seconds", elapsed);
+				RTreeBenchLong("inserts", inserts);
+				RTreeBenchLong("deletes", deletes);
+				RTreeBenchLong("searches", searches);
+				RTreeBenchDouble("ops_per_s", (inserts + deletes + searches) / elapsed);
+				RTreeBenchLong("entries", entries);
+				RTreeBenchLong("errors", errors);
+				RTreeBenchBool("ok", good);
+				RTreeBenchEnd();
+				ok &= good;
+				RTreeIndexFree(t);
+			}
+		}
+	}
+	free(rects);
+	free(present);
+	free(w);
+	return ok;
+}
+
+// MARK: - Snapshots
+/* commits of the writer in the snapshot suite */
+#define SNAPSHOT_COMMITS	30
+
+/* the hits of a search over a whole version: all of them, and those of tids below old */
+typedef struct _SnapshotHits
+{
+	size_t old;
+	long all, before;
+} SnapshotHits;
+
+static int SnapshotHit(void *tid, RTreeRect *r, void *arg) {
+	SnapshotHits *h = (SnapshotHits *)arg;
+	h->all++;
+	h->before += (uintptr_t)tid <= h->old;
+	return 1;
+}
+
+/// Search a whole version.  Returns the data rects in it, with those of the
+/// first old rects in *before.
+static long SnapshotCount(RTreeNode *root, size_t old, long *before) {
+	static RTreeRect all = {{-BENCH_EXTENT, -BENCH_EXTENT, 2*BENCH_EXTENT, 2*BENCH_EXTENT}};
+	SnapshotHits h = { old, 0, 0 };
+
+	RTreeSearch(root, &all, &h, SnapshotHit);
+	*before = h.before;
+	return h.all;
+}
+
+/// Search the old version held by the suite, and the current one, until
+/// the writer is done.  Every version holds n rects, the old one the first n.
+static void * SnapshotReader(void *arg) {
+	RTreeBenchWorker *w = (RTreeBenchWorker *)arg;
+	RTreeSnapshot *s;
+	long all, before;
+
+	while (!__atomic_load_n(w->stop, __ATOMIC_ACQUIRE))
+	{
+		all = SnapshotCount(w->snapshot->root, w->n, &before);
+		w->errors += all != (long)w->n || before != (long)w->n;
+		s = RTreeSnapshotAcquire(w->t);
+		w->errors += SnapshotCount(s->root, w->n, &before) != (long)w->n;
+		RTreeSnapshotRelease(w->t, s);
+		w->searches += 2;
+	}
+	return NULL;
+}
+
+/// One writer replacing the first half of the rects by the second, pair by
+/// pair, and committing SNAPSHOT_COMMITS times, while threads search a
+/// version from before any of it and the current ones.  The old version
+/// must keep its rects throughout, and the nodes it alone holds must be
+/// freed at the first commit after it is released.
+int RTreeBenchSnapshot(RTreeBenchOptions *o) {
+	RTreeRect *rects = (RTreeRect *)malloc(o->n * sizeof(RTreeRect));
+	RTreeBenchWorker *w = NULL;
+	pthread_t *readers = NULL;
+	RTreeArenaStats stats;
+	RTreeAnalysis shape;
+	RTreeSnapshot *old;
+	RTreeIndex *t;
+	double start, elapsed;
+	size_t half = o->n / 2, batch, i;
+	long searches, errors, all, before, held, freed;
+	int d, b, th, k, threads, stop, good, ok = 1;
+
+	assert(rects);
+	batch = (half + SNAPSHOT_COMMITS - 1) / SNAPSHOT_COMMITS;
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		if (!o->datasets[d] || half == 0)
+			continue;
+		RTreeBenchMakeData((RTreeBenchDataset)d, o->n, o->seed, rects);
+		for (b=0; b<RTreeBenchBuildCount; b++)
+		{
+			if (!o->builds[b])
+				continue;
+			for (th=0; th<o->threadCounts; th++)
+			{
+				threads = o->threads[th];
+				w = (RTreeBenchWorker *)realloc(w, threads * sizeof(RTreeBenchWorker));
+				readers = (pthread_t *)realloc(readers, threads * sizeof(pthread_t));
+				assert(w && readers);
+				t = RTreeBenchBuildIndex((RTreeBenchBuild)b, MAXCARD, MAXCARD, rects, half);
+				RTreeIndexEnableSnapshots(t);
+				old = RTreeSnapshotAcquire(t);
+				stop = 0;
+				Workers(w, threads, t, rects, half, o->seed);
+				for (k=0; k<threads; k++)
+				{
+					w[k].snapshot = old;
+					w[k].stop = &stop;
+					pthread_create(&readers[k], NULL, SnapshotReader, &w[k]);
+				}
+
+				errors = 0;
+				start = RTreeBenchNow();
+				for (i=0; i<half; i++)
+				{
+					RTreeIndexInsertRect(t, &rects[half + i], Tid(half + i), 0);
+					errors += RTreeIndexDeleteRect(t, &rects[i], Tid(i)) != 0;
+					if ((i + 1) % batch == 0 || i + 1 == half)
+						RTreeIndexCommit(t);
+				}
+				elapsed = RTreeBenchNow() - start;
+				__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+				for (k=0; k<threads; k++)
+					pthread_join(readers[k], NULL);
+
+				for (searches=0, k=0; k<threads; k++)
+				{
+					searches += w[k].searches;
+					errors += w[k].errors;
+				}
+				all = SnapshotCount(old->root, half, &before);
+				errors += all != (long)half || before != (long)half;
+
+				/* the old version alone holds the nodes replaced since */
+				RTreeIndexGetArenaStats(t, &stats);
+				held = (long)stats.nodesInUse;
+				RTreeSnapshotRelease(t, old);
+				RTreeIndexCommit(t);
+				RTreeIndexGetArenaStats(t, &stats);
+				freed = held - (long)stats.nodesInUse;
+				RTreeIndexAnalyze(t, &shape);
+				good = !errors && freed > 0 && (long)stats.nodesInUse == shape.nodes && RTreeIndexCheck(t) == (long)half;
+				ok &= good;
+
+				RTreeBenchBegin("snapshot");
+				RTreeBenchString("dataset", RTreeBenchDatasetName((RTreeBenchDataset)d));
+				RTreeBenchString("split", RTreeBenchBuildName((RTreeBenchBuild)b));
+				RTreeBenchLong("threads", threads);
+				RTreeBenchDouble("seconds", elapsed);
+				RTreeBenchDouble("updates_per_s", elapsed > 0 ? 2 * half / elapsed : 0);
+				RTreeBenchLong("searches", searches);
+				RTreeBenchLong("nodes_held", held);
+				RTreeBenchLong("nodes_freed", freed);
+				RTreeBenchLong("errors", errors);
+				RTreeBenchBool("ok", good);
+				RTreeBenchEnd();
+				RTreeIndexFree(t);
+			}
+		}
+	}
+	free(rects);
+	free(w);
+	free(readers);
+	return ok;
+}
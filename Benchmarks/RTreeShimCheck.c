@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "RTreeBench.h"
+
+/*
+ * rtree-shim-check [--n N] [--queries N] [--seed N]
+ * The checks of the trees and delete suites, through the RTreeNode**
+ * functions only, for a build that links RTreeShim.cpp in place of
+ * RTreeRect.c, RTreeNode.c, RTreeCard.c, RTreeIndexImpl.c and
+ * RTreeSplit_rstar.c.  Trees are built by RTreeInsertRect and
+ * RTreeInsertRectRStar at every fanout of the trees suite, searched against
+ * a scan of the data, counted, checked by RTreeIndexCheck, totals included,
+ * and half deleted again.
+ * Prints one JSON object per line, like rtree-bench; exits 1 on a failure.
+ */
+
+#define Tid(i) ((void *)(uintptr_t)((i) + 1))
+
+/* the selectivity of the searches, as the default of rtree-bench */
+#define SHIM_SELECTIVITY	0.0001
+
+static const int Fanouts[] = {4, 8, 16, MAXCARD};
+#define FANOUTS (int)(sizeof(Fanouts) / sizeof(Fanouts[0]))
+
+/* the split methods the RTreeNode** functions have */
+static const char *SplitNames[] = {"quadratic", "rstar"};
+
+static int CountHit(void *tid, RTreeRect *r, void *count) {
+	(*(long *)count)++;
+	return 1;
+}
+
+/// The queries whose hits from the tree differ from a scan of the data
+/// rects still in it, or whose RTreeCount differs from the hits.
+static long Mismatches(RTreeNode *root, RTreeRect *rects, unsigned char *present, size_t n, RTreeRect *queries, size_t nq) {
+	long hits, expected, mismatches = 0;
+	size_t i, j;
+
+	for (i=0; i<nq; i++)
+	{
+		hits = 0;
+		RTreeSearch(root, &queries[i], &hits, CountHit);
+		for (expected=0, j=0; j<n; j++)
+			expected += present[j] && RTreeOverlap(&rects[j], &queries[i]);
+		mismatches += hits != expected || (long)RTreeCount(root, &queries[i], RTreeModeIntersecting) != hits;
+	}
+	return mismatches;
+}
+
+/// The data rects of a tree built by the RTreeNode** functions, checked as
+/// RTreeIndexCheck checks an index of the same fanout, or -1.
+static long Check(RTreeNode *root) {
+	RTreeIndex t;
+
+	memset(&t, 0, sizeof(RTreeIndex));
+	t.root = root;
+	t.nodecard = NODECARD;
+	t.leafcard = LEAFCARD;
+	return RTreeIndexCheck(&t);
+}
+
+/// Build a tree one way at one fanout, search it, delete half of it in
+/// a random order, search and check it again, and print a line.
+static int ShimRun(RTreeBenchDataset d, int split, int fanout, RTreeRect *rects, size_t n,
+	RTreeRect *queries, size_t nq, size_t *order, unsigned char *present) {
+	RTreeNode *root;
+	RTreeAnalysis shape;
+	long built, left, missed = 0, mismatches;
+	size_t i, deletes = n / 2;
+	int good;
+
+	RTreeSetNodeMax(fanout);
+	RTreeSetLeafMax(fanout);
+	root = RTreeNewIndex();
+	for (i=0; i<n; i++)
+	{
+		if (split)
+			RTreeInsertRectRStar(&rects[i], Tid(i), &root, 0);
+		else
+			RTreeInsertRect(&rects[i], Tid(i), &root, 0);
+	}
+	memset(present, 1, n);
+	RTreeAnalyze(root, &shape);
+	built = Check(root);
+	mismatches = Mismatches(root, rects, present, n, queries, nq);
+
+	for (i=0; i<deletes; i++)
+	{
+		missed += RTreeDeleteRect(&rects[order[i]], Tid(order[i]), &root);
+		present[order[i]] = 0;
+	}
+	left = Check(root);
+	mismatches += Mismatches(root, rects, present, n, queries, nq);
+	good = built == (long)n && shape.level[0].underfull == 0 && !missed && left == (long)(n - deletes) && !mismatches;
+
+	printf("{\"suite\":\"shim\",\"dataset\":\"%s\",\"split\":\"%s\",\"nodecard\":%d,\"leafcard\":%d,"
+		"\"height\":%d,\"nodes\":%ld,\"entries\":%ld,\"missed\":%ld,\"left\":%ld,\"mismatches\":%ld,\"ok\":%s}\n",
+		RTreeBenchDatasetName(d), SplitNames[split], fanout, fanout,
+		shape.height, shape.nodes, built, missed, left, mismatches, good ? "true" : "false");
+	fflush(stdout);
+	RTreeRecursivelyFreeNode(root);
+	return good;
+}
+
+int main(int argc, char **argv) {
+	size_t n = 10000, nq = 1000, *order;
+	uint64_t seed = 1;
+	RTreeRect *rects, *queries;
+	unsigned char *present;
+	int i, d, s, f, ok = 1;
+
+	for (i=1; i<argc; i++)
+	{
+		if (i + 1 == argc)
+			break;
+		if (!strcmp(argv[i], "--n"))
+			n = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--queries"))
+			nq = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--seed"))
+			seed = strtoull(argv[++i], NULL, 10);
+		else
+			break;
+	}
+	if (i < argc || n == 0)
+	{
+		fprintf(stderr, "usage: rtree-shim-check [--n N] [--queries N] [--seed N]\n");
+		return 2;
+	}
+
+	rects = (RTreeRect *)malloc(n * sizeof(RTreeRect));
+	queries = (RTreeRect *)malloc(nq * sizeof(RTreeRect) + 1);
+	order = (size_t *)malloc(n * sizeof(size_t));
+	present = (unsigned char *)malloc(n);
+	assert(rects && queries && order && present);
+	RTreeBenchShuffle(order, n, seed);
+	for (d=0; d<RTreeBenchDataCount; d++)
+	{
+		RTreeBenchMakeData((RTreeBenchDataset)d, n, seed, rects);
+		RTreeBenchMakeQueries(rects, n, nq, SHIM_SELECTIVITY, seed, queries);
+		for (s=0; s<2; s++)
+			for (f=0; f<FANOUTS; f++)
+				ok &= ShimRun((RTreeBenchDataset)d, s, Fanouts[f], rects, n, queries, nq, order, present);
+	}
+	free(rects);
+	free(queries);
+	free(order);
+	free(present);
+	return !ok;
+}
@@ -28,6 +28,6 @@ let package = Package(
             name: "RTreeSwift",
             dependencies: ["RTreeIndexImpl"],
             path: "Source",
-            exclude: ["RTreeIndexImpl"]),
+            exclude: ["RTreeIndexImpl", "RTreeTemplate"]),
     ]
 )
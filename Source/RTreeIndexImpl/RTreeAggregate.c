@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/// Set the total of a node above the leaves to the sum of its children's,
+/// for one that took in or gave up whole branches, or was split.
+/// A leaf's total is its count, so there is nothing to do for one.
+void RTreeAggregateFix(RTreeNode *n) {
+	register size_t total = 0;
+	register int i;
+
+	assert(n);
+	if (n->level == 0)
+		return;
+	for (i=0; i<n->count; i++)
+		total += RTreeNodeTotal(n->child[i]);
+	n->total = (unsigned int)total;
+}
+
+/// Count the data rects below n that relate to r as mode says.  A branch
+/// whose rect lies inside r holds only data rects that do, unless they are
+/// to contain r, and counts by the total of its child.
+static size_t RTreeCountNode(RTreeNode *n, RTreeRect *r, RTreeSearchMode mode) {
+	uint64_t mask[MASKWORDS], inside[MASKWORDS], m;
+	register size_t count = 0;
+	register int w;
+
+	RTreeNodeSearchMask(n, r, mode, mask);
+	RTreeStatsVisit(n);
+	if (n->level == 0)
+	{
+		for (w=0; w<MASKWORDS; w++)
+			count += __builtin_popcountll(mask[w]);
+		return count;
+	}
+
+	if (mode == RTreeModeContaining)
+		memset(inside, 0, sizeof(inside));
+	else
+		RTreeNodeContainedMask(n, n->count, r, inside);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=inside[w]; m; m&=m-1)
+			count += RTreeNodeTotal(n->child[64*w + MaskLowest(m)]);
+		for (m=mask[w] & ~inside[w]; m; m&=m-1)
+			count += RTreeCountNode(n->child[64*w + MaskLowest(m)], r, mode);
+	}
+	return count;
+}
+
+/// Count the data rects in a tree or subtree that relate to r as mode
+/// says, without visiting them: only the nodes on the border of r are read.
+/// The tree must not have concurrent updates on.
+size_t RTreeCount(RTreeNode *N, RTreeRect *R, RTreeSearchMode mode) {
+	RTreeStatsTimer(timer);
+	size_t count;
+
+	assert(N && R);
+	RTreeStatsStart(timer);
+	count = RTreeCountNode(N, R, mode);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return count;
+}
+
+/// Count the data rects in an index that relate to r as mode says.
+size_t RTreeIndexCount(RTreeIndex *t, RTreeRect *R, RTreeSearchMode mode) {
+	assert(t && t->root);
+	assert(!t->concurrent);
+	return RTreeCount(t->root, R, mode);
+}
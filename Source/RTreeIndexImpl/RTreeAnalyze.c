@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/*
+ * The branch rects of a node cut it into a grid of cells along the sides of
+ * all of them.  Each cell is inside the same branches all over, so adding
+ * up cell areas by how many branches hold them gives the covered, twice
+ * covered and pairwise overlap areas exactly.
+ */
+typedef struct _RTreeCells
+{
+	double side[NUMDIMS][2*MAXCARD];	/* distinct side coordinates, ascending */
+	int sides[NUMDIMS];
+	uint64_t in[NUMDIMS][2*MAXCARD][MASKWORDS];	/* branches spanning the slab from side s to s+1 */
+} RTreeCells;
+
+static int RTreeCompareSides(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/// Cut a node into cells.
+static void RTreeCellsInit(RTreeCells *c, RTreeNode *n) {
+	register int d, i, s, k;
+
+	memset(c->in, 0, sizeof(c->in));
+	for (d=0; d<NUMDIMS; d++)
+	{
+		for (i=0; i<n->count; i++)
+		{
+			c->side[d][2*i] = n->bound[d][i];
+			c->side[d][2*i+1] = n->bound[d+NUMDIMS][i];
+		}
+		qsort(c->side[d], 2*n->count, sizeof(double), RTreeCompareSides);
+		for (k=0, s=0; s<2*n->count; s++)
+			if (k == 0 || c->side[d][s] != c->side[d][k-1])
+				c->side[d][k++] = c->side[d][s];
+		c->sides[d] = k;
+
+		for (s=0; s+1<k; s++)
+			for (i=0; i<n->count; i++)
+				if (n->bound[d][i] <= c->side[d][s] && n->bound[d+NUMDIMS][i] >= c->side[d][s+1])
+					c->in[d][s][i >> 6] |= (uint64_t)1 << (i & 63);
+	}
+}
+
+/// Add up the areas of the cells of a node covered once or more, twice or
+/// more, and each as many times as there are pairs of branches over it.
+static void RTreeCellsArea(RTreeCells *c, double *covered, double *overlap, double *pairwise) {
+	int slab[NUMDIMS];
+	uint64_t in;
+	double area;
+	register int d, w, count;
+
+	*covered = *overlap = *pairwise = 0;
+	for (d=0; d<NUMDIMS; d++)
+	{
+		if (c->sides[d] < 2)	/* flat, no area */
+			return;
+		slab[d] = 0;
+	}
+
+	for (;;)
+	{
+		area = 1;
+		for (d=0; d<NUMDIMS; d++)
+			area *= c->side[d][slab[d]+1] - c->side[d][slab[d]];
+		for (count=0, w=0; w<MASKWORDS; w++)
+		{
+			in = c->in[0][slab[0]][w];
+			for (d=1; d<NUMDIMS; d++)
+				in &= c->in[d][slab[d]][w];
+			count += __builtin_popcountll(in);
+		}
+		if (count >= 1)
+			*covered += area;
+		if (count >= 2)
+		{
+			*overlap += area;
+			*pairwise += area * count * (count - 1) / 2;
+		}
+
+		/* next cell */
+		for (d=0; d<NUMDIMS && ++slab[d] == c->sides[d]-1; d++)
+			slab[d] = 0;
+		if (d == NUMDIMS)
+			break;
+	}
+}
+
+/// Add a subtree to an analysis.
+static void RTreeAnalyzeNode(RTreeIndex *t, RTreeNode *n, int isRoot, RTreeAnalysis *a) {
+	RTreeLevelAnalysis *l = &a->level[n->level < ANALYZE_LEVELS ? n->level : ANALYZE_LEVELS-1];
+	RTreeCells cells;
+	RTreeRect cover;
+	double area, covered, overlap, pairwise;
+	register int i, d;
+
+	a->nodes++;
+	if (n->level == 0)
+		a->entries += n->count;
+	if (l->nodes == 0 || n->count < l->minCount)
+		l->minCount = n->count;
+	if (l->nodes == 0 || n->count > l->maxCount)
+		l->maxCount = n->count;
+	l->nodes++;
+	l->entries += n->count;
+	if (!isRoot && n->count < MINFILL(t, n))
+		l->underfull++;
+
+	if (n->count > 0)
+	{
+		cover = RTreeNodeCover(n);
+		for (area=1, d=0; d<NUMDIMS; d++)
+			area *= (double)cover.boundary[d+NUMDIMS] - cover.boundary[d];
+		RTreeCellsInit(&cells, n);
+		RTreeCellsArea(&cells, &covered, &overlap, &pairwise);
+		l->area += area;
+		l->perimeter += RTreeRectMargin(&cover);
+		l->overlap += overlap;
+		l->pairwiseOverlap += pairwise;
+		l->deadSpace += area - covered;
+	}
+
+	if (n->level > 0)
+		for (i=0; i<n->count; i++)
+			RTreeAnalyzeNode(t, n->child[i], 0, a);
+}
+
+/// Analyze the tree of an index.
+void RTreeIndexAnalyze(RTreeIndex *t, RTreeAnalysis *a) {
+	RTreeLevelAnalysis *l;
+	register int i;
+
+	assert(t && t->root && a);
+	memset(a, 0, sizeof(RTreeAnalysis));
+	a->height = t->root->level + 1;
+	a->nodecard = t->nodecard;
+	a->leafcard = t->leafcard;
+	a->minNodeFill = MinNodeFill(t);
+	a->minLeafFill = MinLeafFill(t);
+	RTreeAnalyzeNode(t, t->root, 1, a);
+
+	for (i=0; i<ANALYZE_LEVELS; i++)
+	{
+		l = &a->level[i];
+		if (l->nodes == 0)
+			continue;
+		l->fill = (double)l->entries / ((double)l->nodes * (i > 0 ? t->nodecard : t->leafcard));
+		a->overlap += l->overlap;
+		a->pairwiseOverlap += l->pairwiseOverlap;
+		a->deadSpace += l->deadSpace;
+		a->perimeter += l->perimeter;
+	}
+}
+
+/// Analyze a tree with the fanout of the default index.
+void RTreeAnalyze(RTreeNode *root, RTreeAnalysis *a) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	RTreeNode *saved = t->root;
+
+	assert(root);
+	t->root = root;
+	RTreeIndexAnalyze(t, a);
+	t->root = saved;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* alignment of a slab, nodes inside it follow each other at sizeof(RTreeNode) */
+#define ARENA_PAGE	4096
+/* bytes in one slab */
+#define ARENA_SLAB	(64*1024)
+
+#define NODES_PER_SLAB (ARENA_SLAB / sizeof(RTreeNode))
+#define LISTNODES_PER_NODE (sizeof(RTreeNode) / sizeof(RTreeListNode))
+
+/* a recycled node on the free list is linked through its first child */
+#define NextFree(n) ((n)->child[0])
+
+/// Initialize an arena, empty.  No memory is taken until the first node.
+void RTreeArenaInit(RTreeArena *a) {
+	assert(a);
+	memset(a, 0, sizeof(RTreeArena));
+}
+
+/// Take a page-aligned slab of the given size into the list of an arena.
+static void * RTreeArenaAddSlab(RTreeArena *a, size_t bytes) {
+	void *slab = NULL, **slabs;
+	int capacity;
+
+	if (a->slabCount == a->slabCapacity)
+	{
+		capacity = a->slabCapacity ? 2 * a->slabCapacity : 16;
+		slabs = (void **)realloc(a->slabs, capacity * sizeof(void *));
+		assert(slabs);
+		a->stats.heapAllocs++;
+		if (a->slabs)
+			a->stats.heapFrees++;
+		a->slabs = slabs;
+		a->slabCapacity = capacity;
+	}
+
+	if (posix_memalign(&slab, ARENA_PAGE, bytes) != 0)
+		slab = NULL;
+	assert(slab);
+	a->stats.heapAllocs++;
+	a->stats.slabs++;
+	a->stats.bytes += bytes;
+
+	a->slabs[a->slabCount++] = slab;
+	return slab;
+}
+
+/// Add a slab to carve nodes from.
+static void RTreeArenaGrow(RTreeArena *a) {
+	void *slab = RTreeArenaAddSlab(a, ARENA_SLAB);
+	a->next = (char *)slab;
+	a->end = (char *)slab + NODES_PER_SLAB * sizeof(RTreeNode);
+}
+
+/// Take node-sized memory from the free list or the newest slab.
+static RTreeNode * RTreeArenaTake(RTreeArena *a) {
+	RTreeNode *n;
+
+	if (a->freeNodes)
+	{
+		n = a->freeNodes;
+		a->freeNodes = NextFree(n);
+		a->stats.nodesFree--;
+		return n;
+	}
+	if (a->next == a->end)
+		RTreeArenaGrow(a);
+	n = (RTreeNode *)a->next;
+	a->next += sizeof(RTreeNode);
+	return n;
+}
+
+/// Make a new node from the arena and initialize it to have all branch cells empty.
+RTreeNode * RTreeArenaNewNode(RTreeArena *a) {
+	RTreeNode *n;
+
+	assert(a);
+	n = RTreeArenaTake(a);
+	RTreeInitNode(n);
+	n->version = 0;
+	a->stats.nodesInUse++;
+	RTreeStatsAdd(nodeAllocs, 1);
+	return n;
+}
+
+/// Take n nodes in a row at once, in a slab of their own, for a tree that
+/// is built whole.  They are not initialized.  Each can later be freed to
+/// the arena like any other node.
+RTreeNode * RTreeArenaReserve(RTreeArena *a, size_t n) {
+	size_t bytes;
+
+	assert(a && n > 0);
+	bytes = (n * sizeof(RTreeNode) + ARENA_PAGE - 1) / ARENA_PAGE * ARENA_PAGE;
+	a->stats.nodesInUse += n;
+	RTreeStatsAdd(nodeAllocs, n);
+	return (RTreeNode *)RTreeArenaAddSlab(a, bytes);
+}
+
+/// Return a node to the arena for reuse.
+void RTreeArenaFreeNode(RTreeArena *a, RTreeNode *n) {
+	assert(a && n);
+	NextFree(n) = a->freeNodes;
+	a->freeNodes = n;
+	a->stats.nodesInUse--;
+	a->stats.nodesFree++;
+	RTreeStatsAdd(nodeFrees, 1);
+}
+
+/// Make a node for the reinsertion list of a deletion.
+/// List nodes are cut out of node-sized blocks so slabs stay node-aligned.
+RTreeListNode * RTreeArenaNewListNode(RTreeArena *a) {
+	RTreeListNode *l;
+	size_t i;
+
+	assert(a);
+	if (!a->freeListNodes)
+	{
+		l = (RTreeListNode *)RTreeArenaTake(a);
+		for (i=0; i<LISTNODES_PER_NODE; i++)
+		{
+			l[i].next = a->freeListNodes;
+			a->freeListNodes = &l[i];
+		}
+	}
+	l = a->freeListNodes;
+	a->freeListNodes = l->next;
+	return l;
+}
+
+/// Return a list node to the arena for reuse.
+void RTreeArenaFreeListNode(RTreeArena *a, RTreeListNode *l) {
+	assert(a && l);
+	l->next = a->freeListNodes;
+	a->freeListNodes = l;
+}
+
+/// Give every slab back at once, whatever nodes are still in use.
+/// The arena is left empty and can be used again.
+void RTreeArenaRelease(RTreeArena *a) {
+	RTreeArenaStats stats;
+	int i;
+
+	assert(a);
+	stats = a->stats;
+	RTreeStatsAdd(nodeFrees, stats.nodesInUse);
+	for (i=0; i<a->slabCount; i++)
+		free(a->slabs[i]);
+	stats.heapFrees += a->slabCount;
+	if (a->slabs)
+	{
+		free(a->slabs);
+		stats.heapFrees++;
+	}
+
+	RTreeArenaInit(a);
+	a->stats.heapAllocs = stats.heapAllocs;
+	a->stats.heapFrees = stats.heapFrees;
+}
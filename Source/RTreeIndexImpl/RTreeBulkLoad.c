@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* bits per dimension of the Hilbert grid, so that the key fits in 64 bits */
+#define HILBERT_BITS ((64 / NUMDIMS) > 31 ? 31 : (64 / NUMDIMS))
+
+/* a branch waiting to be packed, plus its sort key */
+typedef struct _RTreeBulkEntry
+{
+	RTreeBranch branch;
+	union {
+		double center;	/* STR: center along the current dimension */
+		uint64_t hilbert;	/* Hilbert: index of the center on the curve */
+	} key;
+} RTreeBulkEntry;
+
+static int RTreeCompareCenter(const void *A, const void *B) {
+	const RTreeBulkEntry *a = A, *b = B;
+	return a->key.center < b->key.center ? -1 : a->key.center > b->key.center;
+}
+
+static int RTreeCompareHilbert(const void *A, const void *B) {
+	const RTreeBulkEntry *a = A, *b = B;
+	return a->key.hilbert < b->key.hilbert ? -1 : a->key.hilbert > b->key.hilbert;
+}
+
+static double RTreeRectCenter(RTreeRect *r, int dim) {
+	return ((double)r->boundary[dim] + (double)r->boundary[dim+NUMDIMS]) / 2;
+}
+
+/// Sort-Tile-Recursive ordering.
+/// Sorts the entries by center along dimension dim, cuts them into slabs that
+/// hold a whole number of nodes, and orders every slab along the next dimension.
+static void RTreeSortTileRecursive(RTreeBulkEntry *e, size_t n, size_t cap, int dim) {
+	size_t i, pages, slabs, slab;
+
+	for (i=0; i<n; i++)
+		e[i].key.center = RTreeRectCenter(&e[i].branch.rect, dim);
+	qsort(e, n, sizeof(RTreeBulkEntry), RTreeCompareCenter);
+
+	if (dim == NUMDIMS-1)
+		return;
+
+	pages = (n + cap - 1) / cap;
+	slabs = (size_t)ceil(pow((double)pages, 1.0 / (NUMDIMS - dim)));
+	slab = cap * ((pages + slabs - 1) / slabs);
+	for (i=0; i<n; i+=slab)
+		RTreeSortTileRecursive(e + i, n - i < slab ? n - i : slab, cap, dim + 1);
+}
+
+/// Map NUMDIMS grid coordinates to their index along the Hilbert curve.
+/// John Skilling, "Programming the Hilbert curve", AIP Conf. Proc. 707 (2004).
+static uint64_t RTreeHilbertIndex(uint32_t *x) {
+	uint32_t m = 1u << (HILBERT_BITS-1), p, q, t;
+	uint64_t index = 0;
+	int i, bit;
+
+	/* inverse undo */
+	for (q=m; q>1; q>>=1)
+	{
+		p = q - 1;
+		for (i=0; i<NUMDIMS; i++)
+		{
+			if (x[i] & q)
+				x[0] ^= p;
+			else
+			{
+				t = (x[0] ^ x[i]) & p;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+
+	/* gray encode */
+	for (i=1; i<NUMDIMS; i++)
+		x[i] ^= x[i-1];
+	t = 0;
+	for (q=m; q>1; q>>=1)
+		if (x[NUMDIMS-1] & q)
+			t ^= q - 1;
+	for (i=0; i<NUMDIMS; i++)
+		x[i] ^= t;
+
+	/* interleave the transposed bits */
+	for (bit=HILBERT_BITS-1; bit>=0; bit--)
+		for (i=0; i<NUMDIMS; i++)
+			index = (index << 1) | ((x[i] >> bit) & 1);
+	return index;
+}
+
+/// Hilbert ordering of the entry centers over their common bounding box.
+static void RTreeSortHilbert(RTreeBulkEntry *e, size_t n) {
+	double lo[NUMDIMS], scale[NUMDIMS], c;
+	const double cells = (double)((1u << HILBERT_BITS) - 1);
+	uint32_t x[NUMDIMS];
+	size_t i;
+	int d;
+
+	for (d=0; d<NUMDIMS; d++)
+	{
+		double hi;
+		lo[d] = hi = RTreeRectCenter(&e[0].branch.rect, d);
+		for (i=1; i<n; i++)
+		{
+			c = RTreeRectCenter(&e[i].branch.rect, d);
+			if (c < lo[d])
+				lo[d] = c;
+			if (c > hi)
+				hi = c;
+		}
+		scale[d] = hi > lo[d] ? cells / (hi - lo[d]) : 0;
+	}
+
+	for (i=0; i<n; i++)
+	{
+		for (d=0; d<NUMDIMS; d++)
+			x[d] = (uint32_t)((RTreeRectCenter(&e[i].branch.rect, d) - lo[d]) * scale[d]);
+		e[i].key.hilbert = RTreeHilbertIndex(x);
+	}
+	qsort(e, n, sizeof(RTreeBulkEntry), RTreeCompareHilbert);
+}
+
+/// Order branches by Sort-Tile-Recursive to be packed cap to a node, as
+/// RTreeIndexBulkLoad does data rects.
+void RTreeSortTileBranches(RTreeBranch *b, size_t n, size_t cap) {
+	RTreeBulkEntry *e;
+	size_t i;
+
+	assert(b || n == 0);
+	if (n == 0)
+		return;
+	e = (RTreeBulkEntry *)malloc(n * sizeof(RTreeBulkEntry));
+	assert(e);
+	for (i=0; i<n; i++)
+		e[i].branch = b[i];
+	RTreeSortTileRecursive(e, n, cap, 0);
+	for (i=0; i<n; i++)
+		b[i] = e[i].branch;
+	free(e);
+}
+
+/// Order branches along the Hilbert curve through their centers, as
+/// RTreeIndexBulkLoad does data rects.
+void RTreeSortHilbertBranches(RTreeBranch *b, size_t n) {
+	RTreeBulkEntry *e;
+	size_t i;
+
+	assert(b || n == 0);
+	if (n == 0)
+		return;
+	e = (RTreeBulkEntry *)malloc(n * sizeof(RTreeBulkEntry));
+	assert(e);
+	for (i=0; i<n; i++)
+		e[i].branch = b[i];
+	RTreeSortHilbert(e, n);
+	for (i=0; i<n; i++)
+		b[i] = e[i].branch;
+	free(e);
+}
+
+/// Number of entries to put in a packed node of the given capacity.
+static size_t RTreePackedCount(int maxkids, int minfill, double fill) {
+	int cap = (int)(fill * maxkids + 0.5);
+	if (cap > maxkids)
+		cap = maxkids;
+	if (cap < minfill)
+		cap = minfill;
+	if (cap < 2)
+		cap = 2;
+	return (size_t)cap;
+}
+
+/// Pack a run of ordered entries into nodes of one level, about cap entries
+/// per node.  The entries are spread evenly over as many nodes as cap asks
+/// for, or over fewer if that would leave them below minfill, so that no
+/// node but a lone root is left below the minimum fill.
+/// Replaces the first entries of e with branches to the new nodes and
+/// returns how many there are.
+static size_t RTreePackLevel(RTreeIndex *t, RTreeBulkEntry *e, size_t n, size_t cap, size_t minfill, int level) {
+	size_t i, j, k, take, nodes;
+	RTreeNode *node;
+
+	k = (n + cap - 1) / cap;
+	if (n / k < minfill)
+		k = n / minfill;
+	if (k == 0)
+		k = 1;
+
+	for (i=0, nodes=0; nodes<k; i+=take)
+	{
+		take = n / k + (nodes < n % k);
+
+		node = RTreeIndexNewNode(t);
+		node->level = level;
+		for (j=0; j<take; j++)
+			RTreeIndexAddBranch(t, &e[i+j].branch, node, NULL);
+		RTreeAggregateFix(node);
+
+		e[nodes].branch.rect = RTreeNodeCover(node);
+		e[nodes].branch.child = node;
+		nodes++;
+	}
+	assert(i == n);
+	return nodes;
+}
+
+/// Build an index from a complete set of data rectangles in one pass,
+/// replacing whatever the index held before.
+/// The entries are ordered either by Sort-Tile-Recursive or along the Hilbert
+/// curve and packed bottom-up, fill being the fraction of the node and leaf
+/// fanout each node receives (never below MinNodeFill / MinLeafFill).
+/// The result is a regular tree, which searches, insertions and deletions
+/// accept as any other; an empty input gives an empty index.
+void RTreeIndexBulkLoad(RTreeIndex *t, RTreeRect *rects, void **tids, size_t n, RTreeBulkLoadMethod method, double fill) {
+	RTreeBulkEntry *e;
+	size_t i, cap;
+	int level;
+
+	assert(t);
+	assert(fill > 0 && fill <= 1);
+
+	RTreeIndexFreeTree(t);
+	if (n == 0)
+	{
+		t->root = RTreeIndexNewNode(t);
+		t->root->level = 0; /* leaf */
+		return;
+	}
+
+	assert(rects && tids);
+
+	e = (RTreeBulkEntry *)malloc(n * sizeof(RTreeBulkEntry));
+	assert(e);
+	for (i=0; i<n; i++)
+	{
+		e[i].branch.rect = rects[i];
+		e[i].branch.child = (RTreeNode *)tids[i];
+	}
+
+	/* the Hilbert order of the data carries over to every level above it */
+	if (method == RTreeBulkLoadHilbert)
+		RTreeSortHilbert(e, n);
+
+	for (level=0; ; level++)
+	{
+		cap = level > 0 ?
+			RTreePackedCount(t->nodecard, MinNodeFill(t), fill) :
+			RTreePackedCount(t->leafcard, MinLeafFill(t), fill);
+		if (method == RTreeBulkLoadSTR)
+			RTreeSortTileRecursive(e, n, cap, 0);
+		n = RTreePackLevel(t, e, n, cap, level > 0 ? MinNodeFill(t) : MinLeafFill(t), level);
+		if (n == 1)
+			break;
+	}
+
+	t->root = e[0].branch.child;
+	free(e);
+}
+
+/// Build a tree for the default index from a complete set of data rectangles.
+/// Returns its root.
+RTreeNode * RTreeBulkLoad(RTreeRect *rects, void **tids, size_t n, RTreeBulkLoadMethod method, double fill) {
+	RTreeIndex *t = RTreeDefaultIndex();
+
+	t->root = NULL;	/* the tree left there belongs to a caller */
+	RTreeIndexBulkLoad(t, rects, tids, n, method, fill);
+	return t->root;
+}
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* deepest tree an insertion can go down */
+#define CONCURRENT_DEPTH 64
+
+/* a node on the way down of an insertion, with its version when read */
+typedef struct _RTreePathStep
+{
+	RTreeNode *node;
+	unsigned int version;
+	int branch;	/* taken to the next node */
+} RTreePathStep;
+
+/* data rects found by a search, reported once it is known to be valid */
+typedef struct _RTreeConcurrentHits
+{
+	RTreeBranch *hits;
+	size_t count, capacity;
+} RTreeConcurrentHits;
+
+/// Wait until a node is not locked and return its version.
+static unsigned int RTreeReadLock(RTreeNode *n) {
+	unsigned int v;
+	while ((v = __atomic_load_n(&n->version, __ATOMIC_ACQUIRE)) & 1)
+		sched_yield();
+	return v;
+}
+
+/// Whether a node is still at the version it was read at, so what was read
+/// from it meanwhile holds together.
+static int RTreeReadValidate(RTreeNode *n, unsigned int v) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&n->version, __ATOMIC_RELAXED) == v;
+}
+
+/// Lock a node for writing, if it is still at the version it was read at.
+static int RTreeUpgrade(RTreeNode *n, unsigned int v) {
+	return __atomic_compare_exchange_n(&n->version, &v, v + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/// Unlock a node locked for writing.  Returns its new version.
+static unsigned int RTreeWriteUnlock(RTreeNode *n) {
+	unsigned int v = __atomic_load_n(&n->version, __ATOMIC_RELAXED) + 1;
+	__atomic_store_n(&n->version, v, __ATOMIC_RELEASE);
+	return v;
+}
+
+/// Copy a node as it is at one version.  Returns the version.
+static unsigned int RTreeConcurrentRead(RTreeNode *n, RTreeNode *copy) {
+	unsigned int v;
+	do
+	{
+		v = RTreeReadLock(n);
+		memcpy(copy, n, sizeof(RTreeNode));
+	} while (!RTreeReadValidate(n, v));
+	return v;
+}
+
+static unsigned long RTreeConcurrentSplits(RTreeConcurrent *c) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&c->splits, __ATOMIC_ACQUIRE);
+}
+
+/// Start the versions of the nodes of a subtree over at 0, unlocked, from
+/// the totals that were kept in their place.
+static void RTreeConcurrentResetVersions(RTreeNode *n) {
+	register int i;
+	n->version = 0;
+	if (n->level > 0)
+		for (i=0; i<n->count; i++)
+			RTreeConcurrentResetVersions(n->child[i]);
+}
+
+/// Let an index be updated and searched by the functions below from any
+/// number of threads at once.  Meanwhile no other function may modify it.
+/// Not together with snapshots or the locator; the totals of the nodes
+/// are not kept from now on.
+void RTreeIndexEnableConcurrent(RTreeIndex *t) {
+	RTreeConcurrent *c;
+
+	assert(t && t->root);
+	assert(!t->versions && !t->locator);
+	if (t->concurrent)
+		return;
+
+	c = (RTreeConcurrent *)malloc(sizeof(RTreeConcurrent));
+	assert(c);
+	pthread_mutex_init(&c->smoLock, NULL);
+	c->splits = 0;
+	RTreeConcurrentResetVersions(t->root);
+	t->concurrent = c;
+}
+
+/// Split the full leaf at the end of a path to put b in, and the full nodes
+/// above it in turn, up to the first one with room or the root.
+/// Takes smoLock, then the locks of the nodes from that one down, which
+/// fails if one of them changed since it was read.
+/// Returns 1 if the root was split, 0 if not, -1 if the insertion has to
+/// start over.
+static int RTreeConcurrentSplit(RTreeIndex *t, RTreePathStep *path, int depth, RTreeBranch *b) {
+	RTreeConcurrent *c = t->concurrent;
+	register RTreeNode *n, *newroot;
+	RTreeNode *nn;
+	RTreeBranch bb;
+	RTreeRect rect;
+	int top, k, result = 0;
+
+	pthread_mutex_lock(&c->smoLock);
+	for (top=depth; top>0 && path[top].node->count >= MAXKIDS(t, path[top].node); top--)
+		;
+	for (k=top; k<=depth; k++)
+	{
+		if (!RTreeUpgrade(path[k].node, path[k].version))
+			break;
+	}
+	if (k <= depth || (top == 0 && t->root != path[0].node))
+	{
+		while (k-- > top)
+			RTreeWriteUnlock(path[k].node);
+		pthread_mutex_unlock(&c->smoLock);
+		return -1;
+	}
+
+	bb = *b;
+	for (k=depth; ; k--)
+	{
+		n = path[k].node;
+		if (!RTreeIndexAddBranch(t, &bb, n, &nn))
+			break;
+		if (k == 0)  /* grow a new root, & tree taller */
+		{
+			newroot = RTreeIndexNewNode(t);
+			newroot->level = n->level + 1;
+			bb.rect = RTreeNodeCover(n);
+			bb.child = n;
+			RTreeIndexAddBranch(t, &bb, newroot, NULL);
+			bb.rect = RTreeNodeCover(nn);
+			bb.child = nn;
+			RTreeIndexAddBranch(t, &bb, newroot, NULL);
+			__atomic_store_n(&t->root, newroot, __ATOMIC_RELEASE);
+			result = 1;
+			break;
+		}
+		rect = RTreeNodeCover(n);
+		RTreeNodeSetRect(path[k-1].node, path[k-1].branch, &rect);
+		bb.rect = RTreeNodeCover(nn);
+		bb.child = nn;
+	}
+
+	/* before the unlocks, so no one can have read the result and missed the count */
+	__atomic_add_fetch(&c->splits, 1, __ATOMIC_RELEASE);
+	for (k=depth; k>=top; k--)
+		RTreeWriteUnlock(path[k].node);
+	pthread_mutex_unlock(&c->smoLock);
+	return result;
+}
+
+/// Insert a data rectangle into an index that other threads update and
+/// search at the same time.  The branch to go down is picked on a copy of
+/// each node, the rects on the way down are enlarged one node at a time,
+/// and the leaf is locked only to add the entry, unless it is full and has
+/// to split.  Returns 1 if the root was split, 0 if not.
+int RTreeIndexInsertConcurrent(RTreeIndex *t, RTreeRect *r, void *tid) {
+	RTreePathStep path[CONCURRENT_DEPTH];
+	register RTreeNode *n, *child;
+	RTreeNode copy;
+	unsigned int v, cv;
+	int depth, i, result;
+	RTreeRect rect;
+	RTreeBranch b;
+	RTreeStatsTimer(timer);
+
+	assert(t && t->concurrent && r);
+	for (i=0; i<NUMDIMS; i++)
+		assert(r->boundary[i] <= r->boundary[NUMDIMS+i]);
+	RTreeStatsStart(timer);
+	b.rect = *r;
+	b.child = (RTreeNode *)tid;
+
+restart:
+	n = __atomic_load_n(&t->root, __ATOMIC_ACQUIRE);
+	v = RTreeConcurrentRead(n, &copy);
+	if (__atomic_load_n(&t->root, __ATOMIC_ACQUIRE) != n)
+		goto restart;
+
+	for (depth=0; ; depth++)
+	{
+		assert(depth < CONCURRENT_DEPTH);
+		path[depth].node = n;
+		path[depth].version = v;
+		if (copy.level == 0)
+			break;
+
+		i = t->split == RTreeSplitRStar ? RTreePickBranchRStar(r, &copy) : RTreePickBranch(r, &copy);
+		child = copy.child[i];
+		rect = RTreeNodeGetRect(&copy, i);
+		path[depth].branch = i;
+
+		if (!RTreeContained(r, &rect))
+		{
+			if (!RTreeUpgrade(n, v))
+				goto restart;
+			rect = RTreeCombineRect(r, &rect);
+			RTreeNodeSetRect(n, i, &rect);
+			v = path[depth].version = RTreeWriteUnlock(n);
+		}
+
+		/* the child, then whether it is still the child */
+		cv = RTreeConcurrentRead(child, &copy);
+		if (!RTreeReadValidate(n, v))
+			goto restart;
+		n = child;
+		v = cv;
+	}
+
+	/// Have reached the leaf.  Add rect, split if necessary
+	//
+	if (copy.count < MAXKIDS(t, n))
+	{
+		if (!RTreeUpgrade(n, v))
+			goto restart;
+		RTreeIndexAddBranch(t, &b, n, NULL);
+		RTreeWriteUnlock(n);
+		RTreeStatsStop(RTreeStatsInsert, timer);
+		return 0;
+	}
+	if ((result = RTreeConcurrentSplit(t, path, depth, &b)) < 0)
+		goto restart;
+	RTreeStatsStop(RTreeStatsInsert, timer);
+	return result;
+}
+
+/// Take a data rectangle out of the leaf holding it, if it is below n.
+/// Returns 0 if it was, 1 if not.
+static int RTreeDeleteConcurrent2(RTreeRect *r, void *tid, RTreeNode *n) {
+	uint64_t mask[MASKWORDS], m;
+	RTreeNode copy;
+	register int i, w, count;
+	unsigned int v;
+
+	if (n->level > 0)
+	{
+		RTreeConcurrentRead(n, &copy);
+		RTreeStatsVisit(&copy);
+		RTreeNodeOverlapMask(&copy, copy.count, r, mask);
+		for (w=0; w<MASKWORDS; w++)
+			for (m=mask[w]; m; m&=m-1)
+				if (!RTreeDeleteConcurrent2(r, tid, copy.child[64*w + MaskLowest(m)]))
+					return 0;
+		return 1;
+	}
+
+	for (;;)
+	{
+		v = RTreeReadLock(n);
+		count = n->count;
+		for (i=0; i<count && n->child[i] != (RTreeNode *)tid; i++)
+			;
+		if (!RTreeReadValidate(n, v))
+			continue;
+		if (i == count)
+			return 1;
+		if (!RTreeUpgrade(n, v))
+			continue;
+		RTreeDisconnectBranch(n, i);
+		RTreeWriteUnlock(n);
+		return 0;
+	}
+}
+
+/// Delete a data rectangle from an index that other threads update and
+/// search at the same time.  The entry is taken out of its leaf and
+/// nothing else changes; no node is merged or freed.
+/// Returns 1 if record not found, 0 if success.
+int RTreeIndexDeleteConcurrent(RTreeIndex *t, RTreeRect *r, void *tid) {
+	RTreeConcurrent *c;
+	unsigned long splits;
+	int tries, result;
+	RTreeStatsTimer(timer);
+
+	assert(t && t->concurrent && r);
+	c = t->concurrent;
+	RTreeStatsStart(timer);
+	for (tries=0; ; tries++)
+	{
+		/* a split may have moved the entry where the search had been already */
+		if (tries == CONCURRENT_RETRIES)
+			pthread_mutex_lock(&c->smoLock);
+		splits = RTreeConcurrentSplits(c);
+		result = RTreeDeleteConcurrent2(r, tid, __atomic_load_n(&t->root, __ATOMIC_ACQUIRE));
+		if (tries == CONCURRENT_RETRIES)
+		{
+			pthread_mutex_unlock(&c->smoLock);
+			break;
+		}
+		if (result == 0 || RTreeConcurrentSplits(c) == splits)
+			break;
+	}
+	RTreeStatsStop(RTreeStatsDelete, timer);
+	return result;
+}
+
+static void RTreeConcurrentFound(RTreeConcurrentHits *h, RTreeNode *n, int i) {
+	RTreeBranch *hits;
+	size_t capacity;
+
+	if (h->count == h->capacity)
+	{
+		capacity = h->capacity ? 2 * h->capacity : 256;
+		hits = (RTreeBranch *)realloc(h->hits, capacity * sizeof(RTreeBranch));
+		assert(hits);
+		h->hits = hits;
+		h->capacity = capacity;
+	}
+	h->hits[h->count++] = RTreeNodeGetBranch(n, i);
+}
+
+/// Collect the data rects below n that overlap r, reading every node as
+/// it is at one version.
+static void RTreeSearchConcurrent2(RTreeNode *n, RTreeRect *r, RTreeConcurrentHits *h) {
+	uint64_t mask[MASKWORDS], m;
+	RTreeNode copy;
+	register int i, w;
+
+	RTreeConcurrentRead(n, &copy);
+	RTreeStatsVisit(&copy);
+	RTreeNodeOverlapMask(&copy, copy.count, r, mask);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=mask[w]; m; m&=m-1)
+		{
+			i = 64*w + MaskLowest(m);
+			if (copy.level > 0)
+				RTreeSearchConcurrent2(copy.child[i], r, h);
+			else
+				RTreeConcurrentFound(h, &copy, i);
+		}
+	}
+}
+
+/// Search an index that other threads update at the same time for all data
+/// rectangles that overlap the argument rectangle.
+/// The hits are collected first and start over if a split happened
+/// meanwhile, then handed to the callback, each once.
+/// Returns 0 if the callback terminated the search.
+int RTreeIndexSearchConcurrent(RTreeIndex *t, RTreeRect *r, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeConcurrent *c;
+	RTreeConcurrentHits h;
+	unsigned long splits;
+	size_t k;
+	int tries, result = 1;
+	RTreeStatsTimer(timer);
+
+	assert(t && t->concurrent && r);
+	c = t->concurrent;
+	RTreeStatsStart(timer);
+	memset(&h, 0, sizeof(h));
+	for (tries=0; ; tries++)
+	{
+		if (tries == CONCURRENT_RETRIES)
+			pthread_mutex_lock(&c->smoLock);
+		h.count = 0;
+		splits = RTreeConcurrentSplits(c);
+		RTreeSearchConcurrent2(__atomic_load_n(&t->root, __ATOMIC_ACQUIRE), r, &h);
+		if (tries == CONCURRENT_RETRIES)
+		{
+			pthread_mutex_unlock(&c->smoLock);
+			break;
+		}
+		if (RTreeConcurrentSplits(c) == splits)
+			break;
+	}
+
+	RTreeStatsAdd(hits, h.count);
+	for (k=0; k<h.count && callback; k++)
+	{
+		if (!callback(h.hits[k].child, &h.hits[k].rect, cbarg))
+		{
+			result = 0;
+			break;
+		}
+	}
+	free(h.hits);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/// Push a node on the path of a cursor.
+static void RTreeCursorPush(RTreeCursor *c, RTreeNode *n) {
+	register RTreeCursorFrame *f;
+	assert(c->depth < CURSOR_DEPTH);
+
+	f = &c->stack[c->depth++];
+	f->node = n;
+	RTreeNodeSearchMask(n, &c->rect, c->mode, f->mask);
+	RTreeStatsVisit(n);
+}
+
+/// Start a search of the tree under root for the data rects that relate to
+/// rect as mode says.  Hits come from RTreeCursorNext or RTreeCursorNextBatch.
+void RTreeCursorOpen(RTreeCursor *c, RTreeNode *root, RTreeRect *rect, RTreeSearchMode mode) {
+	assert(c && root && rect);
+	assert(root->level >= 0 && root->level < CURSOR_DEPTH);
+
+	c->rect = *rect;
+	c->mode = mode;
+	c->depth = 0;
+	RTreeCursorPush(c, root);
+}
+
+/// Go on to the next hit of a cursor.
+/// Returns 1 and sets *tid, and *rect unless it is NULL, or 0 when the
+/// search is over.
+int RTreeCursorNext(RTreeCursor *c, void **tid, RTreeRect *rect) {
+	register RTreeCursorFrame *f;
+	register RTreeNode *n;
+	register int i, w;
+	assert(c && tid);
+
+	while (c->depth > 0)
+	{
+		f = &c->stack[c->depth-1];
+		for (w=0; w<MASKWORDS && !f->mask[w]; w++)
+			;
+		if (w == MASKWORDS)  /* done with this node */
+		{
+			c->depth--;
+			continue;
+		}
+
+		i = 64*w + MaskLowest(f->mask[w]);
+		f->mask[w] &= f->mask[w] - 1;
+		n = f->node;
+		if (n->level > 0)
+			RTreeCursorPush(c, n->child[i]);
+		else
+		{
+			RTreeStatsAdd(hits, 1);
+			*tid = n->child[i];
+			if (rect)
+				*rect = RTreeNodeGetRect(n, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/// Take up to max hits of a cursor at once into tids, and rects unless it
+/// is NULL.  Returns how many there were, less than max only at the end.
+size_t RTreeCursorNextBatch(RTreeCursor *c, void **tids, RTreeRect *rects, size_t max) {
+	size_t k;
+	assert(c && tids);
+
+	for (k=0; k<max; k++)
+		if (!RTreeCursorNext(c, &tids[k], rects ? &rects[k] : NULL))
+			break;
+	return k;
+}
+
+/// End the search of a cursor; it hands out no more hits until opened again.
+void RTreeCursorClose(RTreeCursor *c) {
+	assert(c);
+	c->depth = 0;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* what a delete is after and what it leaves to do */
+typedef struct
+{
+	RTreeRect *rect;
+	RTreeSearchMode mode;
+	RTreeDeletePredicate predicate;
+	void *arg;
+	RTreeListNode *reinsert;	/* underfull nodes taken out, their branches to put back */
+} RTreeDeleteWhereArgs;
+
+/// Free the nodes of a subtree.  Returns the data rects that were in it.
+static size_t RTreeDeleteWhereDrop(RTreeIndex *t, RTreeNode *n) {
+	register size_t entries = 0;
+	register int i;
+	if (n->level == 0)
+		entries = n->count;
+	else
+		for (i=0; i<n->count; i++)
+			entries += RTreeDeleteWhereDrop(t, n->child[i]);
+	RTreeIndexFreeNode(t, n);
+	return entries;
+}
+
+/// Delete the matching data rects below *N.  A node is made writable only
+/// when something below it goes, and then replaces *N.  Children left with
+/// too few branches are taken out and queued for reinsertion.
+/// Returns the data rects deleted.
+static size_t RTreeDeleteWhereNode(RTreeIndex *t, RTreeNode **N, RTreeDeleteWhereArgs *a) {
+	uint64_t mask[MASKWORDS];
+	RTreeNode *n = *N, *c;
+	RTreeListNode *l;
+	RTreeRect rect;
+	size_t removed = 0, below;
+	register int i;
+
+	RTreeNodeSearchMask(n, a->rect, a->mode, mask);
+	RTreeStatsVisit(n);
+	/* from the last branch down, so one disconnected is replaced by one done */
+	for (i=n->count-1; i>=0; i--)
+	{
+		if (!(mask[i/64] >> (i%64) & 1))
+			continue;
+		rect = RTreeNodeGetRect(n, i);
+		if (n->level == 0)
+		{
+			if (a->predicate && !a->predicate(n->child[i], &rect, a->arg))
+				continue;
+			*N = n = RTreeIndexWritable(t, n);
+			if (t->locator)
+				RTreeLocatorRemoveTid(t->locator, n->child[i]);
+			RTreeDisconnectBranch(n, i);
+			removed++;
+			continue;
+		}
+		if (!a->predicate && a->mode != RTreeModeContaining && RTreeContained(&rect, a->rect))
+		{
+			/* everything below matches */
+			*N = n = RTreeIndexWritable(t, n);
+			removed += RTreeDeleteWhereDrop(t, n->child[i]);
+			RTreeDisconnectBranch(n, i);
+			continue;
+		}
+		c = n->child[i];
+		if (!(below = RTreeDeleteWhereNode(t, &c, a)))
+			continue;
+		removed += below;
+		*N = n = RTreeIndexWritable(t, n);
+		n->child[i] = c;
+		if (c->count >= MINFILL(t, c))
+		{
+			rect = RTreeNodeCover(c);
+			RTreeNodeSetRect(n, i, &rect);
+			continue;
+		}
+		if (c->count > 0)
+		{
+			l = RTreeIndexNewListNode(t);
+			l->node = c;
+			l->next = a->reinsert;
+			a->reinsert = l;
+		}
+		else
+			RTreeIndexFreeNode(t, c);
+		RTreeDisconnectBranch(n, i);
+	}
+	if (removed)
+		RTreeAggregateFix(n);
+	return removed;
+}
+
+/// Delete from an index all the data rects that relate to r as mode says
+/// and, if a predicate is given, that it returns nonzero for.
+/// Returns the number of data rects deleted.
+size_t RTreeIndexDeleteWhere(RTreeIndex *t, RTreeRect *r, RTreeSearchMode mode, RTreeDeletePredicate predicate, void *arg) {
+	RTreeDeleteWhereArgs a;
+	RTreeListNode *e, **top;
+	RTreeNode *n;
+	RTreeRect rect;
+	size_t removed;
+	register int i;
+	RTreeStatsTimer(timer);
+
+	assert(t && t->root && r);
+	RTreeStatsStart(timer);
+	a.rect = r;
+	a.mode = mode;
+	a.predicate = predicate;
+	a.arg = arg;
+	a.reinsert = NULL;
+	removed = RTreeDeleteWhereNode(t, &t->root, &a);
+
+	/* an emptied root takes the highest node to reinsert in its place,
+	 * which the rest can go into */
+	if (t->root->count == 0 && a.reinsert)
+	{
+		for (top=&a.reinsert, e=a.reinsert; e->next; e=e->next)
+			if (e->next->node->level > (*top)->node->level)
+				top = &e->next;
+		e = *top;
+		*top = e->next;
+		RTreeIndexFreeNode(t, t->root);
+		t->root = e->node;
+		RTreeIndexFreeListNode(t, e);
+	}
+	else if (t->root->count == 0)
+		t->root->level = 0;	/* the tree is empty */
+
+	while (a.reinsert)
+	{
+		n = a.reinsert->node;
+		RTreeStatsAdd(reinsertedNodes, 1);
+		RTreeStatsAdd(reinsertedEntries, n->count);
+		for (i=0; i<n->count; i++)
+		{
+			rect = RTreeNodeGetRect(n, i);
+			RTreeIndexInsertRect(t, &rect, (void *)n->child[i], n->level);
+		}
+		e = a.reinsert;
+		a.reinsert = e->next;
+		RTreeIndexFreeNode(t, n);
+		RTreeIndexFreeListNode(t, e);
+	}
+
+	/* the root may be left with a single child, more than one level down */
+	while (t->root->count == 1 && t->root->level > 0)
+	{
+		n = t->root->child[0];
+		RTreeIndexFreeNode(t, t->root);
+		t->root = n;
+	}
+	RTreeStatsStop(RTreeStatsDelete, timer);
+	return removed;
+}
+
+/// Delete from the default index all the data rects that relate to r as
+/// mode says and, if a predicate is given, that it returns nonzero for.
+size_t RTreeDeleteWhere(RTreeNode **Root, RTreeRect *r, RTreeSearchMode mode, RTreeDeletePredicate predicate, void *arg) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	size_t removed;
+
+	assert(Root);
+	t->root = *Root;
+	removed = RTreeIndexDeleteWhere(t, r, mode, predicate, arg);
+	*Root = t->root;
+	return removed;
+}
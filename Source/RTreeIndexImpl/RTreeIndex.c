@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* behind the functions that take an RTreeNode** instead of an RTreeIndex */
+static RTreeIndex DefaultIndex;
+
+/// Make a new index, empty, with its own fanout and split method.
+/// Returns NULL if a fanout is out of the range 2...MAXCARD.
+RTreeIndex * RTreeIndexNew(int nodecard, int leafcard, RTreeSplitMethod split) {
+	RTreeIndex *t;
+
+	if (2 > nodecard || nodecard > MAXCARD || 2 > leafcard || leafcard > MAXCARD)
+		return NULL;
+
+	t = (RTreeIndex *)malloc(sizeof(RTreeIndex));
+	assert(t);
+	t->nodecard = nodecard;
+	t->leafcard = leafcard;
+	t->split = split;
+	t->versions = NULL;
+	t->concurrent = NULL;
+	t->locator = NULL;
+	t->arena = (RTreeArena *)malloc(sizeof(RTreeArena));
+	assert(t->arena);
+	RTreeArenaInit(t->arena);
+	t->root = RTreeIndexNewNode(t);
+	t->root->level = 0; /* leaf */
+	return t;
+}
+
+/// Free an index, its tree and the handle itself.
+void RTreeIndexFree(RTreeIndex *t) {
+	assert(t);
+	RTreeSnapshotFreeVersions(t);
+	if (t->concurrent)
+	{
+		pthread_mutex_destroy(&t->concurrent->smoLock);
+		free(t->concurrent);
+	}
+	RTreeLocatorFree(t);
+	RTreeIndexFreeTree(t);
+	free(t->arena);
+	free(t);
+}
+
+/// Free the nodes of a subtree one by one.
+static void RTreeIndexFreeSubtree(RTreeIndex *t, RTreeNode *n) {
+	int i;
+	if (n->level > 0)
+		for (i=0; i<n->count; i++)
+			RTreeIndexFreeSubtree(t, n->child[i]);
+	RTreeIndexFreeNode(t, n);
+}
+
+/// Free every node of the tree of an index, leaving it without a root.
+/// With an arena this releases its slabs without visiting the nodes.
+/// With snapshots on, readers may still be in the tree, so its nodes are
+/// handed one by one to RTreeIndexFreeNode instead.
+void RTreeIndexFreeTree(RTreeIndex *t) {
+	assert(t);
+	if (t->locator)
+		RTreeLocatorClear(t->locator);
+	if (t->versions)
+	{
+		if (t->root)
+			RTreeIndexFreeSubtree(t, t->root);
+	}
+	else if (t->arena)
+		RTreeArenaRelease(t->arena);
+	else if (t->root)
+		RTreeRecursivelyFreeNode(t->root);
+	t->root = NULL;
+}
+
+/// Remove everything from an index, leaving it empty.
+void RTreeIndexClear(RTreeIndex *t) {
+	assert(t);
+	RTreeIndexFreeTree(t);
+	t->root = RTreeIndexNewNode(t);
+	t->root->level = 0; /* leaf */
+}
+
+/// The index the RTreeNode** functions work on, with the current NODECARD
+/// and LEAFCARD.  The caller sets the root.
+/// Like those functions, it must not be used from more than one thread.
+RTreeIndex * RTreeDefaultIndex() {
+	DefaultIndex.nodecard = NODECARD;
+	DefaultIndex.leafcard = LEAFCARD;
+	DefaultIndex.split = RTreeSplitQuadratic;
+	DefaultIndex.arena = NULL;
+	DefaultIndex.versions = NULL;
+	DefaultIndex.concurrent = NULL;
+	DefaultIndex.locator = NULL;
+	return &DefaultIndex;
+}
+
+/// Make a new node for an index.
+RTreeNode * RTreeIndexNewNode(RTreeIndex *t) {
+	RTreeNode *n;
+	assert(t);
+	n = t->arena ? RTreeArenaNewNode(t->arena) : RTreeNewNode();
+	if (t->versions)
+		RTreeSnapshotAddFresh(t->versions, n);
+	return n;
+}
+
+/// Free a node of an index.
+/// With snapshots on, a node readers may be on is kept until they are gone.
+void RTreeIndexFreeNode(RTreeIndex *t, RTreeNode *n) {
+	assert(t);
+	if (t->locator)
+		RTreeLocatorFreeNode(t->locator, n);
+	if (t->versions && RTreeSnapshotRetire(t, n))
+		return;
+	if (t->arena)
+		RTreeArenaFreeNode(t->arena, n);
+	else
+		RTreeFreeNode(n);
+}
+
+/// Allocate space for a node in the list used in RTreeIndexDeleteRect to
+/// store Nodes that are too empty.
+RTreeListNode * RTreeIndexNewListNode(RTreeIndex *t) {
+	assert(t);
+	if (t->arena)
+		return RTreeArenaNewListNode(t->arena);
+	return (RTreeListNode *) malloc(sizeof(RTreeListNode));
+}
+
+void RTreeIndexFreeListNode(RTreeIndex *t, RTreeListNode *p) {
+	assert(t);
+	if (t->arena)
+		RTreeArenaFreeListNode(t->arena, p);
+	else
+		free(p);
+}
+
+/// Report the allocation counters of the arena of an index,
+/// all 0 for an index without one.
+void RTreeIndexGetArenaStats(RTreeIndex *t, RTreeArenaStats *stats) {
+	assert(t && stats);
+	if (t->arena)
+		*stats = t->arena->stats;
+	else
+		memset(stats, 0, sizeof(RTreeArenaStats));
+}
+
+/// Check a subtree: its children one level down, their rects covering
+/// them, no more branches than the fanout and, unless the index has
+/// concurrent updates on, its total.  Returns its data rects, or -1.
+static long RTreeCheckNode(RTreeIndex *t, RTreeNode *n) {
+	RTreeRect rect, cover;
+	long entries, sub;
+	int i;
+
+	if (n->count < 0 || n->count > MAXKIDS(t, n))
+		return -1;
+	if (n->level == 0)
+		return n->count;
+	for (entries=0, i=0; i<n->count; i++)
+	{
+		if (!n->child[i] || n->child[i]->level != n->level - 1)
+			return -1;
+		/* a leaf emptied by concurrent deletes keeps its rect */
+		rect = RTreeNodeGetRect(n, i);
+		cover = RTreeNodeCover(n->child[i]);
+		if (n->child[i]->count > 0 && !RTreeContained(&cover, &rect))
+			return -1;
+		if ((sub = RTreeCheckNode(t, n->child[i])) < 0)
+			return -1;
+		entries += sub;
+	}
+	if (!t->concurrent && (long)n->total != entries)
+		return -1;
+	return entries;
+}
+
+/// Check the structure of the tree of an index, for tests and debugging.
+/// Returns the number of data rects in it, or -1 if it is broken.
+long RTreeIndexCheck(RTreeIndex *t) {
+	assert(t);
+	if (!t->root || t->root->level < 0)
+		return -1;
+	return RTreeCheckNode(t, t->root);
+}
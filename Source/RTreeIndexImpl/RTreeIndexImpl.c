@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include "assert.h"
 #include "include/RTreeIndexImpl.h"
 
@@ -11,111 +12,85 @@ RTreeNode * RTreeNewIndex() {
 	return x;
 }
 
-/// Search in an index tree or subtree for all data retangles that overlap the argument rectangle.
-/// Return the number of qualifying data rects.
-int RTreeSearch(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
-	register RTreeNode *n = N;
-	register RTreeRect *r = R; /// NOTE: Suspected bug was R sent in as RTreeNode* and cast to RTreeRect* here. Fix not yet tested.
-	register int i;
+typedef void (*RTreeNodeTest)(RTreeNode *, int, RTreeRect *, uint64_t *);
+
+/// Visit the branches of a subtree that pass a whole-node test, internal at
+/// internal nodes and leaf at leaves, calling back for the data rects found.
+/// Returns 0 if the callback terminated the search.
+static int RTreeSearchNode(RTreeNode *n, RTreeRect *r, void* cbarg, RTreeSearchHitCallback callback, RTreeNodeTest internal, RTreeNodeTest leaf) {
+	uint64_t mask[MASKWORDS], m;
+	RTreeRect rect;
+	register int i, w;
 	assert(n);
 	assert(n->level >= 0);
 	assert(r);
 
 	if (n->level > 0) /* this is an internal node in the tree */
+		internal(n, n->count, r, mask);
+	else /* this is a leaf node */
+		leaf(n, n->count, r, mask);
+	RTreeStatsVisit(n);
+
+	for (w=0; w<MASKWORDS; w++)
 	{
-		for (i=0; i<NODECARD; i++)
+		for (m=mask[w]; m; m&=m-1)
 		{
-			if (n->branch[i].child && RTreeOverlap(r, &n->branch[i].rect))
+			i = 64*w + MaskLowest(m);
+			if (n->level > 0)
 			{
-				if(!RTreeSearch(n->branch[i].child, R, callback, cbarg))
+				if (!RTreeSearchNode(n->child[i], r, cbarg, callback, internal, leaf))
 					return 0;
 			}
-		}
-	}
-	else /* this is a leaf node */
-	{
-		for (i=0; i<LEAFCARD; i++)
-		{
-			if (n->branch[i].child && RTreeOverlap(r, &n->branch[i].rect))
+			else if (callback)
 			{
-				if(callback && !callback(n->branch[i].child, &n->branch[i].rect, cbarg))
+				RTreeStatsAdd(hits, 1);
+				rect = RTreeNodeGetRect(n, i);
+				if (!callback(n->child[i], &rect, cbarg))
 					return 0; /// callback wants to terminate search early
 			}
 		}
 	}
-
 	return 1;
 }
 
-/// Search in an index tree or subtree for all data retangles that contain the argument rectangle.
-int RTreeSearchContained(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
-	register RTreeNode *n = N;
-	register RTreeRect *r = R; /// NOTE: Suspected bug was R sent in as RTreeNode* and cast to RTreeRect* here. Fix not yet tested.
-	register int i;
-	assert(n);
-	assert(n->level >= 0);
-	assert(r);
+/// Search in an index tree or subtree for all data retangles that overlap the argument rectangle.
+int RTreeSearch(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
+	RTreeStatsTimer(timer);
+	int result;
 
-	if (n->level > 0) /* this is an internal node in the tree */
-	{
-		for (i=0; i<NODECARD; i++)
-		{
-			if (n->branch[i].child && RTreeContained(&n->branch[i].rect, r))
-			{
-				if(!RTreeSearchContained(n->branch[i].child, R, callback, cbarg))
-					return 0;
-			}
-		}
-	}
-	else /* this is a leaf node */
-	{
-		for (i=0; i<LEAFCARD; i++)
-		{
-			if (n->branch[i].child && RTreeContained(&n->branch[i].rect, r))
-			{
-				if(callback && !callback(n->branch[i].child, &n->branch[i].rect, cbarg))
-					return 0; /// callback wants to terminate search early
-			}
-		}
-	}
+	RTreeStatsStart(timer);
+	result = RTreeSearchNode(N, R, cbarg, callback, RTreeNodeOverlapMask, RTreeNodeOverlapMask);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
+}
 
-	return 1;
+/// Search an index for all data rectangles that overlap the argument rectangle.
+int RTreeIndexSearch(RTreeIndex *t, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
+	assert(t);
+	return RTreeSearch(t->root, R, cbarg, callback);
 }
 
 /// Search in an index tree or subtree for all data retangles that are contained within the argument rectangle.
-/// Return the number of qualifying data rects.
-int RTreeSearchContaining(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
-	register RTreeNode *n = N;
-	register RTreeRect *r = R; /// NOTE: Suspected bug was R sent in as RTreeNode* and cast to RTreeRect* here. Fix not yet tested.
-	register int i;
-	assert(n);
-	assert(n->level >= 0);
-	assert(r);
+/// Any subtree holding one overlaps the argument rectangle.
+int RTreeSearchContained(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
+	RTreeStatsTimer(timer);
+	int result;
 
-	if (n->level > 0) /* this is an internal node in the tree */
-	{
-		for (i=0; i<NODECARD; i++)
-		{
-			if (n->branch[i].child && RTreeContained(r, &n->branch[i].rect))
-			{
-				if(!RTreeSearchContaining(n->branch[i].child, R, callback, cbarg))
-					return 0;
-			}
-		}
-	}
-	else /* this is a leaf node */
-	{
-		for (i=0; i<LEAFCARD; i++)
-		{
-			if (n->branch[i].child && RTreeContained(r, &n->branch[i].rect))
-			{
-				if(callback && !callback(n->branch[i].child, &n->branch[i].rect, cbarg))
-					return 0; /// callback wants to terminate search early
-			}
-		}
-	}
+	RTreeStatsStart(timer);
+	result = RTreeSearchNode(N, R, cbarg, callback, RTreeNodeOverlapMask, RTreeNodeContainedMask);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
+}
 
-	return 1;
+/// Search in an index tree or subtree for all data retangles that contain the argument rectangle.
+int RTreeSearchContaining(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHitCallback callback) {
+	RTreeStatsTimer(timer);
+	int result;
+
+	RTreeStatsStart(timer);
+	result = RTreeSearchNode(N, R, cbarg, callback, RTreeNodeContainingMask, RTreeNodeContainingMask);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
 }
 
 /// Inserts a new data rectangle into the index structure.
@@ -123,7 +98,7 @@ int RTreeSearchContaining(RTreeNode *N, RTreeRect *R, void* cbarg, RTreeSearchHi
 /// Returns 0 if node was not split.  Old node updated.
 /// If node was split, returns 1 and sets the pointer pointed to by new_node to point to the new node.  Old node updated to become one of two.
 /// The level argument specifies the number of steps up from the leaf level to insert; e.g. a data rectangle goes in at level = 0.
-static int RTreeInsertRect2(RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **new_node, int level) {
+static int RTreeInsertRect2(RTreeIndex *t, RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **new_node, int level) {
 /*
 	register RTreeRect *r = R;
 	register int tid = Tid;
@@ -133,7 +108,10 @@ static int RTreeInsertRect2(RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **n
 
 	register int i;
 	RTreeBranch b;
+	RTreeRect rect;
 	RTreeNode *n2;
+	size_t total;
+	int split;
 
 	assert(r && n && new_node);
 	assert(level >= 0 && level <= n->level);
@@ -143,19 +121,29 @@ static int RTreeInsertRect2(RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **n
 	if (n->level > level)
 	{
 		i = RTreePickBranch(r, n);
-		if (!RTreeInsertRect2(r, tid, n->branch[i].child, &n2, level))
+		n->child[i] = RTreeIndexWritable(t, n->child[i]);
+		total = RTreeNodeTotal(n->child[i]);
+		if (!RTreeInsertRect2(t, r, tid, n->child[i], &n2, level))
 		{
 			/// child was not split
 			//
-			n->branch[i].rect = RTreeCombineRect(r, &(n->branch[i].rect));
+			rect = RTreeNodeGetRect(n, i);
+			rect = RTreeCombineRect(r, &rect);
+			RTreeNodeSetRect(n, i, &rect);
+			n->total += RTreeNodeTotal(n->child[i]) - total;
 			return 0;
 		}
 		else    /// child was split
 		{
-			n->branch[i].rect = RTreeNodeCover(n->branch[i].child);
+			rect = RTreeNodeCover(n->child[i]);
+			RTreeNodeSetRect(n, i, &rect);
 			b.child = n2;
 			b.rect = RTreeNodeCover(n2);
-			return RTreeAddBranch(&b, n, new_node);
+			split = RTreeIndexAddBranch(t, &b, n, new_node);
+			RTreeAggregateFix(n);
+			if (split)
+				RTreeAggregateFix(*new_node);
+			return split;
 		}
 	}
 
@@ -166,7 +154,11 @@ static int RTreeInsertRect2(RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **n
 		b.rect = *r;
 		b.child = (RTreeNode *)tid;
 		/* child field of leaves contains tid of data record */
-		return RTreeAddBranch(&b, n, new_node);
+		split = RTreeIndexAddBranch(t, &b, n, new_node);
+		RTreeAggregateFix(n);
+		if (split)
+			RTreeAggregateFix(*new_node);
+		return split;
 	}
 	else
 	{
@@ -177,63 +169,70 @@ static int RTreeInsertRect2(RTreeRect *r, void *tid, RTreeNode *n, RTreeNode **n
 }
 
 /// Insert a data rectangle into an index structure.
-/// RTreeInsertRect provides for splitting the root;
+/// RTreeIndexInsertRect provides for splitting the root;
 /// returns 1 if root was split, 0 if it was not.
 /// The level argument specifies the number of steps up from the leaf level to insert; e.g. a data rectangle goes in at level = 0.
-/// RTreeInsertRect2 does the recursion.
-int RTreeInsertRect(RTreeRect *R, void *Tid, RTreeNode **Root, int Level) {
+/// RTreeInsertRect2 does the recursion, RTreeIndexInsertRectRStar takes over for R* indexes.
+int RTreeIndexInsertRect(RTreeIndex *t, RTreeRect *R, void *Tid, int Level) {
 	register RTreeRect *r = R;
-	register long tid = (int)Tid;
-	register RTreeNode **root = Root;
+	register void *tid = Tid;
 	register int level = Level;
 	register int i;
 	register RTreeNode *newroot;
 	RTreeNode *newnode;
 	RTreeBranch b;
 	int result;
+	RTreeStatsTimer(timer);
 
-	assert(r && root);
-	assert(level >= 0 && level <= (*root)->level);
+	assert(t && r);
+	assert(level >= 0 && level <= t->root->level);
 	for (i=0; i<NUMDIMS; i++)
 		assert(r->boundary[i] <= r->boundary[NUMDIMS+i]);
 
-	if (RTreeInsertRect2(r, (void *)tid, *root, &newnode, level))  /* root split */
+	if (t->split == RTreeSplitRStar)
+		return RTreeIndexInsertRectRStar(t, r, tid, level);
+
+	RTreeStatsStart(timer);
+	t->root = RTreeIndexWritable(t, t->root);
+	if (RTreeInsertRect2(t, r, tid, t->root, &newnode, level))  /* root split */
 	{
-		newroot = RTreeNewNode();  /* grow a new root, & tree taller */
-		newroot->level = (*root)->level + 1;
-		b.rect = RTreeNodeCover(*root);
-		b.child = *root;
-		RTreeAddBranch(&b, newroot, NULL);
+		newroot = RTreeIndexNewNode(t);  /* grow a new root, & tree taller */
+		newroot->level = t->root->level + 1;
+		b.rect = RTreeNodeCover(t->root);
+		b.child = t->root;
+		RTreeIndexAddBranch(t, &b, newroot, NULL);
 		b.rect = RTreeNodeCover(newnode);
 		b.child = newnode;
-		RTreeAddBranch(&b, newroot, NULL);
-		*root = newroot;
+		RTreeIndexAddBranch(t, &b, newroot, NULL);
+		RTreeAggregateFix(newroot);
+		t->root = newroot;
 		result = 1;
 	}
 	else
 		result = 0;
 
+	RTreeStatsStop(RTreeStatsInsert, timer);
 	return result;
 }
 
-/// Allocate space for a node in the list used in DeletRect to
-/// store Nodes that are too empty.
-static RTreeListNode * RTreeNewListNode() {
-	return (RTreeListNode *) malloc(sizeof(RTreeListNode));
-	//return new RTreeListNode;
-}
+/// Insert a data rectangle into the default index.
+int RTreeInsertRect(RTreeRect *R, void *Tid, RTreeNode **Root, int Level) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	int result;
 
-static void RTreeFreeListNode(RTreeListNode *p) {
-	free(p);
-	//delete(p);
+	assert(Root);
+	t->root = *Root;
+	result = RTreeIndexInsertRect(t, R, Tid, Level);
+	*Root = t->root;
+	return result;
 }
 
 /// Add a node to the reinsertion list.  All its branches will later
 /// be reinserted into the index structure.
-static void RTreeReInsert(RTreeNode *n, RTreeListNode **ee) {
+static void RTreeReInsert(RTreeIndex *t, RTreeNode *n, RTreeListNode **ee) {
 	register RTreeListNode *l;
 
-	l = RTreeNewListNode();
+	l = RTreeIndexNewListNode(t);
 	l->node = n;
 	l->next = *ee;
 	*ee = l;
@@ -242,12 +241,15 @@ static void RTreeReInsert(RTreeNode *n, RTreeListNode **ee) {
 /// Delete a rectangle from non-root part of an index structure.
 /// Called by RTreeDeleteRect.  Descends tree recursively, merges branches on the way back up.
 /// Returns 1 if record not found, 0 if success.
-static int RTreeDeleteRect2(RTreeRect *R, void *Tid, RTreeNode *N, RTreeListNode **Ee) {
+static int RTreeDeleteRect2(RTreeIndex *t, RTreeRect *R, void *Tid, RTreeNode *N, RTreeListNode **Ee) {
 	register RTreeRect *r = R;
 	register void *tid = Tid;
 	register RTreeNode *n = N;
 	register RTreeListNode **ee = Ee;
-	register int i;
+	register int i, w;
+	uint64_t mask[MASKWORDS], m;
+	RTreeRect rect;
+	size_t total;
 
 	assert(r && n && ee);
 	assert(tid >= 0);
@@ -255,21 +257,29 @@ static int RTreeDeleteRect2(RTreeRect *R, void *Tid, RTreeNode *N, RTreeListNode
 
 	if (n->level > 0)  /// not a leaf node
 	{
-	    for (i = 0; i < NODECARD; i++)
+	    RTreeNodeOverlapMask(n, n->count, r, mask);
+	    for (w = 0; w < MASKWORDS; w++)
 	    {
-		if (n->branch[i].child && RTreeOverlap(r, &(n->branch[i].rect)))
+		for (m = mask[w]; m; m &= m-1)
 		{
-			if (!RTreeDeleteRect2(r, tid, n->branch[i].child, ee))
+			i = 64*w + MaskLowest(m);
+			total = RTreeNodeTotal(n->child[i]);
+			if (!RTreeDeleteRect2(t, r, tid, n->child[i], ee))
 			{
-				if (n->branch[i].child->count >= MinNodeFill)
-					n->branch[i].rect = RTreeNodeCover(n->branch[i].child);
+				if (n->child[i]->count >= MINFILL(t, n->child[i]))
+				{
+					rect = RTreeNodeCover(n->child[i]);
+					RTreeNodeSetRect(n, i, &rect);
+					n->total -= total - RTreeNodeTotal(n->child[i]);
+				}
 				else
 				{
 					/// not enough entries in child,
 					/// eliminate child node
 					//
-					RTreeReInsert(n->branch[i].child, ee);
+					RTreeReInsert(t, n->child[i], ee);
 					RTreeDisconnectBranch(n, i);
+					n->total -= total;
 				}
 				return 0;
 			}
@@ -279,10 +289,9 @@ static int RTreeDeleteRect2(RTreeRect *R, void *Tid, RTreeNode *N, RTreeListNode
 	}
 	else  /// a leaf node
 	{
-		for (i = 0; i < LEAFCARD; i++)
+		for (i = 0; i < n->count; i++)
 		{
-			if (n->branch[i].child &&
-			    n->branch[i].child == (RTreeNode *) tid)
+			if (n->child[i] == (RTreeNode *) tid)
 			{
 				RTreeDisconnectBranch(n, i);
 				return 0;
@@ -292,68 +301,183 @@ static int RTreeDeleteRect2(RTreeRect *R, void *Tid, RTreeNode *N, RTreeListNode
 	}
 }
 
+/// Copy the nodes on the path down to the leaf holding tid that readers may
+/// be on, bottom up, so each copy goes into a parent that is a copy already.
+/// Takes the same path RTreeDeleteRect2 will.  Returns the node to put in
+/// place of n, or NULL if tid is not below it.
+static RTreeNode * RTreeWritablePath(RTreeIndex *t, RTreeRect *r, void *tid, RTreeNode *n) {
+	register int i, w;
+	uint64_t mask[MASKWORDS], m;
+	RTreeNode *c;
+
+	if (n->level > 0)
+	{
+		RTreeNodeOverlapMask(n, n->count, r, mask);
+		for (w=0; w<MASKWORDS; w++)
+		{
+			for (m=mask[w]; m; m&=m-1)
+			{
+				i = 64*w + MaskLowest(m);
+				if ((c = RTreeWritablePath(t, r, tid, n->child[i])))
+				{
+					n = RTreeIndexWritable(t, n);
+					n->child[i] = c;
+					return n;
+				}
+			}
+		}
+		return NULL;
+	}
+	for (i=0; i<n->count; i++)
+		if (n->child[i] == (RTreeNode *)tid)
+			return RTreeIndexWritable(t, n);
+	return NULL;
+}
+
+/// Reinsert the branches of the nodes taken out by a delete, free them,
+/// and eliminate a redundant root (not leaf, 1 child).
+static void RTreeCondense(RTreeIndex *t, RTreeListNode *reInsertList) {
+	register RTreeNode *tmp_nptr;
+	register RTreeListNode *e;
+	register int i;
+	RTreeRect rect;
+
+	while (reInsertList)
+	{
+		tmp_nptr = reInsertList->node;
+		RTreeStatsAdd(reinsertedNodes, 1);
+		RTreeStatsAdd(reinsertedEntries, tmp_nptr->count);
+		for (i = 0; i < tmp_nptr->count; i++)
+		{
+			rect = RTreeNodeGetRect(tmp_nptr, i);
+			RTreeIndexInsertRect(t,
+				&rect,
+				(void *)tmp_nptr->child[i],
+				tmp_nptr->level);
+		}
+		e = reInsertList;
+		reInsertList = reInsertList->next;
+		RTreeIndexFreeNode(t, e->node);
+		RTreeIndexFreeListNode(t, e);
+	}
+
+	if (t->root->count == 1 && t->root->level > 0)
+	{
+		tmp_nptr = t->root->child[0];
+		assert(tmp_nptr);
+		RTreeIndexFreeNode(t, t->root);
+		t->root = tmp_nptr;
+	}
+}
+
 /// Delete a data rectangle from an index structure.
-/// Pass in a pointer to a RTreeRect, the tid of the record, ptr to ptr to root node.
+/// Pass in a pointer to a RTreeRect, the tid of the record.
 /// Returns 1 if record not found, 0 if success.
-/// RTreeDeleteRect provides for eliminating the root.
-int RTreeDeleteRect(RTreeRect *R, void *Tid, RTreeNode**Nn) {
+/// RTreeIndexDeleteRect provides for eliminating the root.
+/// With the locator on, the rect is not needed and RTreeIndexDeleteTid does it.
+int RTreeIndexDeleteRect(RTreeIndex *t, RTreeRect *R, void *Tid) {
 	register RTreeRect *r = R;
 	register void *tid = Tid;
-	register RTreeNode **nn = Nn;
-	register int i;
 	register RTreeNode *tmp_nptr = NULL;
 	RTreeListNode *reInsertList = NULL;
-	register RTreeListNode *e;
+	int result = 1;
+	RTreeStatsTimer(timer);
 
-	assert(r && nn);
-	assert(*nn);
+	assert(t && r);
+	assert(t->root);
 	assert(tid >= 0);
 
-	if (!RTreeDeleteRect2(r, tid, *nn, &reInsertList))
+	if (t->locator)
+		return RTreeIndexDeleteTid(t, tid);
+
+	RTreeStatsStart(timer);
+	if (t->versions)
+	{
+		if (!(tmp_nptr = RTreeWritablePath(t, r, tid, t->root)))
+			goto done;
+		t->root = tmp_nptr;
+	}
+
+	if (!RTreeDeleteRect2(t, r, tid, t->root, &reInsertList))
 	{
 		/* found and deleted a data item */
+		RTreeCondense(t, reInsertList);
+		result = 0;
+	}
+done:
+	RTreeStatsStop(RTreeStatsDelete, timer);
+	return result;
+}
 
-		/* reinsert any branches from eliminated nodes */
-		while (reInsertList)
-		{
-			tmp_nptr = reInsertList->node;
-			for (i = 0; i < MAXKIDS(tmp_nptr); i++)
-			{
-				if (tmp_nptr->branch[i].child)
-				{
-					RTreeInsertRect(
-						&(tmp_nptr->branch[i].rect),
-						(void *)tmp_nptr->branch[i].child,
-						nn,
-						tmp_nptr->level);
-				}
-			}
-			e = reInsertList;
-			reInsertList = reInsertList->next;
-			RTreeFreeNode(e->node);
-			RTreeFreeListNode(e);
-		}
-		
-		/* check for redundant root (not leaf, 1 child) and eliminate
-		*/
-		if ((*nn)->count == 1 && (*nn)->level > 0)
+/// Delete a data rectangle from an index structure by its tid alone.
+/// With the locator on, goes straight to the leaf holding it and back up,
+/// fixing the rects on the way and taking out nodes left underfull;
+/// without it, searches the whole tree.
+/// Returns 1 if record not found, 0 if success.
+int RTreeIndexDeleteTid(RTreeIndex *t, void *tid) {
+	register RTreeNode *n, *p;
+	register int i;
+	RTreeListNode *reInsertList = NULL;
+	RTreeRect rect;
+	size_t gone = 1;	/* data rects no longer below n */
+	int result = 1;
+	RTreeStatsTimer(timer);
+
+	assert(t && t->root);
+	if (!t->locator)
+	{
+		for (i=0; i<NUMDIMS; i++)
 		{
-			for (i = 0; i < NODECARD; i++)
-			{
-				tmp_nptr = (*nn)->branch[i].child;
-				if(tmp_nptr)
-					break;
-			}
-			assert(tmp_nptr);
-			RTreeFreeNode(*nn);
-			*nn = tmp_nptr;
+			rect.boundary[i] = -INFINITY;
+			rect.boundary[i+NUMDIMS] = INFINITY;
 		}
-		return 0;
+		return RTreeIndexDeleteRect(t, &rect, tid);
 	}
-	else
+
+	RTreeStatsStart(timer);
+	if (!(n = RTreeIndexLocate(t, tid)))
+		goto done;
+	for (i=0; n->child[i] != (RTreeNode *)tid; i++)
+		assert(i < n->count);
+	RTreeDisconnectBranch(n, i);
+	RTreeLocatorRemoveTid(t->locator, tid);
+	RTreeStatsVisit(n);
+
+	for (; n != t->root; n = p)
 	{
-		return 1;
+		p = RTreeLocatorParent(t->locator, n);
+		for (i=0; p->child[i] != n; i++)
+			assert(i < p->count);
+		if (n->count >= MINFILL(t, n))
+		{
+			rect = RTreeNodeCover(n);
+			RTreeNodeSetRect(p, i, &rect);
+		}
+		else
+		{
+			RTreeReInsert(t, n, &reInsertList);
+			RTreeDisconnectBranch(p, i);
+			gone += RTreeNodeTotal(n);
+		}
+		p->total -= gone;
 	}
+	RTreeCondense(t, reInsertList);
+	result = 0;
+done:
+	RTreeStatsStop(RTreeStatsDelete, timer);
+	return result;
+}
+
+/// Delete a data rectangle from the default index.
+int RTreeDeleteRect(RTreeRect *R, void *Tid, RTreeNode**Nn) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	int result;
+
+	assert(Nn);
+	t->root = *Nn;
+	result = RTreeIndexDeleteRect(t, R, Tid);
+	*Nn = t->root;
+	return result;
 }
 
 void RTreeRecursivelyFreeBranch(RTreeBranch *b) {
@@ -365,7 +489,7 @@ void RTreeRecursivelyFreeNode(RTreeNode *n) {
 	if(n->level)
 	{
 		for(int i=0; i<n->count; i++)
-			RTreeRecursivelyFreeBranch(&n->branch[i]);
+			RTreeRecursivelyFreeNode(n->child[i]);
 	}
 
 	RTreeFreeNode(n);
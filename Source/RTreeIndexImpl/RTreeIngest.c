@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* levels of the path a merge keeps; a taller tree is merged by plain inserts */
+#define INGEST_DEPTH	64
+
+/// Count the data rects of a subtree.
+static size_t RTreeIngestCount(RTreeNode *n) {
+	register size_t entries = 0;
+	register int i;
+	if (n->level == 0)
+		return n->count;
+	for (i=0; i<n->count; i++)
+		entries += RTreeIngestCount(n->child[i]);
+	return entries;
+}
+
+/// Put a write buffer in front of an index, to merge into it every
+/// threshold inserts.  The index must not have concurrent updates on.
+RTreeIngest * RTreeIngestNew(RTreeIndex *t, size_t threshold) {
+	RTreeIngest *g;
+
+	assert(t && t->root && !t->concurrent);
+	assert(threshold > 0);
+	g = (RTreeIngest *)calloc(1, sizeof(RTreeIngest));
+	assert(g);
+	g->index = t;
+	g->threshold = threshold;
+	g->entries = RTreeIngestCount(t->root);
+	return g;
+}
+
+/// Merge what is left in the buffer into the index and free the buffer.
+/// The index stays.
+void RTreeIngestFree(RTreeIngest *g) {
+	assert(g);
+	RTreeIngestMerge(g);
+	free(g->buffer);
+	free(g);
+}
+
+/// Add a data rect, to the buffer, merging it into the tree when full.
+void RTreeIngestInsert(RTreeIngest *g, RTreeRect *r, void *tid) {
+	RTreeBranch b;
+	RTreeNode *page;
+
+	assert(g && r);
+	if (g->pages == 0 || g->buffer[g->pages-1].count == MAXCARD)
+	{
+		if (g->pages == g->pageCapacity)
+		{
+			g->pageCapacity = g->pageCapacity ? 2 * g->pageCapacity : 16;
+			g->buffer = (RTreeNode *)realloc(g->buffer, g->pageCapacity * sizeof(RTreeNode));
+			assert(g->buffer);
+		}
+		page = &g->buffer[g->pages++];
+		RTreeInitNode(page);
+		page->level = 0;
+	}
+	b.rect = *r;
+	b.child = (RTreeNode *)tid;
+	page = &g->buffer[g->pages-1];
+	RTreeNodeSetBranch(page, page->count++, &b);
+	if (++g->count >= g->threshold)
+		RTreeIngestMerge(g);
+}
+
+/// Delete a data rect from the buffer or else the tree.
+/// Returns 1 if record not found, 0 if success, as RTreeIndexDeleteRect.
+int RTreeIngestDelete(RTreeIngest *g, RTreeRect *r, void *tid) {
+	RTreeNode *page, *last;
+	RTreeBranch b;
+	register size_t p;
+	register int i;
+
+	assert(g && r);
+	for (p=0; p<g->pages; p++)
+	{
+		page = &g->buffer[p];
+		for (i=0; i<page->count; i++)
+		{
+			if (page->child[i] != (RTreeNode *)tid)
+				continue;
+			/* fill the hole with the last entry of the buffer */
+			last = &g->buffer[g->pages-1];
+			b = RTreeNodeGetBranch(last, last->count-1);
+			RTreeNodeSetBranch(page, i, &b);
+			if (--last->count == 0)
+				g->pages--;
+			g->count--;
+			return 0;
+		}
+	}
+	if (RTreeIndexDeleteRect(g->index, r, tid))
+		return 1;
+	g->entries--;
+	return 0;
+}
+
+/// Put the tree and the buffer together in a new tree bulk loaded in
+/// Hilbert order.
+static void RTreeIngestRebuild(RTreeIngest *g, RTreeBranch *b, size_t n) {
+	RTreeNode **stack, *node;
+	RTreeRect *rects;
+	void **tids;
+	size_t total = g->entries + n, k = 0, depth = 0, i;
+	register int j;
+
+	rects = (RTreeRect *)malloc(total * sizeof(RTreeRect) + 1);
+	tids = (void **)malloc(total * sizeof(void *) + 1);
+	stack = (RTreeNode **)malloc((g->index->root->level + 1) * MAXCARD * sizeof(RTreeNode *));
+	assert(rects && tids && stack);
+	stack[depth++] = g->index->root;
+	while (depth > 0)
+	{
+		node = stack[--depth];
+		for (j=0; j<node->count; j++)
+		{
+			if (node->level > 0)
+				stack[depth++] = node->child[j];
+			else
+			{
+				rects[k] = RTreeNodeGetRect(node, j);
+				tids[k++] = node->child[j];
+			}
+		}
+	}
+	assert(k == g->entries);
+	for (i=0; i<n; i++)
+	{
+		rects[k] = b[i].rect;
+		tids[k++] = b[i].child;
+	}
+	RTreeIndexBulkLoad(g->index, rects, tids, total, RTreeBulkLoadHilbert, 1.0);
+	g->rebuilds++;
+	free(stack);
+	free(tids);
+	free(rects);
+}
+
+/// Insert branches in Hilbert order one by one.  Each goes down from the
+/// lowest node on the path of the one before whose rect holds it, which for
+/// neighbors on the curve is mostly that leaf or its parent, and takes the
+/// branches RTreePickBranch picks from there.  One that lands in a full leaf
+/// goes in by RTreeIndexInsertRect, to split it.
+static void RTreeIngestInsertSorted(RTreeIngest *g, RTreeBranch *b, size_t n) {
+	RTreeIndex *t = g->index;
+	RTreeNode *path[INGEST_DEPTH];
+	int slot[INGEST_DEPTH];	/* branch of path[k] to path[k+1] */
+	RTreeRect rect;
+	size_t e;
+	register int k, top;
+
+	RTreeSortHilbertBranches(b, n);
+	top = -1;	/* no path yet */
+	for (e=0; e<n; e++)
+	{
+		if (t->versions || t->root->level >= INGEST_DEPTH)	/* nodes to copy first */
+		{
+			RTreeIndexInsertRect(t, &b[e].rect, b[e].child, 0);
+			continue;
+		}
+		if (top < 0)
+		{
+			path[0] = t->root;
+			top = 0;
+		}
+		for (k=top; k>0; k--)
+		{
+			rect = RTreeNodeGetRect(path[k-1], slot[k-1]);
+			if (RTreeContained(&b[e].rect, &rect))
+				break;
+		}
+		for (; path[k]->level > 0; k++)
+		{
+			slot[k] = RTreePickBranch(&b[e].rect, path[k]);
+			path[k+1] = path[k]->child[slot[k]];
+		}
+		top = k;
+
+		if (path[top]->count >= t->leafcard)
+		{
+			RTreeIndexInsertRect(t, &b[e].rect, b[e].child, 0);
+			top = -1;	/* the path may have been split */
+			continue;
+		}
+		RTreeIndexAddBranch(t, &b[e], path[top], NULL);
+		for (k=top-1; k>=0; k--)
+			path[k]->total++;
+		for (k=top-1; k>=0; k--)
+		{
+			rect = RTreeNodeGetRect(path[k], slot[k]);
+			if (RTreeContained(&b[e].rect, &rect))
+				break;	/* and so are the ones above */
+			rect = RTreeCombineRect(&rect, &b[e].rect);
+			RTreeNodeSetRect(path[k], slot[k], &rect);
+		}
+	}
+}
+
+/// Move everything in the buffer into the tree.
+void RTreeIngestMerge(RTreeIngest *g) {
+	RTreeBranch *b;
+	size_t n = 0, p;
+	register int i;
+
+	assert(g);
+	if (g->count == 0)
+		return;
+	b = (RTreeBranch *)malloc(g->count * sizeof(RTreeBranch));
+	assert(b);
+	for (p=0; p<g->pages; p++)
+		for (i=0; i<g->buffer[p].count; i++)
+			b[n++] = RTreeNodeGetBranch(&g->buffer[p], i);
+	assert(n == g->count);
+
+	if (n >= g->entries)
+		RTreeIngestRebuild(g, b, n);
+	else
+		RTreeIngestInsertSorted(g, b, n);
+
+	g->entries += n;
+	g->count = 0;
+	g->pages = 0;
+	g->merges++;
+	free(b);
+}
+
+/// Search the tree and the buffer for the data rects that relate to r as
+/// mode says, calling back for each.
+/// Returns 0 if the callback terminated the search, 1 otherwise.
+int RTreeIngestSearch(RTreeIngest *g, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	uint64_t mask[MASKWORDS], bits;
+	RTreeNode *page;
+	RTreeRect rect;
+	register size_t p;
+	register int i, w;
+	int result;
+
+	assert(g && r);
+	switch (mode)
+	{
+	case RTreeModeContained:
+		result = RTreeSearchContained(g->index->root, r, cbarg, callback);
+		break;
+	case RTreeModeContaining:
+		result = RTreeSearchContaining(g->index->root, r, cbarg, callback);
+		break;
+	case RTreeModeIntersecting:
+	default:
+		result = RTreeSearch(g->index->root, r, cbarg, callback);
+		break;
+	}
+	if (!result)
+		return 0;
+
+	for (p=0; p<g->pages; p++)
+	{
+		page = &g->buffer[p];
+		RTreeNodeSearchMask(page, r, mode, mask);
+		for (w=0; w<MASKWORDS; w++)
+		{
+			for (bits=mask[w]; bits; bits&=bits-1)
+			{
+				i = 64*w + MaskLowest(bits);
+				RTreeStatsAdd(hits, 1);
+				if (callback)
+				{
+					rect = RTreeNodeGetRect(page, i);
+					if (!callback(page->child[i], &rect, cbarg))
+						return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* node pairs a parallel join aims to give each worker */
+#define JOIN_TASKS_PER_THREAD 8
+
+/* a pair of subtrees to join, and the rects their parents hold for them */
+typedef struct _RTreeJoinTask
+{
+	RTreeNode *a, *b;
+	RTreeRect ra, rb;
+} RTreeJoinTask;
+
+/* where the pairs found by a join go */
+typedef struct _RTreeJoinState
+{
+	RTreeJoinCallback callback;	/* sequential join */
+	void *cbarg;
+	RTreeJoinBuffer *buffer;	/* one worker of a parallel join */
+	RTreeJoinTask *tasks;	/* collecting node pairs instead of descending */
+	size_t ntasks, capacity;
+} RTreeJoinState;
+
+static int RTreeJoinNodes(RTreeJoinState *j, RTreeNode *a, RTreeRect *ra, RTreeNode *b, RTreeRect *rb);
+
+/// Report a pair of data rects.  Returns 0 if the callback terminated the join.
+static int RTreeJoinFound(RTreeJoinState *j, void *a, void *b) {
+	RTreeJoinBuffer *buf = j->buffer;
+	RTreeJoinPair *pairs;
+	size_t capacity;
+
+	if (!buf)
+		return j->callback(a, b, j->cbarg);
+
+	if (buf->count == buf->capacity)
+	{
+		capacity = buf->capacity ? 2 * buf->capacity : 1024;
+		pairs = (RTreeJoinPair *)realloc(buf->pairs, capacity * sizeof(RTreeJoinPair));
+		assert(pairs);
+		buf->pairs = pairs;
+		buf->capacity = capacity;
+	}
+	buf->pairs[buf->count].a = a;
+	buf->pairs[buf->count].b = b;
+	buf->count++;
+	return 1;
+}
+
+/// Go on with a pair of subtrees, now or, while collecting, later.
+static int RTreeJoinSubtrees(RTreeJoinState *j, RTreeNode *a, RTreeRect *ra, RTreeNode *b, RTreeRect *rb) {
+	RTreeJoinTask *tasks;
+	size_t capacity;
+
+	if (!j->tasks)
+		return RTreeJoinNodes(j, a, ra, b, rb);
+
+	if (j->ntasks == j->capacity)
+	{
+		capacity = 2 * j->capacity;
+		tasks = (RTreeJoinTask *)realloc(j->tasks, capacity * sizeof(RTreeJoinTask));
+		assert(tasks);
+		j->tasks = tasks;
+		j->capacity = capacity;
+	}
+	j->tasks[j->ntasks].a = a;
+	j->tasks[j->ntasks].b = b;
+	j->tasks[j->ntasks].ra = *ra;
+	j->tasks[j->ntasks].rb = *rb;
+	j->ntasks++;
+	return 1;
+}
+
+/// Gather the branches of n that overlap r, the only ones that can take part
+/// in a pair, sorted by their low x side.
+static int RTreeJoinGather(RTreeNode *n, RTreeRect *r, RTreeRect *rect, int *index) {
+	uint64_t mask[MASKWORDS], m;
+	RTreeRect tmp;
+	register int i, j, k, w;
+
+	RTreeNodeOverlapMask(n, n->count, r, mask);
+	for (k=w=0; w<MASKWORDS; w++)
+	{
+		for (m=mask[w]; m; m&=m-1, k++)
+		{
+			i = 64*w + MaskLowest(m);
+			tmp = RTreeNodeGetRect(n, i);
+			for (j=k; j>0 && rect[j-1].boundary[0] > tmp.boundary[0]; j--)
+			{
+				rect[j] = rect[j-1];
+				index[j] = index[j-1];
+			}
+			rect[j] = tmp;
+			index[j] = i;
+		}
+	}
+	return k;
+}
+
+/// Whether two rects overlap along every dimension but x.
+static int RTreeJoinOverlapRest(RTreeRect *r, RTreeRect *s) {
+	register int d;
+	for (d=1; d<NUMDIMS; d++)
+		if (r->boundary[d] > s->boundary[d+NUMDIMS] || s->boundary[d] > r->boundary[d+NUMDIMS])
+			return FALSE;
+	return TRUE;
+}
+
+/* what the plane sweep does with an intersecting pair of branches */
+#define JOIN_PAIR	0	/* join them, the nodes are of the same level */
+#define JOIN_MARK_A	1	/* mark the one of a, the deeper node */
+#define JOIN_MARK_B	2	/* mark the one of b, the deeper node */
+
+/// Handle one intersecting pair of branches p of a and q of b.
+static int RTreeJoinBranches(RTreeJoinState *j, int what, char *marked, RTreeNode *a, int i, RTreeRect *ra, int p, RTreeNode *b, int k, RTreeRect *rb, int q) {
+	if (what == JOIN_MARK_A)
+		marked[p] = 1;
+	else if (what == JOIN_MARK_B)
+		marked[q] = 1;
+	else if (a->level == 0)
+		return RTreeJoinFound(j, a->child[i], b->child[k]);
+	else
+		return RTreeJoinSubtrees(j, a->child[i], ra, b->child[k], rb);
+	return 1;
+}
+
+/// Find the intersecting pairs of the gathered branches of two nodes by a
+/// plane sweep along x over both lists, sorted by their low x side.
+static int RTreeJoinSweep(RTreeJoinState *j, int what, char *marked,
+		RTreeNode *a, RTreeRect *rectA, int *indexA, int na,
+		RTreeNode *b, RTreeRect *rectB, int *indexB, int nb) {
+	register int p, q, k;
+
+	for (p=q=0; p<na && q<nb; )
+	{
+		if (rectA[p].boundary[0] <= rectB[q].boundary[0])
+		{
+			for (k=q; k<nb && rectB[k].boundary[0] <= rectA[p].boundary[NUMDIMS]; k++)
+				if (RTreeJoinOverlapRest(&rectA[p], &rectB[k]) &&
+				    !RTreeJoinBranches(j, what, marked, a, indexA[p], &rectA[p], p, b, indexB[k], &rectB[k], k))
+					return 0;
+			p++;
+		}
+		else
+		{
+			for (k=p; k<na && rectA[k].boundary[0] <= rectB[q].boundary[NUMDIMS]; k++)
+				if (RTreeJoinOverlapRest(&rectA[k], &rectB[q]) &&
+				    !RTreeJoinBranches(j, what, marked, a, indexA[k], &rectA[k], k, b, indexB[q], &rectB[q], q))
+					return 0;
+			q++;
+		}
+	}
+	return 1;
+}
+
+/// Join two subtrees.  ra and rb cover a and b; a branch of one side can
+/// only pair with something inside the cover of the other.
+/// Branches of two nodes of the same level are paired by a plane sweep.
+/// Otherwise one side goes down alone, the one of larger cover unless it is a
+/// leaf, into the branches the sweep finds intersecting some branch of the
+/// other node.
+static int RTreeJoinNodes(RTreeJoinState *j, RTreeNode *a, RTreeRect *ra, RTreeNode *b, RTreeRect *rb) {
+	RTreeRect rectA[MAXCARD], rectB[MAXCARD];
+	int indexA[MAXCARD], indexB[MAXCARD];
+	char marked[MAXCARD] = {0};
+	register int p, q, na, nb;
+
+	if (a->count == 0 || b->count == 0)
+		return 1;
+
+	na = RTreeJoinGather(a, rb, rectA, indexA);
+	nb = RTreeJoinGather(b, ra, rectB, indexB);
+
+	if (a->level == b->level)
+		return RTreeJoinSweep(j, JOIN_PAIR, NULL, a, rectA, indexA, na, b, rectB, indexB, nb);
+
+	if (b->level == 0 || (a->level > 0 && RTreeRectVolume(ra) > RTreeRectVolume(rb)))
+	{
+		RTreeJoinSweep(j, JOIN_MARK_A, marked, a, rectA, indexA, na, b, rectB, indexB, nb);
+		for (p=0; p<na; p++)
+			if (marked[p] && !RTreeJoinSubtrees(j, a->child[indexA[p]], &rectA[p], b, rb))
+				return 0;
+	}
+	else
+	{
+		RTreeJoinSweep(j, JOIN_MARK_B, marked, a, rectA, indexA, na, b, rectB, indexB, nb);
+		for (q=0; q<nb; q++)
+			if (marked[q] && !RTreeJoinSubtrees(j, a, ra, b->child[indexB[q]], &rectB[q]))
+				return 0;
+	}
+	return 1;
+}
+
+/// Find every pair of intersecting data rects of two trees, one from each,
+/// by going down both trees together.
+/// Calls back with the two tids; returns 0 if the callback terminated the join.
+int RTreeJoin(RTreeNode *a, RTreeNode *b, RTreeJoinCallback callback, void *cbarg) {
+	RTreeJoinState j;
+	RTreeRect ra, rb;
+
+	assert(a && b && callback);
+	j.callback = callback;
+	j.cbarg = cbarg;
+	j.buffer = NULL;
+	j.tasks = NULL;
+	ra = RTreeNodeCover(a);
+	rb = RTreeNodeCover(b);
+	return RTreeJoinNodes(&j, a, &ra, b, &rb);
+}
+
+static void RTreeJoinTaskRun(void *task, int worker, void *arg) {
+	RTreeJoinTask *t = (RTreeJoinTask *)task;
+	RTreeJoinState j;
+
+	j.callback = NULL;
+	j.cbarg = NULL;
+	j.buffer = &((RTreeJoinBuffer *)arg)[worker];
+	j.tasks = NULL;
+	RTreeJoinNodes(&j, t->a, &t->ra, t->b, &t->rb);
+}
+
+/// Join two trees on the workers of a pool.
+/// The pairs of subtrees a few levels down are split among the workers,
+/// which write the pairs they find to their own buffer, buffers[worker];
+/// there must be RTreeThreadPoolSize(pool) of them, zeroed or left from an
+/// earlier join, and they are emptied first.  Returns the number of pairs.
+size_t RTreeJoinParallel(RTreeNode *a, RTreeNode *b, RTreeThreadPool *pool, RTreeJoinBuffer *buffers) {
+	RTreeJoinState j;
+	RTreeJoinTask *level;
+	size_t k, n, target, total;
+	int w, deeper;
+
+	assert(a && b && pool && buffers);
+	for (w=0; w<pool->threads; w++)
+		buffers[w].count = 0;
+
+	/* split the pair of roots until there are enough pairs to go round */
+	target = (size_t)pool->threads * JOIN_TASKS_PER_THREAD;
+	j.callback = NULL;
+	j.cbarg = NULL;
+	j.buffer = NULL;	/* no data rects are paired before the leaves */
+	j.capacity = 64;
+	j.ntasks = 1;
+	j.tasks = (RTreeJoinTask *)malloc(j.capacity * sizeof(RTreeJoinTask));
+	assert(j.tasks);
+	j.tasks[0].a = a;
+	j.tasks[0].b = b;
+	j.tasks[0].ra = RTreeNodeCover(a);
+	j.tasks[0].rb = RTreeNodeCover(b);
+	do
+	{
+		level = j.tasks;
+		n = j.ntasks;
+		j.tasks = (RTreeJoinTask *)malloc(j.capacity * sizeof(RTreeJoinTask));
+		assert(j.tasks);
+		j.ntasks = 0;
+		deeper = 0;
+		for (k=0; k<n; k++)
+		{
+			if (level[k].a->level == 0 && level[k].b->level == 0)
+				RTreeJoinSubtrees(&j, level[k].a, &level[k].ra, level[k].b, &level[k].rb);
+			else
+			{
+				RTreeJoinNodes(&j, level[k].a, &level[k].ra, level[k].b, &level[k].rb);
+				deeper = 1;
+			}
+		}
+		free(level);
+	} while (deeper && j.ntasks > 0 && j.ntasks < target);
+
+	RTreeThreadPoolRun(pool, j.tasks, j.ntasks, sizeof(RTreeJoinTask), RTreeJoinTaskRun, buffers);
+	free(j.tasks);
+
+	for (total=0, w=0; w<pool->threads; w++)
+		total += buffers[w].count;
+	return total;
+}
+
+/// Free the pairs of a join buffer.
+void RTreeJoinBufferFree(RTreeJoinBuffer *buf) {
+	assert(buf);
+	free(buf->pairs);
+	buf->pairs = NULL;
+	buf->count = buf->capacity = 0;
+}
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+/*
+ * Every test of a whole node compares each side row of the node, bound[s],
+ * against one value of the search rect, as bound[s][i] <= limit[s].
+ * A row that has to be >= its value is negated together with the value
+ * by flipping the sign bit, so one kernel serves all three tests.
+ */
+typedef struct _RTreeKernelArgs
+{
+	RectReal limit[NUMSIDES];
+	unsigned int flip[NUMSIDES];	/* sign bit mask, 0 or 0x80000000 */
+} RTreeKernelArgs;
+
+typedef void (*RTreeKernelFunc)(RTreeNode *, int, RTreeKernelArgs *, uint64_t *);
+
+/*
+ * The kernels of quantized nodes (RTreeQuantize.c) test their side rows in
+ * whole steps the same way, as bound[s][i] ^ flip[s] <= limit[s]; flipping
+ * all the bits of a step turns >= into <=.
+ */
+typedef struct _RTreeQuantArgs
+{
+	RTreeQuant limit[NUMSIDES];
+	RTreeQuant flip[NUMSIDES];	/* 0 or QUANTSTEPS */
+} RTreeQuantArgs;
+
+typedef void (*RTreeQuantKernelFunc)(RTreeQuantNode *, int, RTreeQuantArgs *, uint64_t *);
+
+#define SIGN 0x80000000u
+#define Undefined(x) ((x)->boundary[0] > (x)->boundary[NUMDIMS])
+
+/// branch i passes iff lo <= r.hi and hi >= r.lo along every dimension
+static void RTreeOverlapArgs(RTreeRect *r, RTreeKernelArgs *a) {
+	int d;
+	for (d=0; d<NUMDIMS; d++)
+	{
+		a->limit[d] = r->boundary[d+NUMDIMS];
+		a->flip[d] = 0;
+		a->limit[d+NUMDIMS] = -r->boundary[d];
+		a->flip[d+NUMDIMS] = SIGN;
+	}
+}
+
+/// branch i passes iff lo >= r.lo and hi <= r.hi along every dimension
+static void RTreeContainedArgs(RTreeRect *r, RTreeKernelArgs *a) {
+	int d;
+	for (d=0; d<NUMDIMS; d++)
+	{
+		a->limit[d] = -r->boundary[d];
+		a->flip[d] = SIGN;
+		a->limit[d+NUMDIMS] = r->boundary[d+NUMDIMS];
+		a->flip[d+NUMDIMS] = 0;
+	}
+}
+
+/// branch i passes iff lo <= r.lo and hi >= r.hi along every dimension
+static void RTreeContainingArgs(RTreeRect *r, RTreeKernelArgs *a) {
+	int d;
+	for (d=0; d<NUMDIMS; d++)
+	{
+		a->limit[d] = r->boundary[d];
+		a->flip[d] = 0;
+		a->limit[d+NUMDIMS] = -r->boundary[d+NUMDIMS];
+		a->flip[d+NUMDIMS] = SIGN;
+	}
+}
+
+static void RTreeNodeMaskScalar(RTreeNode *n, int count, RTreeKernelArgs *a, uint64_t *mask) {
+	register int i, s, pass;
+
+	memset(mask, 0, MASKWORDS * sizeof(uint64_t));
+	for (i=0; i<count; i++)
+	{
+		pass = 1;
+		for (s=0; s<NUMSIDES; s++)
+			pass &= (a->flip[s] ? -n->bound[s][i] : n->bound[s][i]) <= a->limit[s];
+		mask[i >> 6] |= (uint64_t)pass << (i & 63);
+	}
+}
+
+static void RTreeQuantMaskScalar(RTreeQuantNode *n, int count, RTreeQuantArgs *a, uint64_t *mask) {
+	register int i, s, pass;
+
+	memset(mask, 0, QMASKWORDS * sizeof(uint64_t));
+	for (i=0; i<count; i++)
+	{
+		pass = 1;
+		for (s=0; s<NUMSIDES; s++)
+			pass &= (RTreeQuant)(n->bound[s][i] ^ a->flip[s]) <= a->limit[s];
+		mask[i >> 6] |= (uint64_t)pass << (i & 63);
+	}
+}
+
+#ifdef KERNELS_X86
+/* blocks of 4 and 8 never straddle two mask words */
+
+__attribute__((target("sse2")))
+static void RTreeNodeMaskSSE(RTreeNode *n, int count, RTreeKernelArgs *a, uint64_t *mask) {
+	__m128 limit[NUMSIDES], flip[NUMSIDES], pass;
+	register int i, s;
+
+	memset(mask, 0, MASKWORDS * sizeof(uint64_t));
+	for (s=0; s<NUMSIDES; s++)
+	{
+		limit[s] = _mm_set1_ps(a->limit[s]);
+		flip[s] = _mm_castsi128_ps(_mm_set1_epi32((int)a->flip[s]));
+	}
+	for (i=0; i+4<=count; i+=4)
+	{
+		pass = _mm_cmple_ps(_mm_xor_ps(_mm_loadu_ps(&n->bound[0][i]), flip[0]), limit[0]);
+		for (s=1; s<NUMSIDES; s++)
+			pass = _mm_and_ps(pass, _mm_cmple_ps(_mm_xor_ps(_mm_loadu_ps(&n->bound[s][i]), flip[s]), limit[s]));
+		mask[i >> 6] |= (uint64_t)_mm_movemask_ps(pass) << (i & 63);
+	}
+	for (; i<count; i++)
+	{
+		int ok = 1;
+		for (s=0; s<NUMSIDES; s++)
+			ok &= (a->flip[s] ? -n->bound[s][i] : n->bound[s][i]) <= a->limit[s];
+		mask[i >> 6] |= (uint64_t)ok << (i & 63);
+	}
+}
+
+__attribute__((target("avx2")))
+static void RTreeNodeMaskAVX2(RTreeNode *n, int count, RTreeKernelArgs *a, uint64_t *mask) {
+	__m256 limit[NUMSIDES], flip[NUMSIDES], pass;
+	__m256i tail;
+	register int i, s;
+
+	memset(mask, 0, MASKWORDS * sizeof(uint64_t));
+	for (s=0; s<NUMSIDES; s++)
+	{
+		limit[s] = _mm256_set1_ps(a->limit[s]);
+		flip[s] = _mm256_castsi256_ps(_mm256_set1_epi32((int)a->flip[s]));
+	}
+	for (i=0; i+8<=count; i+=8)
+	{
+		pass = _mm256_cmp_ps(_mm256_xor_ps(_mm256_loadu_ps(&n->bound[0][i]), flip[0]), limit[0], _CMP_LE_OQ);
+		for (s=1; s<NUMSIDES; s++)
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(_mm256_xor_ps(_mm256_loadu_ps(&n->bound[s][i]), flip[s]), limit[s], _CMP_LE_OQ));
+		mask[i >> 6] |= (uint64_t)_mm256_movemask_ps(pass) << (i & 63);
+	}
+	if (i < count)
+	{
+		/* lanes past count are neither loaded nor reported */
+		tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		pass = _mm256_castsi256_ps(tail);
+		for (s=0; s<NUMSIDES; s++)
+			pass = _mm256_and_ps(pass, _mm256_cmp_ps(_mm256_xor_ps(_mm256_maskload_ps(&n->bound[s][i], tail), flip[s]), limit[s], _CMP_LE_OQ));
+		mask[i >> 6] |= (uint64_t)_mm256_movemask_ps(pass) << (i & 63);
+	}
+}
+
+/* x <= limit for unsigned steps is a saturated x - limit of 0 */
+#if QUANTBITS == 8
+#define QUANTLANES 16
+#define QuantSet(x) _mm_set1_epi8((char)(x))
+#define QuantNotAbove(x, limit) _mm_cmpeq_epi8(_mm_subs_epu8(x, limit), _mm_setzero_si128())
+#define QuantMoveMask(pass) _mm_movemask_epi8(pass)
+#else
+#define QUANTLANES 8
+#define QuantSet(x) _mm_set1_epi16((short)(x))
+#define QuantNotAbove(x, limit) _mm_cmpeq_epi16(_mm_subs_epu16(x, limit), _mm_setzero_si128())
+#define QuantMoveMask(pass) _mm_movemask_epi8(_mm_packs_epi16(pass, _mm_setzero_si128()))
+#endif
+
+/* blocks of 8 and 16 never straddle two mask words either */
+__attribute__((target("sse2")))
+static void RTreeQuantMaskSSE(RTreeQuantNode *n, int count, RTreeQuantArgs *a, uint64_t *mask) {
+	__m128i limit[NUMSIDES], flip[NUMSIDES], pass;
+	register int i, s;
+
+	memset(mask, 0, QMASKWORDS * sizeof(uint64_t));
+	for (s=0; s<NUMSIDES; s++)
+	{
+		limit[s] = QuantSet(a->limit[s]);
+		flip[s] = QuantSet(a->flip[s]);
+	}
+	for (i=0; i+QUANTLANES<=count; i+=QUANTLANES)
+	{
+		pass = QuantNotAbove(_mm_xor_si128(_mm_loadu_si128((__m128i *)&n->bound[0][i]), flip[0]), limit[0]);
+		for (s=1; s<NUMSIDES; s++)
+			pass = _mm_and_si128(pass, QuantNotAbove(_mm_xor_si128(_mm_loadu_si128((__m128i *)&n->bound[s][i]), flip[s]), limit[s]));
+		mask[i >> 6] |= (uint64_t)(unsigned)QuantMoveMask(pass) << (i & 63);
+	}
+	for (; i<count; i++)
+	{
+		int ok = 1;
+		for (s=0; s<NUMSIDES; s++)
+			ok &= (RTreeQuant)(n->bound[s][i] ^ a->flip[s]) <= a->limit[s];
+		mask[i >> 6] |= (uint64_t)ok << (i & 63);
+	}
+}
+#endif
+
+static RTreeKernelFunc NodeMask = RTreeNodeMaskScalar;
+static RTreeQuantKernelFunc QuantMask = RTreeQuantMaskScalar;
+static RTreeKernel Kernel = RTreeKernelScalar;
+static pthread_once_t KernelOnce = PTHREAD_ONCE_INIT;
+
+/// The best kernel this CPU supports.
+static RTreeKernel RTreeDetectKernel() {
+#ifdef KERNELS_X86
+	if (sizeof(RectReal) == sizeof(float))
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return RTreeKernelAVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return RTreeKernelSSE;
+	}
+#endif
+	return RTreeKernelScalar;
+}
+
+static void RTreeUseKernel(RTreeKernel k) {
+	switch (k)
+	{
+#ifdef KERNELS_X86
+		case RTreeKernelAVX2:
+			NodeMask = RTreeNodeMaskAVX2;
+			QuantMask = RTreeQuantMaskSSE;	/* a node of steps is too short to gain from more lanes */
+			break;
+		case RTreeKernelSSE:
+			NodeMask = RTreeNodeMaskSSE;
+			QuantMask = RTreeQuantMaskSSE;
+			break;
+#endif
+		default:
+			k = RTreeKernelScalar;
+			NodeMask = RTreeNodeMaskScalar;
+			QuantMask = RTreeQuantMaskScalar;
+			break;
+	}
+	Kernel = k;
+}
+
+static void RTreeInitKernel() {
+	RTreeUseKernel(RTreeDetectKernel());
+}
+
+/// Choose the kernel the whole-node tests run on.  RTreeKernelAuto, or one
+/// the CPU lacks, picks the best supported.  Returns the kernel chosen.
+/// Meant for benchmarks; not safe while another thread searches.
+RTreeKernel RTreeSetKernel(RTreeKernel k) {
+	RTreeKernel best;
+
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	best = RTreeDetectKernel();
+	if (k == RTreeKernelAuto || k > best)
+		k = best;
+	RTreeUseKernel(k);
+	return Kernel;
+}
+
+/// The kernel the whole-node tests run on.
+RTreeKernel RTreeGetKernel() {
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	return Kernel;
+}
+
+/// Set bit i of mask for each branch of n a search in the given mode goes
+/// on with.  Above the leaves a contained search follows every overlapping
+/// subtree.
+void RTreeNodeSearchMask(RTreeNode *n, RTreeRect *r, RTreeSearchMode mode, uint64_t *mask) {
+	switch (mode)
+	{
+	case RTreeModeContained:
+		if (n->level > 0)
+			RTreeNodeOverlapMask(n, n->count, r, mask);
+		else
+			RTreeNodeContainedMask(n, n->count, r, mask);
+		break;
+	case RTreeModeContaining:
+		RTreeNodeContainingMask(n, n->count, r, mask);
+		break;
+	case RTreeModeIntersecting:
+	default:
+		RTreeNodeOverlapMask(n, n->count, r, mask);
+		break;
+	}
+}
+
+/// Set bit i of mask for each of the first count branches of n whose rect
+/// overlaps r.
+void RTreeNodeOverlapMask(RTreeNode *n, int count, RTreeRect *r, uint64_t *mask) {
+	RTreeKernelArgs a;
+	assert(n && r && mask);
+	assert(count >= 0 && count <= MAXCARD);
+	RTreeStatsAdd(rectTests, count);
+
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	RTreeOverlapArgs(r, &a);
+	NodeMask(n, count, &a, mask);
+}
+
+/// Set bit i of mask for each of the first count branches of n whose rect
+/// is contained in r.
+void RTreeNodeContainedMask(RTreeNode *n, int count, RTreeRect *r, uint64_t *mask) {
+	RTreeKernelArgs a;
+	assert(n && r && mask);
+	assert(count >= 0 && count <= MAXCARD);
+	RTreeStatsAdd(rectTests, count);
+
+	if (Undefined(r))	/* as RTreeContained: nothing is inside an undefined rect */
+	{
+		memset(mask, 0, MASKWORDS * sizeof(uint64_t));
+		return;
+	}
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	RTreeContainedArgs(r, &a);
+	NodeMask(n, count, &a, mask);
+}
+
+/// Set bit i of mask for each of the first count branches of n whose rect
+/// contains r.
+void RTreeNodeContainingMask(RTreeNode *n, int count, RTreeRect *r, uint64_t *mask) {
+	RTreeKernelArgs a;
+	register int i;
+	assert(n && r && mask);
+	assert(count >= 0 && count <= MAXCARD);
+	RTreeStatsAdd(rectTests, count);
+
+	if (Undefined(r))	/* as RTreeContained: an undefined rect is inside anything */
+	{
+		memset(mask, 0, MASKWORDS * sizeof(uint64_t));
+		for (i=0; i<count; i++)
+			mask[i >> 6] |= (uint64_t)1 << (i & 63);
+		return;
+	}
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	RTreeContainingArgs(r, &a);
+	NodeMask(n, count, &a, mask);
+}
+
+/// Set bit i of mask for each of the first count children of a quantized
+/// node whose sides in steps are within limit: the low side along d at most
+/// limit[d] and the high side at least limit[d+NUMDIMS].
+void RTreeQuantNodeMask(RTreeQuantNode *n, int count, int *limit, uint64_t *mask) {
+	RTreeQuantArgs a;
+	register int d;
+	assert(n && limit && mask);
+	assert(count >= 0 && count <= QMAXCARD);
+	RTreeStatsAdd(rectTests, count);
+
+	for (d=0; d<NUMDIMS; d++)
+	{
+		if (limit[d] < 0 || limit[d+NUMDIMS] > QUANTSTEPS)	/* no child gets past it */
+		{
+			memset(mask, 0, QMASKWORDS * sizeof(uint64_t));
+			return;
+		}
+		a.limit[d] = limit[d] < QUANTSTEPS ? limit[d] : QUANTSTEPS;
+		a.flip[d] = 0;
+		a.limit[d+NUMDIMS] = QUANTSTEPS - (limit[d+NUMDIMS] > 0 ? limit[d+NUMDIMS] : 0);
+		a.flip[d+NUMDIMS] = QUANTSTEPS;
+	}
+	pthread_once(&KernelOnce, RTreeInitKernel);
+	QuantMask(n, count, &a, mask);
+}
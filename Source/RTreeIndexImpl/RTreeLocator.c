@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* the high bits of the product, since tids may be small integers and nodes
+ * are aligned, both with nothing in the low bits to tell them apart */
+#define Hash(p) (((uintptr_t)(p) * 0x9E3779B97F4A7C15ull) >> 32)
+
+/// Find the slot of a key, or the empty one where it would go.
+static size_t RTreeMapSlot(RTreeLocatorMap *m, void *key) {
+	size_t k, mask = m->capacity - 1;
+
+	for (k = Hash(key) & mask; m->slots[k].key && m->slots[k].key != key; k = (k + 1) & mask)
+		;
+	return k;
+}
+
+/// The node a key maps to, or NULL.
+static RTreeNode * RTreeMapGet(RTreeLocatorMap *m, void *key) {
+	if (m->count == 0)
+		return NULL;
+	return m->slots[RTreeMapSlot(m, key)].node;
+}
+
+static void RTreeMapPut(RTreeLocatorMap *m, void *key, RTreeNode *node);
+
+/// Double the slots of a map, or make the first 64.
+static void RTreeMapGrow(RTreeLocatorMap *m) {
+	RTreeLocatorSlot *old = m->slots;
+	size_t k, capacity = m->capacity;
+
+	m->capacity = capacity ? 2 * capacity : 64;
+	m->slots = (RTreeLocatorSlot *)calloc(m->capacity, sizeof(RTreeLocatorSlot));
+	assert(m->slots);
+	m->count = 0;
+	for (k=0; k<capacity; k++)
+		if (old[k].key)
+			RTreeMapPut(m, old[k].key, old[k].node);
+	free(old);
+}
+
+/// Map a key to a node, growing the map past half full.
+static void RTreeMapPut(RTreeLocatorMap *m, void *key, RTreeNode *node) {
+	size_t k;
+
+	if (2 * (m->count + 1) > m->capacity)
+		RTreeMapGrow(m);
+	k = RTreeMapSlot(m, key);
+	if (!m->slots[k].key)
+	{
+		m->slots[k].key = key;
+		m->count++;
+	}
+	m->slots[k].node = node;
+}
+
+/// Take a key out of a map.  The keys after it in its run move back into
+/// the hole if they may, so lookups never need to skip removed slots.
+static void RTreeMapRemove(RTreeLocatorMap *m, void *key) {
+	size_t i, j, h, mask = m->capacity - 1;
+
+	if (m->count == 0)
+		return;
+	i = RTreeMapSlot(m, key);
+	if (!m->slots[i].key)
+		return;
+	for (j=(i+1)&mask; m->slots[j].key; j=(j+1)&mask)
+	{
+		h = Hash(m->slots[j].key) & mask;
+		/* j may fill the hole unless its home lies between the hole and it */
+		if (i <= j ? (h <= i || h > j) : (h <= i && h > j))
+		{
+			m->slots[i] = m->slots[j];
+			i = j;
+		}
+	}
+	m->slots[i].key = NULL;
+	m->slots[i].node = NULL;
+	m->count--;
+}
+
+/// Record that child is a branch of n: a tid in a leaf, a node otherwise.
+void RTreeLocatorAdd(RTreeLocator *l, RTreeNode *n, RTreeNode *child) {
+	assert(l && n && child);
+	RTreeMapPut(n->level > 0 ? &l->parents : &l->leaves, child, n);
+}
+
+/// Forget a tid deleted from its leaf.
+void RTreeLocatorRemoveTid(RTreeLocator *l, void *tid) {
+	assert(l);
+	RTreeMapRemove(&l->leaves, tid);
+}
+
+/// The parent of a node other than the root.
+RTreeNode * RTreeLocatorParent(RTreeLocator *l, RTreeNode *n) {
+	RTreeNode *p;
+	assert(l && n);
+	p = RTreeMapGet(&l->parents, n);
+	assert(p);
+	return p;
+}
+
+/// Forget a node being freed, and the tids of a leaf that are still
+/// recorded in it rather than in the leaf they moved to.
+void RTreeLocatorFreeNode(RTreeLocator *l, RTreeNode *n) {
+	register int i;
+	assert(l && n);
+	RTreeMapRemove(&l->parents, n);
+	if (n->level == 0)
+		for (i=0; i<n->count; i++)
+			if (RTreeMapGet(&l->leaves, n->child[i]) == n)
+				RTreeMapRemove(&l->leaves, n->child[i]);
+}
+
+/// Forget everything, for a tree freed as a whole.
+void RTreeLocatorClear(RTreeLocator *l) {
+	assert(l);
+	if (l->leaves.slots)
+		memset(l->leaves.slots, 0, l->leaves.capacity * sizeof(RTreeLocatorSlot));
+	if (l->parents.slots)
+		memset(l->parents.slots, 0, l->parents.capacity * sizeof(RTreeLocatorSlot));
+	l->leaves.count = l->parents.count = 0;
+}
+
+/// Record the branches of a subtree.
+static void RTreeLocatorAddSubtree(RTreeLocator *l, RTreeNode *n) {
+	register int i;
+	for (i=0; i<n->count; i++)
+	{
+		RTreeLocatorAdd(l, n, n->child[i]);
+		if (n->level > 0)
+			RTreeLocatorAddSubtree(l, n->child[i]);
+	}
+}
+
+/// Turn the locator on for an index: from now on it knows the leaf of
+/// every tid and the parent of every node, and deletes go by them.
+/// The tree as it is is recorded first.
+void RTreeIndexEnableLocator(RTreeIndex *t) {
+	RTreeLocator *l;
+
+	assert(t && t->root);
+	assert(!t->versions && !t->concurrent);
+	if (t->locator)
+		return;
+
+	l = (RTreeLocator *)calloc(1, sizeof(RTreeLocator));
+	assert(l);
+	RTreeLocatorAddSubtree(l, t->root);
+	t->locator = l;
+}
+
+/// The leaf holding a tid, or NULL if it is in none.  The index must
+/// have the locator on.
+RTreeNode * RTreeIndexLocate(RTreeIndex *t, void *tid) {
+	assert(t && t->locator);
+	return RTreeMapGet(&t->locator->leaves, tid);
+}
+
+/// Free the locator of an index, if it has one.
+void RTreeLocatorFree(RTreeIndex *t) {
+	RTreeLocator *l = t->locator;
+
+	if (!l)
+		return;
+	free(l->leaves.slots);
+	free(l->parents.slots);
+	free(l);
+	t->locator = NULL;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#define BLOCK sizeof(RTreeNode)
+
+/* stdio buffer of the writer */
+#define MAPPED_BUFFER	(1 << 20)
+
+/// Count the nodes and data rects of a subtree.
+static void RTreeMappedCount(RTreeNode *n, RTreeMappedHeader *h) {
+	register int i;
+	h->nodes++;
+	if (n->level == 0)
+	{
+		h->entries += n->count;
+		return;
+	}
+	for (i=0; i<n->count; i++)
+		RTreeMappedCount(n->child[i], h);
+}
+
+/// Write a tree to a file to be mapped by RTreeMappedOpen.
+/// The nodes go out in breadth first order, so a node's children come after
+/// all the nodes queued before it and their offsets are known when it is
+/// written.  Returns 0, or -1 with errno set if the file could not be written.
+static int RTreeWriteMappedTree(RTreeNode *root, int nodecard, int leafcard, const char *path) {
+	RTreeMappedHeader h;
+	RTreeNode **queue, block;
+	unsigned char header[BLOCK];
+	FILE *f;
+	char *buffer;
+	uint64_t next;
+	size_t head, tail;
+	register RTreeNode *n;
+	register int i;
+	int ok;
+
+	assert(root && root->level >= 0 && path);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MAPPED_MAGIC, sizeof(h.magic));
+	h.version = MAPPED_VERSION;
+	h.byteOrder = MAPPED_BYTEORDER;
+	h.numdims = NUMDIMS;
+	h.realSize = sizeof(RectReal);
+	h.maxcard = MAXCARD;
+	h.nodeSize = BLOCK;
+	h.nodecard = nodecard;
+	h.leafcard = leafcard;
+	h.height = root->level + 1;
+	h.root = BLOCK;
+	RTreeMappedCount(root, &h);
+
+	if (!(f = fopen(path, "wb")))
+		return -1;
+	buffer = (char *)malloc(MAPPED_BUFFER);
+	queue = (RTreeNode **)malloc(h.nodes * sizeof(RTreeNode *));
+	assert(buffer && queue);
+	setvbuf(f, buffer, _IOFBF, MAPPED_BUFFER);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, &h, sizeof(h));
+	ok = fwrite(header, sizeof(header), 1, f) == 1;
+
+	queue[0] = root;
+	tail = 1;
+	next = 2;	/* block of the next child to be queued */
+	for (head=0; ok && head<tail; head++)
+	{
+		n = queue[head];
+		memset(&block, 0, sizeof(block));
+		block.count = n->count;
+		block.level = n->level;
+		memcpy(block.bound, n->bound, sizeof(block.bound));
+		for (i=0; i<n->count; i++)
+		{
+			if (n->level > 0)
+			{
+				queue[tail++] = n->child[i];
+				block.child[i] = (RTreeNode *)(uintptr_t)(next++ * BLOCK);
+			}
+			else
+				block.child[i] = n->child[i];
+		}
+		ok = fwrite(&block, sizeof(block), 1, f) == 1;
+	}
+	assert(!ok || tail == h.nodes);
+
+	ok &= fflush(f) == 0;
+	ok &= fclose(f) == 0;
+	free(buffer);
+	free(queue);
+	return ok ? 0 : -1;
+}
+
+/// Write the tree of an index to a file to be mapped by RTreeMappedOpen.
+/// Returns 0, or -1 with errno set if the file could not be written.
+int RTreeIndexWriteMapped(RTreeIndex *t, const char *path) {
+	assert(t);
+	return RTreeWriteMappedTree(t->root, t->nodecard, t->leafcard, path);
+}
+
+/// Write a tree with the fanout of the default index to a file to be mapped
+/// by RTreeMappedOpen.  Returns 0, or -1 with errno set if it could not be.
+int RTreeWriteMapped(RTreeNode *root, const char *path) {
+	return RTreeWriteMappedTree(root, NODECARD, LEAFCARD, path);
+}
+
+/// Map a file written by RTreeIndexWriteMapped, read only and shared with
+/// every other process mapping it.  Only the header is checked; nothing is
+/// read until it is searched.
+/// Returns 0, or -1 if the file cannot be mapped or is not one written here.
+int RTreeMappedOpen(RTreeMapped *m, const char *path) {
+	struct stat st;
+	void *base;
+	int fd;
+
+	assert(m && path);
+	memset(m, 0, sizeof(RTreeMapped));
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < 2 * BLOCK)
+	{
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);	/* the mapping keeps the file */
+	if (base == MAP_FAILED)
+		return -1;
+
+	memcpy(&m->header, base, sizeof(RTreeMappedHeader));
+	if (memcmp(m->header.magic, MAPPED_MAGIC, sizeof(m->header.magic)) ||
+		m->header.version != MAPPED_VERSION ||
+		m->header.byteOrder != MAPPED_BYTEORDER ||
+		m->header.numdims != NUMDIMS ||
+		m->header.realSize != sizeof(RectReal) ||
+		m->header.maxcard != MAXCARD ||
+		m->header.nodeSize != BLOCK ||
+		m->header.height < 1 ||
+		m->header.root % BLOCK || m->header.root > (uint64_t)st.st_size - BLOCK ||
+		m->header.nodes > (uint64_t)st.st_size / BLOCK - 1)
+	{
+		munmap(base, st.st_size);
+		return -1;
+	}
+	m->base = (const unsigned char *)base;
+	m->size = st.st_size;
+	m->root = (RTreeNode *)(m->base + m->header.root);
+	return 0;
+}
+
+/// The node at an offset, or NULL if there can be no node of that level.
+static RTreeNode * RTreeMappedNode(RTreeMapped *m, uint64_t offset, int level) {
+	RTreeNode *n;
+	if (offset % BLOCK || offset < BLOCK || offset > m->size - BLOCK)
+		return NULL;
+	n = (RTreeNode *)(m->base + offset);
+	if (n->level != level || n->count < 0 || n->count > MAXCARD)
+		return NULL;
+	return n;
+}
+
+/// Search a mapped subtree as RTreeSearchNode does one in memory.
+/// Returns 1, 0 if the callback terminated the search, or -1 if the file is
+/// broken.
+static int RTreeMappedSearchNode(RTreeMapped *m, RTreeNode *n, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	uint64_t mask[MASKWORDS], bits;
+	RTreeNode *child;
+	RTreeRect rect;
+	register int i, w;
+	int result;
+
+	RTreeNodeSearchMask(n, r, mode, mask);
+	RTreeStatsVisit(n);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (bits=mask[w]; bits; bits&=bits-1)
+		{
+			i = 64*w + MaskLowest(bits);
+			if (n->level > 0)
+			{
+				if (!(child = RTreeMappedNode(m, (uintptr_t)n->child[i], n->level - 1)))
+					return -1;
+				if ((result = RTreeMappedSearchNode(m, child, r, mode, cbarg, callback)) < 1)
+					return result;
+			}
+			else if (callback)
+			{
+				RTreeStatsAdd(hits, 1);
+				rect = RTreeNodeGetRect(n, i);
+				if (!callback(n->child[i], &rect, cbarg))
+					return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/// Search a mapped tree for the data rects that relate to r as mode says,
+/// calling back for each.  Several threads may search one at once.
+/// Returns 1, 0 if the callback terminated the search, or -1 if the search
+/// came upon a broken node; the hits before it were reported.
+int RTreeMappedSearch(RTreeMapped *m, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeStatsTimer(timer);
+	int result;
+
+	assert(m && m->base && r);
+	if (!RTreeMappedNode(m, m->header.root, m->header.height - 1))
+		return -1;
+	RTreeStatsStart(timer);
+	result = RTreeMappedSearchNode(m, m->root, r, mode, cbarg, callback);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
+}
+
+/// Unmap a file mapped by RTreeMappedOpen.
+void RTreeMappedClose(RTreeMapped *m) {
+	assert(m);
+	if (m->base)
+		munmap((void *)m->base, m->size);
+	memset(m, 0, sizeof(RTreeMapped));
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#define Heap(c) ((c)->heap ? (c)->heap : (c)->local)
+
+/// Order of the heap: nearer first, and data rects before nodes at the same
+/// distance so they are reported without expanding more nodes.
+static int RTreeNearestBefore(RTreeNearestEntry *a, RTreeNearestEntry *b) {
+	return a->dist < b->dist || (a->dist == b->dist && a->level < b->level);
+}
+
+static void RTreeNearestPush(RTreeNearestCursor *c, RTreeNearestEntry *e) {
+	register RTreeNearestEntry *heap;
+	register size_t i, parent;
+
+	if (c->count == c->capacity)
+	{
+		c->capacity *= 2;
+		if (c->heap)
+			heap = (RTreeNearestEntry *)realloc(c->heap, c->capacity * sizeof(RTreeNearestEntry));
+		else if ((heap = (RTreeNearestEntry *)malloc(c->capacity * sizeof(RTreeNearestEntry))))
+			memcpy(heap, c->local, c->count * sizeof(RTreeNearestEntry));
+		assert(heap);
+		c->heap = heap;
+	}
+	heap = Heap(c);
+	for (i=c->count++; i>0; i=parent)
+	{
+		parent = (i - 1) / 2;
+		if (!RTreeNearestBefore(e, &heap[parent]))
+			break;
+		heap[i] = heap[parent];
+	}
+	heap[i] = *e;
+}
+
+static RTreeNearestEntry RTreeNearestPop(RTreeNearestCursor *c) {
+	register RTreeNearestEntry *heap = Heap(c);
+	RTreeNearestEntry top = heap[0], last;
+	register size_t i, child;
+
+	assert(c->count > 0);
+	last = heap[--c->count];
+	for (i=0; (child = 2*i + 1) < c->count; i=child)
+	{
+		if (child + 1 < c->count && RTreeNearestBefore(&heap[child+1], &heap[child]))
+			child++;
+		if (!RTreeNearestBefore(&heap[child], &last))
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = last;
+	return top;
+}
+
+/// Squared MINDIST from the query point to every branch of a node,
+/// one side row at a time.
+static void RTreeNodeMinDist(RTreeNode *n, RectReal *point, double *dist) {
+	register int i, d;
+	RectReal p, below, above;
+	double delta;
+
+	for (i=0; i<n->count; i++)
+		dist[i] = 0;
+	for (d=0; d<NUMDIMS; d++)
+	{
+		p = point[d];
+		for (i=0; i<n->count; i++)
+		{
+			/* at most one of them is positive, both 0 inside */
+			below = n->bound[d][i] - p;
+			above = p - n->bound[d+NUMDIMS][i];
+			delta = (double)(below > 0 ? below : 0) + (double)(above > 0 ? above : 0);
+			dist[i] += delta * delta;
+		}
+	}
+}
+
+/// Put the branches of a node within range on the heap.
+static void RTreeNearestExpand(RTreeNearestCursor *c, RTreeNode *n) {
+	double dist[MAXCARD];
+	RTreeNearestEntry e;
+	register int i;
+
+	RTreeNodeMinDist(n, c->point, dist);
+	RTreeStatsVisit(n);
+	RTreeStatsAdd(rectTests, n->count);
+	for (i=0; i<n->count; i++)
+	{
+		if (dist[i] > c->maxDist)
+			continue;
+		e.dist = dist[i];
+		if (n->level > 0)
+		{
+			e.level = n->level - 1;
+			e.node = n->child[i];
+		}
+		else
+		{
+			e.level = -1;
+			e.branch = i;
+			e.node = n;
+		}
+		RTreeNearestPush(c, &e);
+	}
+}
+
+/// Start browsing the data rects of the tree under root by distance from a
+/// point.  Only those no farther than radius are reported; pass HUGE_VAL for
+/// no limit.  The tree must not be modified until the cursor is closed.
+void RTreeNearestOpen(RTreeNearestCursor *c, RTreeNode *root, RectReal *point, double radius) {
+	RTreeNearestEntry e;
+	int d;
+
+	assert(c && root && point);
+	assert(radius >= 0);
+
+	for (d=0; d<NUMDIMS; d++)
+		c->point[d] = point[d];
+	c->maxDist = radius * radius;
+	c->heap = NULL;
+	c->count = 0;
+	c->capacity = NEAREST_LOCAL;
+
+	e.dist = 0;
+	e.level = root->level;
+	e.node = root;
+	RTreeNearestPush(c, &e);
+}
+
+/// Go on to the next nearest data rect.
+/// Returns 1 and sets *tid, and *rect and *dist (its Euclidean distance from
+/// the point) unless they are NULL, or 0 when there are no more in range.
+int RTreeNearestNext(RTreeNearestCursor *c, void **tid, RTreeRect *rect, double *dist) {
+	RTreeNearestEntry e;
+	assert(c && tid);
+
+	while (c->count > 0)
+	{
+		e = RTreeNearestPop(c);
+		if (e.level >= 0)
+		{
+			RTreeNearestExpand(c, e.node);
+			continue;
+		}
+		RTreeStatsAdd(hits, 1);
+		*tid = e.node->child[e.branch];
+		if (rect)
+			*rect = RTreeNodeGetRect(e.node, e.branch);
+		if (dist)
+			*dist = sqrt(e.dist);
+		return 1;
+	}
+	return 0;
+}
+
+/// Free the heap of a cursor.
+void RTreeNearestClose(RTreeNearestCursor *c) {
+	assert(c);
+	free(c->heap);
+	c->heap = NULL;
+	c->count = 0;
+	c->capacity = NEAREST_LOCAL;
+}
+
+/// Find the k data rects nearest to a point and no farther than radius
+/// (HUGE_VAL for no limit), nearest first, into tids and dists unless it is
+/// NULL.  Returns how many there are.
+size_t RTreeSearchNearest(RTreeNode *root, RectReal *point, size_t k, double radius, void **tids, double *dists) {
+	RTreeNearestCursor c;
+	size_t found;
+	RTreeStatsTimer(timer);
+
+	assert(tids || k == 0);
+	RTreeStatsStart(timer);
+	RTreeNearestOpen(&c, root, point, radius);
+	for (found=0; found<k; found++)
+		if (!RTreeNearestNext(&c, &tids[found], NULL, dists ? &dists[found] : NULL))
+			break;
+	RTreeNearestClose(&c);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return found;
+}
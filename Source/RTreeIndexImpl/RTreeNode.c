@@ -4,9 +4,11 @@
 #include "include/RTreeIndexImpl.h"
 
 /// Initialize one branch cell in a node.
-static void RTreeInitBranch(RTreeBranch *b) {
-	RTreeInitRect(&(b->rect));
-	b->child = NULL;
+static void RTreeInitBranch(RTreeNode *n, int i) {
+	RTreeBranch b;
+	RTreeInitRect(&b.rect);
+	b.child = NULL;
+	RTreeNodeSetBranch(n, i, &b);
 }
 
 /// Initialize a RTreeNode structure.
@@ -16,7 +18,7 @@ void RTreeInitNode(RTreeNode *N) {
 	n->count = 0;
 	n->level = -1;
 	for (i = 0; i < MAXCARD; i++)
-		RTreeInitBranch(&(n->branch[i]));
+		RTreeInitBranch(n, i);
 }
 
 /// Make a new node and initialize to have all branch cells empty.
@@ -27,6 +29,8 @@ RTreeNode * RTreeNewNode() {
 	n = (RTreeNode*)malloc(sizeof(RTreeNode));
 	assert(n);
 	RTreeInitNode(n);
+	n->version = 0;
+	RTreeStatsAdd(nodeAllocs, 1);
 	return n;
 }
 
@@ -34,28 +38,29 @@ void RTreeFreeNode(RTreeNode *p) {
 	assert(p);
 	//delete p;
 	free(p);
+	RTreeStatsAdd(nodeFrees, 1);
 }
 
 /// Find the smallest rectangle that includes all rectangles in
 /// branches of a node.
 RTreeRect RTreeNodeCover(RTreeNode *N) {
 	register RTreeNode *n = N;
-	register int i, first_time=1;
+	register int i, s;
 	RTreeRect r;
 	assert(n);
 
 	RTreeInitRect(&r);
-	for (i = 0; i < MAXKIDS(n); i++)
-		if (n->branch[i].child)
-		{
-			if (first_time)
-			{
-				r = n->branch[i].rect;
-				first_time = 0;
-			}
-			else
-				r = RTreeCombineRect(&r, &(n->branch[i].rect));
-		}
+	if (n->count == 0)
+		return r;
+
+	/* one side row at a time */
+	r = RTreeNodeGetRect(n, 0);
+	for (s = 0; s < NUMDIMS; s++)
+		for (i = 1; i < n->count; i++)
+			r.boundary[s] = n->bound[s][i] < r.boundary[s] ? n->bound[s][i] : r.boundary[s];
+	for (; s < NUMSIDES; s++)
+		for (i = 1; i < n->count; i++)
+			r.boundary[s] = n->bound[s][i] > r.boundary[s] ? n->bound[s][i] : r.boundary[s];
 	return r;
 }
 
@@ -67,34 +72,30 @@ RTreeRect RTreeNodeCover(RTreeNode *N) {
 int RTreePickBranch(RTreeRect *R, RTreeNode *N) {
 	register RTreeRect *r = R;
 	register RTreeNode *n = N;
-	register RTreeRect *rr;
 	register int i, first_time=1;
 	RectReal increase, bestIncr=(RectReal)-1, area, bestArea = 0.0;
 	int best = 0;
-	RTreeRect tmp_rect;
+	RTreeRect rr, tmp_rect;
 	assert(r && n);
 
-	for (i=0; i<MAXKIDS(n); i++)
+	for (i=0; i<n->count; i++)
 	{
-		if (n->branch[i].child)
+		rr = RTreeNodeGetRect(n, i);
+		area = RTreeRectSphericalVolume(&rr);
+		tmp_rect = RTreeCombineRect(r, &rr);
+		increase = RTreeRectSphericalVolume(&tmp_rect) - area;
+		if (increase < bestIncr || first_time)
 		{
-			rr = &n->branch[i].rect;
-			area = RTreeRectSphericalVolume(rr);
-			tmp_rect = RTreeCombineRect(r, rr);
-			increase = RTreeRectSphericalVolume(&tmp_rect) - area;
-			if (increase < bestIncr || first_time)
-			{
-				best = i;
-				bestArea = area;
-				bestIncr = increase;
-				first_time = 0;
-			}
-			else if (increase == bestIncr && area < bestArea)
-			{
-				best = i;
-				bestArea = area;
-				bestIncr = increase;
-			}
+			best = i;
+			bestArea = area;
+			bestIncr = increase;
+			first_time = 0;
+		}
+		else if (increase == bestIncr && area < bestArea)
+		{
+			best = i;
+			bestArea = area;
+			bestIncr = increase;
 		}
 	}
 	return best;
@@ -104,41 +105,66 @@ int RTreePickBranch(RTreeRect *R, RTreeNode *N) {
 /// Returns 0 if node not split.  Old node updated.
 /// Returns 1 if node split, sets *new_node to address of new node.
 /// Old node updated, becomes one of two.
-int RTreeAddBranch(RTreeBranch *B, RTreeNode *N, RTreeNode **New_node) {
+int RTreeIndexAddBranch(RTreeIndex *t, RTreeBranch *B, RTreeNode *N, RTreeNode **New_node) {
 	register RTreeBranch *b = B;
 	register RTreeNode *n = N;
 	register RTreeNode **new_node = New_node;
-	register int i;
 
+	assert(t);
 	assert(b);
 	assert(n);
 
-	if (n->count < MAXKIDS(n))  /* split won't be necessary */
+	if (n->count < MAXKIDS(t, n))  /* split won't be necessary */
 	{
-		for (i = 0; i < MAXKIDS(n); i++)  /* find empty branch */
-		{
-			if (n->branch[i].child == NULL)
-			{
-				n->branch[i] = *b;
-				n->count++;
-				break;
-			}
-		}
+		RTreeNodeSetBranch(n, n->count, b);
+		n->count++;
+		if (t->locator)
+			RTreeLocatorAdd(t->locator, n, b->child);
 		return 0;
 	}
 	else
 	{
 		assert(new_node);
-		RTreeSplitNode(n, b, new_node);
+		RTreeSplitNode(t, n, b, new_node);
 		return 1;
 	}
 }
 
+/// Add a branch to a node of the default index.
+int RTreeAddBranch(RTreeBranch *b, RTreeNode *n, RTreeNode **new_node) {
+	return RTreeIndexAddBranch(RTreeDefaultIndex(), b, n, new_node);
+}
+
+/// Split a node with the split method of the index.
+void RTreeSplitNode(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
+	assert(t);
+	switch (t->split)
+	{
+	case RTreeSplitLinear:
+		RTreeSplitNodeLinear(t, n, b, nn);
+		break;
+	case RTreeSplitRStar:
+		RTreeSplitNodeRStar(t, n, b, nn);
+		break;
+	case RTreeSplitQuadratic:
+	default:
+		RTreeSplitNodeQuadratic(t, n, b, nn);
+		break;
+	}
+}
+
 /// Disconnect a dependent node.
+/// The last branch moves into its place, so branches stay packed in [0, count).
 void RTreeDisconnectBranch(RTreeNode *n, int i) {
-	assert(n && i>=0 && i<MAXKIDS(n));
-	assert(n->branch[i].child);
+	RTreeBranch last;
+	assert(n && i>=0 && i<n->count);
+	assert(n->child[i]);
 
-	RTreeInitBranch(&(n->branch[i]));
 	n->count--;
+	if (i != n->count)
+	{
+		last = RTreeNodeGetBranch(n, n->count);
+		RTreeNodeSetBranch(n, i, &last);
+	}
+	RTreeInitBranch(n, n->count);
 }
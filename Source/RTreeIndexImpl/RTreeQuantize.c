@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#define Undefined(x) ((x)->boundary[0] > (x)->boundary[NUMDIMS])
+
+/*
+ * A side of a child is stored as whole steps from the low side of its node:
+ * the low side rounded down and the high side up, each one step further out.
+ * A search rect is turned into steps rounded down, and then only small
+ * integers are compared.  The extra step of the stored sides is more than
+ * all the rounding of the arithmetic on both, so no child whose exact rect
+ * passes a test is ever left out.
+ */
+
+/// Steps per unit along a side of a node, or 0 if the side can't be cut
+/// into steps; then the children are not told apart along it.
+static double RTreeQuantScale(RectReal lo, RectReal hi) {
+	double scale = QUANTSTEPS / ((double)hi - lo);
+	return isfinite(scale) && scale > 0 ? scale : 0;
+}
+
+/// Whole steps from lo to v, rounded down, but kept from -1 to QUANTSTEPS+1.
+static inline int RTreeQuantSteps(RectReal v, RectReal lo, double scale) {
+	double x = ((double)v - lo) * scale;
+	if (!(x > -1))
+		return -1;
+	if (x > QUANTSTEPS + 1)
+		return QUANTSTEPS + 1;
+	return (int)x;	/* below 0 that rounds up, which only lets more through */
+}
+
+/// Count the leaves of a subtree.
+static size_t RTreeQuantCountLeaves(RTreeNode *n) {
+	register size_t leaves = 0;
+	register int i;
+	if (n->level == 0)
+		return 1;
+	for (i=0; i<n->count; i++)
+		leaves += RTreeQuantCountLeaves(n->child[i]);
+	return leaves;
+}
+
+/// Copy the leaves of a subtree in order, each one after the last.
+static void RTreeQuantCopyLeaves(RTreeNode *n, RTreeQuantized *q) {
+	register RTreeNode *leaf;
+	register int i;
+	if (n->level == 0)
+	{
+		leaf = &q->leaves[q->leafCount++];
+		memcpy(leaf, n, sizeof(RTreeNode));
+		leaf->version = 0;
+		q->entries += n->count;
+		return;
+	}
+	for (i=0; i<n->count; i++)
+		RTreeQuantCopyLeaves(n->child[i], q);
+}
+
+/// Store the rect of child i of a node in steps of the node's rect.
+static void RTreeQuantSetRect(RTreeQuantNode *n, int i, RTreeRect *r) {
+	double scale;
+	register int d;
+	int a, b;
+
+	for (d=0; d<NUMDIMS; d++)
+	{
+		scale = RTreeQuantScale(n->cover[d], n->cover[d+NUMDIMS]);
+		a = 0;
+		b = QUANTSTEPS;
+		if (scale > 0)
+		{
+			a = (int)fmax(floor(((double)r->boundary[d] - n->cover[d]) * scale) - 1, 0);
+			b = (int)fmin(ceil(((double)r->boundary[d+NUMDIMS] - n->cover[d]) * scale) + 1, QUANTSTEPS);
+		}
+		n->bound[d][i] = (RTreeQuant)a;
+		n->bound[d+NUMDIMS][i] = (RTreeQuant)b;
+	}
+}
+
+/// Make a quantized copy of a tree.  The leaves are copied as they are;
+/// above them each level is ordered by Sort-Tile-Recursive and packed
+/// QMAXCARD to a node, up to a single root.  The tree is not changed.
+RTreeQuantized * RTreeQuantize(RTreeNode *root) {
+	RTreeQuantized *q;
+	RTreeQuantNode *n;
+	RTreeBranch *e;
+	RTreeRect cover;
+	size_t items, parents, done, take, k, total;
+	register size_t j;
+	register int i;
+	int level;
+
+	assert(root && root->level >= 0);
+	q = (RTreeQuantized *)calloc(1, sizeof(RTreeQuantized));
+	assert(q);
+	items = RTreeQuantCountLeaves(root);
+	assert(items <= UINT32_MAX);
+	q->leaves = (RTreeNode *)malloc(items * sizeof(RTreeNode));
+	assert(q->leaves);
+	RTreeQuantCopyLeaves(root, q);
+	q->height = 1;
+	if (items == 1)
+		return q;
+
+	for (total=0, k=items; k>1; k=(k+QMAXCARD-1)/QMAXCARD)
+		total += (k + QMAXCARD - 1) / QMAXCARD;
+	q->nodes = (RTreeQuantNode *)malloc(total * sizeof(RTreeQuantNode));
+	e = (RTreeBranch *)malloc(items * sizeof(RTreeBranch));
+	assert(q->nodes && e);
+	for (j=0; j<items; j++)
+	{
+		e[j].rect = RTreeNodeCover(&q->leaves[j]);
+		e[j].child = (RTreeNode *)(uintptr_t)j;	/* index of the leaf */
+	}
+
+	for (level=1; items>1; level++)
+	{
+		RTreeSortTileBranches(e, items, QMAXCARD);
+		/* as RTreePackLevel: the last two nodes share their children evenly */
+		for (done=0, parents=0; done<items; done+=take, parents++)
+		{
+			take = items - done < QMAXCARD ? items - done : QMAXCARD;
+			if (items - done > QMAXCARD && items - done < 2 * QMAXCARD)
+				take = (items - done + 1) / 2;
+
+			n = &q->nodes[q->nodeCount];
+			memset(n, 0, sizeof(RTreeQuantNode));
+			n->level = level;
+			n->count = take;
+			cover = e[done].rect;
+			for (j=1; j<take; j++)
+				cover = RTreeCombineRect(&cover, &e[done + j].rect);
+			memcpy(n->cover, cover.boundary, sizeof(n->cover));
+			for (i=0; i<n->count; i++)
+			{
+				RTreeQuantSetRect(n, i, &e[done + i].rect);
+				n->child[i] = (uint32_t)(uintptr_t)e[done + i].child;
+			}
+
+			e[parents].rect = cover;
+			e[parents].child = (RTreeNode *)(uintptr_t)q->nodeCount++;
+		}
+		items = parents;
+	}
+	assert(q->nodeCount == total);
+	free(e);
+	q->height = level;
+	return q;
+}
+
+/// Make a quantized copy of the tree of an index.
+RTreeQuantized * RTreeIndexQuantize(RTreeIndex *t) {
+	assert(t);
+	return RTreeQuantize(t->root);
+}
+
+/// Set bit i of mask for each child of a quantized node whose stored rect a
+/// search in the given mode goes on with, which is every child whose exact
+/// rect it would and maybe a few more.
+static void RTreeQuantSearchMask(RTreeQuantNode *n, RTreeRect *r, RTreeSearchMode mode, uint64_t *mask) {
+	int limit[NUMSIDES];
+	int containing = mode == RTreeModeContaining;
+	double scale;
+	register int d;
+
+	for (d=0; d<NUMDIMS; d++)
+	{
+		scale = RTreeQuantScale(n->cover[d], n->cover[d+NUMDIMS]);
+		if (scale == 0 || (containing && Undefined(r)))
+		{
+			limit[d] = QUANTSTEPS;
+			limit[d+NUMDIMS] = 0;
+		}
+		else if (containing)	/* the child holds r */
+		{
+			limit[d] = RTreeQuantSteps(r->boundary[d], n->cover[d], scale);
+			limit[d+NUMDIMS] = RTreeQuantSteps(r->boundary[d+NUMDIMS], n->cover[d], scale);
+		}
+		else	/* the child overlaps r */
+		{
+			limit[d] = RTreeQuantSteps(r->boundary[d+NUMDIMS], n->cover[d], scale);
+			limit[d+NUMDIMS] = RTreeQuantSteps(r->boundary[d], n->cover[d], scale);
+		}
+	}
+	RTreeQuantNodeMask(n, n->count, limit, mask);
+}
+
+/// Search an exact leaf of a quantized tree, calling back for its hits.
+/// Returns 0 if the callback terminated the search, 1 otherwise.
+static int RTreeQuantSearchLeaf(RTreeNode *leaf, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	uint64_t mask[MASKWORDS], bits;
+	RTreeRect rect;
+	register int i, w;
+
+	RTreeNodeSearchMask(leaf, r, mode, mask);
+	RTreeStatsVisit(leaf);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (bits=mask[w]; bits; bits&=bits-1)
+		{
+			i = 64*w + MaskLowest(bits);
+			RTreeStatsAdd(hits, 1);
+			if (callback)
+			{
+				rect = RTreeNodeGetRect(leaf, i);
+				if (!callback(leaf->child[i], &rect, cbarg))
+					return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/// Search a quantized subtree as RTreeSearchNode does a tree.
+/// Returns 0 if the callback terminated the search, 1 otherwise.
+static int RTreeQuantSearchNode(RTreeQuantized *q, RTreeQuantNode *n, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	uint64_t mask[QMASKWORDS], bits;
+	register int i, w;
+	int result;
+
+	RTreeQuantSearchMask(n, r, mode, mask);
+	RTreeStatsVisit(n);
+	for (w=0; w<QMASKWORDS; w++)
+	{
+		for (bits=mask[w]; bits; bits&=bits-1)
+		{
+			i = 64*w + MaskLowest(bits);
+			if (n->level > 1)
+				result = RTreeQuantSearchNode(q, &q->nodes[n->child[i]], r, mode, cbarg, callback);
+			else
+				result = RTreeQuantSearchLeaf(&q->leaves[n->child[i]], r, mode, cbarg, callback);
+			if (!result)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/// Search a quantized tree for the data rects that relate to r as mode
+/// says, calling back for each.  Several threads may search one at once.
+/// Returns 0 if the callback terminated the search, 1 otherwise.
+int RTreeQuantizedSearch(RTreeQuantized *q, RTreeRect *r, RTreeSearchMode mode, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeStatsTimer(timer);
+	int result;
+
+	assert(q && r);
+	RTreeStatsStart(timer);
+	if (q->nodeCount > 0)
+		result = RTreeQuantSearchNode(q, &q->nodes[q->nodeCount - 1], r, mode, cbarg, callback);
+	else
+		result = RTreeQuantSearchLeaf(q->leaves, r, mode, cbarg, callback);
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return result;
+}
+
+/// Bytes of memory a quantized tree takes.
+size_t RTreeQuantizedBytes(RTreeQuantized *q) {
+	assert(q);
+	return sizeof(RTreeQuantized) + q->leafCount * sizeof(RTreeNode) + q->nodeCount * sizeof(RTreeQuantNode);
+}
+
+/// Free a quantized tree.  The data the tids point at are not freed.
+void RTreeQuantizedFree(RTreeQuantized *q) {
+	assert(q);
+	free(q->leaves);
+	free(q->nodes);
+	free(q);
+}
@@ -218,6 +218,45 @@ RectReal RTreeRectSurfaceArea(struct RTreeRect *R) {
 	return 2 * sum;
 }
 
+/// Calculate the margin of a rectangle, the sum of its edge lengths
+/// (the perimeter in two dimensions).
+RectReal RTreeRectMargin(struct RTreeRect *R) {
+	register struct RTreeRect *r = R;
+	register int i;
+	register RectReal sum = (RectReal)0;
+
+	assert(r);
+	if (Undefined(r))
+		return (RectReal)0;
+
+	for (i=0; i<NUMDIMS; i++)
+		sum += r->boundary[i+NUMDIMS] - r->boundary[i];
+	return (1 << (NUMDIMS-1)) * sum;
+}
+
+/// Calculate the n-dimensional volume of the intersection of two rectangles,
+/// 0 if they do not overlap.
+RectReal RTreeRectOverlapVolume(struct RTreeRect *R, struct RTreeRect *S) {
+	register struct RTreeRect *r = R, *s = S;
+	register int i, j;
+	register RectReal volume = (RectReal)1, lo, hi;
+
+	assert(r && s);
+	if (Undefined(r) || Undefined(s))
+		return (RectReal)0;
+
+	for (i=0; i<NUMDIMS; i++)
+	{
+		j = i + NUMDIMS;  /* index for high sides */
+		lo = MAX(r->boundary[i], s->boundary[i]);
+		hi = MIN(r->boundary[j], s->boundary[j]);
+		if (hi <= lo)
+			return (RectReal)0;
+		volume *= hi - lo;
+	}
+	return volume;
+}
+
 /// Combine two rectangles, make one that includes both.
 struct RTreeRect RTreeCombineRect(struct RTreeRect *R, struct RTreeRect *Rr) {
 	register struct RTreeRect *r = R, *rr = Rr;
@@ -245,6 +284,7 @@ int RTreeOverlap(struct RTreeRect *R, struct RTreeRect *S) {
 	register struct RTreeRect *r = R, *s = S;
 	register int i, j;
 	assert(r && s);
+	RTreeStatsAdd(rectTests, 1);
 
 	for (i=0; i<NUMDIMS; i++)
 	{
@@ -263,6 +303,7 @@ int RTreeContained(struct RTreeRect *R, struct RTreeRect *S) {
 	register struct RTreeRect *r = R, *s = S;
 	register int i, j, result;
 	assert((int)r && (int)s);
+	RTreeStatsAdd(rectTests, 1);
 
  	// undefined rect is contained in any other
 	//
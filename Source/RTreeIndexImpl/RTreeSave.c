@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* bytes a stream moves to or from its file at once, a multiple of 8 */
+#define SAVE_BUFFER	(4 << 20)
+
+#define SAVE_PRIME	0x9E3779B97F4A7C15ull
+
+/* a file read or written through a buffer of its own, checksummed on the way */
+typedef struct _RTreeStream
+{
+	FILE *f;
+	unsigned char *buffer;
+	size_t used, filled;	/* bytes of the buffer taken, and read in */
+	uint64_t left;	/* bytes still to checksum */
+	uint64_t sum;
+	int error;
+} RTreeStream;
+
+/// Add bytes to a checksum, 8 at a time; only the last call may pass a
+/// size that is not a multiple of 8.
+static uint64_t RTreeChecksum(uint64_t sum, const unsigned char *p, size_t n) {
+	uint64_t w;
+	register size_t i;
+
+	for (i=0; i+8<=n; i+=8)
+	{
+		memcpy(&w, p+i, 8);
+		sum = (sum ^ w) * SAVE_PRIME;
+		sum ^= sum >> 29;
+	}
+	if (i < n)
+	{
+		w = 0;
+		memcpy(&w, p+i, n-i);
+		sum = (sum ^ w) * SAVE_PRIME;
+		sum ^= sum >> 29;
+	}
+	return sum;
+}
+
+static int RTreeStreamOpen(RTreeStream *s, const char *path, const char *mode) {
+	memset(s, 0, sizeof(RTreeStream));
+	if (!(s->f = fopen(path, mode)))
+		return -1;
+	setvbuf(s->f, NULL, _IONBF, 0);	/* the stream buffers */
+	s->buffer = (unsigned char *)malloc(SAVE_BUFFER);
+	assert(s->buffer);
+	return 0;
+}
+
+static void RTreeStreamFlush(RTreeStream *s) {
+	if (s->used == 0 || s->error)
+		return;
+	s->sum = RTreeChecksum(s->sum, s->buffer, s->used);
+	s->error = fwrite(s->buffer, 1, s->used, s->f) != s->used;
+	s->used = 0;
+}
+
+static void RTreeStreamWrite(RTreeStream *s, const void *p, size_t n) {
+	const unsigned char *from = (const unsigned char *)p;
+	size_t k;
+
+	while (n > 0)
+	{
+		if (s->used == SAVE_BUFFER)
+			RTreeStreamFlush(s);
+		k = SAVE_BUFFER - s->used < n ? SAVE_BUFFER - s->used : n;
+		memcpy(s->buffer + s->used, from, k);
+		s->used += k;
+		from += k;
+		n -= k;
+	}
+}
+
+/// Read n bytes, or set the error if the file ends first.  Only the first
+/// s->left bytes of the file are checksummed.
+static void RTreeStreamRead(RTreeStream *s, void *p, size_t n) {
+	unsigned char *to = (unsigned char *)p;
+	size_t k, sum;
+
+	while (n > 0 && !s->error)
+	{
+		if (s->used == s->filled)
+		{
+			s->filled = fread(s->buffer, 1, SAVE_BUFFER, s->f);
+			s->used = 0;
+			if (s->filled == 0)
+			{
+				s->error = 1;
+				break;
+			}
+			sum = s->filled < s->left ? s->filled : s->left;
+			s->sum = RTreeChecksum(s->sum, s->buffer, sum);
+			s->left -= sum;
+		}
+		k = s->filled - s->used < n ? s->filled - s->used : n;
+		memcpy(to, s->buffer + s->used, k);
+		s->used += k;
+		to += k;
+		n -= k;
+	}
+}
+
+/// Close a stream.  Returns 0 if all went well.
+static int RTreeStreamClose(RTreeStream *s) {
+	int error = s->error;
+	if (s->f && fclose(s->f) != 0)
+		error = 1;
+	free(s->buffer);
+	s->f = NULL;
+	s->buffer = NULL;
+	return error ? -1 : 0;
+}
+
+// MARK: - Save
+/// Count the nodes and data rects of a subtree.
+static void RTreeSaveCount(RTreeNode *n, RTreeSaveHeader *h) {
+	register int i;
+	h->nodes++;
+	if (n->level == 0)
+	{
+		h->entries += n->count;
+		return;
+	}
+	for (i=0; i<n->count; i++)
+		RTreeSaveCount(n->child[i], h);
+}
+
+static void RTreeSaveNode(RTreeStream *s, RTreeNode *n) {
+	int16_t head[2];
+	uint64_t tid;
+	register int i, side;
+
+	head[0] = n->level;
+	head[1] = n->count;
+	RTreeStreamWrite(s, head, sizeof(head));
+	for (side=0; side<NUMSIDES; side++)
+		RTreeStreamWrite(s, n->bound[side], n->count * sizeof(RectReal));
+	if (n->level == 0)
+		for (i=0; i<n->count; i++)
+		{
+			tid = (uintptr_t)n->child[i];
+			RTreeStreamWrite(s, &tid, sizeof(tid));
+		}
+}
+
+/// Write a tree breadth first, its nodes going through a queue that the
+/// children of each are added to as it is written.
+static int RTreeSaveTree(RTreeNode *root, int nodecard, int leafcard, RTreeSplitMethod split, const char *path) {
+	RTreeSaveHeader h;
+	RTreeStream s;
+	RTreeNode **queue, *n;
+	size_t head, tail;
+	register int i;
+
+	assert(root && root->level >= 0 && path);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SAVE_MAGIC, sizeof(h.magic));
+	h.version = SAVE_VERSION;
+	h.byteOrder = MAPPED_BYTEORDER;
+	h.numdims = NUMDIMS;
+	h.realSize = sizeof(RectReal);
+	h.tidSize = sizeof(uint64_t);
+	h.nodecard = nodecard;
+	h.leafcard = leafcard;
+	h.split = split;
+	h.height = root->level + 1;
+	RTreeSaveCount(root, &h);
+	assert(sizeof(h) % 8 == 0);	/* the checksum goes on from it word by word */
+	/* every node but the root is a branch of its parent */
+	h.bytes = sizeof(h) + h.nodes * 2 * sizeof(int16_t) +
+		(h.nodes - 1 + h.entries) * sizeof(RTreeRect) + h.entries * sizeof(uint64_t);
+
+	if (RTreeStreamOpen(&s, path, "wb") < 0)
+		return -1;
+	queue = (RTreeNode **)malloc(h.nodes * sizeof(RTreeNode *));
+	assert(queue);
+	RTreeStreamWrite(&s, &h, sizeof(h));
+	queue[0] = root;
+	for (head=0, tail=1; head<tail && !s.error; head++)
+	{
+		n = queue[head];
+		RTreeSaveNode(&s, n);
+		if (n->level > 0)
+			for (i=0; i<n->count; i++)
+				queue[tail++] = n->child[i];
+	}
+	RTreeStreamFlush(&s);
+	if (!s.error)
+		s.error = fwrite(&s.sum, sizeof(s.sum), 1, s.f) != 1;
+	free(queue);
+	return RTreeStreamClose(&s);
+}
+
+/// Save the tree of an index to a file for RTreeIndexLoad.  The index must
+/// not change meanwhile.  Returns 0, or -1 if the file could not be written.
+int RTreeIndexSave(RTreeIndex *t, const char *path) {
+	assert(t);
+	return RTreeSaveTree(t->root, t->nodecard, t->leafcard, t->split, path);
+}
+
+/// Save a tree of the default index to a file for RTreeLoad.
+/// Returns 0, or -1 if the file could not be written.
+int RTreeSave(RTreeNode *root, const char *path) {
+	return RTreeSaveTree(root, NODECARD, LEAFCARD, RTreeSplitQuadratic, path);
+}
+
+// MARK: - Load
+/// Read a header and check it is of a file saved here, and as long as it
+/// says.  The header is read past the buffer, which then checksums the rest
+/// from a multiple of 8 on as the writer did.
+static int RTreeLoadHeader(RTreeStream *s, RTreeSaveHeader *h) {
+	struct stat st;
+
+	if (fread(h, sizeof(RTreeSaveHeader), 1, s->f) != 1 || fstat(fileno(s->f), &st) < 0)
+		return 0;
+	if (memcmp(h->magic, SAVE_MAGIC, sizeof(h->magic)) ||
+		h->version != SAVE_VERSION ||
+		h->byteOrder != MAPPED_BYTEORDER ||
+		h->numdims != NUMDIMS ||
+		h->realSize != sizeof(RectReal) ||
+		h->tidSize != sizeof(uint64_t) ||
+		h->height < 1 || h->nodes < 1 ||
+		h->bytes < sizeof(RTreeSaveHeader) ||
+		h->bytes != (uint64_t)st.st_size - sizeof(uint64_t) ||
+		h->nodes > h->bytes / (2 * sizeof(int16_t)))
+		return 0;
+	s->sum = RTreeChecksum(0, (unsigned char *)h, sizeof(RTreeSaveHeader));
+	s->left = h->bytes - sizeof(RTreeSaveHeader);
+	return 1;
+}
+
+/// Read the nodes into nodes[0] to nodes[h->nodes-1], the root first, and
+/// link them up.  t gives the fanout they must keep to.
+/// Returns 0 if the file is whole and well formed.
+static int RTreeLoadNodes(RTreeStream *s, RTreeSaveHeader *h, RTreeIndex *t, RTreeNode **nodes) {
+	int16_t head[2];
+	uint64_t tid, sum;
+	size_t k, next = 1;
+	register RTreeNode *n;
+	register int i, side;
+
+	for (k=0; k<h->nodes && !s->error; k++)
+	{
+		n = nodes[k];
+		RTreeStreamRead(s, head, sizeof(head));
+		memset(n, 0, sizeof(RTreeNode));
+		n->level = head[0];
+		n->count = head[1];
+		if (s->error || n->level < 0 || (k == 0 && n->level != h->height - 1) ||
+			n->count < 0 || n->count > MAXKIDS(t, n))
+			return -1;
+		for (side=0; side<NUMSIDES; side++)
+			RTreeStreamRead(s, n->bound[side], n->count * sizeof(RectReal));
+		if (n->level == 0)
+		{
+			for (i=0; i<n->count; i++)
+			{
+				RTreeStreamRead(s, &tid, sizeof(tid));
+				n->child[i] = (RTreeNode *)(uintptr_t)tid;
+			}
+			continue;
+		}
+		if (next + n->count > h->nodes)
+			return -1;
+		for (i=0; i<n->count; i++)
+			n->child[i] = nodes[next++];
+	}
+	if (s->error || next != h->nodes)
+		return -1;
+
+	/* the children come after their parents, so their levels are read now */
+	for (k=0; k<h->nodes; k++)
+		if (nodes[k]->level > 0)
+			for (i=0; i<nodes[k]->count; i++)
+				if (nodes[k]->child[i]->level != nodes[k]->level - 1)
+					return -1;
+	/* and their totals, the children first */
+	for (k=h->nodes; k>0; k--)
+		RTreeAggregateFix(nodes[k-1]);
+
+	sum = s->sum;
+	RTreeStreamRead(s, &tid, sizeof(tid));
+	return !s->error && s->left == 0 && tid == sum ? 0 : -1;
+}
+
+/// Load a tree saved by RTreeIndexSave into a new index of the same fanout
+/// and split method.  All of its nodes come from the arena in one slab.
+/// Returns NULL if the file cannot be read, is not one saved here, or is
+/// damaged.
+RTreeIndex * RTreeIndexLoad(const char *path) {
+	RTreeSaveHeader h;
+	RTreeStream s;
+	RTreeIndex *t = NULL;
+	RTreeNode **nodes = NULL, *block;
+	size_t k;
+
+	assert(path);
+	if (RTreeStreamOpen(&s, path, "rb") < 0)
+		return NULL;
+	if (!RTreeLoadHeader(&s, &h) ||
+		(unsigned)h.split > RTreeSplitRStar ||
+		!(t = RTreeIndexNew(h.nodecard, h.leafcard, (RTreeSplitMethod)h.split)))
+	{
+		RTreeStreamClose(&s);
+		return NULL;
+	}
+
+	RTreeIndexFreeTree(t);	/* the empty root */
+	block = RTreeArenaReserve(t->arena, h.nodes);
+	nodes = (RTreeNode **)malloc(h.nodes * sizeof(RTreeNode *));
+	assert(nodes);
+	for (k=0; k<h.nodes; k++)
+		nodes[k] = &block[k];
+	t->root = nodes[0];
+
+	if (RTreeLoadNodes(&s, &h, t, nodes) < 0)
+	{
+		RTreeIndexFree(t);
+		t = NULL;
+	}
+	free(nodes);
+	RTreeStreamClose(&s);
+	return t;
+}
+
+/// Load a tree saved by RTreeSave for the default index, whose fanout must
+/// be as large.  Its nodes are allocated one by one, since the default index
+/// frees them so.  Returns NULL if the file cannot be read, is not one saved
+/// here, or is damaged.
+RTreeNode * RTreeLoad(const char *path) {
+	RTreeSaveHeader h;
+	RTreeStream s;
+	RTreeNode **nodes, *root = NULL;
+	size_t k;
+
+	assert(path);
+	if (RTreeStreamOpen(&s, path, "rb") < 0)
+		return NULL;
+	if (!RTreeLoadHeader(&s, &h) || h.nodecard > NODECARD || h.leafcard > LEAFCARD)
+	{
+		RTreeStreamClose(&s);
+		return NULL;
+	}
+
+	nodes = (RTreeNode **)malloc(h.nodes * sizeof(RTreeNode *));
+	assert(nodes);
+	for (k=0; k<h.nodes; k++)
+		nodes[k] = RTreeNewNode();
+	if (RTreeLoadNodes(&s, &h, RTreeDefaultIndex(), nodes) == 0)
+		root = nodes[0];
+	else
+		for (k=0; k<h.nodes; k++)
+			RTreeFreeNode(nodes[k]);
+	free(nodes);
+	RTreeStreamClose(&s);
+	return root;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* state of one batched search */
+typedef struct _RTreeBatch
+{
+	RTreeRect *queries;
+	size_t nq;
+	RTreeSearchMode mode;
+	size_t *active;	/* per level, the queries still active in a node of it */
+	uint64_t *masks;	/* per level, the node mask of every active query */
+	RTreeBatchHit *hits;
+	size_t maxhits, count, total;
+	RTreeBatchFlushCallback flush;
+	void *cbarg;
+} RTreeBatch;
+
+/// Report a hit.  Returns 0 if the flush callback terminated the search.
+static int RTreeBatchFound(RTreeBatch *b, void *tid, size_t query) {
+	RTreeStatsAdd(hits, 1);
+	if (b->count == b->maxhits)
+	{
+		if (!b->flush)	/* no room left, just count */
+		{
+			b->total++;
+			return 1;
+		}
+		if (!b->flush(b->hits, b->count, b->cbarg))
+			return 0;
+		b->count = 0;
+	}
+	b->hits[b->count].tid = tid;
+	b->hits[b->count].query = query;
+	b->count++;
+	b->total++;
+	return 1;
+}
+
+/// Visit a node for the na queries listed in act.
+/// The node is tested against every one of them while it is in cache, then
+/// each child is visited once for the queries that go on into it.
+static int RTreeBatchNode(RTreeBatch *b, RTreeNode *n, size_t *act, size_t na) {
+	uint64_t *mask = b->masks + (size_t)n->level * b->nq * MASKWORDS, m, any[MASKWORDS];
+	size_t *sub, k, ns;
+	register int i, w;
+
+	RTreeStatsVisit(n);
+	for (k=0; k<na; k++)
+		RTreeNodeSearchMask(n, &b->queries[act[k]], b->mode, &mask[k*MASKWORDS]);
+
+	if (n->level == 0) /* this is a leaf node */
+	{
+		for (k=0; k<na; k++)
+			for (w=0; w<MASKWORDS; w++)
+				for (m=mask[k*MASKWORDS+w]; m; m&=m-1)
+				{
+					i = 64*w + MaskLowest(m);
+					if (!RTreeBatchFound(b, n->child[i], act[k]))
+						return 0;
+				}
+		return 1;
+	}
+
+	/* only the children some query goes into */
+	for (w=0; w<MASKWORDS; w++)
+		for (any[w]=0, k=0; k<na; k++)
+			any[w] |= mask[k*MASKWORDS+w];
+
+	sub = b->active + (size_t)(n->level-1) * b->nq;
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=any[w]; m; m&=m-1)
+		{
+			i = MaskLowest(m);
+			for (k=ns=0; k<na; k++)
+				if (mask[k*MASKWORDS+w] >> i & 1)
+					sub[ns++] = act[k];
+			if (!RTreeBatchNode(b, n->child[64*w+i], sub, ns))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/// Search a tree for many rects at once, in a single walk down it that
+/// carries along the queries still active in each subtree, so the upper
+/// nodes are loaded once for the whole batch instead of once per query.
+/// Hits go into the hits buffer tagged with the index of their query.
+/// With a flush callback, every full buffer and finally the rest are handed
+/// to it, and the number of hits is returned.  Without one the search stops
+/// storing when the buffer is full; it returns the number of hits there are,
+/// which is more than maxhits if some did not fit.
+size_t RTreeSearchBatch(RTreeNode *root, RTreeRect *queries, size_t nq, RTreeSearchMode mode, RTreeBatchHit *hits, size_t maxhits, RTreeBatchFlushCallback flush, void *cbarg) {
+	RTreeBatch b;
+	size_t k, levels;
+	int done;
+
+	assert(root && root->level >= 0);
+	assert(queries || nq == 0);
+	assert(hits && maxhits > 0);
+	if (nq == 0)
+		return 0;
+
+	levels = (size_t)root->level + 1;
+	b.queries = queries;
+	b.nq = nq;
+	b.mode = mode;
+	b.active = (size_t *)malloc(levels * nq * sizeof(size_t));
+	b.masks = (uint64_t *)malloc(levels * nq * MASKWORDS * sizeof(uint64_t));
+	assert(b.active && b.masks);
+	b.hits = hits;
+	b.maxhits = maxhits;
+	b.count = b.total = 0;
+	b.flush = flush;
+	b.cbarg = cbarg;
+
+	/* the root is visited for every query, its list is kept in the top level */
+	for (k=0; k<nq; k++)
+		b.active[root->level * nq + k] = k;
+	done = RTreeBatchNode(&b, root, &b.active[root->level * nq], nq);
+	if (done && flush && b.count)
+		flush(b.hits, b.count, cbarg);
+
+	free(b.active);
+	free(b.masks);
+	return b.total;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* batch chunks a parallel batched search aims to give each worker */
+#define BATCH_TASKS_PER_THREAD 8
+
+/* hits a chunk of a batch collects before it copies them out */
+#define BATCH_FLUSH 256
+
+/* state of one parallel search, shared by its workers */
+typedef struct _RTreeParallel
+{
+	RTreeThreadPool *pool;
+	RTreeNode *root;
+	RTreeRect *queries;
+	RTreeSearchMode mode;
+	RTreeHitBuffer *buffers;	/* one per worker */
+} RTreeParallel;
+
+/* a chunk of a batch, the queries [first, first+count) */
+typedef struct _RTreeBatchTask
+{
+	size_t first, count;
+} RTreeBatchTask;
+
+/* where a chunk of a batch copies its hits */
+typedef struct _RTreeBatchOut
+{
+	RTreeHitBuffer *buffer;
+	size_t first;
+} RTreeBatchOut;
+
+/// Make room for n more hits in a buffer.
+static void RTreeHitBufferReserve(RTreeHitBuffer *buf, size_t n) {
+	RTreeBatchHit *hits;
+	size_t capacity;
+
+	if (buf->count + n <= buf->capacity)
+		return;
+	capacity = buf->capacity ? buf->capacity : 1024;
+	while (capacity < buf->count + n)
+		capacity *= 2;
+	hits = (RTreeBatchHit *)realloc(buf->hits, capacity * sizeof(RTreeBatchHit));
+	assert(hits);
+	buf->hits = hits;
+	buf->capacity = capacity;
+}
+
+/// Search a subtree on one worker, appending the hits to its buffer.
+static void RTreeParallelSubtree(RTreeParallel *p, RTreeNode *n, RTreeHitBuffer *buf) {
+	uint64_t mask[MASKWORDS], m;
+	register int i, w;
+
+	RTreeNodeSearchMask(n, p->queries, p->mode, mask);
+	RTreeStatsVisit(n);
+	if (n->level == 0)
+		RTreeHitBufferReserve(buf, n->count);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=mask[w]; m; m&=m-1)
+		{
+			i = 64*w + MaskLowest(m);
+			if (n->level > 0)
+				RTreeParallelSubtree(p, n->child[i], buf);
+			else
+			{
+				RTreeStatsAdd(hits, 1);
+				buf->hits[buf->count].tid = n->child[i];
+				buf->hits[buf->count].query = 0;
+				buf->count++;
+			}
+		}
+	}
+}
+
+/// Run the task of a node: above the cutoff hand its children on as tasks,
+/// to be stolen by idle workers, else search it whole.
+static void RTreeParallelTask(void *task, int worker, void *arg) {
+	RTreeParallel *p = (RTreeParallel *)arg;
+	RTreeNode *n = *(RTreeNode **)task;
+	uint64_t mask[MASKWORDS], m;
+	register int i, w;
+
+	if (n->level <= PARALLEL_CUTOFF)
+	{
+		RTreeParallelSubtree(p, n, &p->buffers[worker]);
+		return;
+	}
+	RTreeNodeSearchMask(n, p->queries, p->mode, mask);
+	RTreeStatsVisit(n);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=mask[w]; m; m&=m-1)
+		{
+			i = 64*w + MaskLowest(m);
+			RTreeThreadPoolPush(p->pool, worker, &n->child[i]);
+		}
+	}
+}
+
+/// Search a tree for a rect on the workers of a pool.
+/// Subtrees above PARALLEL_CUTOFF are split into tasks for their children;
+/// the ones below are searched whole by the worker that takes them, which
+/// adds the hits to its own buffer, buffers[worker], all tagged as query 0.
+/// There must be RTreeThreadPoolSize(pool) buffers, zeroed or left from an
+/// earlier search, and they are emptied first.  Returns the number of hits.
+size_t RTreeSearchParallel(RTreeNode *root, RTreeRect *r, RTreeSearchMode mode, RTreeThreadPool *pool, RTreeHitBuffer *buffers) {
+	RTreeParallel p;
+	size_t total;
+	int w;
+	RTreeStatsTimer(timer);
+
+	assert(root && root->level >= 0);
+	assert(r && pool && buffers);
+	RTreeStatsStart(timer);
+	for (w=0; w<pool->threads; w++)
+		buffers[w].count = 0;
+
+	p.pool = pool;
+	p.root = root;
+	p.queries = r;
+	p.mode = mode;
+	p.buffers = buffers;
+	RTreeThreadPoolRun(pool, &root, 1, sizeof(RTreeNode *), RTreeParallelTask, &p);
+
+	for (total=0, w=0; w<pool->threads; w++)
+		total += buffers[w].count;
+	RTreeStatsStop(RTreeStatsSearch, timer);
+	return total;
+}
+
+/// Copy the hits of a chunk to the buffer of its worker, as hits of the
+/// whole batch.
+static int RTreeBatchOutFlush(RTreeBatchHit *hits, size_t count, void *cbarg) {
+	RTreeBatchOut *out = (RTreeBatchOut *)cbarg;
+	RTreeHitBuffer *buf = out->buffer;
+	size_t k;
+
+	RTreeHitBufferReserve(buf, count);
+	for (k=0; k<count; k++)
+	{
+		buf->hits[buf->count].tid = hits[k].tid;
+		buf->hits[buf->count].query = out->first + hits[k].query;
+		buf->count++;
+	}
+	return 1;
+}
+
+static void RTreeBatchTaskRun(void *task, int worker, void *arg) {
+	RTreeParallel *p = (RTreeParallel *)arg;
+	RTreeBatchTask *t = (RTreeBatchTask *)task;
+	RTreeBatchHit hits[BATCH_FLUSH];
+	RTreeBatchOut out;
+
+	out.buffer = &p->buffers[worker];
+	out.first = t->first;
+	RTreeSearchBatch(p->root, &p->queries[t->first], t->count, p->mode, hits, BATCH_FLUSH, RTreeBatchOutFlush, &out);
+}
+
+/// Search a tree for many rects on the workers of a pool.
+/// The queries are cut into chunks, each searched by RTreeSearchBatch on the
+/// worker that takes it, which adds the hits to its own buffer,
+/// buffers[worker], tagged with the index of their query.  There must be
+/// RTreeThreadPoolSize(pool) buffers, zeroed or left from an earlier search,
+/// and they are emptied first.  Returns the number of hits.
+size_t RTreeSearchBatchParallel(RTreeNode *root, RTreeRect *queries, size_t nq, RTreeSearchMode mode, RTreeThreadPool *pool, RTreeHitBuffer *buffers) {
+	RTreeParallel p;
+	RTreeBatchTask *tasks;
+	size_t k, chunk, ntasks, total;
+	int w;
+
+	assert(root && root->level >= 0);
+	assert(queries || nq == 0);
+	assert(pool && buffers);
+	for (w=0; w<pool->threads; w++)
+		buffers[w].count = 0;
+	if (nq == 0)
+		return 0;
+
+	p.pool = pool;
+	p.root = root;
+	p.queries = queries;
+	p.mode = mode;
+	p.buffers = buffers;
+
+	chunk = nq / ((size_t)pool->threads * BATCH_TASKS_PER_THREAD);
+	if (chunk == 0)
+		chunk = 1;
+	ntasks = (nq + chunk - 1) / chunk;
+	tasks = (RTreeBatchTask *)malloc(ntasks * sizeof(RTreeBatchTask));
+	assert(tasks);
+	for (k=0; k<ntasks; k++)
+	{
+		tasks[k].first = k * chunk;
+		tasks[k].count = k+1 < ntasks ? chunk : nq - tasks[k].first;
+	}
+	RTreeThreadPoolRun(pool, tasks, ntasks, sizeof(RTreeBatchTask), RTreeBatchTaskRun, &p);
+	free(tasks);
+
+	for (total=0, w=0; w<pool->threads; w++)
+		total += buffers[w].count;
+	return total;
+}
+
+/// Free the hits of a buffer.
+void RTreeHitBufferFree(RTreeHitBuffer *buf) {
+	assert(buf);
+	free(buf->hits);
+	buf->hits = NULL;
+	buf->count = buf->capacity = 0;
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* a slot of the fresh set whose node was freed again */
+#define REMOVED ((RTreeNode *)1)
+
+/* the high half of the product: nodes are 512 bytes apart, so the low bits of any multiple of them are the same */
+#define Hash(n) (((uintptr_t)(n) * 0x9E3779B97F4A7C15ull) >> 32)
+
+/// Make a new version with the given root, held once as the current one.
+static RTreeSnapshot * RTreeSnapshotNew(RTreeNode *root) {
+	RTreeSnapshot *s;
+
+	s = (RTreeSnapshot *)malloc(sizeof(RTreeSnapshot));
+	assert(s);
+	memset(s, 0, sizeof(RTreeSnapshot));
+	s->root = root;
+	s->refs = 1;
+	return s;
+}
+
+/// Turn snapshots on for an index: from now on its updates copy the nodes
+/// they change, and become visible to readers at RTreeIndexCommit.
+/// The index must have an arena; the tree as it is becomes the first version.
+/// Not together with the locator.
+void RTreeIndexEnableSnapshots(RTreeIndex *t) {
+	RTreeVersions *v;
+
+	assert(t && t->arena && t->root);
+	assert(!t->locator);
+	if (t->versions)
+		return;
+
+	v = (RTreeVersions *)malloc(sizeof(RTreeVersions));
+	assert(v);
+	memset(v, 0, sizeof(RTreeVersions));
+	pthread_mutex_init(&v->lock, NULL);
+	v->oldest = v->current = RTreeSnapshotNew(t->root);
+	t->versions = v;
+}
+
+/// Put a node in the hash set of fresh nodes, growing it past half full.
+static void RTreeFreshInsert(RTreeVersions *v, RTreeNode *n) {
+	size_t k, mask = v->freshCapacity - 1;
+
+	for (k = Hash(n) & mask; v->fresh[k] && v->fresh[k] != REMOVED; k = (k + 1) & mask)
+		;
+	if (!v->fresh[k])
+		v->freshUsed++;
+	v->fresh[k] = n;
+	v->freshCount++;
+}
+
+static void RTreeFreshGrow(RTreeVersions *v) {
+	RTreeNode **old = v->fresh;
+	size_t k, capacity = v->freshCapacity;
+
+	if (2 * v->freshCount >= capacity)
+		v->freshCapacity = capacity ? 2 * capacity : 64;
+	v->fresh = (RTreeNode **)calloc(v->freshCapacity, sizeof(RTreeNode *));
+	assert(v->fresh);
+	v->freshCount = v->freshUsed = 0;
+	for (k=0; k<capacity; k++)
+		if (old[k] && old[k] != REMOVED)
+			RTreeFreshInsert(v, old[k]);
+	free(old);
+}
+
+/// Remember a node made since the last commit; no reader can have seen it.
+void RTreeSnapshotAddFresh(RTreeVersions *v, RTreeNode *n) {
+	assert(v && n);
+	if (2 * (v->freshUsed + 1) > v->freshCapacity)
+		RTreeFreshGrow(v);
+	RTreeFreshInsert(v, n);
+}
+
+/// Find the slot of a node in the fresh set, or -1.
+static long RTreeFreshFind(RTreeVersions *v, RTreeNode *n) {
+	size_t k, mask = v->freshCapacity - 1;
+
+	if (v->freshCount == 0)
+		return -1;
+	for (k = Hash(n) & mask; v->fresh[k]; k = (k + 1) & mask)
+		if (v->fresh[k] == n)
+			return (long)k;
+	return -1;
+}
+
+/// Whether a node was made since the last commit, and so may be written.
+int RTreeSnapshotIsFresh(RTreeVersions *v, RTreeNode *n) {
+	assert(v && n);
+	return RTreeFreshFind(v, n) >= 0;
+}
+
+/// Add a node of the current version to the ones the next version replaces.
+static void RTreeSnapshotAddRetired(RTreeSnapshot *s, RTreeNode *n) {
+	RTreeNode **retired;
+	size_t capacity;
+
+	if (s->retiredCount == s->retiredCapacity)
+	{
+		capacity = s->retiredCapacity ? 2 * s->retiredCapacity : 64;
+		retired = (RTreeNode **)realloc(s->retired, capacity * sizeof(RTreeNode *));
+		assert(retired);
+		s->retired = retired;
+		s->retiredCapacity = capacity;
+	}
+	s->retired[s->retiredCount++] = n;
+}
+
+/// Called for a node the writer frees.  A fresh node is just forgotten, and
+/// the caller frees it; a node readers may be on is kept until they are gone.
+/// Returns 1 if the node was kept, 0 if the caller is to free it.
+int RTreeSnapshotRetire(RTreeIndex *t, RTreeNode *n) {
+	RTreeVersions *v = t->versions;
+	long k;
+
+	assert(v && n);
+	k = RTreeFreshFind(v, n);
+	if (k >= 0)
+	{
+		v->fresh[k] = REMOVED;
+		v->freshCount--;
+		return 0;
+	}
+	RTreeSnapshotAddRetired(v->current, n);
+	return 1;
+}
+
+/// A node of an index that may be written: the node itself, unless readers
+/// may be on it, then a copy that replaces it in the next version.  The
+/// caller puts the copy in place of the node, in a parent that is writable
+/// itself, or as the root.
+RTreeNode * RTreeIndexWritable(RTreeIndex *t, RTreeNode *n) {
+	RTreeNode *c;
+
+	assert(t && n);
+	if (!t->versions || RTreeSnapshotIsFresh(t->versions, n))
+		return n;
+	c = RTreeIndexNewNode(t);
+	memcpy(c, n, sizeof(RTreeNode));
+	RTreeSnapshotAddRetired(t->versions->current, n);
+	return c;
+}
+
+/// Free the versions no reader holds any more, oldest first, with the nodes
+/// replaced since each.  A version is only freed after all older ones, since
+/// the nodes replaced since it may be part of those too.
+static void RTreeSnapshotReclaim(RTreeIndex *t) {
+	RTreeVersions *v = t->versions;
+	RTreeSnapshot *s, *done, *next;
+	size_t k;
+
+	pthread_mutex_lock(&v->lock);
+	done = v->oldest;
+	for (s=v->oldest; s != v->current && s->refs == 0; s=s->newer)
+		;
+	v->oldest = s;
+	pthread_mutex_unlock(&v->lock);
+
+	while (done != s)
+	{
+		for (k=0; k<done->retiredCount; k++)
+			RTreeArenaFreeNode(t->arena, done->retired[k]);
+		free(done->retired);
+		next = done->newer;
+		free(done);
+		done = next;
+	}
+}
+
+/// Publish the tree as it is now as the current version, for the readers
+/// acquiring a snapshot from now on, and free what older versions no
+/// reader holds any more.  Every update since the last commit becomes
+/// visible at once.  Called by the writer.
+void RTreeIndexCommit(RTreeIndex *t) {
+	RTreeVersions *v;
+	RTreeSnapshot *s, *old;
+
+	assert(t && t->versions);
+	v = t->versions;
+	if (t->root != v->current->root || v->freshCount || v->current->retiredCount)
+	{
+		s = RTreeSnapshotNew(t->root);
+		pthread_mutex_lock(&v->lock);
+		old = v->current;
+		old->newer = s;
+		old->refs--;
+		v->current = s;
+		pthread_mutex_unlock(&v->lock);
+
+		/* a set grown by a big batch goes, rather than be cleared every time */
+		if (v->freshCapacity > 1024 && 8 * v->freshUsed < v->freshCapacity)
+		{
+			free(v->fresh);
+			v->fresh = NULL;
+			v->freshCapacity = 0;
+		}
+		else if (v->freshUsed)
+			memset(v->fresh, 0, v->freshCapacity * sizeof(RTreeNode *));
+		v->freshCount = v->freshUsed = 0;
+	}
+	RTreeSnapshotReclaim(t);
+}
+
+/// Hold the current version of an index, whose tree stays as it is, even
+/// through later commits, until the snapshot is released.  Search it from
+/// its root.  Safe to call from any thread.
+RTreeSnapshot * RTreeSnapshotAcquire(RTreeIndex *t) {
+	RTreeVersions *v;
+	RTreeSnapshot *s;
+
+	assert(t && t->versions);
+	v = t->versions;
+	pthread_mutex_lock(&v->lock);
+	s = v->current;
+	s->refs++;
+	pthread_mutex_unlock(&v->lock);
+	return s;
+}
+
+/// Let go of a snapshot.  Its nodes are freed by a later commit of the
+/// writer.  Safe to call from any thread.
+void RTreeSnapshotRelease(RTreeIndex *t, RTreeSnapshot *s) {
+	RTreeVersions *v;
+
+	assert(t && t->versions && s);
+	v = t->versions;
+	pthread_mutex_lock(&v->lock);
+	assert(s->refs > 0);
+	s->refs--;
+	pthread_mutex_unlock(&v->lock);
+}
+
+/// Free the versions of an index along with the index.  Their nodes go
+/// with the arena.  No reader may hold a snapshot any more.
+void RTreeSnapshotFreeVersions(RTreeIndex *t) {
+	RTreeVersions *v = t->versions;
+	RTreeSnapshot *s, *newer;
+
+	if (!v)
+		return;
+	for (s=v->oldest; s; s=newer)
+	{
+		newer = s->newer;
+		free(s->retired);
+		free(s);
+	}
+	free(v->fresh);
+	pthread_mutex_destroy(&v->lock);
+	free(v);
+	t->versions = NULL;
+}
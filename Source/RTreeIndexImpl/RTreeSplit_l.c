@@ -5,25 +5,9 @@
 
 // #include "include/RTreeSplit_l.h"
 
-#define METHODS 1
-
-static RTreeBranch BranchBuf[MAXCARD+1];
-static int BranchCount;
-static RTreeRect CoverSplit;
-
-/* variables for finding a partition */
-static struct PartitionVars
-{
-	int partition[MAXCARD+1];
-	int total, minfill;
-	int taken[MAXCARD+1];
-	int count[2];
-	RTreeRect cover[2];
-	RectReal area[2];
-} Partitions[METHODS];
-
 /// Load branch buffer with branches from full node plus the extra branch.
-static void RTreeGetBranches(RTreeNode *N, RTreeBranch *B) {
+static void RTreeGetBranches(RTreeIndex *t, RTreeNode *N, RTreeBranch *B) {
+	register RTreeSplitVars *s = &t->splitVars;
 	register RTreeNode *n = N;
 	register RTreeBranch *b = B;
 	register int i;
@@ -32,27 +16,27 @@ static void RTreeGetBranches(RTreeNode *N, RTreeBranch *B) {
 	assert(b);
 
 	/* load the branch buffer */
-	for (i=0; i<MAXKIDS(n); i++)
+	for (i=0; i<MAXKIDS(t, n); i++)
 	{
-		assert(n->branch[i].child);  /* every entry should be full */
-		BranchBuf[i] = n->branch[i];
+		assert(n->child[i]);  /* every entry should be full */
+		s->branch[i] = RTreeNodeGetBranch(n, i);
 	}
-	BranchBuf[MAXKIDS(n)] = *b;
-	BranchCount = MAXKIDS(n) + 1;
+	s->branch[MAXKIDS(t, n)] = *b;
+	s->count = MAXKIDS(t, n) + 1;
 
 	/* calculate rect containing all in the set */
-	CoverSplit = BranchBuf[0].rect;
-	for (i=1; i<MAXKIDS(n)+1; i++)
+	s->cover = s->branch[0].rect;
+	for (i=1; i<s->count; i++)
 	{
-		CoverSplit = RTreeCombineRect(&CoverSplit, &BranchBuf[i].rect);
+		s->cover = RTreeCombineRect(&s->cover, &s->branch[i].rect);
 	}
 
 	RTreeInitNode(n);
 }
 
 /// Initialize a PartitionVars structure.
-static void RTreeInitPVars(struct PartitionVars *P, int maxrects, int minfill) {
-	register struct PartitionVars *p = P;
+static void RTreeInitPVars(RTreePartitionVars *P, int maxrects, int minfill) {
+	register RTreePartitionVars *p = P;
 	register int i;
 	assert(p);
 
@@ -67,7 +51,7 @@ static void RTreeInitPVars(struct PartitionVars *P, int maxrects, int minfill) {
 }
 
 /// Put a branch in one of the groups.
-static void RTreeClassify(int i, int group, struct PartitionVars *p) {
+static void RTreeClassify(RTreeSplitVars *s, int i, int group, RTreePartitionVars *p) {
 	assert(p);
 	assert(!p->taken[i]);
 
@@ -75,9 +59,9 @@ static void RTreeClassify(int i, int group, struct PartitionVars *p) {
 	p->taken[i] = TRUE;
 
 	if (p->count[group] == 0)
-		p->cover[group] = BranchBuf[i].rect;
+		p->cover[group] = s->branch[i].rect;
 	else
-		p->cover[group] = RTreeCombineRect(&BranchBuf[i].rect,
+		p->cover[group] = RTreeCombineRect(&s->branch[i].rect,
 					&p->cover[group]);
 	p->area[group] = RTreeRectSphericalVolume(&p->cover[group]);
 	p->count[group]++;
@@ -87,8 +71,8 @@ static void RTreeClassify(int i, int group, struct PartitionVars *p) {
 /// Pick the two that are separated most along any dimension, or overlap least.
 /// Distance for separation or overlap is measured modulo the width of the
 /// space covered by the entire set along that dimension.
-static void RTreePickSeeds(struct PartitionVars *P) {
-	register struct PartitionVars *p = P;
+static void RTreePickSeeds(RTreeSplitVars *s, RTreePartitionVars *P) {
+	register RTreePartitionVars *p = P;
 	register int i, dim, high;
 	register RTreeRect *r, *rlow, *rhigh;
 	register float w, separation, bestSep = 0.0;
@@ -104,24 +88,24 @@ static void RTreePickSeeds(struct PartitionVars *P) {
 		/* find the rectangles farthest out in each direction
 		 * along this dimens */
 		greatestLower[dim] = leastUpper[dim] = 0;
-		for (i=1; i<NODECARD+1; i++)
+		for (i=1; i<s->count; i++)
 		{
-			r = &BranchBuf[i].rect;
+			r = &s->branch[i].rect;
 			if (r->boundary[dim] >
-			    BranchBuf[greatestLower[dim]].rect.boundary[dim])
+			    s->branch[greatestLower[dim]].rect.boundary[dim])
 			{
 				greatestLower[dim] = i;
 			}
 			if (r->boundary[high] <
-			    BranchBuf[leastUpper[dim]].rect.boundary[high])
+			    s->branch[leastUpper[dim]].rect.boundary[high])
 			{
 				leastUpper[dim] = i;
 			}
 		}
 
 		/* find width of the whole collection along this dimension */
-		width[dim] = CoverSplit.boundary[high] -
-			     CoverSplit.boundary[dim];
+		width[dim] = s->cover.boundary[high] -
+			     s->cover.boundary[dim];
 	}
 
 	/* pick the best separation dimension and the two seed rects */
@@ -136,8 +120,8 @@ static void RTreePickSeeds(struct PartitionVars *P) {
 		else
 			w = width[dim];
 
-		rlow = &BranchBuf[leastUpper[dim]].rect;
-		rhigh = &BranchBuf[greatestLower[dim]].rect;
+		rlow = &s->branch[leastUpper[dim]].rect;
+		rhigh = &s->branch[greatestLower[dim]].rect;
 		if (dim == 0)
 		{
 			seed0 = leastUpper[0];
@@ -162,8 +146,8 @@ static void RTreePickSeeds(struct PartitionVars *P) {
 
 	if (seed0 != seed1)
 	{
-		RTreeClassify(seed0, 0, p);
-		RTreeClassify(seed1, 1, p);
+		RTreeClassify(s, seed0, 0, p);
+		RTreeClassify(s, seed1, 1, p);
 	}
 }
 
@@ -180,25 +164,25 @@ static void RTreePickSeeds(struct PartitionVars *P) {
 /// 5) Put in group 1 (arbitrary).
 ///
 /// Also update the covers for both groups.
-static void RTreePigeonhole(struct PartitionVars *P) {
-	register struct PartitionVars *p = P;
+static void RTreePigeonhole(RTreeSplitVars *s, RTreePartitionVars *P) {
+	register RTreePartitionVars *p = P;
 	RTreeRect newCover[2];
 	register int i, group;
 	RectReal newArea[2], increase[2];
 
-	for (i=0; i<NODECARD+1; i++)
+	for (i=0; i<s->count; i++)
 	{
 		if (!p->taken[i])
 		{
 			/* if one group too full, put rect in the other */
 			if (p->count[0] >= p->total - p->minfill)
 			{
-				RTreeClassify(i, 1, p);
+				RTreeClassify(s, i, 1, p);
 				continue;
 			}
 			else if (p->count[1] >= p->total - p->minfill)
 			{
-				RTreeClassify(i, 0, p);
+				RTreeClassify(s, i, 0, p);
 				continue;
 			}
 
@@ -207,10 +191,10 @@ static void RTreePigeonhole(struct PartitionVars *P) {
 			{
 				if (p->count[group]>0)
 					newCover[group] = RTreeCombineRect(
-						&BranchBuf[i].rect,
+						&s->branch[i].rect,
 						&p->cover[group]);
 				else
-					newCover[group] = BranchBuf[i].rect;
+					newCover[group] = s->branch[i].rect;
 				newArea[group] = RTreeRectSphericalVolume(
 							&newCover[group]);
 				increase[group] = newArea[group]-p->area[group];
@@ -218,50 +202,50 @@ static void RTreePigeonhole(struct PartitionVars *P) {
 
 			/* put rect in group whose cover will expand less */
 			if (increase[0] < increase[1])
-				RTreeClassify(i, 0, p);
+				RTreeClassify(s, i, 0, p);
 			else if (increase[1] < increase[0])
-				RTreeClassify(i, 1, p);
+				RTreeClassify(s, i, 1, p);
 
 			/* put rect in group that will have a smaller cover */
 			else if (p->area[0] < p->area[1])
-				RTreeClassify(i, 0, p);
+				RTreeClassify(s, i, 0, p);
 			else if (p->area[1] < p->area[0])
-				RTreeClassify(i, 1, p);
+				RTreeClassify(s, i, 1, p);
 
 			/* put rect in group with fewer elements */
 			else if (p->count[0] < p->count[1])
-				RTreeClassify(i, 0, p);
+				RTreeClassify(s, i, 0, p);
 			else
-				RTreeClassify(i, 1, p);
+				RTreeClassify(s, i, 1, p);
 		}
 	}
-	assert(p->count[0] + p->count[1] == NODECARD + 1);
+	assert(p->count[0] + p->count[1] == s->count);
 }
 
 /// Method 0 for finding a partition:
 /// First find two seeds, one for each group, well separated.
 /// Then put other rects in whichever group will be smallest after addition.
-static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
-	RTreeInitPVars(p, BranchCount, minfill);
-	RTreePickSeeds(p);
-	RTreePigeonhole(p);
+static void RTreeMethodZero(RTreeSplitVars *s, RTreePartitionVars *p, int minfill) {
+	RTreeInitPVars(p, s->count, minfill);
+	RTreePickSeeds(s, p);
+	RTreePigeonhole(s, p);
 }
 
 /// Copy branches from the buffer into two nodes according to the partition.
-static void RTreeLoadNodes(RTreeNode *N, RTreeNode *Q, struct PartitionVars *P) {
+static void RTreeLoadNodes(RTreeIndex *t, RTreeNode *N, RTreeNode *Q, RTreePartitionVars *P) {
 	register RTreeNode *n = N, *q = Q;
-	register struct PartitionVars *p = P;
+	register RTreePartitionVars *p = P;
 	register int i;
 	assert(n);
 	assert(q);
 	assert(p);
 
-	for (i=0; i<NODECARD+1; i++)
+	for (i=0; i<p->total; i++)
 	{
 		if (p->partition[i] == 0)
-			RTreeAddBranch(&BranchBuf[i], n, NULL);
+			RTreeIndexAddBranch(t, &t->splitVars.branch[i], n, NULL);
 		else if (p->partition[i] == 1)
-			RTreeAddBranch(&BranchBuf[i], q, NULL);
+			RTreeIndexAddBranch(t, &t->splitVars.branch[i], q, NULL);
 		else
 			assert(FALSE);
 	}
@@ -270,30 +254,28 @@ static void RTreeLoadNodes(RTreeNode *N, RTreeNode *Q, struct PartitionVars *P)
 /// Split a node.
 /// Divides the nodes branches and the extra one between two nodes.
 /// Old node is one of the new ones, and one really new one is created.
-void RTreeSplitNodeLinear(RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
-	register struct PartitionVars *p;
+void RTreeSplitNodeLinear(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
+	register RTreePartitionVars *p;
 	register int level;
-	RectReal area;
 
+	assert(t);
 	assert(n);
 	assert(b);
+	RTreeStatsAdd(splits[RTreeSplitLinear], 1);
 
 	/* load all the branches into a buffer, initialize old node */
 	level = n->level;
-	RTreeGetBranches(n, b);
+	RTreeGetBranches(t, n, b);
 
 	/* find partition */
-	p = &Partitions[0];
+	p = &t->splitVars.partition;
 
 	/* Note: can't use MINFILL(n) below since n was cleared by GetBranches() */
-	RTreeMethodZero(p, level>0 ? MinNodeFill : MinLeafFill);
-
-	/* record how good the split was for statistics */
-	area = p->area[0] + p->area[1];
+	RTreeMethodZero(&t->splitVars, p, level>0 ? MinNodeFill(t) : MinLeafFill(t));
 
 	/* put branches from buffer in 2 nodes according to chosen partition */
-	*nn = RTreeNewNode();
+	*nn = RTreeIndexNewNode(t);
 	(*nn)->level = n->level = level;
-	RTreeLoadNodes(n, *nn, p);
-	assert(n->count + (*nn)->count == NODECARD+1);
+	RTreeLoadNodes(t, n, *nn, p);
+	assert(n->count + (*nn)->count == p->total);
 }
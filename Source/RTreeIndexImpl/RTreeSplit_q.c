@@ -5,53 +5,36 @@
 
 // #include "include/RTreeSplit_q.h"
 
-#define METHODS 1
-
-static RTreeBranch BranchBuf[MAXCARD+1];
-static int BranchCount;
-static RTreeRect CoverSplit;
-static RectReal CoverSplitArea;
-
-/* variables for finding a partition */
-static struct PartitionVars
-{
-	int partition[MAXCARD+1];
-	int total, minfill;
-	int taken[MAXCARD+1];
-	int count[2];
-	RTreeRect cover[2];
-	RectReal area[2];
-} Partitions[METHODS];
-
 /// Load branch buffer with branches from full node plus the extra branch.
-static void RTreeGetBranches(RTreeNode *n, RTreeBranch *b) {
+static void RTreeGetBranches(RTreeIndex *t, RTreeNode *n, RTreeBranch *b) {
+	register RTreeSplitVars *s = &t->splitVars;
 	register int i;
 
 	assert(n);
 	assert(b);
 
 	/* load the branch buffer */
-	for (i=0; i<MAXKIDS(n); i++)
+	for (i=0; i<MAXKIDS(t, n); i++)
 	{
-		assert(n->branch[i].child); /* n should have every entry full */
-		BranchBuf[i] = n->branch[i];
+		assert(n->child[i]); /* n should have every entry full */
+		s->branch[i] = RTreeNodeGetBranch(n, i);
 	}
-	BranchBuf[MAXKIDS(n)] = *b;
-	BranchCount = MAXKIDS(n) + 1;
+	s->branch[MAXKIDS(t, n)] = *b;
+	s->count = MAXKIDS(t, n) + 1;
 
 	/* calculate rect containing all in the set */
-	CoverSplit = BranchBuf[0].rect;
-	for (i=1; i<MAXKIDS(n)+1; i++)
+	s->cover = s->branch[0].rect;
+	for (i=1; i<s->count; i++)
 	{
-		CoverSplit = RTreeCombineRect(&CoverSplit, &BranchBuf[i].rect);
+		s->cover = RTreeCombineRect(&s->cover, &s->branch[i].rect);
 	}
-	CoverSplitArea = RTreeRectSphericalVolume(&CoverSplit);
+	s->coverArea = RTreeRectSphericalVolume(&s->cover);
 
 	RTreeInitNode(n);
 }
 
 /// Put a branch in one of the groups.
-static void RTreeClassify(int i, int group, struct PartitionVars *p) {
+static void RTreeClassify(RTreeSplitVars *s, int i, int group, RTreePartitionVars *p) {
 	assert(p);
 	assert(!p->taken[i]);
 
@@ -59,31 +42,31 @@ static void RTreeClassify(int i, int group, struct PartitionVars *p) {
 	p->taken[i] = TRUE;
 
 	if (p->count[group] == 0)
-		p->cover[group] = BranchBuf[i].rect;
+		p->cover[group] = s->branch[i].rect;
 	else
 		p->cover[group] =
-			RTreeCombineRect(&BranchBuf[i].rect, &p->cover[group]);
+			RTreeCombineRect(&s->branch[i].rect, &p->cover[group]);
 	p->area[group] = RTreeRectSphericalVolume(&p->cover[group]);
 	p->count[group]++;
 }
 
 /// Pick two rects from set to be the first elements of the two groups.
 /// Pick the two that waste the most area if covered by a single rectangle.
-static void RTreePickSeeds(struct PartitionVars *p) {
+static void RTreePickSeeds(RTreeSplitVars *s, RTreePartitionVars *p) {
 	register int i, j, seed0 = 0, seed1 = 0;
 	RectReal worst, waste, area[MAXCARD+1];
 
 	for (i=0; i<p->total; i++)
-		area[i] = RTreeRectSphericalVolume(&BranchBuf[i].rect);
+		area[i] = RTreeRectSphericalVolume(&s->branch[i].rect);
 
-	worst = -CoverSplitArea - 1;
+	worst = -s->coverArea - 1;
 	for (i=0; i<p->total-1; i++)
 	{
 		for (j=i+1; j<p->total; j++)
 		{
 			RTreeRect one_rect = RTreeCombineRect(
-						&BranchBuf[i].rect,
-						&BranchBuf[j].rect);
+						&s->branch[i].rect,
+						&s->branch[j].rect);
 			waste = RTreeRectSphericalVolume(&one_rect) -
 					area[i] - area[j];
 			if (waste > worst)
@@ -94,12 +77,12 @@ static void RTreePickSeeds(struct PartitionVars *p) {
 			}
 		}
 	}
-	RTreeClassify(seed0, 0, p);
-	RTreeClassify(seed1, 1, p);
+	RTreeClassify(s, seed0, 0, p);
+	RTreeClassify(s, seed1, 1, p);
 }
 
 /// Copy branches from the buffer into two nodes according to the partition.
-static void RTreeLoadNodes(RTreeNode *n, RTreeNode *q, struct PartitionVars *p) {
+static void RTreeLoadNodes(RTreeIndex *t, RTreeNode *n, RTreeNode *q, RTreePartitionVars *p) {
 	register int i;
 	assert(n);
 	assert(q);
@@ -109,14 +92,14 @@ static void RTreeLoadNodes(RTreeNode *n, RTreeNode *q, struct PartitionVars *p)
 	{
 		assert(p->partition[i] == 0 || p->partition[i] == 1);
 		if (p->partition[i] == 0)
-			RTreeAddBranch(&BranchBuf[i], n, NULL);
+			RTreeIndexAddBranch(t, &t->splitVars.branch[i], n, NULL);
 		else if (p->partition[i] == 1)
-			RTreeAddBranch(&BranchBuf[i], q, NULL);
+			RTreeIndexAddBranch(t, &t->splitVars.branch[i], q, NULL);
 	}
 }
 
 /// Initialize a PartitionVars structure.
-static void RTreeInitPVars(struct PartitionVars *p, int maxrects, int minfill) {
+static void RTreeInitPVars(RTreePartitionVars *p, int maxrects, int minfill) {
 	register int i;
 	assert(p);
 
@@ -143,14 +126,14 @@ static void RTreeInitPVars(struct PartitionVars *p, int maxrects, int minfill) {
 /// If one group gets too full (more would force other group to violate min
 /// fill requirement) then other group gets the rest.
 /// These last are the ones that can go in either group most easily.
-static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
+static void RTreeMethodZero(RTreeSplitVars *s, RTreePartitionVars *p, int minfill) {
 	register int i;
 	RectReal biggestDiff;
 	register int group, chosen = 0, betterGroup = 0;
 	assert(p);
 
-	RTreeInitPVars(p, BranchCount, minfill);
-	RTreePickSeeds(p);
+	RTreeInitPVars(p, s->count, minfill);
+	RTreePickSeeds(s, p);
 
 	while (p->count[0] + p->count[1] < p->total
 		&& p->count[0] < p->total - p->minfill
@@ -164,7 +147,7 @@ static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
 				RTreeRect *r, rect_0, rect_1;
 				RectReal growth0, growth1, diff;
 
-				r = &BranchBuf[i].rect;
+				r = &s->branch[i].rect;
 				rect_0 = RTreeCombineRect(r, &p->cover[0]);
 				rect_1 = RTreeCombineRect(r, &p->cover[1]);
 				growth0 = RTreeRectSphericalVolume(
@@ -194,7 +177,7 @@ static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
 				}
 			}
 		}
-		RTreeClassify(chosen, betterGroup, p);
+		RTreeClassify(s, chosen, betterGroup, p);
 	}
 
 	/* if one group too full, put remaining rects in the other */
@@ -207,7 +190,7 @@ static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
 		for (i=0; i<p->total; i++)
 		{
 			if (!p->taken[i])
-				RTreeClassify(i, group, p);
+				RTreeClassify(s, i, group, p);
 		}
 	}
 
@@ -219,28 +202,30 @@ static void RTreeMethodZero(struct PartitionVars *p, int minfill) {
 /// Divides the nodes branches and the extra one between two nodes.
 /// Old node is one of the new ones, and one really new one is created.
 /// Tries more than one method for choosing a partition, uses best result.
-void RTreeSplitNodeQuadratic(RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
-	register struct PartitionVars *p;
+void RTreeSplitNodeQuadratic(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
+	register RTreePartitionVars *p;
 	register int level;
 
+	assert(t);
 	assert(n);
 	assert(b);
+	RTreeStatsAdd(splits[RTreeSplitQuadratic], 1);
 
 	/* load all the branches into a buffer, initialize old node */
 	level = n->level;
-	RTreeGetBranches(n, b);
+	RTreeGetBranches(t, n, b);
 
 	/* find partition */
-	p = &Partitions[0];
+	p = &t->splitVars.partition;
 	/* Note: can't use MINFILL(n) below since n was cleared by GetBranches() */
-	RTreeMethodZero(p, level>0 ? MinNodeFill : MinLeafFill);
+	RTreeMethodZero(&t->splitVars, p, level>0 ? MinNodeFill(t) : MinLeafFill(t));
 
 	/*
 	 * put branches from buffer into 2 nodes
 	 * according to chosen partition
 	 */
-	*nn = RTreeNewNode();
+	*nn = RTreeIndexNewNode(t);
 	(*nn)->level = n->level = level;
-	RTreeLoadNodes(n, *nn, p);
+	RTreeLoadNodes(t, n, *nn, p);
 	assert(n->count+(*nn)->count == p->total);
 }
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/* fraction of the entries of an overflowing node that are reinserted */
+#define REINSERT_FRACTION	0.3
+
+/// Load branch buffer with branches from full node plus the extra branch.
+static void RTreeGetBranches(RTreeIndex *t, RTreeNode *n, RTreeBranch *b) {
+	register RTreeSplitVars *s = &t->splitVars;
+	register int i;
+
+	assert(n);
+	assert(b);
+
+	/* load the branch buffer */
+	for (i=0; i<MAXKIDS(t, n); i++)
+	{
+		assert(n->child[i]); /* n should have every entry full */
+		s->branch[i] = RTreeNodeGetBranch(n, i);
+	}
+	s->branch[MAXKIDS(t, n)] = *b;
+	s->count = MAXKIDS(t, n) + 1;
+
+	RTreeInitNode(n);
+}
+
+/// Sort branch buffer indices by one boundary, ties broken by the opposite side.
+/// Insertion sort, the buffer never holds more than MAXCARD+1 entries.
+static void RTreeSortBranches(RTreeSplitVars *sv, int *order, int side) {
+	register int i, j, k;
+	int opposite = side < NUMDIMS ? side + NUMDIMS : side - NUMDIMS;
+	RTreeRect *r, *s;
+
+	for (i=0; i<sv->count; i++)
+	{
+		k = i;
+		r = &sv->branch[k].rect;
+		for (j=i; j>0; j--)
+		{
+			s = &sv->branch[order[j-1]].rect;
+			if (s->boundary[side] < r->boundary[side] ||
+			    (s->boundary[side] == r->boundary[side] &&
+			     s->boundary[opposite] <= r->boundary[opposite]))
+				break;
+			order[j] = order[j-1];
+		}
+		order[j] = k;
+	}
+}
+
+/// Covers of every prefix and suffix of a sorted branch buffer:
+/// lower[k] covers order[0..k], upper[k] covers order[k..count-1].
+static void RTreeDistributionCovers(RTreeSplitVars *s, int *order, RTreeRect *lower, RTreeRect *upper) {
+	register int k;
+
+	lower[0] = s->branch[order[0]].rect;
+	for (k=1; k<s->count; k++)
+		lower[k] = RTreeCombineRect(&lower[k-1], &s->branch[order[k]].rect);
+
+	upper[s->count-1] = s->branch[order[s->count-1]].rect;
+	for (k=s->count-2; k>=0; k--)
+		upper[k] = RTreeCombineRect(&upper[k+1], &s->branch[order[k]].rect);
+}
+
+/// Split a node, R* style.
+/// The split axis is the one whose distributions have the smallest margin sum;
+/// along it the distribution with the least overlap between the two groups
+/// wins, ties going to the one with the least total area.
+/// Old node is one of the new ones, and one really new one is created.
+void RTreeSplitNodeRStar(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn) {
+	register RTreeSplitVars *s = &t->splitVars;
+	int order[NUMDIMS][2][MAXCARD+1];
+	RTreeRect lower[MAXCARD+1], upper[MAXCARD+1];
+	RectReal margin, bestMargin = 0, overlap, bestOverlap = 0, area, bestArea = 0;
+	register int axis, sort, k;
+	int level, minfill, bestAxis = 0, bestSort = 0, bestK = 0, first_time;
+
+	assert(t);
+	assert(n);
+	RTreeStatsAdd(splits[RTreeSplitRStar], 1);
+	assert(b);
+
+	/* load all the branches into a buffer, initialize old node */
+	level = n->level;
+	RTreeGetBranches(t, n, b);
+
+	/* Note: can't use MINFILL(n) below since n was cleared by GetBranches() */
+	minfill = level>0 ? MinNodeFill(t) : MinLeafFill(t);
+
+	/* choose the split axis */
+	first_time = 1;
+	for (axis=0; axis<NUMDIMS; axis++)
+	{
+		margin = 0;
+		for (sort=0; sort<2; sort++)
+		{
+			RTreeSortBranches(s, order[axis][sort], axis + sort*NUMDIMS);
+			RTreeDistributionCovers(s, order[axis][sort], lower, upper);
+			for (k=minfill; k<=s->count-minfill; k++)
+				margin += RTreeRectMargin(&lower[k-1]) + RTreeRectMargin(&upper[k]);
+		}
+		if (first_time || margin < bestMargin)
+		{
+			bestMargin = margin;
+			bestAxis = axis;
+			first_time = 0;
+		}
+	}
+
+	/* choose the split index along that axis */
+	first_time = 1;
+	for (sort=0; sort<2; sort++)
+	{
+		RTreeDistributionCovers(s, order[bestAxis][sort], lower, upper);
+		for (k=minfill; k<=s->count-minfill; k++)
+		{
+			overlap = RTreeRectOverlapVolume(&lower[k-1], &upper[k]);
+			area = RTreeRectVolume(&lower[k-1]) + RTreeRectVolume(&upper[k]);
+			if (first_time || overlap < bestOverlap ||
+			    (overlap == bestOverlap && area < bestArea))
+			{
+				bestOverlap = overlap;
+				bestArea = area;
+				bestSort = sort;
+				bestK = k;
+				first_time = 0;
+			}
+		}
+	}
+
+	/* first bestK entries of the chosen order stay, the rest move out */
+	*nn = RTreeIndexNewNode(t);
+	(*nn)->level = n->level = level;
+	for (k=0; k<s->count; k++)
+		RTreeIndexAddBranch(t, &s->branch[order[bestAxis][bestSort][k]],
+			k < bestK ? n : *nn, NULL);
+	assert(n->count >= minfill && (*nn)->count >= minfill);
+}
+
+/// Pick a branch, R* style.
+/// Just above the leaves pick the one whose rectangle overlaps its siblings
+/// least more after taking in the new rectangle, higher up the one that
+/// needs the smallest increase in area.  Ties go to the smaller increase in
+/// area, then to the smaller area.
+int RTreePickBranchRStar(RTreeRect *R, RTreeNode *N) {
+	register RTreeRect *r = R;
+	register RTreeNode *n = N;
+	register int i, j;
+	RectReal increase, bestIncr = 0, area, bestArea = 0;
+	RectReal overlap, bestOverlap = 0;
+	int best = 0, first_time = 1;
+	RTreeRect rect[MAXCARD], tmp_rect;
+	assert(r && n);
+	assert(n->level > 0);
+
+	for (i=0; i<n->count; i++)
+		rect[i] = RTreeNodeGetRect(n, i);
+
+	for (i=0; i<n->count; i++)
+	{
+		area = RTreeRectVolume(&rect[i]);
+		tmp_rect = RTreeCombineRect(r, &rect[i]);
+		increase = RTreeRectVolume(&tmp_rect) - area;
+
+		overlap = 0;
+		if (n->level == 1)
+		{
+			for (j=0; j<n->count; j++)
+			{
+				if (j != i)
+				{
+					overlap +=
+						RTreeRectOverlapVolume(&tmp_rect, &rect[j]) -
+						RTreeRectOverlapVolume(&rect[i], &rect[j]);
+				}
+			}
+		}
+
+		if (first_time || overlap < bestOverlap ||
+		    (overlap == bestOverlap && (increase < bestIncr ||
+		    (increase == bestIncr && area < bestArea))))
+		{
+			best = i;
+			bestOverlap = overlap;
+			bestIncr = increase;
+			bestArea = area;
+			first_time = 0;
+		}
+	}
+	return best;
+}
+
+/// Take the entries farthest from the center of a full node, together with
+/// the extra branch, out of the node and queue them for reinsertion.
+/// The closest of them are queued last so they go back in first.
+static void RTreeForcedReinsert(RTreeIndex *t, RTreeNode *n, RTreeBranch *b) {
+	register RTreeSplitVars *s = &t->splitVars;
+	register RTreeReinsertVars *v = &t->reinsertVars;
+	int order[MAXCARD+1];
+	double dist[MAXCARD+1], center[NUMDIMS], d;
+	register int i, j, k, dim;
+	int level, reinsert, minfill;
+	RTreeRect cover;
+
+	assert(n);
+	assert(b);
+
+	level = n->level;
+	RTreeGetBranches(t, n, b);
+	n->level = level;
+	minfill = level>0 ? MinNodeFill(t) : MinLeafFill(t);
+
+	cover = s->branch[0].rect;
+	for (i=1; i<s->count; i++)
+		cover = RTreeCombineRect(&cover, &s->branch[i].rect);
+	for (dim=0; dim<NUMDIMS; dim++)
+		center[dim] = ((double)cover.boundary[dim] + cover.boundary[dim+NUMDIMS]) / 2;
+
+	/* order the entries by decreasing distance of their center */
+	for (i=0; i<s->count; i++)
+	{
+		dist[i] = 0;
+		for (dim=0; dim<NUMDIMS; dim++)
+		{
+			d = ((double)s->branch[i].rect.boundary[dim] +
+				s->branch[i].rect.boundary[dim+NUMDIMS]) / 2 - center[dim];
+			dist[i] += d * d;
+		}
+		for (j=i; j>0 && dist[order[j-1]] < dist[i]; j--)
+			order[j] = order[j-1];
+		order[j] = i;
+	}
+
+	reinsert = (int)(s->count * REINSERT_FRACTION + 0.5);
+	if (reinsert > s->count - minfill)
+		reinsert = s->count - minfill;
+	if (reinsert < 1)
+		reinsert = 1;
+
+	RTreeStatsAdd(forcedReinserts, reinsert);
+	for (i=0; i<reinsert; i++)
+	{
+		k = v->count++;
+		v->branch[k] = s->branch[order[i]];
+		v->level[k] = level;
+	}
+	for (; i<s->count; i++)
+		RTreeIndexAddBranch(t, &s->branch[order[i]], n, NULL);
+}
+
+/// Add a branch to a node, R* style.
+/// The first time a level below the root overflows during an insertion,
+/// some of its entries are reinserted instead of splitting the node.
+/// Returns 1 and sets *new_node if the node was split, 0 otherwise.
+static int RTreeAddBranchRStar(RTreeIndex *t, RTreeBranch *b, RTreeNode *n, RTreeNode **new_node, int rootlevel) {
+	unsigned int bit;
+	int split = 0;
+
+	bit = n->level < REINSERT_LEVELS ? 1u << n->level : 0;
+	if (n->count < MAXKIDS(t, n))
+		split = RTreeIndexAddBranch(t, b, n, new_node);
+	else if (n->level < rootlevel && bit && !(t->reinsertVars.overflowed & bit))
+	{
+		t->reinsertVars.overflowed |= bit;
+		RTreeForcedReinsert(t, n, b);
+	}
+	else
+	{
+		assert(new_node);
+		RTreeSplitNodeRStar(t, n, b, new_node);
+		split = 1;
+	}
+
+	/* the branches n took in or gave up */
+	RTreeAggregateFix(n);
+	if (split)
+		RTreeAggregateFix(*new_node);
+	return split;
+}
+
+/// Inserts a branch at the given level, descending with RTreePickBranchRStar.
+/// Returns 0 if node was not split, 1 if it was and *new_node is the new node.
+/// Child rectangles are recomputed on the way up since a forced reinsertion
+/// below can shrink them.
+static int RTreeInsertRStar2(RTreeIndex *t, RTreeBranch *b, RTreeNode *n, RTreeNode **new_node, int level, int rootlevel) {
+	register int i;
+	RTreeBranch b2;
+	RTreeRect rect;
+	RTreeNode *n2;
+	size_t total;
+
+	assert(b && n && new_node);
+	assert(level >= 0 && level <= n->level);
+
+	if (n->level > level)
+	{
+		i = RTreePickBranchRStar(&b->rect, n);
+		n->child[i] = RTreeIndexWritable(t, n->child[i]);
+		total = RTreeNodeTotal(n->child[i]);
+		if (!RTreeInsertRStar2(t, b, n->child[i], &n2, level, rootlevel))
+		{
+			rect = RTreeNodeCover(n->child[i]);
+			RTreeNodeSetRect(n, i, &rect);
+			n->total += RTreeNodeTotal(n->child[i]) - total;
+			return 0;
+		}
+		rect = RTreeNodeCover(n->child[i]);
+		RTreeNodeSetRect(n, i, &rect);
+		b2.child = n2;
+		b2.rect = RTreeNodeCover(n2);
+		return RTreeAddBranchRStar(t, &b2, n, new_node, rootlevel);
+	}
+	else if (n->level == level)
+	{
+		return RTreeAddBranchRStar(t, b, n, new_node, rootlevel);
+	}
+	else
+	{
+		/* Not supposed to happen */
+		assert (FALSE);
+		return 0;
+	}
+}
+
+/// Insert a branch below the root, growing a new root if the old one splits.
+static int RTreeInsertRStarRoot(RTreeIndex *t, RTreeBranch *b, int level) {
+	register RTreeNode *newroot;
+	RTreeNode *newnode;
+	RTreeBranch b2;
+
+	t->root = RTreeIndexWritable(t, t->root);
+	if (!RTreeInsertRStar2(t, b, t->root, &newnode, level, t->root->level))
+		return 0;
+
+	newroot = RTreeIndexNewNode(t);  /* grow a new root, & tree taller */
+	newroot->level = t->root->level + 1;
+	b2.rect = RTreeNodeCover(t->root);
+	b2.child = t->root;
+	RTreeIndexAddBranch(t, &b2, newroot, NULL);
+	b2.rect = RTreeNodeCover(newnode);
+	b2.child = newnode;
+	RTreeIndexAddBranch(t, &b2, newroot, NULL);
+	RTreeAggregateFix(newroot);
+	t->root = newroot;
+	return 1;
+}
+
+/// Insert a data rectangle into an index, R* style.
+/// Entries moved out by forced reinsertion are put back before returning.
+/// Returns 1 if the root was split, 0 if it was not.
+/// The level argument specifies the number of steps up from the leaf level to insert; e.g. a data rectangle goes in at level = 0.
+int RTreeIndexInsertRectRStar(RTreeIndex *t, RTreeRect *R, void *Tid, int Level) {
+	register RTreeReinsertVars *v = &t->reinsertVars;
+	RTreeBranch b;
+	int i, result;
+	RTreeStatsTimer(timer);
+
+	assert(t && R);
+	assert(Level >= 0 && Level <= t->root->level);
+	for (i=0; i<NUMDIMS; i++)
+		assert(R->boundary[i] <= R->boundary[NUMDIMS+i]);
+
+	RTreeStatsStart(timer);
+	v->count = 0;
+	v->overflowed = 0;
+
+	b.rect = *R;
+	b.child = (RTreeNode *)Tid;
+	result = RTreeInsertRStarRoot(t, &b, Level);
+
+	while (v->count)
+	{
+		i = --v->count;
+		b = v->branch[i];
+		result |= RTreeInsertRStarRoot(t, &b, v->level[i]);
+	}
+	RTreeStatsStop(RTreeStatsInsert, timer);
+	return result;
+}
+
+/// Insert a data rectangle into the default index, R* style.
+int RTreeInsertRectRStar(RTreeRect *R, void *Tid, RTreeNode **Root, int Level) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	int result;
+
+	assert(Root);
+	t->root = *Root;
+	t->split = RTreeSplitRStar;
+	result = RTreeIndexInsertRectRStar(t, R, Tid, Level);
+	*Root = t->root;
+	return result;
+}
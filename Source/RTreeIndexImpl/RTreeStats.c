@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#ifdef RTREE_STATS
+/* the counters of a thread, on the list of all of them */
+typedef struct _RTreeThreadStats
+{
+	RTreeStats stats;	/* first, so the block is found from RTreeStatsOfThread */
+	struct _RTreeThreadStats *next, **prev;
+} RTreeThreadStats;
+
+#define STATS_WORDS (sizeof(RTreeStats) / sizeof(uint64_t))
+
+__thread RTreeStats *RTreeStatsOfThread = NULL;
+static __thread int Timing;	/* inside a timed operation */
+
+static pthread_mutex_t StatsLock = PTHREAD_MUTEX_INITIALIZER;
+static RTreeThreadStats *Threads;	/* running */
+static RTreeStats Gone;	/* added up from the threads that ended */
+static pthread_key_t StatsKey;
+static pthread_once_t StatsOnce = PTHREAD_ONCE_INIT;
+
+/// Add the counters of one block to another.
+static void RTreeStatsAddUp(RTreeStats *to, RTreeStats *from) {
+	register uint64_t *t = (uint64_t *)to, *f = (uint64_t *)from;
+	register size_t i;
+	for (i=0; i<STATS_WORDS; i++)
+		t[i] += __atomic_load_n(&f[i], __ATOMIC_RELAXED);
+}
+
+static void RTreeStatsClear(RTreeStats *s) {
+	register uint64_t *w = (uint64_t *)s;
+	register size_t i;
+	for (i=0; i<STATS_WORDS; i++)
+		__atomic_store_n(&w[i], 0, __ATOMIC_RELAXED);
+}
+
+/// Keep the counts of a thread that ends, and free its block.
+static void RTreeStatsDetach(void *block) {
+	RTreeThreadStats *s = (RTreeThreadStats *)block;
+
+	pthread_mutex_lock(&StatsLock);
+	RTreeStatsAddUp(&Gone, &s->stats);
+	if (s->next)
+		s->next->prev = s->prev;
+	*s->prev = s->next;
+	pthread_mutex_unlock(&StatsLock);
+	free(s);
+	RTreeStatsOfThread = NULL;
+}
+
+static void RTreeStatsInit() {
+	pthread_key_create(&StatsKey, RTreeStatsDetach);
+}
+
+/// Give the calling thread its block of counters, on its first count.
+RTreeStats * RTreeStatsAttach() {
+	RTreeThreadStats *s;
+
+	pthread_once(&StatsOnce, RTreeStatsInit);
+	s = (RTreeThreadStats *)calloc(1, sizeof(RTreeThreadStats));
+	assert(s);
+	pthread_mutex_lock(&StatsLock);
+	s->next = Threads;
+	if (Threads)
+		Threads->prev = &s->next;
+	s->prev = &Threads;
+	Threads = s;
+	pthread_mutex_unlock(&StatsLock);
+	pthread_setspecific(StatsKey, s);
+	RTreeStatsOfThread = &s->stats;
+	return RTreeStatsOfThread;
+}
+
+static uint64_t RTreeStatsNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Start timing an operation.  Returns 0 inside another one, which then
+/// takes the time of this one.
+uint64_t RTreeStatsBegin() {
+	if (Timing)
+		return 0;
+	Timing = 1;
+	return RTreeStatsNow();
+}
+
+/// Count the time since RTreeStatsBegin in the histogram of an operation.
+void RTreeStatsEnd(RTreeStatsOperation operation, uint64_t started) {
+	RTreeStats *s;
+	uint64_t *histogram, ns;
+	int bucket;
+
+	if (!started)
+		return;
+	Timing = 0;
+	ns = RTreeStatsNow() - started;
+	bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+	if (bucket >= STATS_BUCKETS)
+		bucket = STATS_BUCKETS - 1;
+	s = RTreeStatsHere();
+	switch (operation)
+	{
+	case RTreeStatsInsert:
+		histogram = s->insertLatency;
+		break;
+	case RTreeStatsDelete:
+		histogram = s->deleteLatency;
+		break;
+	default:
+		histogram = s->searchLatency;
+		break;
+	}
+	RTreeStatsBump(&histogram[bucket], 1);
+}
+#endif
+
+/// Whether the library keeps counters, that is, was built with RTREE_STATS.
+int RTreeStatsEnabled() {
+#ifdef RTREE_STATS
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/// Add up the counters of all threads since the last reset.  Counts still
+/// being made on other threads may or may not be in.
+void RTreeGetStats(RTreeStats *stats) {
+	assert(stats);
+	memset(stats, 0, sizeof(RTreeStats));
+#ifdef RTREE_STATS
+	RTreeThreadStats *s;
+
+	pthread_mutex_lock(&StatsLock);
+	RTreeStatsAddUp(stats, &Gone);
+	for (s=Threads; s; s=s->next)
+		RTreeStatsAddUp(stats, &s->stats);
+	pthread_mutex_unlock(&StatsLock);
+#endif
+}
+
+/// Set the counters of all threads to 0.  A count another thread makes
+/// meanwhile may be lost.
+void RTreeResetStats() {
+#ifdef RTREE_STATS
+	RTreeThreadStats *s;
+
+	pthread_mutex_lock(&StatsLock);
+	RTreeStatsClear(&Gone);
+	for (s=Threads; s; s=s->next)
+		RTreeStatsClear(&s->stats);
+	pthread_mutex_unlock(&StatsLock);
+#endif
+}
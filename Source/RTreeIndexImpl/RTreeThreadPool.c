@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+#define Task(q, k) ((q)->items + (k) * (q)->taskSize)
+
+static void RTreeTaskQueueInit(RTreeTaskQueue *q) {
+	memset(q, 0, sizeof(RTreeTaskQueue));
+	pthread_mutex_init(&q->lock, NULL);
+}
+
+static void RTreeTaskQueueFree(RTreeTaskQueue *q) {
+	pthread_mutex_destroy(&q->lock);
+	free(q->items);
+}
+
+/// Add a task at the tail of a queue, its owner's end.
+static void RTreeTaskQueuePush(RTreeTaskQueue *q, void *task) {
+	size_t capacity;
+	char *items;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail == q->capacity)
+	{
+		if (q->head > 0)	/* slide the live tasks to the front */
+		{
+			memmove(q->items, Task(q, q->head), (q->tail - q->head) * q->taskSize);
+			q->tail -= q->head;
+			q->head = 0;
+		}
+		else
+		{
+			capacity = q->capacity ? 2 * q->capacity : 64;
+			items = (char *)realloc(q->items, capacity * q->taskSize);
+			assert(items);
+			q->items = items;
+			q->capacity = capacity;
+		}
+	}
+	memcpy(Task(q, q->tail), task, q->taskSize);
+	q->tail++;
+	pthread_mutex_unlock(&q->lock);
+}
+
+/// Take a task from a queue, from the tail for its owner and from the head
+/// for a thief, so a thief takes the oldest and usually largest piece.
+/// Returns 0 if the queue is empty.
+static int RTreeTaskQueuePop(RTreeTaskQueue *q, void *task, int steal) {
+	int found = 0;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail)
+	{
+		if (steal)
+			memcpy(task, Task(q, q->head++), q->taskSize);
+		else
+			memcpy(task, Task(q, --q->tail), q->taskSize);
+		found = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return found;
+}
+
+/// Run tasks until there are none left anywhere, stealing from the other
+/// workers when the own queue is empty.
+static void RTreeThreadPoolWork(RTreeThreadPool *p, int worker) {
+	RTreeTaskQueue *own = &p->queues[worker];
+	char *task = p->scratch + (size_t)worker * p->taskSize;
+	int i, found;
+
+	while (__atomic_load_n(&p->pending, __ATOMIC_ACQUIRE) > 0)
+	{
+		found = RTreeTaskQueuePop(own, task, 0);
+		for (i=1; !found && i<p->threads; i++)
+			found = RTreeTaskQueuePop(&p->queues[(worker + i) % p->threads], task, 1);
+		if (!found)
+		{
+			/* others are still running tasks that may push more */
+			sched_yield();
+			continue;
+		}
+		p->func(task, worker, p->arg);
+		__atomic_sub_fetch(&p->pending, 1, __ATOMIC_ACQ_REL);
+	}
+}
+
+static void * RTreeThreadPoolMain(void *arg) {
+	RTreeThreadPoolWorker *w = (RTreeThreadPoolWorker *)arg;
+	RTreeThreadPool *p = w->pool;
+	unsigned int generation = 0;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&p->lock);
+		while (p->generation == generation && !p->quit)
+			pthread_cond_wait(&p->start, &p->lock);
+		if (p->quit)
+		{
+			pthread_mutex_unlock(&p->lock);
+			return NULL;
+		}
+		generation = p->generation;
+		pthread_mutex_unlock(&p->lock);
+
+		RTreeThreadPoolWork(p, w->index);
+
+		pthread_mutex_lock(&p->lock);
+		if (--p->busy == 0)
+			pthread_cond_signal(&p->done);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+/// Make a pool of the given number of workers, the calling thread of
+/// RTreeThreadPoolRun being one of them.  0 or less means one per CPU.
+RTreeThreadPool * RTreeThreadPoolNew(int threads) {
+	RTreeThreadPool *p;
+	int i;
+
+	if (threads <= 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (int)cpus : 1;
+	}
+
+	p = (RTreeThreadPool *)malloc(sizeof(RTreeThreadPool));
+	assert(p);
+	memset(p, 0, sizeof(RTreeThreadPool));
+	p->threads = threads;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->start, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	p->queues = (RTreeTaskQueue *)malloc(threads * sizeof(RTreeTaskQueue));
+	p->workers = (RTreeThreadPoolWorker *)malloc(threads * sizeof(RTreeThreadPoolWorker));
+	assert(p->queues && p->workers);
+	for (i=0; i<threads; i++)
+	{
+		RTreeTaskQueueInit(&p->queues[i]);
+		p->workers[i].pool = p;
+		p->workers[i].index = i;
+	}
+	for (i=1; i<threads; i++)
+		pthread_create(&p->workers[i].thread, NULL, RTreeThreadPoolMain, &p->workers[i]);
+	return p;
+}
+
+/// Stop the workers of a pool and free it.
+void RTreeThreadPoolFree(RTreeThreadPool *p) {
+	int i;
+	assert(p);
+
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+	for (i=1; i<p->threads; i++)
+		pthread_join(p->workers[i].thread, NULL);
+
+	for (i=0; i<p->threads; i++)
+		RTreeTaskQueueFree(&p->queues[i]);
+	free(p->queues);
+	free(p->workers);
+	free(p->scratch);
+	pthread_cond_destroy(&p->start);
+	pthread_cond_destroy(&p->done);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
+
+/// Number of workers in a pool.
+int RTreeThreadPoolSize(RTreeThreadPool *p) {
+	assert(p);
+	return p->threads;
+}
+
+/// Run ntasks tasks of taskSize bytes each on the workers of a pool, calling
+/// func(task, worker, arg) for each, and wait until all of them are done,
+/// including those pushed meanwhile by RTreeThreadPoolPush.
+/// The tasks are dealt out round robin; idle workers steal.
+/// One run at a time per pool.
+void RTreeThreadPoolRun(RTreeThreadPool *p, void *tasks, size_t ntasks, size_t taskSize, RTreeTaskFunc func, void *arg) {
+	size_t k;
+	int i;
+
+	assert(p && func);
+	assert(tasks || ntasks == 0);
+	assert(taskSize > 0);
+	if (ntasks == 0)
+		return;
+
+	p->func = func;
+	p->arg = arg;
+	if (p->taskSize != taskSize)
+	{
+		for (i=0; i<p->threads; i++)
+		{
+			RTreeTaskQueueFree(&p->queues[i]);
+			RTreeTaskQueueInit(&p->queues[i]);
+			p->queues[i].taskSize = taskSize;
+		}
+		free(p->scratch);
+		p->scratch = (char *)malloc(p->threads * taskSize);
+		assert(p->scratch);
+		p->taskSize = taskSize;
+	}
+	p->pending = ntasks;
+	for (k=0; k<ntasks; k++)
+		RTreeTaskQueuePush(&p->queues[k % p->threads], (char *)tasks + k * taskSize);
+
+	pthread_mutex_lock(&p->lock);
+	p->busy = p->threads - 1;
+	p->generation++;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+
+	RTreeThreadPoolWork(p, 0);
+
+	pthread_mutex_lock(&p->lock);
+	while (p->busy > 0)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/// From inside a task, add another task to the current run of a pool, on
+/// the queue of the worker running it.
+void RTreeThreadPoolPush(RTreeThreadPool *p, int worker, void *task) {
+	assert(p && task);
+	assert(worker >= 0 && worker < p->threads);
+	__atomic_add_fetch(&p->pending, 1, __ATOMIC_ACQ_REL);
+	RTreeTaskQueuePush(&p->queues[worker], task);
+}
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "include/RTreeIndexImpl.h"
+
+/// Find the path down to the leaf holding tid, going into the branches whose
+/// rects overlap r as RTreeDeleteRect2 does.  path[d] is the node at depth d
+/// and slot[d] its branch on the path, at the leaf the entry itself.
+/// Returns the depth of the leaf, or -1 if tid is not below n.
+static int RTreeUpdateFindPath(RTreeNode *n, RTreeRect *r, void *tid, RTreeNode **path, int *slot, int depth) {
+	uint64_t mask[MASKWORDS], m;
+	register int i, w;
+	int k;
+
+	path[depth] = n;
+	if (n->level == 0)
+	{
+		for (i=0; i<n->count; i++)
+		{
+			if (n->child[i] == (RTreeNode *)tid)
+			{
+				slot[depth] = i;
+				return depth;
+			}
+		}
+		return -1;
+	}
+	RTreeNodeOverlapMask(n, n->count, r, mask);
+	for (w=0; w<MASKWORDS; w++)
+	{
+		for (m=mask[w]; m; m&=m-1)
+		{
+			i = 64*w + MaskLowest(m);
+			slot[depth] = i;
+			if ((k = RTreeUpdateFindPath(n->child[i], r, tid, path, slot, depth + 1)) >= 0)
+				return k;
+		}
+	}
+	return -1;
+}
+
+/// Find the same path through the locator, from the leaf up.
+/// Returns the depth of the leaf, or -1 if tid is in no leaf.
+static int RTreeUpdateLocatePath(RTreeIndex *t, void *tid, RTreeNode **path, int *slot) {
+	RTreeNode *n, *p;
+	register int i, k;
+	int depth = t->root->level;
+
+	if (!(n = RTreeIndexLocate(t, tid)))
+		return -1;
+	for (i=0; n->child[i] != (RTreeNode *)tid; i++)
+		assert(i < n->count);
+	path[depth] = n;
+	slot[depth] = i;
+	for (k=depth; k>0; k--)
+	{
+		p = RTreeLocatorParent(t->locator, n);
+		for (i=0; p->child[i] != n; i++)
+			assert(i < p->count);
+		path[k-1] = p;
+		slot[k-1] = i;
+		n = p;
+	}
+	assert(n == t->root);
+	return depth;
+}
+
+/// Move the data rect of tid from oldRect to newRect, in place if it can be.
+/// oldRect must be the rect it was inserted with, unless the locator is on.
+/// With snapshots on it is deleted and inserted.
+/// Returns how it was moved, or RTreeUpdateNotFound.
+RTreeUpdateKind RTreeIndexUpdateRect(RTreeIndex *t, void *tid, RTreeRect *oldRect, RTreeRect *newRect) {
+	RTreeNode *path[UPDATE_DEPTH], *leaf, *p;
+	int slot[UPDATE_DEPTH];
+	RTreeBranch b;
+	RTreeRect rect, cover, outer;
+	RectReal area, bestArea = 0;
+	register int i;
+	int k, j, best;
+
+	assert(t && t->root && oldRect && newRect);
+	assert(!t->concurrent);
+	if (t->versions || t->root->level >= UPDATE_DEPTH)
+		goto reinsert;
+	if (t->locator)
+		k = RTreeUpdateLocatePath(t, tid, path, slot);
+	else
+		k = RTreeUpdateFindPath(t->root, oldRect, tid, path, slot, 0);
+	if (k < 0)
+		return RTreeUpdateNotFound;
+
+	leaf = path[k];
+	if (k == 0)	/* the root is the leaf */
+	{
+		RTreeNodeSetRect(leaf, slot[0], newRect);
+		return RTreeUpdateInPlace;
+	}
+	p = path[k-1];
+	j = slot[k-1];
+	rect = RTreeNodeGetRect(p, j);
+	if (RTreeContained(newRect, &rect))
+	{
+		RTreeNodeSetRect(leaf, slot[k], newRect);
+		return RTreeUpdateInPlace;
+	}
+
+	/* the leaf's rect made to fit it again, if that grows it only a little
+	 * and keeps it inside the parent's, so nothing above changes */
+	b = RTreeNodeGetBranch(leaf, slot[k]);
+	RTreeNodeSetRect(leaf, slot[k], newRect);
+	cover = RTreeNodeCover(leaf);
+	if (k >= 2)
+		outer = RTreeNodeGetRect(path[k-2], slot[k-2]);
+	if (RTreeRectMargin(&cover) <= (1 + UPDATE_SLACK) * RTreeRectMargin(&rect) &&
+		(k < 2 || RTreeContained(&cover, &outer)))
+	{
+		RTreeNodeSetRect(p, j, &cover);
+		return RTreeUpdateEnlarged;
+	}
+	RTreeNodeSetRect(leaf, slot[k], &b.rect);
+
+	/* the sibling leaf of least area whose rect holds it and that has room,
+	 * if the leaf can spare the entry */
+	if (leaf->count > MINFILL(t, leaf))
+	{
+		best = -1;
+		for (i=0; i<p->count; i++)
+		{
+			if (i == j || p->child[i]->count >= t->leafcard)
+				continue;
+			rect = RTreeNodeGetRect(p, i);
+			if (!RTreeContained(newRect, &rect))
+				continue;
+			area = RTreeRectVolume(&rect);
+			if (best < 0 || area < bestArea)
+			{
+				best = i;
+				bestArea = area;
+			}
+		}
+		if (best >= 0)
+		{
+			b.rect = *newRect;
+			RTreeDisconnectBranch(leaf, slot[k]);
+			RTreeIndexAddBranch(t, &b, p->child[best], NULL);
+			return RTreeUpdateMoved;
+		}
+	}
+
+reinsert:
+	if (RTreeIndexDeleteRect(t, oldRect, tid))
+		return RTreeUpdateNotFound;
+	RTreeIndexInsertRect(t, newRect, tid, 0);
+	return RTreeUpdateReinserted;
+}
+
+/// Move a data rect of the default index, as RTreeIndexUpdateRect.
+RTreeUpdateKind RTreeUpdateRect(RTreeNode **Root, void *tid, RTreeRect *oldRect, RTreeRect *newRect) {
+	RTreeIndex *t = RTreeDefaultIndex();
+	RTreeUpdateKind result;
+
+	assert(Root);
+	t->root = *Root;
+	result = RTreeIndexUpdateRect(t, tid, oldRect, newRect);
+	*Root = t->root;
+	return result;
+}
@@ -6,6 +6,10 @@
 #define NUMDIMS	2	/* number of dimensions */
 #define NDEBUG
 
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
 typedef float RectReal;
 // Global definitions.
 
@@ -33,15 +37,54 @@ typedef struct _RTreeBranch
 } RTreeBranch;
 
 /* max branching factor of a node */
-#define MAXCARD (int)((PGSIZE-(2*sizeof(int))) / sizeof(RTreeBranch))
+#define MAXCARD (int)((PGSIZE-(2*sizeof(short)+sizeof(unsigned int))) / (NUMSIDES*sizeof(RectReal) + sizeof(RTreeNode *)))
 
+/*
+ * The branches of a node are stored as a structure of arrays: side s of the
+ * rect of branch i is bound[s][i], so every side of all the branches lies in
+ * one contiguous row and a whole node can be tested at once (RTreeKernels.c).
+ * Use RTreeNodeGetBranch and friends to read or write a single branch.
+ * The branches in use are always the first count ones.
+ */
 struct _RTreeNode
 {
-	int count;
-	int level; /* 0 is leaf, others positive */
-	RTreeBranch branch[MAXCARD];
+	short count;
+	short level; /* 0 is leaf, others positive */
+	union
+	{
+		unsigned int version;	/* lock of concurrent updates, odd while held, see RTreeConcurrent.c */
+		unsigned int total;	/* data rects below, in a node above the leaves, see RTreeAggregate.c */
+	};
+	RectReal bound[NUMSIDES][MAXCARD];
+	RTreeNode *child[MAXCARD];
 };
 
+static inline RTreeRect RTreeNodeGetRect(RTreeNode *n, int i) {
+	RTreeRect r;
+	int s;
+	for (s=0; s<NUMSIDES; s++)
+		r.boundary[s] = n->bound[s][i];
+	return r;
+}
+
+static inline void RTreeNodeSetRect(RTreeNode *n, int i, RTreeRect *r) {
+	int s;
+	for (s=0; s<NUMSIDES; s++)
+		n->bound[s][i] = r->boundary[s];
+}
+
+static inline RTreeBranch RTreeNodeGetBranch(RTreeNode *n, int i) {
+	RTreeBranch b;
+	b.rect = RTreeNodeGetRect(n, i);
+	b.child = n->child[i];
+	return b;
+}
+
+static inline void RTreeNodeSetBranch(RTreeNode *n, int i, RTreeBranch *b) {
+	RTreeNodeSetRect(n, i, &b->rect);
+	n->child[i] = b->child;
+}
+
 typedef struct _RTreeListNode
 {
 	struct _RTreeListNode *next;
@@ -73,6 +116,8 @@ extern RTreeRect RTreeNullRect();
 extern RectReal RTreeRectArea(RTreeRect*);
 extern RectReal RTreeRectSphericalVolume(RTreeRect *R);
 extern RectReal RTreeRectVolume(RTreeRect *R);
+extern RectReal RTreeRectMargin(RTreeRect *R);
+extern RectReal RTreeRectOverlapVolume(RTreeRect *R, RTreeRect *S);
 extern RTreeRect RTreeCombineRect(RTreeRect*, RTreeRect*);
 extern int RTreeOverlap(RTreeRect*, RTreeRect*);
 extern int RTreeContained(struct RTreeRect *R, struct RTreeRect *S);
@@ -80,27 +125,785 @@ extern int RTreeAddBranch(RTreeBranch *, RTreeNode *, RTreeNode **);
 extern int RTreePickBranch(RTreeRect *, RTreeNode *);
 extern void RTreeDisconnectBranch(RTreeNode *, int);
 
-// MARK: - RTreeSplitNode
-extern void RTreeSplitNodeQuadratic(RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
-extern void RTreeSplitNodeLinear(RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
-#define RTreeSplitNode	RTreeSplitNodeQuadratic
-
 extern int RTreeSetNodeMax(int);
 extern int RTreeSetLeafMax(int);
 extern int RTreeGetNodeMax();
 extern int RTreeGetLeafMax();
 
+// MARK: - RTreeIndex
+typedef enum
+{
+	RTreeSplitQuadratic,
+	RTreeSplitLinear,
+	RTreeSplitRStar	/* R*-tree insertion, see RTreeSplit_rstar.c */
+} RTreeSplitMethod;
+
+/* variables for finding a partition */
+typedef struct _RTreePartitionVars
+{
+	int partition[MAXCARD+1];
+	int total, minfill;
+	int taken[MAXCARD+1];
+	int count[2];
+	RTreeRect cover[2];
+	RectReal area[2];
+} RTreePartitionVars;
+
+/* branches of a node being split, plus the extra one */
+typedef struct _RTreeSplitVars
+{
+	RTreeBranch branch[MAXCARD+1];
+	int count;
+	RTreeRect cover;
+	RectReal coverArea;
+	RTreePartitionVars partition;
+} RTreeSplitVars;
+
+/* levels that can be tracked for R* forced reinsertion during one insertion */
+#define REINSERT_LEVELS	(int)(8*sizeof(unsigned int))
+
+/* entries taken out by R* forced reinsertion, waiting to go back in */
+typedef struct _RTreeReinsertVars
+{
+	RTreeBranch branch[REINSERT_LEVELS*(MAXCARD+1)];
+	int level[REINSERT_LEVELS*(MAXCARD+1)];
+	int count;
+	unsigned int overflowed;	/* one bit for every level that already reinserted */
+} RTreeReinsertVars;
+
+/* allocation counters of a node arena */
+typedef struct _RTreeArenaStats
+{
+	size_t heapAllocs;	/* calls into the heap allocator, ever */
+	size_t heapFrees;	/* calls to free, ever */
+	size_t slabs;	/* slabs held now */
+	size_t bytes;	/* bytes held in slabs now */
+	size_t nodesInUse;	/* nodes handed out and not returned */
+	size_t nodesFree;	/* returned nodes waiting for reuse */
+} RTreeArenaStats;
+
+/*
+ * Nodes of one index, carved from page-aligned slabs and recycled through
+ * a free list, so insertions and deletions reuse memory instead of calling
+ * malloc and free.  The whole tree goes away by releasing the slabs.
+ */
+typedef struct _RTreeArena
+{
+	void **slabs;
+	int slabCount, slabCapacity;
+	char *next, *end;	/* unused part of the newest slab */
+	RTreeNode *freeNodes;
+	RTreeListNode *freeListNodes;
+	RTreeArenaStats stats;
+} RTreeArena;
+
+extern void RTreeArenaInit(RTreeArena *);
+extern RTreeNode * RTreeArenaNewNode(RTreeArena *);
+extern RTreeNode * RTreeArenaReserve(RTreeArena *, size_t n);
+extern void RTreeArenaFreeNode(RTreeArena *, RTreeNode *);
+extern RTreeListNode * RTreeArenaNewListNode(RTreeArena *);
+extern void RTreeArenaFreeListNode(RTreeArena *, RTreeListNode *);
+extern void RTreeArenaRelease(RTreeArena *);
+
+/*
+ * A tree together with its fanout, split method and the scratch space used
+ * while modifying it.  Nothing is shared between two indexes, so each one
+ * can be updated on its own thread.  The functions taking an RTreeNode**
+ * all work through one shared default index, configured by RTreeSetNodeMax
+ * and RTreeSetLeafMax.
+ */
+typedef struct _RTreeIndex
+{
+	RTreeNode *root;
+	int nodecard;	/* max branching factor of internal nodes */
+	int leafcard;	/* max branching factor of leaves */
+	RTreeSplitMethod split;
+	RTreeArena *arena;	/* NULL: nodes come from malloc, as for the default index */
+	RTreeSplitVars splitVars;
+	RTreeReinsertVars reinsertVars;
+	struct _RTreeVersions *versions;	/* NULL unless snapshots are on, see RTreeSnapshot.c */
+	struct _RTreeConcurrent *concurrent;	/* NULL unless concurrent updates are on, see RTreeConcurrent.c */
+	struct _RTreeLocator *locator;	/* NULL unless tids are located, see RTreeLocator.c */
+} RTreeIndex;
+
+extern RTreeIndex * RTreeIndexNew(int nodecard, int leafcard, RTreeSplitMethod split);
+extern void RTreeIndexFree(RTreeIndex *);
+extern void RTreeIndexClear(RTreeIndex *);
+extern RTreeIndex * RTreeDefaultIndex();
+extern RTreeNode * RTreeIndexNewNode(RTreeIndex *);
+extern void RTreeIndexFreeNode(RTreeIndex *, RTreeNode *);
+extern RTreeListNode * RTreeIndexNewListNode(RTreeIndex *);
+extern void RTreeIndexFreeListNode(RTreeIndex *, RTreeListNode *);
+extern void RTreeIndexFreeTree(RTreeIndex *);
+extern void RTreeIndexGetArenaStats(RTreeIndex *, RTreeArenaStats *);
+extern int RTreeIndexSearch(RTreeIndex *, RTreeRect*, void* cbarg, RTreeSearchHitCallback callback);
+extern int RTreeIndexInsertRect(RTreeIndex *, RTreeRect*, void *, int depth);
+extern int RTreeIndexDeleteRect(RTreeIndex *, RTreeRect*, void *);
+extern int RTreeIndexAddBranch(RTreeIndex *, RTreeBranch *, RTreeNode *, RTreeNode **);
+
+// MARK: - RTreeSnapshot
+/*
+ * Copy-on-write versions of an index, for one writer and any number of
+ * readers.  With snapshots on, an update copies the nodes on its path
+ * instead of changing them, so no node a reader can reach is ever written;
+ * RTreeIndexCommit publishes the new root as the current version.
+ * A reader holds a version from RTreeSnapshotAcquire to RTreeSnapshotRelease
+ * and searches from its root.  The nodes replaced since a version are freed
+ * by the writer, at a later commit, once no reader holds it or an older one.
+ */
+typedef struct _RTreeSnapshot
+{
+	RTreeNode *root;
+	int refs;	/* readers holding it, plus one while it is the current version */
+	RTreeNode **retired;	/* its nodes replaced in the next version */
+	size_t retiredCount, retiredCapacity;
+	struct _RTreeSnapshot *newer;
+} RTreeSnapshot;
+
+typedef struct _RTreeVersions
+{
+	pthread_mutex_t lock;	/* over refs, current and the list of versions */
+	RTreeSnapshot *oldest, *current;
+	RTreeNode **fresh;	/* hash set of the nodes made since the last commit */
+	size_t freshCount, freshUsed, freshCapacity;	/* used counts removed slots too */
+} RTreeVersions;
+
+extern void RTreeIndexEnableSnapshots(RTreeIndex *);
+extern void RTreeIndexCommit(RTreeIndex *);
+extern RTreeSnapshot * RTreeSnapshotAcquire(RTreeIndex *);
+extern void RTreeSnapshotRelease(RTreeIndex *, RTreeSnapshot *);
+extern RTreeNode * RTreeIndexWritable(RTreeIndex *, RTreeNode *);
+extern int RTreeSnapshotIsFresh(RTreeVersions *, RTreeNode *);
+extern void RTreeSnapshotAddFresh(RTreeVersions *, RTreeNode *);
+extern int RTreeSnapshotRetire(RTreeIndex *, RTreeNode *);
+extern void RTreeSnapshotFreeVersions(RTreeIndex *);
+
+// MARK: - RTreeConcurrent
+/*
+ * Inserts, deletes and searches of an index from any number of threads at
+ * once, by optimistic lock coupling (Leis et al., "The ART of practical
+ * synchronization", DaMoN 2016) on the version of every node.  A thread
+ * reads a node without locking it and checks afterwards that its version
+ * did not change; it locks a node only to write it, one node at a time,
+ * except for a split, which also locks the parent.  Splits are serialized
+ * and counted; a search or delete that saw one happen starts over, since
+ * it may have missed the entries moved to the new node.
+ * Deletes are lazy: they take the entry out of its leaf and leave the
+ * rects above as they are, and never free a node, so a reader is never
+ * on freed memory.  An R* index splits here without forced reinsertion.
+ */
+typedef struct _RTreeConcurrent
+{
+	pthread_mutex_t smoLock;	/* over splits, the arena and the split scratch space */
+	unsigned long splits;	/* splits done, changed only under smoLock */
+} RTreeConcurrent;
+
+/* searches that start over this often take smoLock for the next try */
+#define CONCURRENT_RETRIES 3
+
+extern void RTreeIndexEnableConcurrent(RTreeIndex *);
+extern int RTreeIndexInsertConcurrent(RTreeIndex *, RTreeRect *, void *tid);
+extern int RTreeIndexDeleteConcurrent(RTreeIndex *, RTreeRect *, void *tid);
+extern int RTreeIndexSearchConcurrent(RTreeIndex *, RTreeRect *, void *cbarg, RTreeSearchHitCallback callback);
+extern long RTreeIndexCheck(RTreeIndex *);
+
+// MARK: - RTreeLocator
+/*
+ * Hash maps from every tid to the leaf holding it and from every node but
+ * the root to its parent, kept by RTreeIndexAddBranch and
+ * RTreeIndexFreeNode as entries and nodes move.  With them a delete goes
+ * straight to the leaf and back up to the root, and needs no rect.  Tids
+ * must not be NULL.  Not with snapshots or concurrent updates.
+ */
+typedef struct
+{
+	void *key;	/* NULL: the slot is empty */
+	RTreeNode *node;
+} RTreeLocatorSlot;
+
+typedef struct
+{
+	RTreeLocatorSlot *slots;	/* open addressing, a power of 2 of them */
+	size_t capacity, count;
+} RTreeLocatorMap;
+
+typedef struct _RTreeLocator
+{
+	RTreeLocatorMap leaves;	/* tid to the leaf holding it */
+	RTreeLocatorMap parents;	/* node to its parent */
+} RTreeLocator;
+
+extern void RTreeIndexEnableLocator(RTreeIndex *);
+extern RTreeNode * RTreeIndexLocate(RTreeIndex *, void *tid);
+extern int RTreeIndexDeleteTid(RTreeIndex *, void *tid);
+extern void RTreeLocatorAdd(RTreeLocator *, RTreeNode *n, RTreeNode *child);
+extern void RTreeLocatorRemoveTid(RTreeLocator *, void *tid);
+extern RTreeNode * RTreeLocatorParent(RTreeLocator *, RTreeNode *);
+extern void RTreeLocatorFreeNode(RTreeLocator *, RTreeNode *);
+extern void RTreeLocatorClear(RTreeLocator *);
+extern void RTreeLocatorFree(RTreeIndex *);
+
+// MARK: - RTreeUpdate
+/*
+ * Moves an entry to a new rect with as little change to the tree as will
+ * do, trying in turn: the same leaf, if the new rect is within the rect the
+ * parent has for it; the same leaf with that rect fitted to the entries
+ * again, if that grows its margin by at most UPDATE_SLACK and keeps it
+ * within the parent's own rect; a sibling leaf whose rect holds the new
+ * rect and that has room; and last a delete and insert.  Nothing above the
+ * leaf's rect changes but in the last case, and the leaf's rect is not
+ * shrunk when an entry moves away inside it, so it may get looser than the
+ * entries in it until a delete or insert goes through.
+ */
+typedef enum
+{
+	RTreeUpdateInPlace,	/* within the leaf's rect */
+	RTreeUpdateEnlarged,	/* the leaf's rect grown */
+	RTreeUpdateMoved,	/* to a sibling leaf */
+	RTreeUpdateReinserted,	/* deleted and inserted */
+	RTreeUpdateNotFound
+} RTreeUpdateKind;
+
+/* growth of the margin of a leaf's rect, relative to it, an update may make */
+#define UPDATE_SLACK	0.1
+
+/* deepest tree an update works on in place; a taller one deletes and inserts */
+#define UPDATE_DEPTH	64
+
+extern RTreeUpdateKind RTreeIndexUpdateRect(RTreeIndex *, void *tid, RTreeRect *oldRect, RTreeRect *newRect);
+extern RTreeUpdateKind RTreeUpdateRect(RTreeNode **, void *tid, RTreeRect *oldRect, RTreeRect *newRect);
+
+// MARK: - RTreeSplitNode
+extern void RTreeSplitNode(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
+extern void RTreeSplitNodeQuadratic(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
+extern void RTreeSplitNodeLinear(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
+
+// MARK: - R*-tree
+/*
+ * Beckmann, Kriegel, Schneider, Seeger: "The R*-tree", SIGMOD 1990.
+ * Used for every insertion into an index whose split method is RTreeSplitRStar:
+ * it picks the subtree by least overlap enlargement above the leaves, splits
+ * along the axis with the smallest margin sum, and reinserts part of the
+ * entries of a node the first time a level overflows during an insertion.
+ */
+extern int RTreeInsertRectRStar(RTreeRect*, void *, RTreeNode**, int depth);
+extern int RTreeIndexInsertRectRStar(RTreeIndex *, RTreeRect*, void *, int depth);
+extern int RTreePickBranchRStar(RTreeRect *, RTreeNode *);
+extern void RTreeSplitNodeRStar(RTreeIndex *t, RTreeNode *n, RTreeBranch *b, RTreeNode **nn);
+
+// MARK: - RTreeBulkLoad
+typedef enum
+{
+	RTreeBulkLoadSTR,	/* Sort-Tile-Recursive */
+	RTreeBulkLoadHilbert	/* order of the rect centers along a Hilbert curve */
+} RTreeBulkLoadMethod;
+
+extern RTreeNode * RTreeBulkLoad(RTreeRect *rects, void **tids, size_t n, RTreeBulkLoadMethod method, double fill);
+extern void RTreeIndexBulkLoad(RTreeIndex *, RTreeRect *rects, void **tids, size_t n, RTreeBulkLoadMethod method, double fill);
+extern void RTreeSortTileBranches(RTreeBranch *, size_t n, size_t cap);
+extern void RTreeSortHilbertBranches(RTreeBranch *, size_t n);
+
+// MARK: - Node kernels
+/*
+ * Tests of a search rect against all branches of a node at once, one bit of
+ * the result per branch, run with SIMD instructions where the CPU has them.
+ * The kernel is picked on first use; RTreeSetKernel overrides that choice.
+ */
+typedef enum
+{
+	RTreeKernelAuto,	/* the best one the CPU supports */
+	RTreeKernelScalar,
+	RTreeKernelSSE,
+	RTreeKernelAVX2
+} RTreeKernel;
+
+typedef enum
+{
+	RTreeModeIntersecting,	/* data rects that overlap the search rect, as RTreeSearch */
+	RTreeModeContained,	/* data rects inside the search rect, as RTreeSearchContained */
+	RTreeModeContaining	/* data rects around the search rect, as RTreeSearchContaining */
+} RTreeSearchMode;
+
+/* 64-bit words in a mask with one bit per branch of a node */
+#define MASKWORDS ((MAXCARD + 63) / 64)
+
+/* index of the lowest bit set in a nonzero mask word */
+#define MaskLowest(m) __builtin_ctzll(m)
+
+extern RTreeKernel RTreeSetKernel(RTreeKernel);
+extern RTreeKernel RTreeGetKernel();
+extern void RTreeNodeOverlapMask(RTreeNode *, int count, RTreeRect *, uint64_t *mask);
+extern void RTreeNodeContainedMask(RTreeNode *, int count, RTreeRect *, uint64_t *mask);
+extern void RTreeNodeContainingMask(RTreeNode *, int count, RTreeRect *, uint64_t *mask);
+extern void RTreeNodeSearchMask(RTreeNode *, RTreeRect *, RTreeSearchMode, uint64_t *mask);
+
+// MARK: - RTreeCursor
+/* deepest tree a cursor can walk */
+#define CURSOR_DEPTH 64
+
+/* a node on the path of a cursor and the branches of it still to visit */
+typedef struct _RTreeCursorFrame
+{
+	RTreeNode *node;
+	uint64_t mask[MASKWORDS];
+} RTreeCursorFrame;
+
+/*
+ * A search that hands out its hits one at a time or in batches, keeping the
+ * path it is on in an explicit stack instead of recursing.  A cursor lives
+ * wherever the caller puts it and holds no other memory.  The tree must not
+ * be modified while a cursor on it is open.
+ */
+typedef struct _RTreeCursor
+{
+	RTreeRect rect;
+	RTreeSearchMode mode;
+	int depth;	/* frames in use, 0 once the search is over */
+	RTreeCursorFrame stack[CURSOR_DEPTH];
+} RTreeCursor;
+
+extern void RTreeCursorOpen(RTreeCursor *, RTreeNode *, RTreeRect *, RTreeSearchMode);
+extern int RTreeCursorNext(RTreeCursor *, void **tid, RTreeRect *);
+extern size_t RTreeCursorNextBatch(RTreeCursor *, void **tids, RTreeRect *, size_t max);
+extern void RTreeCursorClose(RTreeCursor *);
+
+// MARK: - RTreeSearchBatch
+/* a data rect found by a batched search, and the query it answers */
+typedef struct _RTreeBatchHit
+{
+	void *tid;
+	size_t query;	/* index into the queries */
+} RTreeBatchHit;
+
+/*
+ * Called by a batched search with a buffer full of hits, and once more with
+ * the rest at the end.  It can terminate the search by returning 0.
+ */
+typedef int (*RTreeBatchFlushCallback)(RTreeBatchHit *, size_t, void *);
+
+extern size_t RTreeSearchBatch(RTreeNode *, RTreeRect *queries, size_t nq, RTreeSearchMode, RTreeBatchHit *hits, size_t maxhits, RTreeBatchFlushCallback flush, void *cbarg);
+
+// MARK: - RTreeNearest
+/*
+ * Best-first nearest neighbor search, Hjaltason & Samet, "Distance browsing
+ * in spatial databases", TODS 1999.  Nodes and data rects wait in one
+ * min-heap ordered by MINDIST from the query point, so the data rects come
+ * out in order of distance, one at a time, for as long as the caller asks.
+ */
+typedef struct _RTreeNearestEntry
+{
+	double dist;	/* squared MINDIST from the query point */
+	int level;	/* of the node, -1 for a data rect */
+	int branch;	/* of a data rect in its leaf */
+	RTreeNode *node;	/* the node, or the leaf of a data rect */
+} RTreeNearestEntry;
+
+/* heap entries a cursor holds before it allocates */
+#define NEAREST_LOCAL 128
+
+typedef struct _RTreeNearestCursor
+{
+	RectReal point[NUMDIMS];
+	double maxDist;	/* squared radius, nothing farther is reported */
+	RTreeNearestEntry *heap;	/* NULL while the heap fits in local */
+	size_t count, capacity;
+	RTreeNearestEntry local[NEAREST_LOCAL];
+} RTreeNearestCursor;
+
+extern void RTreeNearestOpen(RTreeNearestCursor *, RTreeNode *, RectReal *point, double radius);
+extern int RTreeNearestNext(RTreeNearestCursor *, void **tid, RTreeRect *, double *dist);
+extern void RTreeNearestClose(RTreeNearestCursor *);
+extern size_t RTreeSearchNearest(RTreeNode *, RectReal *point, size_t k, double radius, void **tids, double *dists);
+
+// MARK: - RTreeThreadPool
+/* called for a task with the index of the worker running it */
+typedef void (*RTreeTaskFunc)(void *task, int worker, void *arg);
+
+/* tasks waiting for a worker, taken from the tail by their owner and from the head by thieves */
+typedef struct _RTreeTaskQueue
+{
+	pthread_mutex_t lock;
+	char *items;
+	size_t head, tail, capacity, taskSize;
+} RTreeTaskQueue;
+
+struct _RTreeThreadPool;
+
+typedef struct _RTreeThreadPoolWorker
+{
+	struct _RTreeThreadPool *pool;
+	int index;
+	pthread_t thread;	/* not for worker 0, the thread calling RTreeThreadPoolRun */
+} RTreeThreadPoolWorker;
+
+/*
+ * A fixed set of worker threads with a task queue each.  A worker runs the
+ * tasks of its own queue and steals from the others when it runs dry.
+ */
+typedef struct _RTreeThreadPool
+{
+	int threads;
+	RTreeThreadPoolWorker *workers;
+	RTreeTaskQueue *queues;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	unsigned int generation;	/* of the current run */
+	int busy;	/* helper threads not done with the current run */
+	int quit;
+	size_t pending;	/* tasks of the current run not done yet */
+	size_t taskSize;
+	char *scratch;	/* one task per worker */
+	RTreeTaskFunc func;
+	void *arg;
+} RTreeThreadPool;
+
+extern RTreeThreadPool * RTreeThreadPoolNew(int threads);
+extern void RTreeThreadPoolFree(RTreeThreadPool *);
+extern int RTreeThreadPoolSize(RTreeThreadPool *);
+extern void RTreeThreadPoolRun(RTreeThreadPool *, void *tasks, size_t ntasks, size_t taskSize, RTreeTaskFunc, void *arg);
+extern void RTreeThreadPoolPush(RTreeThreadPool *, int worker, void *task);
+
+// MARK: - RTreeJoin
+/*
+ * Called for every pair of intersecting data rects of two trees, with
+ * their tids.  It can terminate the join by returning 0.
+ */
+typedef int (*RTreeJoinCallback)(void *, void *, void *);
+
+typedef struct _RTreeJoinPair
+{
+	void *a, *b;	/* tids */
+} RTreeJoinPair;
+
+/* the pairs found by one worker of a parallel join */
+typedef struct _RTreeJoinBuffer
+{
+	RTreeJoinPair *pairs;
+	size_t count, capacity;
+} RTreeJoinBuffer;
+
+extern int RTreeJoin(RTreeNode *, RTreeNode *, RTreeJoinCallback callback, void *cbarg);
+extern size_t RTreeJoinParallel(RTreeNode *, RTreeNode *, RTreeThreadPool *, RTreeJoinBuffer *buffers);
+extern void RTreeJoinBufferFree(RTreeJoinBuffer *);
+
+// MARK: - RTreeSearchParallel
+/* subtrees of this level or lower are searched by one worker, whole */
+#define PARALLEL_CUTOFF 1
+
+/* the hits found by one worker of a parallel search */
+typedef struct _RTreeHitBuffer
+{
+	RTreeBatchHit *hits;
+	size_t count, capacity;
+} RTreeHitBuffer;
+
+extern size_t RTreeSearchParallel(RTreeNode *, RTreeRect *, RTreeSearchMode, RTreeThreadPool *, RTreeHitBuffer *buffers);
+extern size_t RTreeSearchBatchParallel(RTreeNode *, RTreeRect *queries, size_t nq, RTreeSearchMode, RTreeThreadPool *, RTreeHitBuffer *buffers);
+extern void RTreeHitBufferFree(RTreeHitBuffer *);
+
+// MARK: - RTreeStats
+/*
+ * Counters of what the library does, kept only when it is built with
+ * RTREE_STATS defined; otherwise the macros below are empty and
+ * RTreeGetStats reports all 0.  Every thread counts into its own block,
+ * with no atomic read-modify-writes or locks on the way;
+ * RTreeGetStats adds up the blocks of all threads, the ones gone included.
+ * The counters are of the whole process, not of one tree: reset them,
+ * run the operations of interest and read them.
+ * A latency is taken per insertion, deletion, search of one rect and
+ * nearest search; batched searches count visits and hits only.
+ */
+
+/* levels counted apart, deeper ones go to the last */
+#define STATS_LEVELS	16
+
+/* latency buckets, bucket b for [2^b, 2^(b+1)) ns, the last one open */
+#define STATS_BUCKETS	32
+
+typedef struct _RTreeStats
+{
+	uint64_t visits[STATS_LEVELS];	/* nodes read by searches, by level */
+	uint64_t rectTests;	/* tests of a rect against a branch */
+	uint64_t hits;	/* data rects found by searches */
+	uint64_t splits[3];	/* node splits, by RTreeSplitMethod */
+	uint64_t reinsertedNodes;	/* underfull nodes a deletion took out */
+	uint64_t reinsertedEntries;	/* and the branches of them it put back */
+	uint64_t forcedReinserts;	/* branches R* insertion took out and put back */
+	uint64_t nodeAllocs, nodeFrees;
+	uint64_t insertLatency[STATS_BUCKETS];
+	uint64_t deleteLatency[STATS_BUCKETS];
+	uint64_t searchLatency[STATS_BUCKETS];
+} RTreeStats;
+
+typedef enum
+{
+	RTreeStatsInsert,
+	RTreeStatsDelete,
+	RTreeStatsSearch
+} RTreeStatsOperation;
+
+extern int RTreeStatsEnabled();
+extern void RTreeGetStats(RTreeStats *);
+extern void RTreeResetStats();
+
+#ifdef RTREE_STATS
+extern __thread RTreeStats *RTreeStatsOfThread;
+extern RTreeStats * RTreeStatsAttach();
+extern uint64_t RTreeStatsBegin();
+extern void RTreeStatsEnd(RTreeStatsOperation, uint64_t started);
+
+/* written by its own thread only, read by RTreeGetStats on any */
+static inline void RTreeStatsBump(uint64_t *counter, uint64_t n) {
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+#define RTreeStatsHere() (RTreeStatsOfThread ? RTreeStatsOfThread : RTreeStatsAttach())
+#define RTreeStatsAdd(field, n) RTreeStatsBump(&RTreeStatsHere()->field, (uint64_t)(n))
+#define RTreeStatsVisit(n) RTreeStatsAdd(visits[(n)->level < STATS_LEVELS ? (n)->level : STATS_LEVELS-1], 1)
+/* time an operation; the ones it calls are not timed apart */
+#define RTreeStatsTimer(timer) uint64_t timer
+#define RTreeStatsStart(timer) (timer = RTreeStatsBegin())
+#define RTreeStatsStop(operation, timer) RTreeStatsEnd(operation, timer)
+#else
+#define RTreeStatsAdd(field, n)
+#define RTreeStatsVisit(n)
+#define RTreeStatsTimer(timer)
+#define RTreeStatsStart(timer)
+#define RTreeStatsStop(operation, timer)
+#endif
+
+// MARK: - RTreeAnalyze
+/*
+ * The shape of a tree, to tell how well it is built: how full its nodes
+ * are against MinNodeFill and MinLeafFill, and how much of the area of each
+ * node its branches cover twice (overlap) or not at all (dead space), per
+ * level.  Areas are volumes in more than two dimensions.  Reads every node
+ * once; the tree must not change meanwhile.
+ */
+
+/* levels reported apart, a taller tree's top ones go to the last */
+#define ANALYZE_LEVELS	16
+
+typedef struct _RTreeLevelAnalysis
+{
+	long nodes;
+	long entries;	/* branches of the nodes */
+	int minCount, maxCount;	/* fewest and most branches of one node */
+	long underfull;	/* nodes below the minimum fill, the root left out */
+	double fill;	/* entries / (nodes * fanout) */
+	double area;	/* sum of the areas of the nodes */
+	double perimeter;	/* sum of the margins of the nodes */
+	double overlap;	/* area of the nodes covered by two branches or more */
+	double pairwiseOverlap;	/* sum of the overlap areas of every pair of sibling branches */
+	double deadSpace;	/* area of the nodes covered by no branch */
+} RTreeLevelAnalysis;
+
+typedef struct _RTreeAnalysis
+{
+	int height;	/* levels, 1 for a lone leaf */
+	long nodes, entries;	/* data rects */
+	int nodecard, leafcard;	/* the fanout fill is against */
+	int minNodeFill, minLeafFill;
+	double overlap, pairwiseOverlap, deadSpace, perimeter;	/* of all levels */
+	RTreeLevelAnalysis level[ANALYZE_LEVELS];	/* by node level, the leaves first */
+} RTreeAnalysis;
+
+extern void RTreeIndexAnalyze(RTreeIndex *, RTreeAnalysis *);
+extern void RTreeAnalyze(RTreeNode *root, RTreeAnalysis *);
+
+// MARK: - RTreeMapped
+/*
+ * A tree in a file, searched where it is mapped without reading it in.
+ * The file is a header block followed by the nodes, each a block the size
+ * of an RTreeNode laid out as one, breadth first from the root.  An internal
+ * node holds the file offsets of its children where a node in memory has
+ * pointers; a leaf holds the tids as they were, so they had better be ids
+ * rather than addresses.  Blocks are aligned to their size and so never
+ * straddle a page.  Files are in the byte order and node layout of the
+ * machine that wrote them, which the header records, and are rejected
+ * elsewhere.
+ */
+#define MAPPED_MAGIC	"RTREEMAP"
+#define MAPPED_VERSION	1
+#define MAPPED_BYTEORDER	0x01020304
+
+typedef struct _RTreeMappedHeader
+{
+	char magic[8];	/* MAPPED_MAGIC */
+	uint32_t version;	/* MAPPED_VERSION */
+	uint32_t byteOrder;	/* MAPPED_BYTEORDER as written */
+	uint16_t numdims, realSize, maxcard, nodeSize;
+	int32_t nodecard, leafcard;
+	int32_t height;
+	uint64_t nodes, entries;
+	uint64_t root;	/* offset of the root node */
+} RTreeMappedHeader;
+
+/* an open mapped file */
+typedef struct _RTreeMapped
+{
+	const unsigned char *base;
+	size_t size;
+	RTreeMappedHeader header;
+	RTreeNode *root;
+} RTreeMapped;
+
+extern int RTreeIndexWriteMapped(RTreeIndex *, const char *path);
+extern int RTreeWriteMapped(RTreeNode *root, const char *path);
+extern int RTreeMappedOpen(RTreeMapped *, const char *path);
+extern int RTreeMappedSearch(RTreeMapped *, RTreeRect *, RTreeSearchMode, void *cbarg, RTreeSearchHitCallback callback);
+extern void RTreeMappedClose(RTreeMapped *);
+
+// MARK: - RTreeSave
+/*
+ * A checkpoint of a tree to load back as a tree to go on changing.
+ * The file is a header, then every node breadth first from the root as its
+ * level, count and branch rects, side by side, and the tids at leaves; the
+ * children of the internal nodes are the nodes that follow in order, so no
+ * links are stored.  A checksum of all of it comes last.  Like a mapped
+ * file it is read only on a machine of the same byte order and layout.
+ */
+#define SAVE_MAGIC	"RTREESAV"
+#define SAVE_VERSION	1
+
+typedef struct _RTreeSaveHeader
+{
+	char magic[8];	/* SAVE_MAGIC */
+	uint32_t version;	/* SAVE_VERSION */
+	uint32_t byteOrder;	/* MAPPED_BYTEORDER as written */
+	uint16_t numdims, realSize, tidSize, reserved;
+	int32_t nodecard, leafcard, split;
+	int32_t height;
+	uint64_t nodes, entries;
+	uint64_t bytes;	/* of the header and nodes, that the checksum is of */
+} RTreeSaveHeader;
+
+extern int RTreeIndexSave(RTreeIndex *, const char *path);
+extern RTreeIndex * RTreeIndexLoad(const char *path);
+extern int RTreeSave(RTreeNode *root, const char *path);
+extern RTreeNode * RTreeLoad(const char *path);
+
+// MARK: - RTreeQuantized
+/*
+ * A read only copy of a tree with compact internal nodes.  The rect of each
+ * child of an internal node is kept as a number of steps of 1/QUANTSTEPS of
+ * the node's own rect, rounded outward, so it holds all of the exact rect
+ * and a node of PGSIZE bytes takes QMAXCARD children where an RTreeNode
+ * takes MAXCARD: 41 instead of 21 at 16 bits, 61 at 8.  The leaves keep
+ * their exact rects, so a search finds just what one of the tree does.
+ */
+#ifndef QUANTBITS
+#define QUANTBITS	16	/* 8 or 16 */
+#endif
+#if QUANTBITS == 8
+typedef uint8_t RTreeQuant;
+#else
+typedef uint16_t RTreeQuant;
+#endif
+#define QUANTSTEPS	((1 << QUANTBITS) - 1)
+
+/* max branching factor of a quantized node */
+#define QMAXCARD (int)((PGSIZE-(2*sizeof(short)+NUMSIDES*sizeof(RectReal))) / (NUMSIDES*sizeof(RTreeQuant) + sizeof(uint32_t)))
+
+/* 64-bit words in a mask with one bit per child of a quantized node */
+#define QMASKWORDS ((QMAXCARD + 63) / 64)
+
+typedef struct _RTreeQuantNode
+{
+	short count;
+	short level;	/* 1 and up; the children at level 1 are leaves */
+	RectReal cover[NUMSIDES];	/* exact rect of the node, that the children are in steps of */
+	RTreeQuant bound[NUMSIDES][QMAXCARD];
+	uint32_t child[QMAXCARD];	/* index in nodes, or in leaves at level 1 */
+} RTreeQuantNode;
+
+typedef struct _RTreeQuantized
+{
+	RTreeNode *leaves;	/* exact copies of the leaves of the tree */
+	RTreeQuantNode *nodes;	/* level by level up, the root last */
+	size_t leafCount, nodeCount;
+	size_t entries;
+	int height;	/* 1 if the root is a leaf */
+} RTreeQuantized;
+
+extern void RTreeQuantNodeMask(RTreeQuantNode *, int count, int *limit, uint64_t *mask);
+extern RTreeQuantized * RTreeIndexQuantize(RTreeIndex *);
+extern RTreeQuantized * RTreeQuantize(RTreeNode *root);
+extern int RTreeQuantizedSearch(RTreeQuantized *, RTreeRect *, RTreeSearchMode, void *cbarg, RTreeSearchHitCallback callback);
+extern size_t RTreeQuantizedBytes(RTreeQuantized *);
+extern void RTreeQuantizedFree(RTreeQuantized *);
+
+// MARK: - RTreeIngest
+/*
+ * A write buffer in front of an index for a fast stream of inserts.  New
+ * entries are appended to the buffer, kept as leaves outside the tree that
+ * searches scan along with it.  At threshold entries the buffer goes into
+ * the tree in one batch: sorted in Hilbert order, so that each entry goes
+ * down most of the way the one before it did, or, once it holds as many
+ * entries as the tree, by bulk loading the two together.  While an ingest
+ * is on, the index is changed only through it, from one thread.
+ */
+typedef struct _RTreeIngest
+{
+	RTreeIndex *index;
+	RTreeNode *buffer;	/* leaves of the entries not in the tree yet, all but the last full */
+	size_t pages, pageCapacity;
+	size_t count;	/* entries in the buffer */
+	size_t threshold;	/* count at which the buffer is merged */
+	size_t entries;	/* in the tree */
+	size_t merges, rebuilds;
+} RTreeIngest;
+
+extern RTreeIngest * RTreeIngestNew(RTreeIndex *, size_t threshold);
+extern void RTreeIngestFree(RTreeIngest *);
+extern void RTreeIngestInsert(RTreeIngest *, RTreeRect *, void *tid);
+extern int RTreeIngestDelete(RTreeIngest *, RTreeRect *, void *tid);
+extern void RTreeIngestMerge(RTreeIngest *);
+extern int RTreeIngestSearch(RTreeIngest *, RTreeRect *, RTreeSearchMode, void *cbarg, RTreeSearchHitCallback callback);
+
+// MARK: - RTreeDeleteWhere
+/*
+ * Deletes all the data rects that relate to a search rect as the mode says
+ * in one walk down the tree.  A predicate, if given, is called with the tid
+ * and rect of each of them, as a search callback is, plus its argument, and
+ * returns nonzero for the ones to delete.  Without one, a subtree whose rect
+ * is inside the search rect goes as a whole, its entries not looked at.
+ * Underfull nodes are reinserted once, after the walk.
+ */
+typedef int (*RTreeDeletePredicate)(void *, RTreeRect *, void *);
+
+extern size_t RTreeIndexDeleteWhere(RTreeIndex *, RTreeRect *, RTreeSearchMode, RTreeDeletePredicate predicate, void *arg);
+extern size_t RTreeDeleteWhere(RTreeNode **, RTreeRect *, RTreeSearchMode, RTreeDeletePredicate predicate, void *arg);
+
+// MARK: - RTreeAggregate
+/*
+ * Every node above the leaves keeps the number of data rects below it in
+ * total, brought up to date by insertions, deletions, splits and
+ * reinsertions on their way back up, so a count takes a branch whose rect
+ * lies inside the search rect as a whole instead of going down it.  It
+ * shares the word of the version, so with concurrent updates on the
+ * totals are not kept.
+ */
+static inline size_t RTreeNodeTotal(RTreeNode *n) {
+	return n->level > 0 ? n->total : (size_t)n->count;
+}
+
+extern void RTreeAggregateFix(RTreeNode *);
+extern size_t RTreeCount(RTreeNode *, RTreeRect *, RTreeSearchMode);
+extern size_t RTreeIndexCount(RTreeIndex *, RTreeRect *, RTreeSearchMode);
+
 extern void RTreeRecursivelyFreeBranch(RTreeBranch *b);
 extern void RTreeRecursivelyFreeNode(RTreeNode *n);
 
+/* fanout of the default index */
 extern int NODECARD;
 extern int LEAFCARD;
 
 /* balance criteria for node splitting */
 /* NOTE: can be changed if needed. */
-#define MinNodeFill (NODECARD / 2)
-#define MinLeafFill (LEAFCARD / 2)
+#define MinNodeFill(t) ((t)->nodecard / 2)
+#define MinLeafFill(t) ((t)->leafcard / 2)
 
-#define MAXKIDS(n) ((n)->level > 0 ? NODECARD : LEAFCARD)
-#define MINFILL(n) ((n)->level > 0 ? MinNodeFill : MinLeafFill)
+#define MAXKIDS(t, n) ((n)->level > 0 ? (t)->nodecard : (t)->leafcard)
+#define MINFILL(t, n) ((n)->level > 0 ? MinNodeFill(t) : MinLeafFill(t))
 #endif /* _INDEX_ */
@@ -28,6 +28,14 @@ public enum RTreeSearchOptions {
 		case .containing: return RTreeSearchContaining
 		}
 	}
+
+	var mode: RTreeSearchMode {
+		switch self {
+		case .intersecting: return RTreeModeIntersecting
+		case .contained: return RTreeModeContained
+		case .containing: return RTreeModeContaining
+		}
+	}
 }
 
 // MARK: - RTreeRect
@@ -43,86 +51,186 @@ extension RTreeRect {
 	}
 }
 
+// MARK: - RTreeStats
+/// Counters of all trees of the process, kept when the C library is built
+/// with RTREE_STATS; reset, run the operations of interest, then read.
+public extension RTreeStats {
+	static var isEnabled: Bool { RTreeStatsEnabled() != 0 }
+	static var current: RTreeStats {
+		var stats = RTreeStats()
+		RTreeGetStats(&stats)
+		return stats
+	}
+	static func reset() {
+		RTreeResetStats()
+	}
+
+	/// Nodes read by searches, by level, the leaves first.
+	var visitsByLevel: [UInt64] { Self.array(visits) }
+	/// Splits by `RTreeSplitMethod` raw value.
+	var splitsByMethod: [UInt64] { Self.array(splits) }
+	/// Latency histograms: bucket `b` counts operations that took
+	/// `2^b` up to `2^(b+1)` nanoseconds.
+	var insertHistogram: [UInt64] { Self.array(insertLatency) }
+	var deleteHistogram: [UInt64] { Self.array(deleteLatency) }
+	var searchHistogram: [UInt64] { Self.array(searchLatency) }
+
+	private static func array<T>(_ tuple: T) -> [UInt64] {
+		withUnsafeBytes(of: tuple) { Array($0.bindMemory(to: UInt64.self)) }
+	}
+}
+
+// MARK: - RTreeAnalysis
+public extension RTreeAnalysis {
+	/// The levels of the tree, the leaves first.
+	var levels: [RTreeLevelAnalysis] {
+		withUnsafeBytes(of: level) {
+			Array($0.bindMemory(to: RTreeLevelAnalysis.self).prefix(Int(min(height, ANALYZE_LEVELS))))
+		}
+	}
+}
+
 // MARK: - RTree
 final public class RTree<Element> where Element: Identifiable {
-	var root: UnsafeMutablePointer<RTreeNode>?
+	let index: UnsafeMutablePointer<RTreeIndex>
+	var root: UnsafeMutablePointer<RTreeNode>? { index.pointee.root }
 	var elements = [Element.ID: Element]()
+	/// The tree stores a pointer to a copy of the element's id as the tid of its entry;
+	/// the copies live here until the element is removed.
+	var tids = [Element.ID: UnsafeMutablePointer<Element.ID>]()
+	/// The rect of every element's entry, to find it by without the locator.
+	var rects = [Element.ID: RTreeRect]()
+	/// Worker threads of the last parallel search or join, kept for the next.
+	var pool: UnsafeMutablePointer<RTreeThreadPool>?
 	deinit {
-		RTreeRecursivelyFreeNode(root)
+		RTreeIndexFree(index)
+		releaseTids()
+		if let pool = pool {
+			RTreeThreadPoolFree(pool)
+		}
+	}
+	/// Every tree has its own fanout and split method, and can be
+	/// modified independently of other trees on another thread.
+	/// With `locator` the tree keeps the leaf of every element, so that
+	/// `remove(id:)` and replacing `insert` go straight to it rather than
+	/// searching for its rect.
+	public init(nodeMax: Int32 = RTreeGetNodeMax(), leafMax: Int32 = RTreeGetLeafMax(), split: RTreeSplitMethod = RTreeSplitQuadratic, locator: Bool = false) {
+		guard let index = RTreeIndexNew(nodeMax, leafMax, split) else {
+			fatalError("invalid fanout: \(nodeMax), \(leafMax)")
+		}
+		self.index = index
+		if locator {
+			RTreeIndexEnableLocator(index)
+		}
 	}
-	public init() {
-		root = RTreeNewIndex()
+}
+
+public extension RTree where Element: RTreeElement {
+	/// Builds the tree from the complete set of elements in one pass
+	/// instead of inserting them one by one.
+	convenience init<S>(elements: S, method: RTreeBulkLoadMethod = RTreeBulkLoadSTR, fill: Double = 1) where S: Sequence, S.Element == Element {
+		self.init()
+
+		var rects = [RTreeRect]()
+		var ids = [UnsafeMutableRawPointer?]()
+		for element in elements where nil == self.elements.updateValue(element, forKey: element.id) {
+			rects.append(RTreeRect(element.rect))
+			self.rects[element.id] = rects.last
+			ids.append(UnsafeMutableRawPointer(tid(for: element.id)))
+		}
+
+		RTreeIndexBulkLoad(index, &rects, &ids, rects.count, method, fill)
 	}
 }
 
 public extension RTree {
 	var bounds: CGRect {
 		guard let root = root else { fatalError() }
-		var node = root.pointee
-		assert(node.level >= 0)
-
-		return withUnsafeBytes(of: &node.branch) { rawPtr in
-			let branch = rawPtr.baseAddress!.assumingMemoryBound(to: RTreeBranch.self)
-			let count = Int(node.level > 0 ? NODECARD : LEAFCARD)
-			return (0 ..< count).reduce(CGRect.zero) {
-				$0.union(branch[$1].rect.rect)
-			}
-		}
+		assert(root.pointee.level >= 0)
+		return root.pointee.count > 0 ? RTreeNodeCover(root).rect : .zero
+	}
+	
+	/// Allocation counters of the tree's node arena; insertions and
+	/// deletions in steady state leave `heapAllocs` unchanged.
+	var arenaStats: RTreeArenaStats {
+		var stats = RTreeArenaStats()
+		RTreeIndexGetArenaStats(index, &stats)
+		return stats
+	}
+	
+	/// Fill, overlap and dead space of the tree, per level; see `RTreeAnalysis`.
+	var analysis: RTreeAnalysis {
+		var analysis = RTreeAnalysis()
+		RTreeIndexAnalyze(index, &analysis)
+		return analysis
 	}
 	
 	func contains(_ element: Element) -> Bool {
 		nil != elements[element.id]
 	}
+	/// Inserts an element, or replaces the one with its id, so that every
+	/// id has a single entry in the tree.  The old entry is found by the
+	/// rect it was inserted or last moved with, as `remove(id:)` does.
 	func insert(_ element: Element, rect: CGRect) {
+		if nil != tids[element.id] {
+			guard deleteEntry(for: element.id) else { fatalError("error replacing element with id: \(element.id)") }
+		}
 		elements[element.id] = element
 
-		var id = element.id
+		let tid = self.tid(for: element.id)
 		var rect = RTreeRect(rect)
+		rects[element.id] = rect
 
-		withUnsafeMutablePointer(to: &rect) { ptrRect in
-			withUnsafeMutableBytes(of: &id) { ptrID in
-				withUnsafeMutablePointer(to: &root) { ptrRoot in
-					_ = RTreeInsertRect(ptrRect, ptrID.baseAddress, ptrRoot, 0)
-				}
-			}
+		_ = RTreeIndexInsertRect(index, &rect, tid, 0)
+	}
+	/// Moves an element to a new rect, in place in its leaf when the tree
+	/// allows; `oldRect` is the one it was inserted or last moved with.
+	@discardableResult
+	func update(_ element: Element, from oldRect: CGRect, to rect: CGRect) -> RTreeUpdateKind {
+		guard let tid = tids[element.id] else { return RTreeUpdateNotFound }
+		var oldRect = RTreeRect(oldRect)
+		var rect = RTreeRect(rect)
+		elements[element.id] = element
+		let kind = RTreeIndexUpdateRect(index, tid, &oldRect, &rect)
+		if kind != RTreeUpdateNotFound {
+			rects[element.id] = rect
 		}
+		return kind
 	}
 	func removeAll() {
 		elements.removeAll()
-		RTreeRecursivelyFreeNode(root)
-		root = RTreeNewIndex()
+		RTreeIndexClear(index)
+		releaseTids()
+	}
+	/// Removes an element by its id alone, without its rect.
+	@discardableResult
+	func remove(id: Element.ID) -> Element? {
+		guard let element = elements[id], nil != tids[id] else { return nil }
+		guard deleteEntry(for: id) else { fatalError("error removing element with id: \(id)") }
+		elements.removeValue(forKey: id)
+		releaseTid(for: id)
+		return element
 	}
+	/// Removes the elements found by a search in one walk down the tree.
 	func remove(in rect: CGRect, options: RTreeSearchOptions = .default) -> [Element] {
-		var foundElements = [(Element.ID, RTreeRect)]()
-		search(RTreeRect(rect), options: options) {
-			guard let ptrID = $0, let rect = $1?.pointee else { return 0 }
-			let id = ptrID.assumingMemoryBound(to: Element.ID.self).pointee
-			foundElements.append((id, rect))
+		var rect = RTreeRect(rect)
+		var removedIDs = [Element.ID]()
+		var function = Function { ptrID, _ in
+			guard let ptrID = ptrID else { return 0 }
+			removedIDs.append(ptrID.assumingMemoryBound(to: Element.ID.self).pointee)
 			return 1
 		}
+		_ = withUnsafeMutablePointer(to: &function) { ptrFunction in
+			RTreeIndexDeleteWhere(index, &rect, options.mode, searchCallback, ptrFunction)
+		}
 
-		var deletedElements = [Element]()
-		withUnsafeMutablePointer(to: &root) { ptrRoot in
-			for element in foundElements {
-				var (id, rect) = element
-				guard let deletedElement = elements[id],
-					let index = elements.index(forKey: id) else {
-					fatalError("this should not have happened!")
-				}
-
-				let deleted = withUnsafeMutablePointer(to: &rect) { ptrRect in
-					withUnsafeMutablePointer(to: &id) { ptrID in
-						0 != RTreeDeleteRect(ptrRect, ptrID, ptrRoot)
-					}
-				}
-				
-				guard deleted else { fatalError("error removing element with id: \(id)") }
-
-				deletedElements.append(deletedElement)
-				elements.remove(at: index)
+		return removedIDs.map { id in
+			guard let deletedElement = elements.removeValue(forKey: id) else {
+				fatalError("this should not have happened!")
 			}
+			releaseTid(for: id)
+			return deletedElement
 		}
-		return deletedElements
 	}
 	func search(_ rect: CGRect, options: RTreeSearchOptions = .default, body: (Element.ID, CGRect) -> Bool) {
 		withoutActuallyEscaping(body) { escapingBody in
@@ -133,6 +241,121 @@ public extension RTree {
 			}
 		}
 	}
+	/// The number of elements a search would find, from the counts the
+	/// nodes keep, without visiting them.
+	func count(in rect: CGRect, options: RTreeSearchOptions = .default) -> Int {
+		var rect = RTreeRect(rect)
+		return RTreeIndexCount(index, &rect, options.mode)
+	}
+	/// Elements found by a search, produced lazily as the sequence is iterated,
+	/// without a callback per hit.  The tree must not be modified meanwhile.
+	func elements(in rect: CGRect, options: RTreeSearchOptions = .default) -> RTreeSearchSequence<Element> {
+		RTreeSearchSequence(tree: self, rect: RTreeRect(rect), options: options)
+	}
+	/// Ids of the elements intersecting each of the rects, found in a single
+	/// walk down the tree for all of them.
+	func search(_ rects: [CGRect], options: RTreeSearchOptions = .default) -> [[Element.ID]] {
+		guard let root = root else { fatalError() }
+		var queries = rects.map(RTreeRect.init)
+		var result = [[Element.ID]](repeating: [], count: rects.count)
+		var hits = [RTreeBatchHit](repeating: RTreeBatchHit(), count: 1024)
+		var flush = BatchFunction { hits, count in
+			guard let hits = hits else { return 0 }
+			for hit in UnsafeBufferPointer(start: hits, count: count) {
+				guard let ptrID = hit.tid else { return 0 }
+				result[hit.query].append(ptrID.assumingMemoryBound(to: Element.ID.self).pointee)
+			}
+			return 1
+		}
+		_ = withUnsafeMutablePointer(to: &flush) { ptrFlush in
+			RTreeSearchBatch(root, &queries, queries.count, options.mode, &hits, hits.count, batchFlushCallback, ptrFlush)
+		}
+		return result
+	}
+	/// Ids of the elements nearest to a point, nearest first, with their
+	/// distances; at most count of them and none farther than radius.
+	func nearest(to point: CGPoint, count: Int = 1, within radius: CGFloat = .infinity) -> [(id: Element.ID, distance: CGFloat)] {
+		guard let root = root else { fatalError() }
+		var point = [RectReal(point.x), RectReal(point.y)]
+		var tids = [UnsafeMutableRawPointer?](repeating: nil, count: count)
+		var dists = [Double](repeating: 0, count: count)
+		let found = RTreeSearchNearest(root, &point, count, Double(radius), &tids, &dists)
+		return (0..<found).map { i in
+			guard let ptrID = tids[i] else { fatalError("entry without a tid") }
+			return (ptrID.assumingMemoryBound(to: Element.ID.self).pointee, CGFloat(dists[i]))
+		}
+	}
+	/// Elements by increasing distance from a point, produced lazily as the
+	/// sequence is iterated.  The tree must not be modified meanwhile.
+	func neighbors(of point: CGPoint, within radius: CGFloat = .infinity) -> RTreeNearestSequence<Element> {
+		RTreeNearestSequence(tree: self, point: point, radius: radius)
+	}
+	/// Pairs of ids of intersecting elements, one of this tree and one of
+	/// the other, found by going down both trees together.  With more than
+	/// one thread the pairs come in no particular order.
+	func join<Other>(_ other: RTree<Other>, threads: Int = 1) -> [(Element.ID, Other.ID)] {
+		guard let root = root, let otherRoot = other.root else { fatalError() }
+		var result = [(Element.ID, Other.ID)]()
+		if threads == 1 {
+			var function = JoinFunction { ptrA, ptrB in
+				guard let ptrA = ptrA, let ptrB = ptrB else { return 0 }
+				result.append((ptrA.assumingMemoryBound(to: Element.ID.self).pointee, ptrB.assumingMemoryBound(to: Other.ID.self).pointee))
+				return 1
+			}
+			_ = withUnsafeMutablePointer(to: &function) { ptrFunction in
+				RTreeJoin(root, otherRoot, joinCallback, ptrFunction)
+			}
+			return result
+		}
+		let pool = threadPool(threads)
+		var buffers = [RTreeJoinBuffer](repeating: RTreeJoinBuffer(), count: Int(RTreeThreadPoolSize(pool)))
+		result.reserveCapacity(RTreeJoinParallel(root, otherRoot, pool, &buffers))
+		for i in buffers.indices {
+			for pair in UnsafeBufferPointer(start: buffers[i].pairs, count: buffers[i].count) {
+				guard let ptrA = pair.a, let ptrB = pair.b else { fatalError("entry without a tid") }
+				result.append((ptrA.assumingMemoryBound(to: Element.ID.self).pointee, ptrB.assumingMemoryBound(to: Other.ID.self).pointee))
+			}
+			RTreeJoinBufferFree(&buffers[i])
+		}
+		return result
+	}
+	/// Ids of the elements found by a search spread over threads, 0 meaning
+	/// one per CPU, in no particular order.  For large results; the tree must
+	/// not be modified meanwhile.
+	func search(_ rect: CGRect, options: RTreeSearchOptions = .default, threads: Int) -> [Element.ID] {
+		guard let root = root else { fatalError() }
+		var rect = RTreeRect(rect)
+		let pool = threadPool(threads)
+		var buffers = [RTreeHitBuffer](repeating: RTreeHitBuffer(), count: Int(RTreeThreadPoolSize(pool)))
+		var result = [Element.ID]()
+		result.reserveCapacity(RTreeSearchParallel(root, &rect, options.mode, pool, &buffers))
+		for i in buffers.indices {
+			for hit in UnsafeBufferPointer(start: buffers[i].hits, count: buffers[i].count) {
+				guard let ptrID = hit.tid else { fatalError("entry without a tid") }
+				result.append(ptrID.assumingMemoryBound(to: Element.ID.self).pointee)
+			}
+			RTreeHitBufferFree(&buffers[i])
+		}
+		return result
+	}
+	/// Ids of the elements intersecting each of the rects, the queries spread
+	/// over threads, 0 meaning one per CPU.
+	func search(_ rects: [CGRect], options: RTreeSearchOptions = .default, threads: Int) -> [[Element.ID]] {
+		guard let root = root else { fatalError() }
+		var queries = rects.map(RTreeRect.init)
+		let pool = threadPool(threads)
+		var buffers = [RTreeHitBuffer](repeating: RTreeHitBuffer(), count: Int(RTreeThreadPoolSize(pool)))
+		var result = [[Element.ID]](repeating: [], count: rects.count)
+		_ = RTreeSearchBatchParallel(root, &queries, queries.count, options.mode, pool, &buffers)
+		for i in buffers.indices {
+			for hit in UnsafeBufferPointer(start: buffers[i].hits, count: buffers[i].count) {
+				guard let ptrID = hit.tid else { fatalError("entry without a tid") }
+				result[hit.query].append(ptrID.assumingMemoryBound(to: Element.ID.self).pointee)
+			}
+			RTreeHitBufferFree(&buffers[i])
+		}
+		return result
+	}
 	func hitTest(_ point: CGPoint, size: CGSize = CGSize(width: 4, height: 4), body: (Element.ID, CGRect) -> Bool) {
 		let rect = CGRect(origin: point, size: size).offsetBy(dx: -size.width / 2, dy: -size.height / 2)
 		search(rect, body: body)
@@ -143,6 +366,123 @@ public extension RTree {
 	}
 }
 
+// MARK: - Tids
+extension RTree {
+	func tid(for id: Element.ID) -> UnsafeMutablePointer<Element.ID> {
+		if let tid = tids[id] { return tid }
+		let tid = UnsafeMutablePointer<Element.ID>.allocate(capacity: 1)
+		tid.initialize(to: id)
+		tids[id] = tid
+		return tid
+	}
+	/// Takes the entry of an element out of the tree: straight from its
+	/// leaf with the locator on, else by a search down to its rect, which
+	/// reads only the nodes covering it.
+	func deleteEntry(for id: Element.ID) -> Bool {
+		guard let tid = tids[id], var rect = rects[id] else { return false }
+		if nil != index.pointee.locator {
+			return 0 == RTreeIndexDeleteTid(index, tid)
+		}
+		return 0 == RTreeIndexDeleteRect(index, &rect, tid)
+	}
+	func releaseTid(for id: Element.ID) {
+		rects.removeValue(forKey: id)
+		guard let tid = tids.removeValue(forKey: id) else { return }
+		tid.deinitialize(count: 1)
+		tid.deallocate()
+	}
+	func releaseTids() {
+		rects.removeAll()
+		for tid in tids.values {
+			tid.deinitialize(count: 1)
+			tid.deallocate()
+		}
+		tids.removeAll()
+	}
+}
+
+// MARK: - RTreeSearchSequence
+public struct RTreeSearchSequence<Element>: Sequence where Element: Identifiable {
+	let tree: RTree<Element>
+	let rect: RTreeRect
+	let options: RTreeSearchOptions
+
+	public func makeIterator() -> Iterator {
+		Iterator(tree: tree, rect: rect, mode: options.mode)
+	}
+
+	/// Pulls hits from an RTreeCursor a batch at a time.
+	public final class Iterator: IteratorProtocol {
+		let tree: RTree<Element>
+		let cursor = UnsafeMutablePointer<RTreeCursor>.allocate(capacity: 1)
+		var tids = [UnsafeMutableRawPointer?](repeating: nil, count: 64)
+		var rects = [RTreeRect](repeating: RTreeRect(), count: 64)
+		var count = 0, position = 0, done = false
+
+		init(tree: RTree<Element>, rect: RTreeRect, mode: RTreeSearchMode) {
+			var rect = rect
+			self.tree = tree
+			RTreeCursorOpen(cursor, tree.root, &rect, mode)
+		}
+		deinit {
+			RTreeCursorClose(cursor)
+			cursor.deallocate()
+		}
+
+		public func next() -> (Element.ID, CGRect)? {
+			if position == count {
+				guard !done else { return nil }
+				count = tids.withUnsafeMutableBufferPointer { tids in
+					rects.withUnsafeMutableBufferPointer { rects in
+						RTreeCursorNextBatch(cursor, tids.baseAddress, rects.baseAddress, tids.count)
+					}
+				}
+				position = 0
+				done = count < tids.count
+				guard count > 0 else { return nil }
+			}
+			defer { position += 1 }
+			guard let ptrID = tids[position] else { fatalError("entry without a tid") }
+			return (ptrID.assumingMemoryBound(to: Element.ID.self).pointee, rects[position].rect)
+		}
+	}
+}
+
+// MARK: - RTreeNearestSequence
+public struct RTreeNearestSequence<Element>: Sequence where Element: Identifiable {
+	let tree: RTree<Element>
+	let point: CGPoint
+	let radius: CGFloat
+
+	public func makeIterator() -> Iterator {
+		Iterator(tree: tree, point: point, radius: radius)
+	}
+
+	/// Pulls elements from an RTreeNearestCursor.
+	public final class Iterator: IteratorProtocol {
+		let tree: RTree<Element>
+		let cursor = UnsafeMutablePointer<RTreeNearestCursor>.allocate(capacity: 1)
+
+		init(tree: RTree<Element>, point: CGPoint, radius: CGFloat) {
+			var point = [RectReal(point.x), RectReal(point.y)]
+			self.tree = tree
+			RTreeNearestOpen(cursor, tree.root, &point, Double(radius))
+		}
+		deinit {
+			RTreeNearestClose(cursor)
+			cursor.deallocate()
+		}
+
+		public func next() -> (id: Element.ID, distance: CGFloat)? {
+			var tid: UnsafeMutableRawPointer?
+			var distance = 0.0
+			guard 0 != RTreeNearestNext(cursor, &tid, nil, &distance) else { return nil }
+			guard let ptrID = tid else { fatalError("entry without a tid") }
+			return (ptrID.assumingMemoryBound(to: Element.ID.self).pointee, CGFloat(distance))
+		}
+	}
+}
+
 // MARK: - Search
 fileprivate struct Function {
 	var body: (UnsafeMutableRawPointer?, UnsafeMutablePointer<RTreeRect>?) -> Int32
@@ -153,7 +493,38 @@ fileprivate func searchCallback(_ ptrID: UnsafeMutableRawPointer?, _ ptrRect: Un
 	return function.body(ptrID, ptrRect)
 }
 
+fileprivate struct BatchFunction {
+	var body: (UnsafeMutablePointer<RTreeBatchHit>?, Int) -> Int32
+}
+
+fileprivate func batchFlushCallback(_ hits: UnsafeMutablePointer<RTreeBatchHit>?, _ count: Int, userInfo: UnsafeMutableRawPointer?) -> Int32 {
+	guard let function = userInfo?.assumingMemoryBound(to: BatchFunction.self).pointee else { return 0 }
+	return function.body(hits, count)
+}
+
+fileprivate struct JoinFunction {
+	var body: (UnsafeMutableRawPointer?, UnsafeMutableRawPointer?) -> Int32
+}
+
+fileprivate func joinCallback(_ ptrA: UnsafeMutableRawPointer?, _ ptrB: UnsafeMutableRawPointer?, userInfo: UnsafeMutableRawPointer?) -> Int32 {
+	guard let function = userInfo?.assumingMemoryBound(to: JoinFunction.self).pointee else { return 0 }
+	return function.body(ptrA, ptrB)
+}
+
 fileprivate extension RTree {
+	/// The pool of the tree, made anew if it has another number of threads.
+	func threadPool(_ threads: Int) -> UnsafeMutablePointer<RTreeThreadPool> {
+		let threads = threads > 0 ? threads : ProcessInfo.processInfo.activeProcessorCount
+		if let pool = pool, RTreeThreadPoolSize(pool) == Int32(threads) {
+			return pool
+		}
+		if let pool = pool {
+			RTreeThreadPoolFree(pool)
+		}
+		guard let newPool = RTreeThreadPoolNew(Int32(threads)) else { fatalError() }
+		pool = newPool
+		return newPool
+	}
 	func search(_ rect: RTreeRect, options: RTreeSearchOptions = .default, body: @escaping (UnsafeMutableRawPointer?, UnsafeMutablePointer<RTreeRect>?) -> Int32) {
 		var rect = rect
 		var function = Function(body: body)
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+extern "C" {
+#include "../RTreeIndexImpl/include/RTreeIndexImpl.h"
+}
+#include "include/RTree.hpp"
+
+/*
+ * The RTreeNode** functions of RTreeIndexImpl.h, and the rect and node
+ * functions under them, for the float, 2-D configuration, on top of
+ * RTree<RectReal, NUMDIMS, PGSIZE, void *>.  Its nodes are laid out as
+ * RTreeNode and keep the totals of RTreeAggregate.c, so a tree is the same
+ * whichever side built it, and RTreeCount works on either.
+ * Link this instead of RTreeRect.c, RTreeNode.c, RTreeCard.c,
+ * RTreeIndexImpl.c and RTreeSplit_rstar.c, for programs using only those
+ * functions; the RTreeIndex functions of those files go with them, the
+ * rest of the C library stays.  rtree-shim-check is built that way.
+ */
+typedef RTree<RectReal, NUMDIMS, PGSIZE, void *> RTreeClassic;
+
+static_assert(RTreeClassic::MaxCard == MAXCARD, "fanout differs from RTreeNode");
+static_assert(sizeof(RTreeClassic::Rect) == sizeof(RTreeRect), "rect differs from RTreeRect");
+static_assert(sizeof(RTreeClassic::Branch) == sizeof(RTreeBranch), "branch differs from RTreeBranch");
+static_assert(sizeof(RTreeClassic::Node) == sizeof(RTreeNode), "node differs from RTreeNode");
+static_assert(offsetof(RTreeClassic::Node, level) == offsetof(RTreeNode, level), "node differs from RTreeNode");
+static_assert(offsetof(RTreeClassic::Node, total) == offsetof(RTreeNode, total), "node differs from RTreeNode");
+static_assert(offsetof(RTreeClassic::Node, bound) == offsetof(RTreeNode, bound), "node differs from RTreeNode");
+static_assert(offsetof(RTreeClassic::Node, child) == offsetof(RTreeNode, child), "node differs from RTreeNode");
+
+/* nodes are shared as they are; rects are copied, being different types */
+#define ClassicNode(n) reinterpret_cast<RTreeClassic::Node *>(n)
+#define CNode(n) reinterpret_cast<RTreeNode *>(n)
+
+static RTreeClassic::Rect ClassicRect(const RTreeRect *r) {
+	RTreeClassic::Rect c;
+	memcpy(&c, r, sizeof(c));
+	return c;
+}
+
+static RTreeRect CRect(const RTreeClassic::Rect &r) {
+	RTreeRect c;
+	memcpy(&c, &r, sizeof(c));
+	return c;
+}
+
+extern "C" {
+
+int NODECARD = MAXCARD;
+int LEAFCARD = MAXCARD;
+
+}
+
+/// The tree the RTreeNode** functions work on, with the current NODECARD
+/// and LEAFCARD.  The caller sets the root, and takes it back after.
+/// Like those functions, it must not be used from more than one thread.
+static RTreeClassic * RTreeDefaultTree(RTreeTemplateSplit split) {
+	static RTreeClassic *t = NULL;
+
+	if (!t)
+	{
+		t = new RTreeClassic();
+		RTreeClassic::FreeNode(t->Root());	/* the roots come from the callers */
+		t->SetRoot(NULL);
+	}
+	t->SetNodeMax(NODECARD);
+	t->SetLeafMax(LEAFCARD);
+	t->SetSplit(split);
+	return t;
+}
+
+/* calls back a C search callback for each hit */
+struct RTreeShimHit
+{
+	void *cbarg;
+	RTreeSearchHitCallback callback;
+
+	bool operator()(void *tid, const RTreeClassic::Rect &r) const {
+		RTreeRect rect;
+		if (!callback)
+			return true;
+		rect = CRect(r);
+		return callback(tid, &rect, cbarg) != 0;
+	}
+};
+
+extern "C" {
+
+// MARK: - Rects
+/// Initialize a rectangle to have all 0 coordinates.
+void RTreeInitRect(RTreeRect *r) {
+	*r = CRect(RTreeClassic::ZeroRect());
+}
+
+/// Return a rect whose first low side is higher than its opposite side -
+/// interpreted as an undefined rect.
+RTreeRect RTreeNullRect() {
+	return CRect(RTreeClassic::NullRect());
+}
+
+RectReal RTreeRectVolume(RTreeRect *r) {
+	return RTreeClassic::RectVolume(ClassicRect(r));
+}
+
+RectReal RTreeRectSphericalVolume(RTreeRect *r) {
+	return RTreeClassic::RectSphericalVolume(ClassicRect(r));
+}
+
+RectReal RTreeRectMargin(RTreeRect *r) {
+	return RTreeClassic::RectMargin(ClassicRect(r));
+}
+
+RectReal RTreeRectOverlapVolume(RTreeRect *r, RTreeRect *s) {
+	return RTreeClassic::RectOverlapVolume(ClassicRect(r), ClassicRect(s));
+}
+
+RTreeRect RTreeCombineRect(RTreeRect *r, RTreeRect *s) {
+	return CRect(RTreeClassic::CombineRect(ClassicRect(r), ClassicRect(s)));
+}
+
+int RTreeOverlap(RTreeRect *r, RTreeRect *s) {
+	return RTreeClassic::Overlap(ClassicRect(r), ClassicRect(s));
+}
+
+int RTreeContained(RTreeRect *r, RTreeRect *s) {
+	return RTreeClassic::Contained(ClassicRect(r), ClassicRect(s));
+}
+
+// MARK: - Nodes
+RTreeNode * RTreeNewNode() {
+	return CNode(RTreeClassic::NewNode());
+}
+
+void RTreeInitNode(RTreeNode *n) {
+	RTreeClassic::InitNode(ClassicNode(n));
+}
+
+void RTreeFreeNode(RTreeNode *n) {
+	RTreeClassic::FreeNode(ClassicNode(n));
+}
+
+void RTreeRecursivelyFreeNode(RTreeNode *n) {
+	RTreeClassic::FreeSubtree(ClassicNode(n));
+}
+
+void RTreeRecursivelyFreeBranch(RTreeBranch *b) {
+	RTreeRecursivelyFreeNode(b->child);
+}
+
+RTreeRect RTreeNodeCover(RTreeNode *n) {
+	return CRect(RTreeClassic::NodeCover(ClassicNode(n)));
+}
+
+int RTreePickBranch(RTreeRect *r, RTreeNode *n) {
+	return RTreeClassic::PickBranch(ClassicRect(r), ClassicNode(n));
+}
+
+int RTreePickBranchRStar(RTreeRect *r, RTreeNode *n) {
+	return RTreeClassic::PickBranchRStar(ClassicRect(r), ClassicNode(n));
+}
+
+void RTreeDisconnectBranch(RTreeNode *n, int i) {
+	RTreeClassic::DisconnectBranch(ClassicNode(n), i);
+}
+
+/// Add a branch to a node with the current NODECARD and LEAFCARD, splitting
+/// it quadratic if full.
+int RTreeAddBranch(RTreeBranch *b, RTreeNode *n, RTreeNode **new_node) {
+	RTreeClassic::Branch cb;
+	RTreeClassic::Node *nn = NULL;
+	int result;
+
+	cb.rect = ClassicRect(&b->rect);
+	cb.child.node = ClassicNode(b->child);
+	result = RTreeDefaultTree(RTreeTemplateSplitQuadratic)->AddBranch(cb, ClassicNode(n), &nn);
+	if (new_node)
+		*new_node = CNode(nn);
+	return result;
+}
+
+static int set_max(int *which, int new_max) {
+	if (2 > new_max || new_max > MAXCARD)
+		return 0;
+	*which = new_max;
+	return 1;
+}
+
+int RTreeSetNodeMax(int new_max) { return set_max(&NODECARD, new_max); }
+int RTreeSetLeafMax(int new_max) { return set_max(&LEAFCARD, new_max); }
+int RTreeGetNodeMax() { return NODECARD; }
+int RTreeGetLeafMax() { return LEAFCARD; }
+
+// MARK: - Trees
+/// Make a new index, empty.  Consists of a single node.
+RTreeNode * RTreeNewIndex() {
+	RTreeClassic::Node *n = RTreeClassic::NewNode();
+	n->level = 0; /* leaf */
+	return CNode(n);
+}
+
+int RTreeSearch(RTreeNode *n, RTreeRect *r, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeShimHit hit = { cbarg, callback };
+	return RTreeClassic::SearchSubtree(ClassicNode(n), ClassicRect(r), hit);
+}
+
+int RTreeSearchContained(RTreeNode *n, RTreeRect *r, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeShimHit hit = { cbarg, callback };
+	return RTreeClassic::SearchSubtreeContained(ClassicNode(n), ClassicRect(r), hit);
+}
+
+int RTreeSearchContaining(RTreeNode *n, RTreeRect *r, void *cbarg, RTreeSearchHitCallback callback) {
+	RTreeShimHit hit = { cbarg, callback };
+	return RTreeClassic::SearchSubtreeContaining(ClassicNode(n), ClassicRect(r), hit);
+}
+
+/// Insert a branch into the tree of the caller with a split method.
+static int RTreeShimInsert(RTreeRect *r, void *tid, RTreeNode **root, int level, RTreeTemplateSplit split) {
+	RTreeClassic *t = RTreeDefaultTree(split);
+	RTreeClassic::Branch b;
+	int result;
+
+	assert(r && root);
+	b.rect = ClassicRect(r);
+	b.child.data = tid;
+	t->SetRoot(ClassicNode(*root));
+	result = t->InsertBranch(b, level);
+	*root = CNode(t->Root());
+	t->SetRoot(NULL);
+	return result;
+}
+
+/// Insert a data rectangle into an index structure.
+/// Returns 1 if root was split, 0 if it was not.
+int RTreeInsertRect(RTreeRect *r, void *tid, RTreeNode **root, int level) {
+	return RTreeShimInsert(r, tid, root, level, RTreeTemplateSplitQuadratic);
+}
+
+int RTreeInsertRectRStar(RTreeRect *r, void *tid, RTreeNode **root, int level) {
+	return RTreeShimInsert(r, tid, root, level, RTreeTemplateSplitRStar);
+}
+
+/// Delete a data rectangle from an index structure.
+/// Returns 1 if record not found, 0 if success.
+int RTreeDeleteRect(RTreeRect *r, void *tid, RTreeNode **root) {
+	RTreeClassic *t = RTreeDefaultTree(RTreeTemplateSplitQuadratic);
+	int result;
+
+	assert(r && root);
+	t->SetRoot(ClassicNode(*root));
+	result = t->Delete(ClassicRect(r), tid) ? 0 : 1;
+	*root = CNode(t->Root());
+	t->SetRoot(NULL);
+	return result;
+}
+
+}
@@ -0,0 +1,1366 @@
+#ifndef _RTREE_HPP_
+#define _RTREE_HPP_
+
+/*
+ * The R-tree of RTreeIndexImpl as a header-only C++ template, for any
+ * coordinate type, number of dimensions, node size and payload:
+ *
+ *	RTree<float, 2>			the configuration of RTreeIndexImpl.h
+ *	RTree<double, 3, 1024>		3-D, double precision, 1 KB nodes
+ *	RTree<int32_t, 2, 512, uint64_t>	2-D integer grid, 64-bit ids
+ *
+ * The algorithms are the ones of the C library, step for step: Guttman's
+ * insertion and deletion with the quadratic or linear split, and R*
+ * insertion with forced reinsertion.  With RTree<float, 2, 512, void *> the
+ * nodes have the very layout of RTreeNode and the trees come out the same
+ * as those of RTreeIndex, subtree totals included; RTreeShim.cpp exports
+ * the RTreeNode** functions of RTreeIndexImpl.h on top of it.
+ *
+ * The rect kernels unroll over Dims at compile time, so a 2-D overlap test
+ * is four comparisons and nothing else, and a search tests all the branches
+ * of a node in one loop of fixed length, which the compiler vectorizes at
+ * -O3 (or -O2 -ftree-vectorize).  Integer coordinates measure areas
+ * in double.  Payloads are copied around as raw bytes and compared with ==.
+ *
+ * Like RTreeIndex, a tree holds the scratch space of its updates: one
+ * thread may update it at a time, or many search it while nobody does.
+ * Needs C++17.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+typedef enum
+{
+	RTreeTemplateSplitQuadratic,
+	RTreeTemplateSplitLinear,
+	RTreeTemplateSplitRStar	/* R*-tree insertion */
+} RTreeTemplateSplit;
+
+/// Bytes of a node with room for card branches of the given sizes, padding
+/// included, after a header of two shorts and an unsigned int.
+constexpr size_t RTreeTemplateNodeSize(size_t card, size_t rectSize, size_t coordAlign, size_t slotSize, size_t slotAlign) {
+	size_t header = 2*sizeof(short) + sizeof(unsigned int), align = alignof(unsigned int), size = 0;
+
+	align = coordAlign > align ? coordAlign : align;
+	align = slotAlign > align ? slotAlign : align;
+	size = (header + coordAlign - 1) / coordAlign * coordAlign + rectSize*card;
+	size = (size + slotAlign - 1) / slotAlign * slotAlign + slotSize*card;
+	return (size + align - 1) / align * align;
+}
+
+/// The most branches that fit in a node of nodeBytes.
+constexpr int RTreeTemplateCard(size_t nodeBytes, size_t rectSize, size_t coordAlign, size_t slotSize, size_t slotAlign) {
+	size_t header = 2*sizeof(short) + sizeof(unsigned int);
+	size_t card = nodeBytes > header ? (nodeBytes - header) / (rectSize + slotSize) : 0;
+
+	while (card > 0 && RTreeTemplateNodeSize(card, rectSize, coordAlign, slotSize, slotAlign) > nodeBytes)
+		card--;
+	return (int)card;
+}
+
+/* Precomputed volumes of the unit spheres, as in RTreeRect.c */
+constexpr double RTreeTemplateUnitSphereVolumes[] = {
+	0.000000, 2.000000, 3.141593, 4.188790, 4.934802, 5.263789, 5.167713,
+	4.724766, 4.058712, 3.298509, 2.550164, 1.884104, 1.335263, 0.910629,
+	0.599265, 0.381443, 0.235331, 0.140981, 0.082146, 0.046622, 0.025807,
+};
+
+template <typename Coord, int Dims, size_t NodeBytes = 512, typename Payload = void *>
+class RTree
+{
+	static_assert(std::is_arithmetic<Coord>::value && std::is_signed<Coord>::value, "coordinates must be signed numbers");
+	static_assert(Dims >= 1 && Dims <= 20, "1 to 20 dimensions");
+	static_assert(std::is_trivially_copyable<Payload>::value && std::is_trivially_default_constructible<Payload>::value,
+		"payloads are copied around as raw bytes");
+
+public:
+	static constexpr int NumSides = 2*Dims;
+
+	/* areas, volumes and margins, in double for integer coordinates */
+	typedef typename std::conditional<std::is_floating_point<Coord>::value, Coord, double>::type Real;
+
+	struct Rect
+	{
+		Coord boundary[NumSides];	/* xmin,ymin,...,xmax,ymax,... */
+	};
+
+	struct Node;
+
+	/* a child at internal nodes, a data item at leaves */
+	union Slot
+	{
+		Node *node;
+		Payload data;
+	};
+
+	struct Branch
+	{
+		Rect rect;
+		Slot child;
+	};
+
+	/* max branching factor of a node */
+	static constexpr int MaxCard = RTreeTemplateCard(NodeBytes, NumSides*sizeof(Coord), alignof(Coord), sizeof(Slot), alignof(Slot));
+	static_assert(MaxCard >= 2, "NodeBytes too small for two branches");
+
+	/*
+	 * The branches of a node are stored as a structure of arrays, as in
+	 * RTreeNode: side s of the rect of branch i is bound[s][i].
+	 * The branches in use are always the first count ones.
+	 */
+	struct Node
+	{
+		short count;
+		short level;	/* 0 is leaf, others positive */
+		union
+		{
+			unsigned int version;	/* unused, keeps the layout of RTreeNode */
+			unsigned int total;	/* data rects below, in a node above the leaves */
+		};
+		Coord bound[NumSides][MaxCard];
+		Slot child[MaxCard];
+
+		Rect GetRect(int i) const {
+			Rect r;
+			for (int s=0; s<NumSides; s++)
+				r.boundary[s] = bound[s][i];
+			return r;
+		}
+
+		void SetRect(int i, const Rect &r) {
+			for (int s=0; s<NumSides; s++)
+				bound[s][i] = r.boundary[s];
+		}
+
+		Branch GetBranch(int i) const {
+			Branch b;
+			b.rect = GetRect(i);
+			b.child = child[i];
+			return b;
+		}
+
+		void SetBranch(int i, const Branch &b) {
+			SetRect(i, b.rect);
+			child[i] = b.child;
+		}
+	};
+	static_assert(sizeof(Node) <= NodeBytes, "node larger than NodeBytes");
+
+	// MARK: - Rects
+private:
+	typedef std::make_index_sequence<Dims> Dimensions;
+
+	static bool Undefined(const Rect &r) { return r.boundary[0] > r.boundary[Dims]; }
+
+	static Real Extent(const Rect &r, int d) { return (Real)r.boundary[d+Dims] - (Real)r.boundary[d]; }
+
+	template <size_t... D>
+	static bool Overlap(const Rect &r, const Rect &s, std::index_sequence<D...>) {
+		return ((r.boundary[D] <= s.boundary[D+Dims] && s.boundary[D] <= r.boundary[D+Dims]) && ...);
+	}
+
+	template <size_t... D>
+	static bool Contained(const Rect &r, const Rect &s, std::index_sequence<D...>) {
+		return ((r.boundary[D] >= s.boundary[D] && r.boundary[D+Dims] <= s.boundary[D+Dims]) && ...);
+	}
+
+	template <size_t... D>
+	static void Combine(const Rect &r, const Rect &s, Rect &c, std::index_sequence<D...>) {
+		((c.boundary[D] = r.boundary[D] < s.boundary[D] ? r.boundary[D] : s.boundary[D]), ...);
+		((c.boundary[D+Dims] = r.boundary[D+Dims] > s.boundary[D+Dims] ? r.boundary[D+Dims] : s.boundary[D+Dims]), ...);
+	}
+
+	template <size_t... D>
+	static Real Volume(const Rect &r, std::index_sequence<D...>) {
+		return (Real(1) * ... * Extent(r, D));
+	}
+
+public:
+	/// A rect with all 0 coordinates.
+	static Rect ZeroRect() {
+		Rect r;
+		for (int i=0; i<NumSides; i++)
+			r.boundary[i] = 0;
+		return r;
+	}
+
+	/// A rect whose first low side is higher than its opposite side -
+	/// interpreted as an undefined rect.
+	static Rect NullRect() {
+		Rect r = ZeroRect();
+		r.boundary[0] = 1;
+		r.boundary[Dims] = -1;
+		return r;
+	}
+
+	/// Decide whether two rects overlap.
+	static bool Overlap(const Rect &r, const Rect &s) {
+		return Overlap(r, s, Dimensions());
+	}
+
+	/// Decide whether rect r is contained in rect s.
+	static bool Contained(const Rect &r, const Rect &s) {
+		if (Undefined(r))	/* undefined rect is contained in any other */
+			return true;
+		if (Undefined(s))	/* no rect (except an undefined one) is contained in an undef rect */
+			return false;
+		return Contained(r, s, Dimensions());
+	}
+
+	/// Combine two rects, make one that includes both.
+	static Rect CombineRect(const Rect &r, const Rect &s) {
+		Rect c;
+		if (Undefined(r))
+			return s;
+		if (Undefined(s))
+			return r;
+		Combine(r, s, c, Dimensions());
+		return c;
+	}
+
+	/// The n-dimensional volume of a rect.
+	static Real RectVolume(const Rect &r) {
+		if (Undefined(r))
+			return 0;
+		return Volume(r, Dimensions());
+	}
+
+	/// The n-dimensional volume of the bounding sphere of a rect.
+	static Real RectSphericalVolume(const Rect &r) {
+		double sum_of_squares = 0, half_extent;
+
+		if (Undefined(r))
+			return 0;
+		for (int i=0; i<Dims; i++)
+		{
+			half_extent = Extent(r, i) / 2;
+			sum_of_squares += half_extent * half_extent;
+		}
+		return (Real)(pow(sqrt(sum_of_squares), Dims) * RTreeTemplateUnitSphereVolumes[Dims]);
+	}
+
+	/// The margin of a rect, the sum of its edge lengths.
+	static Real RectMargin(const Rect &r) {
+		Real sum = 0;
+
+		if (Undefined(r))
+			return 0;
+		for (int i=0; i<Dims; i++)
+			sum += Extent(r, i);
+		return (1 << (Dims-1)) * sum;
+	}
+
+	/// The n-dimensional volume of the intersection of two rects, 0 if they
+	/// do not overlap.
+	static Real RectOverlapVolume(const Rect &r, const Rect &s) {
+		Real volume = 1, lo, hi;
+
+		if (Undefined(r) || Undefined(s))
+			return 0;
+		for (int i=0; i<Dims; i++)
+		{
+			lo = r.boundary[i] > s.boundary[i] ? r.boundary[i] : s.boundary[i];
+			hi = r.boundary[i+Dims] < s.boundary[i+Dims] ? r.boundary[i+Dims] : s.boundary[i+Dims];
+			if (hi <= lo)
+				return 0;
+			volume *= hi - lo;
+		}
+		return volume;
+	}
+
+	// MARK: - Nodes
+private:
+	/* branch tests without branches, so a loop over all the branches of a node vectorizes */
+	template <size_t... D>
+	static bool BranchOverlaps(const Node *n, int i, const Rect &r, std::index_sequence<D...>) {
+		return (((n->bound[D][i] <= r.boundary[D+Dims]) & (n->bound[D+Dims][i] >= r.boundary[D])) & ...);
+	}
+
+	template <size_t... D>
+	static bool BranchContained(const Node *n, int i, const Rect &r, std::index_sequence<D...>) {
+		return (((n->bound[D][i] >= r.boundary[D]) & (n->bound[D+Dims][i] <= r.boundary[D+Dims])) & ...);
+	}
+
+	template <size_t... D>
+	static bool BranchContaining(const Node *n, int i, const Rect &r, std::index_sequence<D...>) {
+		return (((n->bound[D][i] <= r.boundary[D]) & (n->bound[D+Dims][i] >= r.boundary[D+Dims])) & ...);
+	}
+
+public:
+	/// Initialize a node to have all branch cells empty.
+	static void InitNode(Node *n) {
+		Branch b;
+		b.rect = ZeroRect();
+		b.child.node = NULL;
+		n->count = 0;
+		n->level = -1;
+		for (int i=0; i<MaxCard; i++)
+			n->SetBranch(i, b);
+	}
+
+	/// Make a new node with all branch cells empty.
+	static Node * NewNode() {
+		Node *n = new Node;
+		InitNode(n);
+		n->total = 0;
+		return n;
+	}
+
+	/// The data rects below a node: its total, or its count at a leaf.
+	static size_t NodeTotal(const Node *n) {
+		return n->level > 0 ? n->total : (size_t)n->count;
+	}
+
+	/// Set the total of a node above the leaves to the sum of its
+	/// children's, for one that took in or gave up whole branches, or was
+	/// split.  Nothing to do for a leaf.
+	static void AggregateFix(Node *n) {
+		size_t total = 0;
+		assert(n);
+
+		if (n->level == 0)
+			return;
+		for (int i=0; i<n->count; i++)
+			total += NodeTotal(n->child[i].node);
+		n->total = (unsigned int)total;
+	}
+
+	static void FreeNode(Node *n) {
+		assert(n);
+		delete n;
+	}
+
+	/// Free a subtree, node by node.
+	static void FreeSubtree(Node *n) {
+		assert(n);
+		if (n->level > 0)
+			for (int i=0; i<n->count; i++)
+				FreeSubtree(n->child[i].node);
+		FreeNode(n);
+	}
+
+	/// Find the smallest rect that includes all rects in branches of a node.
+	static Rect NodeCover(const Node *n) {
+		Rect r;
+		int i, s;
+		assert(n);
+
+		if (n->count == 0)
+			return ZeroRect();
+
+		/* one side row at a time */
+		r = n->GetRect(0);
+		for (s=0; s<Dims; s++)
+			for (i=1; i<n->count; i++)
+				r.boundary[s] = n->bound[s][i] < r.boundary[s] ? n->bound[s][i] : r.boundary[s];
+		for (; s<NumSides; s++)
+			for (i=1; i<n->count; i++)
+				r.boundary[s] = n->bound[s][i] > r.boundary[s] ? n->bound[s][i] : r.boundary[s];
+		return r;
+	}
+
+	/// Pick a branch.  Pick the one that will need the smallest increase
+	/// in area to accomodate the new rect.  In case of a tie, pick the one
+	/// which was smaller before, to get the best resolution when searching.
+	static int PickBranch(const Rect &r, const Node *n) {
+		Real increase, bestIncr = -1, area, bestArea = 0;
+		int i, best = 0, first_time = 1;
+		Rect rr, tmp_rect;
+
+		for (i=0; i<n->count; i++)
+		{
+			rr = n->GetRect(i);
+			area = RectSphericalVolume(rr);
+			tmp_rect = CombineRect(r, rr);
+			increase = RectSphericalVolume(tmp_rect) - area;
+			if (increase < bestIncr || first_time)
+			{
+				best = i;
+				bestArea = area;
+				bestIncr = increase;
+				first_time = 0;
+			}
+			else if (increase == bestIncr && area < bestArea)
+			{
+				best = i;
+				bestArea = area;
+				bestIncr = increase;
+			}
+		}
+		return best;
+	}
+
+	/// Pick a branch, R* style.
+	/// Just above the leaves pick the one whose rect overlaps its siblings
+	/// least more after taking in the new rect, higher up the one that needs
+	/// the smallest increase in area.  Ties go to the smaller increase in
+	/// area, then to the smaller area.
+	static int PickBranchRStar(const Rect &r, const Node *n) {
+		Real increase, bestIncr = 0, area, bestArea = 0, overlap, bestOverlap = 0;
+		int i, j, best = 0, first_time = 1;
+		Rect rect[MaxCard], tmp_rect;
+		assert(n->level > 0);
+
+		for (i=0; i<n->count; i++)
+			rect[i] = n->GetRect(i);
+
+		for (i=0; i<n->count; i++)
+		{
+			area = RectVolume(rect[i]);
+			tmp_rect = CombineRect(r, rect[i]);
+			increase = RectVolume(tmp_rect) - area;
+
+			overlap = 0;
+			if (n->level == 1)
+				for (j=0; j<n->count; j++)
+					if (j != i)
+						overlap += RectOverlapVolume(tmp_rect, rect[j]) - RectOverlapVolume(rect[i], rect[j]);
+
+			if (first_time || overlap < bestOverlap ||
+			    (overlap == bestOverlap && (increase < bestIncr ||
+			    (increase == bestIncr && area < bestArea))))
+			{
+				best = i;
+				bestOverlap = overlap;
+				bestIncr = increase;
+				bestArea = area;
+				first_time = 0;
+			}
+		}
+		return best;
+	}
+
+	/// Disconnect a dependent node.
+	/// The last branch moves into its place, so branches stay packed in [0, count).
+	static void DisconnectBranch(Node *n, int i) {
+		Branch b;
+		assert(n && i>=0 && i<n->count);
+
+		n->count--;
+		if (i != n->count)
+			n->SetBranch(i, n->GetBranch(n->count));
+		b.rect = ZeroRect();
+		b.child.node = NULL;
+		n->SetBranch(n->count, b);
+	}
+
+	// MARK: - Tree
+	/// An empty tree with the given fanouts, each 2...MaxCard.
+	explicit RTree(RTreeTemplateSplit split = RTreeTemplateSplitQuadratic, int nodecard = MaxCard, int leafcard = MaxCard) :
+		root(NULL), nodecard(MaxCard), leafcard(MaxCard), split(split) {
+		SetNodeMax(nodecard);
+		SetLeafMax(leafcard);
+		Clear();
+	}
+
+	~RTree() {
+		if (root)
+			FreeSubtree(root);
+	}
+
+	RTree(const RTree &) = delete;
+	RTree & operator=(const RTree &) = delete;
+
+	/// Remove everything from the tree, leaving it empty.
+	void Clear() {
+		if (root)
+			FreeSubtree(root);
+		root = NewNode();
+		root->level = 0;	/* leaf */
+	}
+
+	/// The root of the tree.  It changes as the tree grows and shrinks.
+	Node * Root() const { return root; }
+
+	/// Work on another tree from now on, as the functions of RTreeIndexImpl.h
+	/// taking an RTreeNode** do; the tree of the caller is not freed.
+	/// NULL leaves it without one, which is only good for setting another.
+	void SetRoot(Node *n) { root = n; }
+
+	RTreeTemplateSplit GetSplit() const { return split; }
+	void SetSplit(RTreeTemplateSplit s) { split = s; }
+
+	bool SetNodeMax(int max) { return SetMax(&nodecard, max); }
+	bool SetLeafMax(int max) { return SetMax(&leafcard, max); }
+	int GetNodeMax() const { return nodecard; }
+	int GetLeafMax() const { return leafcard; }
+
+	// MARK: - Search
+	/// Call f(payload, rect) for every data rect that overlaps r.
+	/// f can terminate the search by returning false; returns false then.
+	template <class F>
+	bool Search(const Rect &r, F &&f) const {
+		return SearchNode(root, r, f, BranchOverlapsTest(), BranchOverlapsTest());
+	}
+
+	/// Call f(payload, rect) for every data rect contained in r.
+	/// Any subtree holding one overlaps r.
+	template <class F>
+	bool SearchContained(const Rect &r, F &&f) const {
+		return SearchNode(root, r, f, BranchOverlapsTest(), BranchContainedTest());
+	}
+
+	/// Call f(payload, rect) for every data rect that contains r.
+	template <class F>
+	bool SearchContaining(const Rect &r, F &&f) const {
+		return SearchNode(root, r, f, BranchContainingTest(), BranchContainingTest());
+	}
+
+	/// Search a subtree that is not the root of a tree, such as one given
+	/// by a caller of RTreeSearch.
+	template <class F>
+	static bool SearchSubtree(const Node *n, const Rect &r, F &&f) {
+		return SearchNode(n, r, f, BranchOverlapsTest(), BranchOverlapsTest());
+	}
+
+	template <class F>
+	static bool SearchSubtreeContained(const Node *n, const Rect &r, F &&f) {
+		return SearchNode(n, r, f, BranchOverlapsTest(), BranchContainedTest());
+	}
+
+	template <class F>
+	static bool SearchSubtreeContaining(const Node *n, const Rect &r, F &&f) {
+		return SearchNode(n, r, f, BranchContainingTest(), BranchContainingTest());
+	}
+
+	// MARK: - Insert
+	/// Insert a data rect.  Returns true if the root was split.
+	bool Insert(const Rect &r, const Payload &data) {
+		Branch b;
+		for (int i=0; i<Dims; i++)
+			assert(r.boundary[i] <= r.boundary[Dims+i]);
+		b.rect = r;
+		b.child.data = data;
+		return InsertBranch(b, 0);
+	}
+
+	/// Insert a branch the given number of steps up from the leaf level.
+	/// Returns true if the root was split.
+	bool InsertBranch(const Branch &b, int level) {
+		assert(level >= 0 && level <= root->level);
+		if (split == RTreeTemplateSplitRStar)
+			return InsertRStar(b, level);
+		return InsertRoot(b, level);
+	}
+
+	/// Add a branch to a node.  Split the node if necessary.
+	/// Returns false if node not split.  Old node updated.
+	/// Returns true if node split, sets *new_node to address of new node.
+	/// Old node updated, becomes one of two.
+	bool AddBranch(const Branch &b, Node *n, Node **new_node) {
+		assert(n);
+		if (n->count < MaxKids(n))	/* split won't be necessary */
+		{
+			n->SetBranch(n->count, b);
+			n->count++;
+			return false;
+		}
+		assert(new_node);
+		SplitNode(n, b, new_node);
+		return true;
+	}
+
+	// MARK: - Delete
+	/// Delete a data rect, found under r by its payload.
+	/// Returns false if it is not in the tree.
+	bool Delete(const Rect &r, const Payload &data) {
+		std::vector<Node *> reinsert;
+		Node *n;
+		Branch b;
+
+		assert(root);
+		if (!DeleteNode(r, data, root, reinsert))
+			return false;
+
+		/* reinsert any branches from eliminated nodes, last eliminated first */
+		while (!reinsert.empty())
+		{
+			n = reinsert.back();
+			reinsert.pop_back();
+			for (int i=0; i<n->count; i++)
+			{
+				b = n->GetBranch(i);
+				InsertBranch(b, n->level);
+			}
+			FreeNode(n);
+		}
+
+		/* check for redundant root (not leaf, 1 child) and eliminate */
+		if (root->count == 1 && root->level > 0)
+		{
+			n = root->child[0].node;
+			assert(n);
+			FreeNode(root);
+			root = n;
+		}
+		return true;
+	}
+
+	// MARK: - Implementation
+private:
+	/* variables for finding a partition */
+	struct PartitionVars
+	{
+		int partition[MaxCard+1];
+		int total, minfill;
+		int taken[MaxCard+1];
+		int count[2];
+		Rect cover[2];
+		Real area[2];
+	};
+
+	/* branches of a node being split, plus the extra one */
+	struct SplitVars
+	{
+		Branch branch[MaxCard+1];
+		int count;
+		Rect cover;
+		Real coverArea;
+		PartitionVars partition;
+	};
+
+	/* levels that can be tracked for R* forced reinsertion during one insertion */
+	static constexpr int ReinsertLevels = 8*sizeof(unsigned int);
+
+	/* fraction of the entries of an overflowing node that are reinserted */
+	static constexpr double ReinsertFraction = 0.3;
+
+	/* entries taken out by R* forced reinsertion, waiting to go back in */
+	struct ReinsertVars
+	{
+		std::vector<std::pair<Branch, int> > branch;	/* and their level */
+		unsigned int overflowed;	/* one bit for every level that already reinserted */
+	};
+
+	Node *root;
+	int nodecard;	/* max branching factor of internal nodes */
+	int leafcard;	/* max branching factor of leaves */
+	RTreeTemplateSplit split;
+	SplitVars splitVars;
+	ReinsertVars reinsertVars;
+
+	static bool SetMax(int *which, int max) {
+		if (2 > max || max > MaxCard)
+			return false;
+		*which = max;
+		return true;
+	}
+
+	int MaxKids(const Node *n) const { return n->level > 0 ? nodecard : leafcard; }
+	int NodeMinFill() const { return nodecard / 2; }
+	int LeafMinFill() const { return leafcard / 2; }
+	int MinFill(const Node *n) const { return n->level > 0 ? NodeMinFill() : LeafMinFill(); }
+
+	struct BranchOverlapsTest
+	{
+		bool operator()(const Node *n, int i, const Rect &r) const { return BranchOverlaps(n, i, r, Dimensions()); }
+	};
+
+	struct BranchContainedTest
+	{
+		bool operator()(const Node *n, int i, const Rect &r) const { return BranchContained(n, i, r, Dimensions()); }
+	};
+
+	struct BranchContainingTest
+	{
+		bool operator()(const Node *n, int i, const Rect &r) const { return BranchContaining(n, i, r, Dimensions()); }
+	};
+
+	/// Visit the branches of a subtree that pass a test, internal at internal
+	/// nodes and leaf at leaves, calling back for the data rects found.
+	/// Every branch cell of a node is tested, the unused ones too, in one
+	/// loop of fixed length before any is visited.
+	/// Returns false if the callback terminated the search.
+	template <class F, class InternalTest, class LeafTest>
+	static bool SearchNode(const Node *n, const Rect &r, F &f, InternalTest internal, LeafTest leaf) {
+		bool pass[MaxCard];
+		int i;
+		assert(n);
+		assert(n->level >= 0);
+
+		if (n->level > 0)	/* this is an internal node in the tree */
+		{
+			for (i=0; i<MaxCard; i++)
+				pass[i] = internal(n, i, r);
+			for (i=0; i<n->count; i++)
+				if (pass[i] && !SearchNode(n->child[i].node, r, f, internal, leaf))
+					return false;
+		}
+		else	/* this is a leaf node */
+		{
+			for (i=0; i<MaxCard; i++)
+				pass[i] = leaf(n, i, r);
+			for (i=0; i<n->count; i++)
+				if (pass[i] && !f(n->child[i].data, n->GetRect(i)))
+					return false;	/* callback wants to terminate search early */
+		}
+		return true;
+	}
+
+	/// Inserts a branch, descending with PickBranch.
+	/// Returns false if node was not split, true if it was and *new_node is
+	/// the new node.
+	bool InsertNode(const Branch &b, Node *n, Node **new_node, int level) {
+		Branch b2;
+		Node *n2;
+		Rect rect;
+		size_t total;
+		int i;
+
+		assert(n && new_node);
+		assert(level >= 0 && level <= n->level);
+
+		/* still above level for insertion, go down tree recursively */
+		if (n->level > level)
+		{
+			i = PickBranch(b.rect, n);
+			total = NodeTotal(n->child[i].node);
+			if (!InsertNode(b, n->child[i].node, &n2, level))
+			{
+				/* child was not split */
+				rect = n->GetRect(i);
+				n->SetRect(i, CombineRect(b.rect, rect));
+				n->total += NodeTotal(n->child[i].node) - total;
+				return false;
+			}
+			/* child was split */
+			n->SetRect(i, NodeCover(n->child[i].node));
+			b2.child.node = n2;
+			b2.rect = NodeCover(n2);
+			return AddBranchFix(b2, n, new_node);
+		}
+
+		/* have reached level for insertion, add rect, split if necessary */
+		return AddBranchFix(b, n, new_node);
+	}
+
+	/// Add a branch to a node, then set the totals of the node and of the
+	/// one split off it.
+	bool AddBranchFix(const Branch &b, Node *n, Node **new_node) {
+		bool split = AddBranch(b, n, new_node);
+
+		AggregateFix(n);
+		if (split)
+			AggregateFix(*new_node);
+		return split;
+	}
+
+	/// Put a new root above the old one and the node split off it.
+	void GrowRoot(Node *newnode) {
+		Node *newroot;
+		Branch b;
+
+		newroot = NewNode();	/* grow a new root, & tree taller */
+		newroot->level = root->level + 1;
+		b.rect = NodeCover(root);
+		b.child.node = root;
+		AddBranch(b, newroot, NULL);
+		b.rect = NodeCover(newnode);
+		b.child.node = newnode;
+		AddBranch(b, newroot, NULL);
+		AggregateFix(newroot);
+		root = newroot;
+	}
+
+	/// Insert a branch below the root, growing a new root if the old one splits.
+	bool InsertRoot(const Branch &b, int level) {
+		Node *newnode;
+
+		if (!InsertNode(b, root, &newnode, level))
+			return false;
+		GrowRoot(newnode);
+		return true;
+	}
+
+	/// Insert a branch, R* style.  Entries moved out by forced reinsertion
+	/// are put back before returning.  Returns true if the root was split.
+	bool InsertRStar(const Branch &b, int level) {
+		ReinsertVars &v = reinsertVars;
+		std::pair<Branch, int> e;
+		bool result;
+
+		v.branch.clear();
+		v.overflowed = 0;
+
+		result = InsertRStarRoot(b, level);
+		while (!v.branch.empty())
+		{
+			e = v.branch.back();
+			v.branch.pop_back();
+			result |= InsertRStarRoot(e.first, e.second);
+		}
+		return result;
+	}
+
+	bool InsertRStarRoot(const Branch &b, int level) {
+		Node *newnode;
+
+		if (!InsertRStarNode(b, root, &newnode, level, root->level))
+			return false;
+		GrowRoot(newnode);
+		return true;
+	}
+
+	/// Inserts a branch at the given level, descending with PickBranchRStar.
+	/// Child rects are recomputed on the way up since a forced reinsertion
+	/// below can shrink them.
+	bool InsertRStarNode(const Branch &b, Node *n, Node **new_node, int level, int rootlevel) {
+		Branch b2;
+		Node *n2;
+		size_t total;
+		int i;
+		bool split;
+
+		assert(n && new_node);
+		assert(level >= 0 && level <= n->level);
+
+		if (n->level > level)
+		{
+			i = PickBranchRStar(b.rect, n);
+			total = NodeTotal(n->child[i].node);
+			if (!InsertRStarNode(b, n->child[i].node, &n2, level, rootlevel))
+			{
+				n->SetRect(i, NodeCover(n->child[i].node));
+				n->total += NodeTotal(n->child[i].node) - total;
+				return false;
+			}
+			n->SetRect(i, NodeCover(n->child[i].node));
+			b2.child.node = n2;
+			b2.rect = NodeCover(n2);
+			split = AddBranchRStar(b2, n, new_node, rootlevel);
+		}
+		else
+			split = AddBranchRStar(b, n, new_node, rootlevel);
+
+		/* took in a branch, or gave some up to reinsertion, or was split */
+		AggregateFix(n);
+		if (split)
+			AggregateFix(*new_node);
+		return split;
+	}
+
+	/// Add a branch to a node, R* style.
+	/// The first time a level below the root overflows during an insertion,
+	/// some of its entries are reinserted instead of splitting the node.
+	bool AddBranchRStar(const Branch &b, Node *n, Node **new_node, int rootlevel) {
+		unsigned int bit;
+
+		if (n->count < MaxKids(n))
+			return AddBranch(b, n, new_node);
+
+		bit = n->level < ReinsertLevels ? 1u << n->level : 0;
+		if (n->level < rootlevel && bit && !(reinsertVars.overflowed & bit))
+		{
+			reinsertVars.overflowed |= bit;
+			ForcedReinsert(n, b);
+			return false;
+		}
+
+		assert(new_node);
+		SplitNodeRStar(n, b, new_node);
+		return true;
+	}
+
+	/// Take the entries farthest from the center of a full node, together
+	/// with the extra branch, out of the node and queue them for reinsertion.
+	/// The closest of them are queued last so they go back in first.
+	void ForcedReinsert(Node *n, const Branch &b) {
+		SplitVars &s = splitVars;
+		int order[MaxCard+1];
+		double dist[MaxCard+1], center[Dims], d;
+		int i, j, dim, level, reinsert, minfill;
+
+		level = n->level;
+		GetBranches(n, b);
+		n->level = level;
+		minfill = level>0 ? NodeMinFill() : LeafMinFill();
+
+		for (dim=0; dim<Dims; dim++)
+			center[dim] = ((double)s.cover.boundary[dim] + s.cover.boundary[dim+Dims]) / 2;
+
+		/* order the entries by decreasing distance of their center */
+		for (i=0; i<s.count; i++)
+		{
+			dist[i] = 0;
+			for (dim=0; dim<Dims; dim++)
+			{
+				d = ((double)s.branch[i].rect.boundary[dim] +
+					s.branch[i].rect.boundary[dim+Dims]) / 2 - center[dim];
+				dist[i] += d * d;
+			}
+			for (j=i; j>0 && dist[order[j-1]] < dist[i]; j--)
+				order[j] = order[j-1];
+			order[j] = i;
+		}
+
+		reinsert = (int)(s.count * ReinsertFraction + 0.5);
+		if (reinsert > s.count - minfill)
+			reinsert = s.count - minfill;
+		if (reinsert < 1)
+			reinsert = 1;
+
+		for (i=0; i<reinsert; i++)
+			reinsertVars.branch.push_back(std::make_pair(s.branch[order[i]], level));
+		for (; i<s.count; i++)
+			AddBranch(s.branch[order[i]], n, NULL);
+	}
+
+	/// Delete a data rect from a subtree.  Descends the tree recursively,
+	/// puts the nodes left too empty on the reinsert list on the way back up.
+	/// Returns false if the data rect is not in the subtree.
+	bool DeleteNode(const Rect &r, const Payload &data, Node *n, std::vector<Node *> &reinsert) {
+		Node *c;
+		size_t total;
+		int i;
+
+		assert(n && n->level >= 0);
+
+		if (n->level > 0)	/* not a leaf node */
+		{
+			for (i=0; i<n->count; i++)
+			{
+				if (!BranchOverlaps(n, i, r, Dimensions()))
+					continue;
+				c = n->child[i].node;
+				total = NodeTotal(c);
+				if (DeleteNode(r, data, c, reinsert))
+				{
+					if (c->count >= MinFill(c))
+					{
+						n->SetRect(i, NodeCover(c));
+						n->total -= total - NodeTotal(c);
+					}
+					else
+					{
+						/* not enough entries in child, eliminate child node */
+						reinsert.push_back(c);
+						DisconnectBranch(n, i);
+						n->total -= total;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/* a leaf node */
+		for (i=0; i<n->count; i++)
+		{
+			if (n->child[i].data == data)
+			{
+				DisconnectBranch(n, i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// MARK: - Split
+	/// Split a node with the split method of the tree.
+	void SplitNode(Node *n, const Branch &b, Node **nn) {
+		switch (split)
+		{
+		case RTreeTemplateSplitLinear:
+			SplitNodeLinear(n, b, nn);
+			break;
+		case RTreeTemplateSplitRStar:
+			SplitNodeRStar(n, b, nn);
+			break;
+		case RTreeTemplateSplitQuadratic:
+		default:
+			SplitNodeQuadratic(n, b, nn);
+			break;
+		}
+	}
+
+	/// Load branch buffer with branches from full node plus the extra branch,
+	/// with the rect and the area that cover them all.
+	void GetBranches(Node *n, const Branch &b) {
+		SplitVars &s = splitVars;
+		int i;
+
+		assert(n->count == MaxKids(n));	/* n should have every entry full */
+		for (i=0; i<MaxKids(n); i++)
+			s.branch[i] = n->GetBranch(i);
+		s.branch[MaxKids(n)] = b;
+		s.count = MaxKids(n) + 1;
+
+		s.cover = s.branch[0].rect;
+		for (i=1; i<s.count; i++)
+			s.cover = CombineRect(s.cover, s.branch[i].rect);
+		s.coverArea = RectSphericalVolume(s.cover);
+
+		InitNode(n);
+	}
+
+	/// Initialize a PartitionVars structure.
+	static void InitPVars(PartitionVars &p, int maxrects, int minfill) {
+		p.count[0] = p.count[1] = 0;
+		p.cover[0] = p.cover[1] = NullRect();
+		p.area[0] = p.area[1] = 0;
+		p.total = maxrects;
+		p.minfill = minfill;
+		for (int i=0; i<maxrects; i++)
+		{
+			p.taken[i] = false;
+			p.partition[i] = -1;
+		}
+	}
+
+	/// Put a branch in one of the groups.
+	void Classify(int i, int group, PartitionVars &p) {
+		assert(!p.taken[i]);
+
+		p.partition[i] = group;
+		p.taken[i] = true;
+
+		if (p.count[group] == 0)
+			p.cover[group] = splitVars.branch[i].rect;
+		else
+			p.cover[group] = CombineRect(splitVars.branch[i].rect, p.cover[group]);
+		p.area[group] = RectSphericalVolume(p.cover[group]);
+		p.count[group]++;
+	}
+
+	/// Copy branches from the buffer into two nodes according to the partition.
+	void LoadNodes(Node *n, Node *q, PartitionVars &p) {
+		for (int i=0; i<p.total; i++)
+		{
+			assert(p.partition[i] == 0 || p.partition[i] == 1);
+			AddBranch(splitVars.branch[i], p.partition[i] == 0 ? n : q, NULL);
+		}
+	}
+
+	/// Quadratic seeds: the two rects that waste the most area if covered by
+	/// a single rect.
+	void PickSeedsQuadratic(PartitionVars &p) {
+		SplitVars &s = splitVars;
+		Real worst, waste, area[MaxCard+1];
+		int i, j, seed0 = 0, seed1 = 0;
+
+		for (i=0; i<p.total; i++)
+			area[i] = RectSphericalVolume(s.branch[i].rect);
+
+		worst = -s.coverArea - 1;
+		for (i=0; i<p.total-1; i++)
+		{
+			for (j=i+1; j<p.total; j++)
+			{
+				waste = RectSphericalVolume(CombineRect(s.branch[i].rect, s.branch[j].rect)) - area[i] - area[j];
+				if (waste > worst)
+				{
+					worst = waste;
+					seed0 = i;
+					seed1 = j;
+				}
+			}
+		}
+		Classify(seed0, 0, p);
+		Classify(seed1, 1, p);
+	}
+
+	/// Quadratic partition: after the seeds, one at a time the rect most
+	/// strongly attracted to one group and repelled from the other goes to
+	/// that group.  If one group gets too full, the other gets the rest.
+	void MethodQuadratic(PartitionVars &p, int minfill) {
+		SplitVars &s = splitVars;
+		Real biggestDiff, growth0, growth1, diff;
+		int i, group, chosen = 0, betterGroup = 0;
+
+		InitPVars(p, s.count, minfill);
+		PickSeedsQuadratic(p);
+
+		while (p.count[0] + p.count[1] < p.total
+			&& p.count[0] < p.total - p.minfill
+			&& p.count[1] < p.total - p.minfill)
+		{
+			biggestDiff = -1;
+			for (i=0; i<p.total; i++)
+			{
+				if (p.taken[i])
+					continue;
+				growth0 = RectSphericalVolume(CombineRect(s.branch[i].rect, p.cover[0])) - p.area[0];
+				growth1 = RectSphericalVolume(CombineRect(s.branch[i].rect, p.cover[1])) - p.area[1];
+				diff = growth1 - growth0;
+				if (diff >= 0)
+					group = 0;
+				else
+				{
+					group = 1;
+					diff = -diff;
+				}
+
+				if (diff > biggestDiff)
+				{
+					biggestDiff = diff;
+					chosen = i;
+					betterGroup = group;
+				}
+				else if (diff == biggestDiff && p.count[group] < p.count[betterGroup])
+				{
+					chosen = i;
+					betterGroup = group;
+				}
+			}
+			Classify(chosen, betterGroup, p);
+		}
+
+		/* if one group too full, put remaining rects in the other */
+		if (p.count[0] + p.count[1] < p.total)
+		{
+			group = p.count[0] >= p.total - p.minfill ? 1 : 0;
+			for (i=0; i<p.total; i++)
+				if (!p.taken[i])
+					Classify(i, group, p);
+		}
+
+		assert(p.count[0] + p.count[1] == p.total);
+		assert(p.count[0] >= p.minfill && p.count[1] >= p.minfill);
+	}
+
+	/// Linear seeds: the two rects that are separated most along any
+	/// dimension, or overlap least, measured relative to the width of the
+	/// whole set along that dimension.
+	void PickSeedsLinear(PartitionVars &p) {
+		SplitVars &s = splitVars;
+		Real w, separation, bestSep = 0, width[Dims];
+		int leastUpper[Dims], greatestLower[Dims];
+		int i, dim, high, seed0 = 0, seed1 = 0;
+		const Rect *rlow, *rhigh;
+
+		for (dim=0; dim<Dims; dim++)
+		{
+			high = dim + Dims;
+
+			/* find the rects farthest out in each direction along this dimension */
+			greatestLower[dim] = leastUpper[dim] = 0;
+			for (i=1; i<s.count; i++)
+			{
+				if (s.branch[i].rect.boundary[dim] > s.branch[greatestLower[dim]].rect.boundary[dim])
+					greatestLower[dim] = i;
+				if (s.branch[i].rect.boundary[high] < s.branch[leastUpper[dim]].rect.boundary[high])
+					leastUpper[dim] = i;
+			}
+
+			/* find width of the whole collection along this dimension */
+			width[dim] = Extent(s.cover, dim);
+		}
+
+		/* pick the best separation dimension and the two seed rects */
+		for (dim=0; dim<Dims; dim++)
+		{
+			/* divisor for normalizing by width */
+			assert(width[dim] >= 0);
+			w = width[dim] == 0 ? 1 : width[dim];
+
+			rlow = &s.branch[leastUpper[dim]].rect;
+			rhigh = &s.branch[greatestLower[dim]].rect;
+			separation = ((Real)rhigh->boundary[dim] - (Real)rlow->boundary[dim+Dims]) / w;
+			if (dim == 0 || separation > bestSep)
+			{
+				seed0 = leastUpper[dim];
+				seed1 = greatestLower[dim];
+				bestSep = separation;
+			}
+		}
+
+		if (seed0 != seed1)
+		{
+			Classify(seed0, 0, p);
+			Classify(seed1, 1, p);
+		}
+	}
+
+	/// Put each rect that is not already in a group into the group whose
+	/// cover will expand less, then will be smaller, then has fewer
+	/// elements, unless the other group needs all the rest for its minimum
+	/// fill.
+	void Pigeonhole(PartitionVars &p) {
+		SplitVars &s = splitVars;
+		Rect newCover[2];
+		Real newArea[2], increase[2];
+		int i, group;
+
+		for (i=0; i<s.count; i++)
+		{
+			if (p.taken[i])
+				continue;
+
+			/* if one group too full, put rect in the other */
+			if (p.count[0] >= p.total - p.minfill)
+			{
+				Classify(i, 1, p);
+				continue;
+			}
+			else if (p.count[1] >= p.total - p.minfill)
+			{
+				Classify(i, 0, p);
+				continue;
+			}
+
+			/* find areas of the two groups' old and new covers */
+			for (group=0; group<2; group++)
+			{
+				if (p.count[group] > 0)
+					newCover[group] = CombineRect(s.branch[i].rect, p.cover[group]);
+				else
+					newCover[group] = s.branch[i].rect;
+				newArea[group] = RectSphericalVolume(newCover[group]);
+				increase[group] = newArea[group] - p.area[group];
+			}
+
+			if (increase[0] < increase[1])	/* group whose cover will expand less */
+				Classify(i, 0, p);
+			else if (increase[1] < increase[0])
+				Classify(i, 1, p);
+			else if (p.area[0] < p.area[1])	/* group that will have a smaller cover */
+				Classify(i, 0, p);
+			else if (p.area[1] < p.area[0])
+				Classify(i, 1, p);
+			else if (p.count[0] < p.count[1])	/* group with fewer elements */
+				Classify(i, 0, p);
+			else
+				Classify(i, 1, p);
+		}
+		assert(p.count[0] + p.count[1] == s.count);
+	}
+
+	/// Split a node, quadratic cost.
+	/// Old node is one of the new ones, and one really new one is created.
+	void SplitNodeQuadratic(Node *n, const Branch &b, Node **nn) {
+		PartitionVars &p = splitVars.partition;
+		int level = n->level;
+
+		GetBranches(n, b);
+		MethodQuadratic(p, level>0 ? NodeMinFill() : LeafMinFill());
+		*nn = NewNode();
+		(*nn)->level = n->level = level;
+		LoadNodes(n, *nn, p);
+		assert(n->count + (*nn)->count == p.total);
+	}
+
+	/// Split a node, linear cost.
+	void SplitNodeLinear(Node *n, const Branch &b, Node **nn) {
+		PartitionVars &p = splitVars.partition;
+		int level = n->level;
+
+		GetBranches(n, b);
+		InitPVars(p, splitVars.count, level>0 ? NodeMinFill() : LeafMinFill());
+		PickSeedsLinear(p);
+		Pigeonhole(p);
+		*nn = NewNode();
+		(*nn)->level = n->level = level;
+		LoadNodes(n, *nn, p);
+		assert(n->count + (*nn)->count == p.total);
+	}
+
+	/// Sort branch buffer indices by one boundary, ties broken by the
+	/// opposite side.
+	void SortBranches(int *order, int side) {
+		SplitVars &sv = splitVars;
+		int i, j, opposite = side < Dims ? side + Dims : side - Dims;
+		const Rect *r, *s;
+
+		for (i=0; i<sv.count; i++)
+		{
+			r = &sv.branch[i].rect;
+			for (j=i; j>0; j--)
+			{
+				s = &sv.branch[order[j-1]].rect;
+				if (s->boundary[side] < r->boundary[side] ||
+				    (s->boundary[side] == r->boundary[side] &&
+				     s->boundary[opposite] <= r->boundary[opposite]))
+					break;
+				order[j] = order[j-1];
+			}
+			order[j] = i;
+		}
+	}
+
+	/// Covers of every prefix and suffix of a sorted branch buffer:
+	/// lower[k] covers order[0..k], upper[k] covers order[k..count-1].
+	void DistributionCovers(const int *order, Rect *lower, Rect *upper) {
+		SplitVars &s = splitVars;
+		int k;
+
+		lower[0] = s.branch[order[0]].rect;
+		for (k=1; k<s.count; k++)
+			lower[k] = CombineRect(lower[k-1], s.branch[order[k]].rect);
+
+		upper[s.count-1] = s.branch[order[s.count-1]].rect;
+		for (k=s.count-2; k>=0; k--)
+			upper[k] = CombineRect(upper[k+1], s.branch[order[k]].rect);
+	}
+
+	/// Split a node, R* style.
+	/// The split axis is the one whose distributions have the smallest margin
+	/// sum; along it the distribution with the least overlap between the two
+	/// groups wins, ties going to the one with the least total area.
+	void SplitNodeRStar(Node *n, const Branch &b, Node **nn) {
+		SplitVars &s = splitVars;
+		int order[Dims][2][MaxCard+1];
+		Rect lower[MaxCard+1], upper[MaxCard+1];
+		Real margin, bestMargin = 0, overlap, bestOverlap = 0, area, bestArea = 0;
+		int axis, sort, k, level, minfill, bestAxis = 0, bestSort = 0, bestK = 0, first_time;
+
+		level = n->level;
+		GetBranches(n, b);
+		minfill = level>0 ? NodeMinFill() : LeafMinFill();
+
+		/* choose the split axis */
+		first_time = 1;
+		for (axis=0; axis<Dims; axis++)
+		{
+			margin = 0;
+			for (sort=0; sort<2; sort++)
+			{
+				SortBranches(order[axis][sort], axis + sort*Dims);
+				DistributionCovers(order[axis][sort], lower, upper);
+				for (k=minfill; k<=s.count-minfill; k++)
+					margin += RectMargin(lower[k-1]) + RectMargin(upper[k]);
+			}
+			if (first_time || margin < bestMargin)
+			{
+				bestMargin = margin;
+				bestAxis = axis;
+				first_time = 0;
+			}
+		}
+
+		/* choose the split index along that axis */
+		first_time = 1;
+		for (sort=0; sort<2; sort++)
+		{
+			DistributionCovers(order[bestAxis][sort], lower, upper);
+			for (k=minfill; k<=s.count-minfill; k++)
+			{
+				overlap = RectOverlapVolume(lower[k-1], upper[k]);
+				area = RectVolume(lower[k-1]) + RectVolume(upper[k]);
+				if (first_time || overlap < bestOverlap ||
+				    (overlap == bestOverlap && area < bestArea))
+				{
+					bestOverlap = overlap;
+					bestArea = area;
+					bestSort = sort;
+					bestK = k;
+					first_time = 0;
+				}
+			}
+		}
+
+		/* first bestK entries of the chosen order stay, the rest move out */
+		*nn = NewNode();
+		(*nn)->level = n->level = level;
+		for (k=0; k<s.count; k++)
+			AddBranch(s.branch[order[bestAxis][bestSort][k]], k < bestK ? n : *nn, NULL);
+		assert(n->count >= minfill && (*nn)->count >= minfill);
+	}
+};
+
+#endif /* _RTREE_HPP_ */